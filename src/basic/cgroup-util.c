@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
 #include <errno.h>
+#include <fcntl.h>
 //#include <ftw.h>
 #include <limits.h>
 #include <signal.h>
@@ -416,6 +417,41 @@ int cg_kill_recursive(
         return ret;
 }
 
+#if 1 /// elogind kills whole session cgroups in one go where the kernel supports it
+int cg_kill_kernel_sigkill(const char *controller, const char *path) {
+        _cleanup_free_ char *fs = NULL, *killfile = NULL;
+        int r;
+
+        /* Kills the cgroup at 'path' and everything below it by writing to its cgroup.kill file. Unlike
+         * cg_kill_recursive() this is atomic: the kernel SIGKILLs every process in the subtree, including
+         * those forked while it does so, hence there is no need to re-read cgroup.procs until it settles.
+         * Returns -EOPNOTSUPP if the kernel does not offer cgroup.kill (legacy hierarchy or kernel < 5.14). */
+
+        assert(path);
+
+        r = cg_all_unified();
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return -EOPNOTSUPP;
+
+        r = cg_get_path(controller, path, "cgroup.kill", &killfile);
+        if (r < 0)
+                return r;
+
+        r = write_string_file(killfile, "1", WRITE_STRING_FILE_DISABLE_BUFFER);
+        if (r != -ENOENT)
+                return r;
+
+        /* Tell a cgroup that is gone from a kernel that lacks cgroup.kill */
+        r = cg_get_path(controller, path, NULL, &fs);
+        if (r < 0)
+                return r;
+
+        return access(fs, F_OK) < 0 ? -ENOENT : -EOPNOTSUPP;
+}
+#endif // 1
+
 static const char *controller_to_dirname(const char *controller) {
         const char *e;
 
@@ -748,6 +784,101 @@ int cg_pid_get_path(const char *controller, pid_t pid, char **ret_path) {
         }
 }
 
+#if 1 /// elogind resolves many PIDs in one go, see sd_pids_get_sessions()
+int cg_pid_get_path_buffered(pid_t pid, char **buffer, const char **ret_path) {
+        _cleanup_close_ int fd = -1;
+        const char *fs, *controller_str = NULL;
+        size_t size = 0;
+        int unified;
+
+        /* Like cg_pid_get_path() for our own hierarchy, but reads /proc/PID/cgroup into *buffer, which is
+         * grown as needed and may be reused for the next PID, and returns a pointer into it. That saves
+         * the FILE object and the allocation of each line and of the result. */
+
+        assert(pid >= 0);
+        assert(buffer);
+        assert(ret_path);
+
+        unified = cg_unified_controller(SYSTEMD_CGROUP_CONTROLLER);
+        if (unified < 0)
+                return unified;
+        if (unified == 0)
+                controller_str = SYSTEMD_CGROUP_CONTROLLER_LEGACY;
+
+        fs = procfs_file_alloca(pid, "cgroup");
+        fd = open(fs, O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return errno == ENOENT ? -ESRCH : -errno;
+
+        for (;;) {
+                ssize_t n;
+
+                if (!GREEDY_REALLOC(*buffer, size + LINE_MAX + 1))
+                        return -ENOMEM;
+
+                n = read(fd, *buffer + size, MALLOC_SIZEOF_SAFE(*buffer) - size - 1);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return -errno;
+                }
+                if (n == 0)
+                        break;
+
+                size += n;
+        }
+
+        (*buffer)[size] = 0;
+
+        for (char *line = *buffer, *next; *line; line = next) {
+                char *e;
+
+                next = strchrnul(line, '\n');
+                if (*next)
+                        *(next++) = 0;
+
+                if (unified) {
+                        e = startswith(line, "0:");
+                        if (!e)
+                                continue;
+
+                        e = strchr(e, ':');
+                        if (!e)
+                                continue;
+                } else {
+                        char *l;
+                        int r;
+
+                        l = strchr(line, ':');
+                        if (!l)
+                                continue;
+
+                        l++;
+                        e = strchr(l, ':');
+                        if (!e)
+                                continue;
+                        *e = 0;
+
+                        r = string_contains_word(l, ",", controller_str);
+                        if (r < 0)
+                                return r;
+                        if (r == 0)
+                                continue;
+                }
+
+                /* Truncate suffix indicating the process is a zombie */
+                line = endswith(e + 1, " (deleted)");
+                if (line)
+                        *line = 0;
+
+                *ret_path = e + 1;
+                return 0;
+        }
+
+        return -ENODATA;
+}
+#endif // 1
+
 #if 0 /// UNNEEDED by elogind
 int cg_install_release_agent(const char *controller, const char *agent) {
         _cleanup_free_ char *fs = NULL, *contents = NULL;
@@ -183,6 +183,9 @@ typedef int (*cg_kill_log_func_t)(pid_t pid, int sig, void *userdata);
 
 int cg_kill(const char *controller, const char *path, int sig, CGroupFlags flags, Set *s, cg_kill_log_func_t kill_log, void *userdata);
 int cg_kill_recursive(const char *controller, const char *path, int sig, CGroupFlags flags, Set *s, cg_kill_log_func_t kill_log, void *userdata);
+#if 1 /// elogind kills whole session cgroups in one go where the kernel supports it
+int cg_kill_kernel_sigkill(const char *controller, const char *path);
+#endif // 1
 
 int cg_split_spec(const char *spec, char **ret_controller, char **ret_path);
 int cg_mangle_path(const char *path, char **result);
@@ -191,6 +194,9 @@ int cg_get_path(const char *controller, const char *path, const char *suffix, ch
 int cg_get_path_and_check(const char *controller, const char *path, const char *suffix, char **fs);
 
 int cg_pid_get_path(const char *controller, pid_t pid, char **path);
+#if 1 /// elogind resolves many PIDs in one go
+int cg_pid_get_path_buffered(pid_t pid, char **buffer, const char **ret_path);
+#endif // 1
 
 int cg_rmdir(const char *controller, const char *path);
 
@@ -410,7 +410,6 @@ int load_env_file(FILE *f, const char *fname, char ***rl) {
         return 0;
 }
 
-#if 0 /// UNNEEDED by elogind
 static int load_env_file_push_pairs(
                 const char *filename, unsigned line,
                 const char *key, char *value,
@@ -457,6 +456,7 @@ int load_env_file_pairs(FILE *f, const char *fname, char ***rl) {
         return 0;
 }
 
+#if 0 /// UNNEEDED by elogind
 static int merge_env_file_push(
                 const char *filename, unsigned line,
                 const char *key, char *value,
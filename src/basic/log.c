@@ -36,6 +36,10 @@
 #include "terminal-util.h"
 #include "time-util.h"
 #include "utf8.h"
+/// Additional includes needed by elogind
+#include <sched.h>
+
+#include "util.h"
 
 #define SNDBUF_SIZE (8*1024*1024)
 
@@ -366,6 +370,9 @@ void log_set_target(LogTarget target) {
 void log_close(void) {
         /* Do not call from library code. */
 
+#if 1 /// elogind may have log messages queued, do not lose them.
+        log_flush();
+#endif // 1
         log_close_journal();
         log_close_syslog();
         log_close_kmsg();
@@ -658,7 +665,11 @@ static int write_to_journal(
 }
 #endif // 0
 
+#if 0 /// elogind may queue messages, see log_dispatch_internal() below, and writes them out here
 int log_dispatch_internal(
+#else // 0
+static int log_dispatch_write(
+#endif // 0
                 int level,
                 int error,
                 const char *file,
@@ -745,6 +756,256 @@ int log_dispatch_internal(
         return -ERRNO_VALUE(error);
 }
 
+#if 1 /// elogind can queue log messages in a ring buffer, and write them out in one go later
+/* The queue is a bounded multi-producer ring: every entry carries a sequence number, which tells
+ * producers whether the entry is free for the position they claimed, and the consumer whether the
+ * entry at its position is completely written. Positions are claimed with atomic operations, so
+ * logging threads never block each other. Only one caller at a time drains the queue, and it stops
+ * at the first entry that is not completely written yet, so messages always come out in order. */
+#define LOG_BUFFER_ENTRIES_MAX 4096U
+#define LOG_BUFFER_ENTRIES_DEFAULT 256U
+
+typedef struct LogBufferEntry {
+        volatile unsigned sequence;
+        int level;
+        int error;
+        const char *file; /* Always static strings, see PROJECT_FILE and __func__ */
+        int line;
+        const char *func;
+        char message[LINE_MAX];
+} LogBufferEntry;
+
+static LogBufferEntry *log_buffer = NULL;
+static unsigned log_buffer_mask = 0;
+static volatile unsigned log_buffer_head = 0; /* Next position to claim for writing */
+static volatile unsigned log_buffer_tail = 0; /* Next position to write out */
+static volatile unsigned log_buffer_flushing = 0;
+static thread_local bool log_buffer_flushing_here = false; /* This thread holds log_buffer_flushing */
+static thread_local bool log_buffer_pushing_here = false; /* This thread is writing an entry */
+static bool log_buffer_atexit_registered = false;
+static pid_t log_buffer_pid = 0; /* The process the queued messages belong to */
+
+static void log_buffer_forget_inherited(void) {
+        /* A forked off child inherits the queue with everything its parent had queued so far. The parent
+         * writes those messages out itself, so the child drops them without writing them. */
+
+        if (_likely_(log_buffer_pid == getpid_cached()))
+                return;
+
+        for (unsigned i = 0; i <= log_buffer_mask; i++)
+                log_buffer[i].sequence = i;
+
+        log_buffer_head = log_buffer_tail = 0;
+        log_buffer_flushing = 0;
+        log_buffer_flushing_here = log_buffer_pushing_here = false;
+        log_buffer_pid = getpid_cached();
+}
+
+static bool log_buffer_push(
+                int level,
+                int error,
+                const char *file,
+                int line,
+                const char *func,
+                const char *buffer) {
+
+        LogBufferEntry *entry;
+        unsigned pos;
+
+        for (;;) {
+                int d;
+
+                __sync_synchronize();
+                pos = log_buffer_head;
+                entry = log_buffer + (pos & log_buffer_mask);
+                d = (int) (entry->sequence - pos);
+
+                if (d < 0)
+                        /* The consumer did not get around to this entry yet, hence we are full. */
+                        return false;
+
+                if (d == 0 && __sync_bool_compare_and_swap(&log_buffer_head, pos, pos + 1))
+                        break;
+        }
+
+        log_buffer_pushing_here = true;
+
+        entry->level = level;
+        entry->error = error;
+        entry->file = file;
+        entry->line = line;
+        entry->func = func;
+        strncpy(entry->message, buffer, sizeof(entry->message) - 1);
+        entry->message[sizeof(entry->message) - 1] = 0;
+
+        /* Publish the entry to the consumer only after all of its contents are visible */
+        __sync_synchronize();
+        entry->sequence = pos + 1;
+        log_buffer_pushing_here = false;
+
+        return true;
+}
+
+static void log_buffer_drain(bool wait) {
+        unsigned end;
+
+        PROTECT_ERRNO;
+
+        if (!log_buffer)
+                return;
+
+        log_buffer_forget_inherited();
+
+        /* Only one thread drains the queue at a time. Unless asked to wait for it, leave it to whoever is at
+         * it already. A thread that logs while draining the queue itself cannot wait for that, though. */
+        while (!__sync_bool_compare_and_swap(&log_buffer_flushing, 0, 1)) {
+                if (!wait || log_buffer_flushing_here)
+                        return;
+
+                sched_yield();
+        }
+
+        log_buffer_flushing_here = true;
+        __sync_synchronize();
+        end = log_buffer_head;
+
+        for (;;) {
+                LogBufferEntry *entry;
+                unsigned pos;
+
+                __sync_synchronize();
+                pos = log_buffer_tail;
+                entry = log_buffer + (pos & log_buffer_mask);
+
+                if (entry->sequence != pos + 1) {
+                        /* Empty, or the next entry is still being written. If asked to wait, wait for those
+                         * claimed before we started, unless one of them might be our own. */
+                        if (!wait || log_buffer_pushing_here || (int) (end - pos) <= 0)
+                                break;
+
+                        sched_yield();
+                        continue;
+                }
+
+                (void) log_dispatch_write(entry->level, entry->error, entry->file, entry->line, entry->func,
+                                          NULL, NULL, NULL, NULL, entry->message);
+
+                log_buffer_tail = pos + 1;
+                __sync_synchronize();
+                entry->sequence = pos + log_buffer_mask + 1;
+        }
+
+        log_buffer_flushing_here = false;
+        __sync_synchronize();
+        log_buffer_flushing = 0;
+}
+
+void log_flush(void) {
+        log_buffer_drain(true);
+}
+
+static void log_buffer_free(void) {
+        log_flush();
+        log_buffer = mfree(log_buffer);
+        log_buffer_mask = 0;
+}
+
+int log_set_buffered(unsigned n_entries) {
+        LogBufferEntry *b;
+        unsigned n;
+
+        /* Do not call from library code, and not while other threads are logging. */
+
+        log_buffer_free();
+
+        if (n_entries == 0)
+                return 0;
+
+        n = MIN(n_entries, LOG_BUFFER_ENTRIES_MAX);
+        n = 1U << log2u_round_up(n);
+
+        b = new(LogBufferEntry, n);
+        if (!b)
+                return -ENOMEM;
+
+        for (unsigned i = 0; i < n; i++)
+                b[i].sequence = i;
+
+        log_buffer_head = log_buffer_tail = 0;
+        log_buffer_mask = n - 1;
+        log_buffer_pid = getpid_cached();
+        log_buffer = b;
+
+        if (!log_buffer_atexit_registered) {
+                /* Make sure nothing stays behind in the queue if we exit() from somewhere */
+                if (atexit(log_buffer_free) != 0) {
+                        log_buffer_free();
+                        return -ENOMEM;
+                }
+                log_buffer_atexit_registered = true;
+        }
+
+        return 0;
+}
+
+int log_set_buffered_from_string(const char *e) {
+        unsigned n;
+        int r;
+
+        /* Accept both a boolean and the number of queue entries */
+        r = parse_boolean(e);
+        if (r >= 0)
+                return log_set_buffered(r > 0 ? LOG_BUFFER_ENTRIES_DEFAULT : 0);
+
+        r = safe_atou(e, &n);
+        if (r < 0)
+                return r;
+
+        return log_set_buffered(n);
+}
+
+bool log_get_buffered(void) {
+        return log_buffer;
+}
+
+int log_dispatch_internal(
+                int level,
+                int error,
+                const char *file,
+                int line,
+                const char *func,
+                const char *object_field,
+                const char *object,
+                const char *extra_field,
+                const char *extra,
+                char *buffer) {
+
+        assert_raw(buffer);
+
+        if (log_target == LOG_TARGET_NULL)
+                return -ERRNO_VALUE(error);
+
+        if (log_buffer) {
+                log_buffer_forget_inherited();
+
+                /* Errors and worse are never delayed, and neither is what does not fit into the queue, but
+                 * everything queued before goes first. */
+                if (LOG_PRI(level) > LOG_ERR &&
+                    log_buffer_push(level, error, file, line, func, buffer)) {
+
+                        if (log_buffer_head - log_buffer_tail > log_buffer_mask / 2)
+                                log_buffer_drain(false);
+
+                        return -ERRNO_VALUE(error);
+                }
+
+                log_buffer_drain(true);
+        }
+
+        return log_dispatch_write(level, error, file, line, func, object_field, object, extra_field, extra, buffer);
+}
+#endif // 1
+
 #if 0 /// UNNEEDED by elogind
 int log_dump_internal(
                 int level,
@@ -327,6 +327,19 @@ void log_set_always_reopen_console(bool b);
  * desired as we want to reuse our logging streams. It is useful however  */
 void log_set_open_when_needed(bool b);
 
+#if 1 /// elogind can queue log messages in a ring buffer instead of writing them out synchronously
+/* If turned on, messages below LOG_ERR are not written out immediately, but queued in a ring of the
+ * given number of entries (rounded up to a power of two, 0 turns buffering off again). The queue is
+ * drained by log_flush(), which the daemon is expected to call whenever its event loop goes idle. It
+ * is also drained implicitly once it is half full, before any message of LOG_ERR or higher priority
+ * is written, and on exit. Messages that do not fit into a full queue are written out right away, after
+ * the queue was drained. */
+int log_set_buffered(unsigned n_entries);
+int log_set_buffered_from_string(const char *e);
+bool log_get_buffered(void) _pure_;
+void log_flush(void);
+#endif // 1
+
 #if 0 /// UNNEEDED by elogind
 /* If turned on, then we'll never use IPC-based logging, i.e. never log to syslog or the journal. We'll only log to
  * stderr, the console or kmsg */
@@ -0,0 +1,684 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "env-file.h"
+#include "fd-util.h"
+#include "fs-util.h"
+#include "login-shm.h"
+#include "sort-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tmpfile-util.h"
+
+/* The file consists of a LoginShmHeader, followed by a LoginShmEntry for each state file, sorted by path,
+ * followed by the paths and contents these refer to. The contents of a state file are stored as parsed
+ * key/value pairs, each NUL terminated, so that readers need not unquote anything.
+ *
+ * There is a single writer, elogind. It changes the file in place, and protects its changes with a
+ * seqlock: it increases 'seqnum' before and after each change, hence it is odd while a change is under way.
+ * Readers sample it before and after they copy out what they are after, and try again if it was odd, or
+ * changed in between. As readers may see anything while a change is under way, they check every offset
+ * against the size of the mapping before they follow it.
+ *
+ * Whenever elogind changes a state file, it first clears 'valid', and only sets it again once the change
+ * was published here, a moment later. Until then, readers go to the state files, as they do when there is
+ * no file here at all. Should the state files outgrow the file, a bigger one takes its place, and the old
+ * one is marked as 'replaced', telling readers to map the new one. */
+
+#define LOGIN_SHM_SIZE_MIN (64U * 1024U)
+#define LOGIN_SHM_SIZE_MAX (1024U * 1024U * 1024U)
+#define LOGIN_SHM_RETRIES 64U
+
+/* Reader side */
+
+typedef struct LoginShmMapping {
+        unsigned n_ref;
+        const LoginShmHeader *header;
+        size_t size;
+} LoginShmMapping;
+
+/* All threads share the one mapping. Each lookup pins it with a reference, so that a thread which notices
+ * that the file was replaced may swap in the new one while others are still reading the old one, which is
+ * unmapped once the last of them is done with it. The mutex only guards swapping and pinning. It is held
+ * across fork(), so that the child neither inherits it locked by a thread it does not have, nor a mapping
+ * that is halfway swapped. */
+static pthread_mutex_t shm_mutex = PTHREAD_MUTEX_INITIALIZER;
+static LoginShmMapping *shm_mapping = NULL;
+
+static void login_shm_atfork_prepare(void) {
+        assert_se(pthread_mutex_lock(&shm_mutex) == 0);
+}
+
+static void login_shm_atfork_release(void) {
+        assert_se(pthread_mutex_unlock(&shm_mutex) == 0);
+}
+
+static void login_shm_atfork_register(void) {
+        assert_se(pthread_atfork(login_shm_atfork_prepare, login_shm_atfork_release, login_shm_atfork_release) == 0);
+}
+
+static LoginShmMapping* login_shm_mapping_unref(LoginShmMapping *m) {
+        if (!m)
+                return NULL;
+
+        if (__atomic_sub_fetch(&m->n_ref, 1, __ATOMIC_ACQ_REL) > 0)
+                return NULL;
+
+        (void) munmap((void*) m->header, m->size);
+        return mfree(m);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(LoginShmMapping*, login_shm_mapping_unref);
+
+static int login_shm_mapping_new(LoginShmMapping **ret) {
+        _cleanup_close_ int fd = -1;
+        const LoginShmHeader *h;
+        LoginShmMapping *m;
+        struct stat st;
+        void *p;
+
+        fd = open(LOGIN_SHM_PATH, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (st.st_size < (off_t) sizeof(LoginShmHeader) || st.st_size > (off_t) LOGIN_SHM_SIZE_MAX)
+                return -EBADMSG;
+
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        h = p;
+        if (h->magic != LOGIN_SHM_MAGIC ||
+            h->version != LOGIN_SHM_VERSION ||
+            h->header_size != sizeof(LoginShmHeader) ||
+            h->size != (uint64_t) st.st_size) {
+                (void) munmap(p, st.st_size);
+                return -EBADMSG;
+        }
+
+        m = new(LoginShmMapping, 1);
+        if (!m) {
+                (void) munmap(p, st.st_size);
+                return -ENOMEM;
+        }
+
+        *m = (LoginShmMapping) {
+                .n_ref = 1,
+                .header = h,
+                .size = st.st_size,
+        };
+
+        *ret = m;
+        return 0;
+}
+
+/* Returns a reference to the current mapping, the caller has to drop it again */
+static int login_shm_map(LoginShmMapping **ret) {
+        static pthread_once_t once = PTHREAD_ONCE_INIT;
+        LoginShmMapping *m = NULL;
+        int r = 0;
+
+        assert(ret);
+
+        assert_se(pthread_once(&once, login_shm_atfork_register) == 0);
+        assert_se(pthread_mutex_lock(&shm_mutex) == 0);
+
+        if (!shm_mapping || __atomic_load_n(&shm_mapping->header->replaced, __ATOMIC_ACQUIRE)) {
+                shm_mapping = login_shm_mapping_unref(shm_mapping);
+                r = login_shm_mapping_new(&shm_mapping);
+        }
+        if (r >= 0) {
+                m = shm_mapping;
+                __atomic_add_fetch(&m->n_ref, 1, __ATOMIC_RELAXED);
+        }
+
+        assert_se(pthread_mutex_unlock(&shm_mutex) == 0);
+
+        if (r < 0)
+                return r;
+
+        *ret = m;
+        return 0;
+}
+
+/* Looks up a path without caring for the seqlock, the caller has to check whether what we found is any
+ * good. Returns > 0 if found, 0 if not. */
+static int login_shm_lookup_unlocked(
+                const LoginShmMapping *m,
+                const char *path,
+                size_t path_size,
+                char **ret_data,
+                size_t *ret_size) {
+
+        const LoginShmHeader *shm_header = m->header;
+        const uint8_t *base = (const uint8_t*) shm_header;
+        size_t shm_size = m->size;
+        const LoginShmEntry *entries;
+        uint64_t n, lo = 0, hi;
+
+        if (!shm_header->valid)
+                return -ESTALE;
+
+        n = shm_header->n_entries;
+        if (n > (shm_size - sizeof(LoginShmHeader)) / sizeof(LoginShmEntry))
+                return -EBADMSG;
+
+        entries = (const LoginShmEntry*) (base + sizeof(LoginShmHeader));
+
+        hi = n;
+        while (lo < hi) {
+                uint64_t mid = lo + (hi - lo) / 2;
+                LoginShmEntry e = entries[mid];
+                int c;
+
+                if (e.path_offset > shm_size || e.path_size > shm_size - e.path_offset)
+                        return -EBADMSG;
+
+                c = memcmp(path, base + e.path_offset, MIN(path_size, (size_t) e.path_size));
+                if (c == 0)
+                        c = CMP(path_size, (size_t) e.path_size);
+                if (c < 0)
+                        hi = mid;
+                else if (c > 0)
+                        lo = mid + 1;
+                else {
+                        char *data;
+
+                        if (e.data_offset > shm_size || e.data_size > shm_size - e.data_offset)
+                                return -EBADMSG;
+
+                        data = memdup_suffix0(base + e.data_offset, e.data_size);
+                        if (!data)
+                                return -ENOMEM;
+
+                        *ret_data = data;
+                        *ret_size = e.data_size;
+                        return 1;
+                }
+        }
+
+        return 0;
+}
+
+int login_shm_get(const char *path, char **ret_data, size_t *ret_size) {
+        _cleanup_(login_shm_mapping_unrefp) LoginShmMapping *m = NULL;
+        size_t path_size;
+        int r;
+
+        assert(path);
+        assert(ret_data);
+        assert(ret_size);
+
+        /* Returns > 0 and the contents of the state file if there is one, 0 if there is none. Returns < 0
+         * if we cannot tell right now, in which case the caller should look at the state file itself. */
+
+        r = login_shm_map(&m);
+        if (r < 0)
+                return r;
+
+        path_size = strlen(path);
+
+        for (unsigned i = 0; i < LOGIN_SHM_RETRIES; i++) {
+                _cleanup_free_ char *data = NULL;
+                uint64_t seqnum;
+                size_t size = 0;
+
+                seqnum = __atomic_load_n(&m->header->seqnum, __ATOMIC_ACQUIRE);
+                if (seqnum & 1)
+                        continue;
+
+                r = login_shm_lookup_unlocked(m, path, path_size, &data, &size);
+
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                if (__atomic_load_n(&m->header->seqnum, __ATOMIC_RELAXED) != seqnum)
+                        continue;
+
+                if (r > 0) {
+                        *ret_data = TAKE_PTR(data);
+                        *ret_size = size;
+                }
+
+                return r;
+        }
+
+        return -EBUSY;
+}
+
+int login_shm_parse_env_file_sentinel(const char *path, ...) {
+        _cleanup_free_ char *data = NULL;
+        int r, n_pushed = 0;
+        size_t size = 0;
+        va_list ap;
+
+        assert(path);
+
+        /* Like parse_env_file(NULL, path, ...), but served from the shared memory file where possible */
+
+        r = login_shm_get(path, &data, &size);
+        if (r < 0) {
+                va_start(ap, path);
+                r = parse_env_filev(NULL, path, ap);
+                va_end(ap);
+                return r;
+        }
+        if (r == 0)
+                return -ENOENT;
+
+        for (const char *p = data; p < data + size; ) {
+                const char *key = p, *value, *k;
+
+                value = key + strlen(key) + 1;
+                if (value >= data + size)
+                        return -EBADMSG;
+                p = value + strlen(value) + 1;
+
+                va_start(ap, path);
+                while ((k = va_arg(ap, const char *))) {
+                        char **v = va_arg(ap, char **);
+
+                        if (streq(key, k)) {
+                                r = free_and_strdup(v, value);
+                                if (r < 0) {
+                                        va_end(ap);
+                                        return r;
+                                }
+
+                                n_pushed++;
+                                break;
+                        }
+                }
+                va_end(ap);
+        }
+
+        return n_pushed;
+}
+
+int login_shm_get_files_in_directory(const char *path, char ***ret) {
+        _cleanup_(login_shm_mapping_unrefp) LoginShmMapping *m = NULL;
+        _cleanup_strv_free_ char **l = NULL;
+        const LoginShmHeader *shm_header;
+        const uint8_t *base;
+        size_t path_size, shm_size;
+        int r;
+
+        assert(path);
+
+        /* Like get_files_in_directory(), for the directories of state files. 'path' has to end in a slash. */
+
+        r = login_shm_map(&m);
+        if (r < 0)
+                return get_files_in_directory(path, ret);
+
+        shm_header = m->header;
+        shm_size = m->size;
+        base = (const uint8_t*) shm_header;
+        path_size = strlen(path);
+
+        for (unsigned i = 0; i < LOGIN_SHM_RETRIES; i++) {
+                const LoginShmEntry *entries;
+                uint64_t seqnum, n;
+                bool bad = false;
+
+                l = strv_free(l);
+
+                seqnum = __atomic_load_n(&shm_header->seqnum, __ATOMIC_ACQUIRE);
+                if (seqnum & 1)
+                        continue;
+
+                if (!shm_header->valid)
+                        break;
+
+                n = shm_header->n_entries;
+                if (n > (shm_size - sizeof(LoginShmHeader)) / sizeof(LoginShmEntry))
+                        bad = true;
+
+                entries = (const LoginShmEntry*) (base + sizeof(LoginShmHeader));
+
+                /* The entries of one directory are next to each other, but there are few enough
+                 * directories that looking at all entries does not hurt */
+                for (uint64_t j = 0; !bad && j < n; j++) {
+                        LoginShmEntry e = entries[j];
+                        const char *name;
+
+                        if (e.path_offset > shm_size || e.path_size > shm_size - e.path_offset) {
+                                bad = true;
+                                break;
+                        }
+
+                        if (e.path_size <= path_size || memcmp(base + e.path_offset, path, path_size) != 0)
+                                continue;
+
+                        name = (const char*) base + e.path_offset + path_size;
+                        if (memchr(name, '/', e.path_size - path_size))
+                                continue;
+
+                        r = strv_consume(&l, strndup(name, e.path_size - path_size));
+                        if (r < 0)
+                                return r;
+                }
+
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                if (__atomic_load_n(&shm_header->seqnum, __ATOMIC_RELAXED) != seqnum || bad)
+                        continue;
+
+                r = (int) strv_length(l);
+                if (ret)
+                        *ret = TAKE_PTR(l);
+
+                return r;
+        }
+
+        return get_files_in_directory(path, ret);
+}
+
+/* Writer side */
+
+struct LoginShm {
+        char *path;
+        LoginShmHeader *header;
+        size_t size;
+};
+
+LoginShmFile* login_shm_file_free(LoginShmFile *f) {
+        if (!f)
+                return NULL;
+
+        free(f->path);
+        free(f->data);
+
+        return mfree(f);
+}
+
+int login_shm_file_read(const char *path, LoginShmFile **ret) {
+        _cleanup_(login_shm_file_freep) LoginShmFile *f = NULL;
+        _cleanup_strv_free_ char **pairs = NULL;
+        size_t size = 0;
+        char *p, **i;
+        int r;
+
+        assert(path);
+        assert(ret);
+
+        r = load_env_file_pairs(NULL, path, &pairs);
+        if (r < 0)
+                return r;
+
+        STRV_FOREACH(i, pairs)
+                size += strlen(*i) + 1;
+
+        f = new(LoginShmFile, 1);
+        if (!f)
+                return -ENOMEM;
+
+        *f = (LoginShmFile) {
+                .path = strdup(path),
+                .data = new(char, size + 1),
+                .size = size,
+        };
+        if (!f->path || !f->data)
+                return -ENOMEM;
+
+        p = f->data;
+        STRV_FOREACH(i, pairs)
+                p = stpcpy(p, *i) + 1;
+        *p = 0;
+
+        *ret = TAKE_PTR(f);
+        return 0;
+}
+
+static void login_shm_write_begin(LoginShmHeader *h) {
+        __atomic_store_n(&h->seqnum, h->seqnum + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void login_shm_write_end(LoginShmHeader *h) {
+        __atomic_store_n(&h->seqnum, h->seqnum + 1, __ATOMIC_RELEASE);
+}
+
+static void login_shm_retire(LoginShmHeader *h) {
+        login_shm_write_begin(h);
+        h->valid = false;
+        __atomic_store_n(&h->replaced, true, __ATOMIC_RELEASE);
+        login_shm_write_end(h);
+}
+
+static int login_shm_file_compare(LoginShmFile * const *a, LoginShmFile * const *b) {
+        return strcmp((*a)->path, (*b)->path);
+}
+
+static void login_shm_fill(LoginShmHeader *h, LoginShmFile **files, size_t n) {
+        uint8_t *base = (uint8_t*) h;
+        LoginShmEntry *entries;
+        uint64_t offset;
+
+        entries = (LoginShmEntry*) (base + sizeof(LoginShmHeader));
+        offset = sizeof(LoginShmHeader) + n * sizeof(LoginShmEntry);
+
+        for (size_t i = 0; i < n; i++) {
+                size_t path_size = strlen(files[i]->path);
+
+                entries[i] = (LoginShmEntry) {
+                        .path_offset = offset,
+                        .path_size = path_size,
+                };
+                memcpy(base + offset, files[i]->path, path_size + 1);
+                offset += path_size + 1;
+
+                entries[i].data_offset = offset;
+                entries[i].data_size = files[i]->size;
+                memcpy(base + offset, files[i]->data, files[i]->size);
+                offset += files[i]->size;
+        }
+
+        h->n_entries = n;
+        h->valid = true;
+}
+
+static int login_shm_create(const char *path, size_t size, LoginShmFile **files, size_t n, LoginShmHeader **ret) {
+        _cleanup_free_ char *t = NULL;
+        _cleanup_close_ int fd = -1;
+        LoginShmHeader *h;
+        void *p;
+        int r;
+
+        assert(path);
+        assert(ret);
+
+        /* Creates a new file, with the given files in it, and puts it in place */
+
+        r = tempfn_xxxxxx(path, NULL, &t);
+        if (r < 0)
+                return r;
+
+        fd = mkostemp_safe(t);
+        if (fd < 0)
+                return fd;
+
+        /* Everybody may read it, like the state files */
+        if (fchmod(fd, 0644) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        /* Allocate all of it right away: writing through the mapping into a hole of a file on a full tmpfs
+         * gets us SIGBUS rather than an error. */
+        r = posix_fallocate_loop(fd, 0, size);
+        if (r < 0)
+                goto fail;
+
+        p = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+                r = -errno;
+                goto fail;
+        }
+
+        h = p;
+        *h = (LoginShmHeader) {
+                .magic = LOGIN_SHM_MAGIC,
+                .version = LOGIN_SHM_VERSION,
+                .header_size = sizeof(LoginShmHeader),
+                .size = size,
+        };
+        /* Without any files, nothing was published yet, and the file starts out invalid */
+        if (files)
+                login_shm_fill(h, files, n);
+
+        if (rename(t, path) < 0) {
+                r = -errno;
+                (void) munmap(p, size);
+                goto fail;
+        }
+
+        *ret = h;
+        return 0;
+
+fail:
+        (void) unlink(t);
+        return r;
+}
+
+static int login_shm_replace(LoginShm *s, size_t size, LoginShmFile **files, size_t n) {
+        LoginShmHeader *h = NULL;
+        int r;
+
+        assert(s);
+
+        r = login_shm_create(s->path, size, files, n, &h);
+        if (r < 0)
+                return r;
+
+        if (s->header) {
+                login_shm_retire(s->header);
+                (void) munmap(s->header, s->size);
+        }
+
+        s->header = h;
+        s->size = size;
+
+        return 0;
+}
+
+int login_shm_new(const char *path, LoginShm **ret) {
+        _cleanup_(login_shm_freep) LoginShm *s = NULL;
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(path);
+        assert(ret);
+
+        s = new0(LoginShm, 1);
+        if (!s)
+                return -ENOMEM;
+
+        s->path = strdup(path);
+        if (!s->path)
+                return -ENOMEM;
+
+        /* If a previous instance left a file behind, tell its readers that it is gone. Until ours is in
+         * place, they find the old file marked invalid, and go to the state files. */
+        fd = open(path, O_RDWR|O_CLOEXEC|O_NOCTTY);
+        if (fd >= 0) {
+                struct stat st;
+                void *p;
+
+                if (fstat(fd, &st) >= 0 && st.st_size >= (off_t) sizeof(LoginShmHeader)) {
+                        p = mmap(NULL, sizeof(LoginShmHeader), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+                        if (p != MAP_FAILED) {
+                                login_shm_retire(p);
+                                (void) munmap(p, sizeof(LoginShmHeader));
+                        }
+                }
+        }
+
+        r = login_shm_replace(s, LOGIN_SHM_SIZE_MIN, NULL, 0);
+        if (r < 0) {
+                /* Should we not get ours in place (ENOSPC, say), make sure nobody trusts the old one */
+                if (fd >= 0)
+                        (void) unlink(path);
+                return r;
+        }
+
+        *ret = TAKE_PTR(s);
+        return 0;
+}
+
+LoginShm* login_shm_free(LoginShm *s) {
+        if (!s)
+                return NULL;
+
+        if (s->header) {
+                login_shm_retire(s->header);
+                (void) munmap(s->header, s->size);
+                (void) unlink(s->path);
+        }
+
+        free(s->path);
+
+        return mfree(s);
+}
+
+void login_shm_invalidate(LoginShm *s) {
+        assert(s);
+        assert(s->header);
+
+        if (!s->header->valid)
+                return;
+
+        login_shm_write_begin(s->header);
+        s->header->valid = false;
+        login_shm_write_end(s->header);
+}
+
+int login_shm_publish(LoginShm *s, Hashmap *files) {
+        _cleanup_free_ LoginShmFile **sorted = NULL;
+        size_t n = 0, size;
+        LoginShmFile *f;
+
+        assert(s);
+        assert(s->header);
+
+        sorted = new(LoginShmFile*, hashmap_size(files) + 1);
+        if (!sorted)
+                return -ENOMEM;
+
+        size = sizeof(LoginShmHeader);
+        HASHMAP_FOREACH(f, files) {
+                sorted[n++] = f;
+                size += sizeof(LoginShmEntry) + strlen(f->path) + 1 + f->size;
+        }
+
+        typesafe_qsort(sorted, n, login_shm_file_compare);
+
+        if (size > s->size) {
+                size_t new_size = s->size;
+
+                /* Leave some room to grow, so that we do not have to replace the file every time */
+                while (new_size < size * 2)
+                        new_size *= 2;
+                if (new_size > LOGIN_SHM_SIZE_MAX)
+                        return -E2BIG;
+
+                /* If there is no room for a bigger file (ENOSPC), the current one stays invalid, and readers
+                 * keep going to the state files */
+                return login_shm_replace(s, new_size, sorted, n);
+        }
+
+        login_shm_write_begin(s->header);
+        login_shm_fill(s->header, sorted, n);
+        login_shm_write_end(s->header);
+
+        return 0;
+}
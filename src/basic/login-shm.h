@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+#include "hashmap.h"
+#include "macro.h"
+
+/* elogind publishes the contents of the session, user and seat state files below /run/systemd/ in a single
+ * file, which sd-login maps and reads from, instead of opening and parsing each state file. See login-shm.c
+ * for the details. */
+
+#define LOGIN_SHM_PATH "/run/systemd/sd-login.shm"
+
+#define LOGIN_SHM_MAGIC UINT64_C(0x314d48534e474f4c) /* "LOGNSHM1" */
+#define LOGIN_SHM_VERSION 1
+
+typedef struct LoginShmHeader {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t header_size;
+
+        uint64_t seqnum;       /* odd while the writer changes anything below */
+        uint64_t size;         /* of the mapping, never changes for the lifetime of the file */
+        uint32_t valid;        /* false while the state files are ahead of us */
+        uint32_t replaced;     /* true once another file took the place of this one */
+
+        uint64_t n_entries;    /* LoginShmEntry objects following the header, sorted by path */
+} LoginShmHeader;
+
+typedef struct LoginShmEntry {
+        uint64_t path_offset;  /* NUL terminated */
+        uint64_t data_offset;  /* NUL separated keys and values */
+        uint32_t path_size;    /* without the NUL */
+        uint32_t data_size;
+} LoginShmEntry;
+
+/* elogind rewrites the file of a category in place whenever state files of that category changed, once for
+ * each burst of changes, so that sd_login_monitor objects watching it wake up once rather than for every state
+ * file written. The files only exist while elogind is running. */
+#define LOGIN_GENERATION_DIR "/run/systemd/login-generation"
+#define LOGIN_GENERATION_SEAT LOGIN_GENERATION_DIR "/seat"
+#define LOGIN_GENERATION_SESSION LOGIN_GENERATION_DIR "/session"
+#define LOGIN_GENERATION_UID LOGIN_GENERATION_DIR "/uid"
+
+/* Reader side, used by sd-login */
+int login_shm_get(const char *path, char **ret_data, size_t *ret_size);
+int login_shm_parse_env_file_sentinel(const char *path, ...) _sentinel_;
+#define login_shm_parse_env_file(path, ...) login_shm_parse_env_file_sentinel(path, __VA_ARGS__, NULL)
+int login_shm_get_files_in_directory(const char *path, char ***ret);
+
+/* Writer side, used by elogind */
+typedef struct LoginShmFile {
+        char *path;
+        char *data;
+        size_t size;
+} LoginShmFile;
+
+LoginShmFile* login_shm_file_free(LoginShmFile *f);
+DEFINE_TRIVIAL_CLEANUP_FUNC(LoginShmFile*, login_shm_file_free);
+int login_shm_file_read(const char *path, LoginShmFile **ret);
+
+typedef struct LoginShm LoginShm;
+
+int login_shm_new(const char *path, LoginShm **ret);
+LoginShm* login_shm_free(LoginShm *s);
+DEFINE_TRIVIAL_CLEANUP_FUNC(LoginShm*, login_shm_free);
+void login_shm_invalidate(LoginShm *s);
+int login_shm_publish(LoginShm *s, Hashmap *files);
@@ -526,7 +526,6 @@ int get_process_exe(pid_t pid, char **name) {
         return 0;
 }
 
-#if 0 /// UNNEEDED by elogind
 static int get_process_id(pid_t pid, const char *field, uid_t *uid) {
         _cleanup_fclose_ FILE *f = NULL;
         const char *p;
@@ -580,6 +579,7 @@ int get_process_uid(pid_t pid, uid_t *uid) {
         return get_process_id(pid, "Uid:", uid);
 }
 
+#if 0 /// UNNEEDED by elogind
 int get_process_gid(pid_t pid, gid_t *gid) {
 
         if (pid == 0 || pid == getpid_cached()) {
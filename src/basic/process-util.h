@@ -42,8 +42,8 @@ typedef enum ProcessCmdlineFlags {
 int get_process_comm(pid_t pid, char **name);
 int get_process_cmdline(pid_t pid, size_t max_columns, ProcessCmdlineFlags flags, char **line);
 int get_process_exe(pid_t pid, char **name);
-#if 0 /// UNNEEDED by elogind
 int get_process_uid(pid_t pid, uid_t *uid);
+#if 0 /// UNNEEDED by elogind
 int get_process_gid(pid_t pid, gid_t *gid);
 int get_process_capeff(pid_t pid, char **capeff);
 int get_process_cwd(pid_t pid, char **cwd);
@@ -930,7 +930,6 @@ int getpeergroups(int fd, gid_t **ret) {
         return (int) n;
 }
 
-#if 0 /// UNNEEDED by elogind
 ssize_t send_one_fd_iov_sa(
                 int transport_fd,
                 int fd,
@@ -975,6 +974,7 @@ ssize_t send_one_fd_iov_sa(
         return k;
 }
 
+#if 0 /// UNNEEDED by elogind
 int send_one_fd_sa(
                 int transport_fd,
                 int fd,
@@ -985,6 +985,7 @@ int send_one_fd_sa(
 
         return (int) send_one_fd_iov_sa(transport_fd, fd, NULL, 0, sa, len, flags);
 }
+#endif // 0
 
 ssize_t receive_one_fd_iov(
                 int transport_fd,
@@ -1034,6 +1035,7 @@ ssize_t receive_one_fd_iov(
         return k;
 }
 
+#if 0 /// UNNEEDED by elogind
 int receive_one_fd(int transport_fd, int flags) {
         int fd;
         ssize_t k;
@@ -1136,6 +1138,7 @@ int flush_accept(int fd) {
                 safe_close(cfd);
         }
 }
+#endif // 0
 
 struct cmsghdr* cmsg_find(struct msghdr *mh, int level, int type, socklen_t length) {
         struct cmsghdr *cmsg;
@@ -1150,7 +1153,6 @@ struct cmsghdr* cmsg_find(struct msghdr *mh, int level, int type, socklen_t leng
 
         return NULL;
 }
-#endif // 0
 
 int socket_ioctl_fd(void) {
         int fd;
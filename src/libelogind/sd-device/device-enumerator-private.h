@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 #pragma once
 
+#include <stdbool.h>
+
 #include "sd-device.h"
 
 int device_enumerator_scan_devices(sd_device_enumerator *enumeartor);
@@ -10,6 +12,9 @@ int device_enumerator_add_device(sd_device_enumerator *enumerator, sd_device *de
 int device_enumerator_add_match_is_initialized(sd_device_enumerator *enumerator);
 #endif // 0
 int device_enumerator_add_match_parent_incremental(sd_device_enumerator *enumerator, sd_device *parent);
+#if 1 /// elogind allows skipping the sorting
+int device_enumerator_set_unsorted(sd_device_enumerator *enumerator, bool b);
+#endif // 1
 #if 0 /// UNNEEDED by elogind
 sd_device *device_enumerator_get_first(sd_device_enumerator *enumerator);
 sd_device *device_enumerator_get_next(sd_device_enumerator *enumerator);
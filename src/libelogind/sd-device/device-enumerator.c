@@ -10,6 +10,8 @@
 #include "device-util.h"
 #include "dirent-util.h"
 #include "fd-util.h"
+#include "fileio.h"
+#include "path-util.h"
 #include "set.h"
 #include "sort-util.h"
 #include "string-util.h"
@@ -41,6 +43,9 @@ struct sd_device_enumerator {
         Set *match_tag;
         Set *match_parent;
         bool match_allow_uninitialized;
+#if 1 /// elogind allows skipping the sorting, see device_enumerator_set_unsorted()
+        bool unsorted;
+#endif // 1
 };
 
 _public_ int sd_device_enumerator_new(sd_device_enumerator **ret) {
@@ -225,6 +230,24 @@ int device_enumerator_add_match_is_initialized(sd_device_enumerator *enumerator)
 }
 #endif // 0
 
+#if 1 /// elogind allows skipping the sorting
+int device_enumerator_set_unsorted(sd_device_enumerator *enumerator, bool b) {
+        assert_return(enumerator, -EINVAL);
+
+        /* Devices are sorted by devpath by default, with a few exceptions, see device_compare(). Callers
+         * that only count or look for specific devices do not care, and may spare the sorting. Duplicates
+         * are removed either way. */
+
+        if (enumerator->unsorted == b)
+                return 0;
+
+        enumerator->unsorted = b;
+        enumerator->scan_uptodate = false;
+
+        return 1;
+}
+#endif // 1
+
 static int device_compare(sd_device * const *_a, sd_device * const *_b) {
         sd_device *a = *(sd_device **)_a, *b = *(sd_device **)_b;
         const char *devpath_a, *devpath_b, *sound_a;
@@ -349,7 +372,11 @@ static bool match_sysname(sd_device_enumerator *enumerator, const char *sysname)
         return false;
 }
 
+#if 0 /// elogind opens the directory relative to the already opened base directory, if there is one
 static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator, const char *basedir, const char *subdir1, const char *subdir2) {
+#else // 0
+static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator, int basedir_fd, const char *basedir, const char *subdir1, const char *subdir2) {
+#endif // 0
         _cleanup_closedir_ DIR *dir = NULL;
         char *path;
         struct dirent *dent;
@@ -366,7 +393,16 @@ static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator,
         if (subdir2)
                 path = strjoina(path, subdir2, "/");
 
+#if 0 /// elogind opens the directory relative to the already opened base directory, if there is one
         dir = opendir(path);
+#else // 0
+        /* The kernel then only has to look up the last one or two components, not the whole path */
+        if (basedir_fd >= 0) {
+                assert(subdir1);
+                dir = xopendirat(basedir_fd, path + STRLEN("/sys/") + strlen(basedir) + 1, 0);
+        } else
+                dir = opendir(path);
+#endif // 0
         if (!dir)
                 /* this is necessarily racey, so ignore missing directories */
                 return (errno == ENOENT && (subdir1 || subdir2)) ? 0 : -errno;
@@ -483,7 +519,11 @@ static int enumerator_scan_dir(sd_device_enumerator *enumerator, const char *bas
                 if (!match_subsystem(enumerator, subsystem ? : dent->d_name))
                         continue;
 
+#if 0 /// elogind opens the directory relative to the already opened base directory
                 k = enumerator_scan_dir_and_add_devices(enumerator, basedir, dent->d_name, subdir);
+#else // 0
+                k = enumerator_scan_dir_and_add_devices(enumerator, dirfd(dir), basedir, dent->d_name, subdir);
+#endif // 0
                 if (k < 0)
                         r = k;
         }
@@ -519,6 +559,28 @@ static int enumerator_scan_devices_tag(sd_device_enumerator *enumerator, const c
                 if (dent->d_name[0] == '.')
                         continue;
 
+#if 1 /// elogind filters devices by their ID already, if it tells the subsystem and sysname
+                if (dent->d_name[0] == '+') {
+                        const char *sep;
+
+                        sep = strchr(dent->d_name, ':');
+                        if (sep) {
+                                char id_subsystem[sep - dent->d_name];
+
+                                memcpy(id_subsystem, dent->d_name + 1, sep - dent->d_name - 1);
+                                id_subsystem[sep - dent->d_name - 1] = '\0';
+
+                                if (!match_subsystem(enumerator, id_subsystem))
+                                        continue;
+
+                                /* Drivers are "+drivers:<driver subsystem>:<sysname>" */
+                                if (!streq(id_subsystem, "drivers") &&
+                                    !match_sysname(enumerator, sep + 1))
+                                        continue;
+                        }
+                }
+#endif // 1
+
                 k = sd_device_new_from_device_id(&device, dent->d_name);
                 if (k < 0) {
                         if (k != -ENODEV)
@@ -625,6 +687,7 @@ static int parent_add_child(sd_device_enumerator *enumerator, const char *path)
         return 1;
 }
 
+#if 0 /// elogind crawls relative to the already opened directories
 static int parent_crawl_children(sd_device_enumerator *enumerator, const char *path, unsigned maxdepth) {
         _cleanup_closedir_ DIR *dir = NULL;
         struct dirent *dent;
@@ -660,19 +723,90 @@ static int parent_crawl_children(sd_device_enumerator *enumerator, const char *p
 
         return r;
 }
+#else // 0
+static int parent_crawl_children(sd_device_enumerator *enumerator, DIR *dir, const char *path, unsigned maxdepth) {
+        struct dirent *dent;
+        bool check_uevent;
+        int r = 0;
+
+        assert(enumerator);
+        assert(dir);
+        assert(path);
+
+        /* Most subdirectories of a device are not devices themselves, but e.g. "power/" or "queue/". Only
+         * directories with an "uevent" file are devices below /sys/devices/, see device_set_syspath(), so
+         * don't bother creating a device object for anything else. */
+        check_uevent = path_startswith(path, "/sys/devices/");
+
+        FOREACH_DIRENT_ALL(dent, dir, return -errno) {
+                _cleanup_closedir_ DIR *child_dir = NULL;
+                char child[strlen(path) + 1 + strlen(dent->d_name) + 1];
+                int k;
+
+                if (dent->d_name[0] == '.')
+                        continue;
+
+                if (dent->d_type != DT_DIR)
+                        continue;
+
+                (void) sprintf(child, "%s/%s", path, dent->d_name);
+
+                child_dir = xopendirat(dirfd(dir), dent->d_name, 0);
+                if (!child_dir) {
+                        /* this is necessarily racy, so ignore missing directories */
+                        if (errno != ENOENT)
+                                r = log_debug_errno(errno, "sd-device-enumerator: Failed to open directory %s: %m", child);
+                        continue;
+                }
+
+                /* The sysname is the directory name, unless it contains a '!', which stands for a '/' */
+                if ((!check_uevent || faccessat(dirfd(child_dir), "uevent", F_OK, 0) >= 0) &&
+                    (strchr(dent->d_name, '!') || match_sysname(enumerator, dent->d_name))) {
+                        k = parent_add_child(enumerator, child);
+                        if (k < 0)
+                                r = k;
+                }
+
+                if (maxdepth > 0) {
+                        k = parent_crawl_children(enumerator, child_dir, child, maxdepth - 1);
+                        if (k < 0)
+                                r = k;
+                } else
+                        log_debug("sd-device-enumerator: Max depth reached, %s: ignoring devices", child);
+        }
+
+        return r;
+}
+#endif // 0
 
 static int enumerator_scan_devices_children(sd_device_enumerator *enumerator) {
         const char *path;
         int r = 0, k;
 
         SET_FOREACH(path, enumerator->match_parent) {
+#if 1 /// elogind crawls relative to the already opened directories
+                _cleanup_closedir_ DIR *dir = NULL;
+
+#endif // 1
                 k = parent_add_child(enumerator, path);
                 if (k < 0)
                         r = k;
 
+#if 0 /// elogind crawls relative to the already opened directories
                 k = parent_crawl_children(enumerator, path, DEVICE_ENUMERATE_MAX_DEPTH);
                 if (k < 0)
                         r = k;
+#else // 0
+                dir = opendir(path);
+                if (!dir) {
+                        r = log_debug_errno(errno, "sd-device-enumerator: Failed to open parent directory %s: %m", path);
+                        continue;
+                }
+
+                k = parent_crawl_children(enumerator, dir, path, DEVICE_ENUMERATE_MAX_DEPTH);
+                if (k < 0)
+                        r = k;
+#endif // 0
         }
 
         return r;
@@ -730,6 +864,54 @@ static void device_enumerator_dedup_devices(sd_device_enumerator *enumerator) {
         enumerator->n_devices = b - enumerator->devices + 1;
 }
 
+#if 1 /// elogind allows skipping the sorting, see device_enumerator_set_unsorted()
+static int device_enumerator_dedup_devices_unsorted(sd_device_enumerator *enumerator) {
+        _cleanup_set_free_ Set *devpaths = NULL;
+        size_t n = 0;
+        int r;
+
+        assert(enumerator);
+
+        if (enumerator->n_devices <= 1)
+                return 0;
+
+        /* Reserve everything upfront, so that we don't fail half way through */
+        r = set_ensure_allocated(&devpaths, &path_hash_ops);
+        if (r < 0)
+                return r;
+
+        r = set_reserve(devpaths, enumerator->n_devices);
+        if (r < 0)
+                return r;
+
+        for (size_t i = 0; i < enumerator->n_devices; i++) {
+                const char *devpath;
+
+                assert_se(sd_device_get_devpath(enumerator->devices[i], &devpath) >= 0);
+
+                if (set_put(devpaths, devpath) == 0) {
+                        sd_device_unref(enumerator->devices[i]);
+                        continue;
+                }
+
+                enumerator->devices[n++] = enumerator->devices[i];
+        }
+
+        enumerator->n_devices = n;
+        return 0;
+}
+
+static void device_enumerator_sort_devices(sd_device_enumerator *enumerator) {
+        assert(enumerator);
+
+        if (enumerator->unsorted && device_enumerator_dedup_devices_unsorted(enumerator) >= 0)
+                return;
+
+        typesafe_qsort(enumerator->devices, enumerator->n_devices, device_compare);
+        device_enumerator_dedup_devices(enumerator);
+}
+#endif // 1
+
 int device_enumerator_scan_devices(sd_device_enumerator *enumerator) {
         int r = 0, k;
 
@@ -758,8 +940,12 @@ int device_enumerator_scan_devices(sd_device_enumerator *enumerator) {
                         r = k;
         }
 
+#if 0 /// elogind allows skipping the sorting, see device_enumerator_set_unsorted()
         typesafe_qsort(enumerator->devices, enumerator->n_devices, device_compare);
         device_enumerator_dedup_devices(enumerator);
+#else // 0
+        device_enumerator_sort_devices(enumerator);
+#endif // 0
 
         enumerator->scan_uptodate = true;
         enumerator->type = DEVICE_ENUMERATION_TYPE_DEVICES;
@@ -812,7 +998,11 @@ int device_enumerator_scan_subsystems(sd_device_enumerator *enumerator) {
 
         /* modules */
         if (match_subsystem(enumerator, "module")) {
+#if 0 /// elogind opens the directory relative to the already opened base directory, if there is one
                 k = enumerator_scan_dir_and_add_devices(enumerator, "module", NULL, NULL);
+#else // 0
+                k = enumerator_scan_dir_and_add_devices(enumerator, -1, "module", NULL, NULL);
+#endif // 0
                 if (k < 0)
                         r = log_debug_errno(k, "sd-device-enumerator: Failed to scan modules: %m");
         }
@@ -824,7 +1014,11 @@ int device_enumerator_scan_subsystems(sd_device_enumerator *enumerator) {
 
         /* subsystems (only buses support coldplug) */
         if (match_subsystem(enumerator, "subsystem")) {
+#if 0 /// elogind opens the directory relative to the already opened base directory, if there is one
                 k = enumerator_scan_dir_and_add_devices(enumerator, subsysdir, NULL, NULL);
+#else // 0
+                k = enumerator_scan_dir_and_add_devices(enumerator, -1, subsysdir, NULL, NULL);
+#endif // 0
                 if (k < 0)
                         r = log_debug_errno(k, "sd-device-enumerator: Failed to scan subsystems: %m");
         }
@@ -836,8 +1030,12 @@ int device_enumerator_scan_subsystems(sd_device_enumerator *enumerator) {
                         r = log_debug_errno(k, "sd-device-enumerator: Failed to scan drivers: %m");
         }
 
+#if 0 /// elogind allows skipping the sorting, see device_enumerator_set_unsorted()
         typesafe_qsort(enumerator->devices, enumerator->n_devices, device_compare);
         device_enumerator_dedup_devices(enumerator);
+#else // 0
+        device_enumerator_sort_devices(enumerator);
+#endif // 0
 
         enumerator->scan_uptodate = true;
         enumerator->type = DEVICE_ENUMERATION_TYPE_SUBSYSTEMS;
@@ -13,6 +13,14 @@ typedef enum MonitorNetlinkGroup {
         _MONITOR_NETLINK_GROUP_INVALID = -EINVAL,
 } MonitorNetlinkGroup;
 
+#if 1 /// elogind keeps statistics about received uevents
+typedef struct DeviceMonitorStats {
+        uint64_t n_wakeups;   /* times the socket was found readable */
+        uint64_t n_received;  /* messages received, whether they passed the filter or not */
+        uint64_t n_overflows; /* times the kernel reported ENOBUFS, i.e. uevents were lost */
+} DeviceMonitorStats;
+#endif // 1
+
 int device_monitor_new_full(sd_device_monitor **ret, MonitorNetlinkGroup group, int fd);
 int device_monitor_disconnect(sd_device_monitor *m);
 int device_monitor_allow_unicast_sender(sd_device_monitor *m, sd_device_monitor *sender);
@@ -22,3 +30,12 @@ int device_monitor_get_fd(sd_device_monitor *m);
 #endif // 0
 int device_monitor_send_device(sd_device_monitor *m, sd_device_monitor *destination, sd_device *device);
 int device_monitor_receive_device(sd_device_monitor *m, sd_device **ret);
+#if 1 /// elogind allows matching tags and subsystems as alternatives
+int device_monitor_filter_match_either(sd_device_monitor *m, bool b);
+#endif // 1
+#if 1 /// elogind keeps statistics about received uevents
+void device_monitor_get_stats(sd_device_monitor *m, DeviceMonitorStats *ret);
+#endif // 1
+#if 1 /// elogind can cache devices, see device_cache_enable()
+int device_monitor_covers_device(sd_device_monitor *m, sd_device *device);
+#endif // 1
@@ -27,6 +27,10 @@
 #include "string-util.h"
 #include "strv.h"
 
+#if 1 /// elogind can receive uevents in batches
+typedef struct DeviceMonitorBatch DeviceMonitorBatch;
+#endif // 1
+
 struct sd_device_monitor {
         unsigned n_ref;
 
@@ -42,6 +46,14 @@ struct sd_device_monitor {
         Set *match_parent_filter;
         Set *nomatch_parent_filter;
         bool filter_uptodate;
+#if 1 /// elogind allows matching tags and subsystems as alternatives, see device_monitor_filter_match_either()
+        bool filter_match_either;
+#endif // 1
+#if 1 /// elogind can receive uevents in batches, see sd_device_monitor_set_receive_batch()
+        bool receive_batch;
+        DeviceMonitorBatch *batch;
+        DeviceMonitorStats stats;
+#endif // 1
 
         sd_event *event;
         sd_event_source *event_source;
@@ -70,6 +82,25 @@ typedef struct monitor_netlink_header {
         unsigned filter_tag_bloom_lo;
 } monitor_netlink_header;
 
+#if 1 /// elogind can receive uevents in batches
+#define DEVICE_MONITOR_BATCH_MAX 32U
+
+typedef union DeviceMonitorMessage {
+        monitor_netlink_header nlh;
+        char raw[8192];
+} DeviceMonitorMessage;
+
+/* Everything recvmmsg() needs to receive DEVICE_MONITOR_BATCH_MAX messages in one go. Allocated on first use,
+ * and reused for every wakeup after that. */
+struct DeviceMonitorBatch {
+        struct mmsghdr msgs[DEVICE_MONITOR_BATCH_MAX];
+        struct iovec iovs[DEVICE_MONITOR_BATCH_MAX];
+        union sockaddr_union names[DEVICE_MONITOR_BATCH_MAX];
+        CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(struct ucred))) controls[DEVICE_MONITOR_BATCH_MAX];
+        DeviceMonitorMessage buffers[DEVICE_MONITOR_BATCH_MAX];
+};
+#endif // 1
+
 static int monitor_set_nl_address(sd_device_monitor *m) {
         union sockaddr_union snl;
         socklen_t addrlen;
@@ -100,6 +131,36 @@ _public_ int sd_device_monitor_set_receive_buffer_size(sd_device_monitor *m, siz
         return fd_set_rcvbuf(m->sock, size, false);
 }
 
+#if 1 /// elogind can receive uevents in batches
+_public_ int sd_device_monitor_set_receive_batch(sd_device_monitor *m, int b) {
+        assert_return(m, -EINVAL);
+
+        /* If enabled, each wakeup drains up to DEVICE_MONITOR_BATCH_MAX queued uevents with a single
+         * recvmmsg(), and hands them to the handler in the order they were received. */
+        m->receive_batch = b;
+        return 0;
+}
+
+void device_monitor_get_stats(sd_device_monitor *m, DeviceMonitorStats *ret) {
+        assert(m);
+        assert(ret);
+
+        *ret = m->stats;
+}
+
+static void device_monitor_count_overflow(sd_device_monitor *m) {
+        assert(m);
+
+        /* The kernel tells us that our receive buffer overflowed, and uevents were dropped. There is nothing
+         * we can do about those, but let's keep track, so that the buffer size can be tuned. */
+        m->stats.n_overflows++;
+        log_debug("sd-device-monitor: Receive buffer overrun, %" PRIu64 " so far, uevents were lost.", m->stats.n_overflows);
+
+        /* We cannot tell which devices the lost uevents were about */
+        device_cache_invalidate(NULL);
+}
+#endif // 1
+
 int device_monitor_disconnect(sd_device_monitor *m) {
         assert(m);
 
@@ -227,12 +288,99 @@ _public_ int sd_device_monitor_stop(sd_device_monitor *m) {
         return 0;
 }
 
+#if 1 /// elogind can receive uevents in batches
+static int device_monitor_parse_message(sd_device_monitor *m, struct msghdr *smsg, ssize_t buflen, sd_device **ret);
+
+static int device_monitor_receive_batch(sd_device_monitor *m) {
+        DeviceMonitorBatch *b;
+        int n;
+
+        assert(m);
+
+        if (!m->batch) {
+                m->batch = new(DeviceMonitorBatch, 1);
+                if (!m->batch)
+                        return -ENOMEM;
+        }
+
+        b = m->batch;
+
+        /* recvmmsg() updates the lengths, hence reset all of them */
+        for (unsigned i = 0; i < DEVICE_MONITOR_BATCH_MAX; i++) {
+                b->iovs[i] = IOVEC_MAKE(&b->buffers[i], sizeof(b->buffers[i]));
+                b->msgs[i] = (struct mmsghdr) {
+                        .msg_hdr = {
+                                .msg_iov = &b->iovs[i],
+                                .msg_iovlen = 1,
+                                .msg_control = &b->controls[i],
+                                .msg_controllen = sizeof(b->controls[i]),
+                                .msg_name = &b->names[i],
+                                .msg_namelen = sizeof(b->names[i]),
+                        },
+                };
+        }
+
+        n = recvmmsg(m->sock, b->msgs, DEVICE_MONITOR_BATCH_MAX, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+                if (errno == ENOBUFS)
+                        device_monitor_count_overflow(m);
+                else if (!IN_SET(errno, EINTR, EAGAIN))
+                        log_debug_errno(errno, "sd-device-monitor: Failed to receive messages: %m");
+                return -errno;
+        }
+
+        m->stats.n_received += n;
+        return n;
+}
+
+static int device_monitor_dispatch_batch(sd_device_monitor *m) {
+        _cleanup_(sd_device_monitor_unrefp) sd_device_monitor *ref = NULL;
+        int n, r;
+
+        assert(m);
+
+        n = device_monitor_receive_batch(m);
+        if (n <= 0)
+                return 0;
+
+        /* The handler might drop the last reference to us */
+        ref = sd_device_monitor_ref(m);
+
+        for (int i = 0; i < n; i++) {
+                _cleanup_(sd_device_unrefp) sd_device *device = NULL;
+
+                if (device_monitor_parse_message(m, &m->batch->msgs[i].msg_hdr, m->batch->msgs[i].msg_len, &device) <= 0)
+                        continue;
+
+                if (!m->callback)
+                        continue;
+
+                r = m->callback(m, device, m->userdata);
+                if (r < 0)
+                        return r;
+
+                /* Stopped from within the handler? Then don't bother with the rest. */
+                if (!m->event_source)
+                        break;
+        }
+
+        return 0;
+}
+#endif // 1
+
 static int device_monitor_event_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         _cleanup_(sd_device_unrefp) sd_device *device = NULL;
         sd_device_monitor *m = userdata;
 
         assert(m);
 
+#if 1 /// elogind can receive uevents in batches
+        m->stats.n_wakeups++;
+
+        if (m->receive_batch)
+                return device_monitor_dispatch_batch(m);
+#endif // 1
+
         if (device_monitor_receive_device(m, &device) <= 0)
                 return 0;
 
@@ -339,6 +487,9 @@ static sd_device_monitor *device_monitor_free(sd_device_monitor *m) {
         assert(m);
 
         (void) sd_device_monitor_detach_event(m);
+#if 1 /// elogind can receive uevents in batches
+        free(m->batch);
+#endif // 1
 
         hashmap_free(m->subsystem_filter);
         set_free(m->tag_filter);
@@ -397,18 +548,46 @@ static bool check_tag_filter(sd_device_monitor *m, sd_device *device) {
         return false;
 }
 
+#if 1 /// elogind allows matching tags and subsystems as alternatives
+/* The part of the filter that is also applied in the kernel, see sd_device_monitor_filter_update(). */
+static int passes_subsystem_and_tag_filter(sd_device_monitor *m, sd_device *device) {
+        int r;
+
+        assert(m);
+        assert(device);
+
+        r = check_subsystem_filter(m, device);
+        if (r < 0)
+                return r;
+
+        if (m->filter_match_either && !hashmap_isempty(m->subsystem_filter) && !set_isempty(m->tag_filter)) {
+                if (r > 0)
+                        return true;
+        } else if (r == 0)
+                return false;
+
+        return check_tag_filter(m, device);
+}
+#endif // 1
+
 static int passes_filter(sd_device_monitor *m, sd_device *device) {
         int r;
 
         assert(m);
         assert(device);
 
+#if 0 /// elogind allows matching tags and subsystems as alternatives
         r = check_subsystem_filter(m, device);
         if (r <= 0)
                 return r;
 
         if (!check_tag_filter(m, device))
                 return false;
+#else // 0
+        r = passes_subsystem_and_tag_filter(m, device);
+        if (r <= 0)
+                return r;
+#endif // 0
 
         if (!device_match_sysattr(device, m->match_sysattr_filter, m->nomatch_sysattr_filter))
                 return false;
@@ -416,8 +595,26 @@ static int passes_filter(sd_device_monitor *m, sd_device *device) {
         return device_match_parent(device, m->match_parent_filter, m->nomatch_parent_filter);
 }
 
+#if 1 /// elogind can cache devices, see device_cache_enable()
+int device_monitor_covers_device(sd_device_monitor *m, sd_device *device) {
+        assert(m);
+        assert(device);
+
+        /* Returns > 0 if uevents of the device reach this monitor, i.e. if it is running and the device
+         * passes the subsystem and tag filters. Those may be applied by the kernel already. The other filters
+         * are applied only after a uevent was received, and are of no concern here. */
+
+        if (!m->event_source || m->sock < 0)
+                return false;
+
+        return passes_subsystem_and_tag_filter(m, device);
+}
+#endif // 1
+
 int device_monitor_receive_device(sd_device_monitor *m, sd_device **ret) {
+#if 0 /// elogind parses messages in device_monitor_parse_message()
         _cleanup_(sd_device_unrefp) sd_device *device = NULL;
+#endif // 0
         union {
                 monitor_netlink_header nlh;
                 char raw[8192];
@@ -436,22 +633,31 @@ int device_monitor_receive_device(sd_device_monitor *m, sd_device **ret) {
                 .msg_name = &snl,
                 .msg_namelen = sizeof(snl),
         };
+#if 0 /// elogind parses messages in device_monitor_parse_message()
         struct cmsghdr *cmsg;
         struct ucred *cred;
         ssize_t buflen, bufpos;
         bool is_initialized = false;
         int r;
+#else // 0
+        ssize_t buflen;
+#endif // 0
 
         assert(m);
         assert(ret);
 
         buflen = recvmsg(m->sock, &smsg, 0);
         if (buflen < 0) {
+#if 1 /// elogind keeps track of lost uevents
+                if (errno == ENOBUFS)
+                        device_monitor_count_overflow(m);
+#endif // 1
                 if (errno != EINTR)
                         log_debug_errno(errno, "sd-device-monitor: Failed to receive message: %m");
                 return -errno;
         }
 
+#if 0 /// elogind parses messages separately from receiving them, as it can receive them in batches
         if (buflen < 32 || (smsg.msg_flags & MSG_TRUNC))
                 return log_debug_errno(SYNTHETIC_ERRNO(EINVAL),
                                        "sd-device-monitor: Invalid message length.");
@@ -526,8 +732,115 @@ int device_monitor_receive_device(sd_device_monitor *m, sd_device **ret) {
                 *ret = TAKE_PTR(device);
 
         return r;
+#else // 0
+        m->stats.n_received++;
+
+        return device_monitor_parse_message(m, &smsg, buflen, ret);
+#endif // 0
 }
 
+#if 1 /// elogind parses messages separately from receiving them, as it can receive them in batches
+static int device_monitor_parse_message(sd_device_monitor *m, struct msghdr *smsg, ssize_t buflen, sd_device **ret) {
+        _cleanup_(sd_device_unrefp) sd_device *device = NULL;
+        DeviceMonitorMessage *buf;
+        union sockaddr_union *snl;
+        struct cmsghdr *cmsg;
+        struct ucred *cred;
+        const char *syspath;
+        ssize_t bufpos;
+        bool is_initialized = false;
+        int r;
+
+        assert(m);
+        assert(smsg);
+        assert(smsg->msg_iovlen == 1);
+        assert(ret);
+
+        buf = smsg->msg_iov[0].iov_base;
+        snl = smsg->msg_name;
+
+        if (buflen < 32 || (smsg->msg_flags & MSG_TRUNC))
+                return log_debug_errno(SYNTHETIC_ERRNO(EINVAL),
+                                       "sd-device-monitor: Invalid message length.");
+
+        if (snl->nl.nl_groups == MONITOR_GROUP_NONE) {
+                /* unicast message, check if we trust the sender */
+                if (m->snl_trusted_sender.nl.nl_pid == 0 ||
+                    snl->nl.nl_pid != m->snl_trusted_sender.nl.nl_pid)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
+                                               "sd-device-monitor: Unicast netlink message ignored.");
+
+        } else if (snl->nl.nl_groups == MONITOR_GROUP_KERNEL) {
+                if (snl->nl.nl_pid > 0)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
+                                               "sd-device-monitor: Multicast kernel netlink message from PID %"PRIu32" ignored.", snl->nl.nl_pid);
+        }
+
+        cmsg = CMSG_FIRSTHDR(smsg);
+        if (!cmsg || cmsg->cmsg_type != SCM_CREDENTIALS)
+                return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
+                                       "sd-device-monitor: No sender credentials received, message ignored.");
+
+        cred = (struct ucred*) CMSG_DATA(cmsg);
+        if (cred->uid != 0)
+                return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
+                                       "sd-device-monitor: Sender uid="UID_FMT", message ignored.", cred->uid);
+
+        if (streq(buf->raw, "libudev")) {
+                /* udev message needs proper version magic */
+                if (buf->nlh.magic != htobe32(UDEV_MONITOR_MAGIC))
+                        return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
+                                               "sd-device-monitor: Invalid message signature (%x != %x)",
+                                               buf->nlh.magic, htobe32(UDEV_MONITOR_MAGIC));
+
+                if (buf->nlh.properties_off+32 > (size_t) buflen)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
+                                               "sd-device-monitor: Invalid message length (%u > %zd)",
+                                               buf->nlh.properties_off+32, buflen);
+
+                bufpos = buf->nlh.properties_off;
+
+                /* devices received from udev are always initialized */
+                is_initialized = true;
+
+        } else {
+                /* kernel message with header */
+                bufpos = strlen(buf->raw) + 1;
+                if ((size_t) bufpos < sizeof("a@/d") || bufpos >= buflen)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
+                                               "sd-device-monitor: Invalid message length");
+
+                /* check message header */
+                if (!strstr(buf->raw, "@/"))
+                        return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
+                                               "sd-device-monitor: Invalid message header");
+        }
+
+        r = device_new_from_nulstr(&device, (uint8_t*) &buf->raw[bufpos], buflen - bufpos);
+        if (r < 0)
+                return log_debug_errno(r, "sd-device-monitor: Failed to create device from received message: %m");
+
+        if (is_initialized)
+                device_set_is_initialized(device);
+
+        /* Whatever happened to the device, cached copies of it are outdated now, whether it passes the
+         * filter or not. */
+        if (sd_device_get_syspath(device, &syspath) >= 0)
+                device_cache_invalidate(syspath);
+
+        /* Skip device, if it does not pass the current filter */
+        r = passes_filter(m, device);
+        if (r < 0)
+                return log_device_debug_errno(device, r, "sd-device-monitor: Failed to check received device passing filter: %m");
+        if (r == 0)
+                log_device_debug(device, "sd-device-monitor: Received device does not pass filter, ignoring");
+        else
+                *ret = TAKE_PTR(device);
+
+        return r;
+}
+#endif // 1
+
 static uint32_t string_hash32(const char *str) {
         return MurmurHash2(str, strlen(str), 0);
 }
@@ -696,8 +1009,19 @@ _public_ int sd_device_monitor_filter_update(sd_device_monitor *m) {
                         bpf_jmp(ins, &i, BPF_JMP|BPF_JEQ|BPF_K, tag_bloom_lo, 1 + (tag_matches * 6), 0);
                 }
 
+#if 0 /// elogind allows matching tags and subsystems as alternatives
                 /* nothing matched, drop packet */
                 bpf_stmt(ins, &i, BPF_RET|BPF_K, 0);
+#else // 0
+                if (m->filter_match_either && !hashmap_isempty(m->subsystem_filter)) {
+                        /* nothing matched, try the subsystems, skipping the next instruction */
+                        bpf_stmt(ins, &i, BPF_JMP|BPF_JA, 1);
+                        /* a tag matched, pass packet */
+                        bpf_stmt(ins, &i, BPF_RET|BPF_K, 0xffffffff);
+                } else
+                        /* nothing matched, drop packet */
+                        bpf_stmt(ins, &i, BPF_RET|BPF_K, 0);
+#endif // 0
         }
 
         /* add all subsystem matches */
@@ -776,6 +1100,24 @@ _public_ int sd_device_monitor_filter_add_match_tag(sd_device_monitor *m, const
         return r;
 }
 
+#if 1 /// elogind allows matching tags and subsystems as alternatives
+int device_monitor_filter_match_either(sd_device_monitor *m, bool b) {
+        assert_return(m, -EINVAL);
+
+        /* By default a device has to match one of the subsystems *and* one of the tags, if filters for both
+         * are installed. With this enabled, matching one of them is sufficient. This allows a single monitor
+         * to receive all events of, say, "tagged foo, or of subsystem bar" in one go. */
+
+        if (m->filter_match_either == b)
+                return 0;
+
+        m->filter_match_either = b;
+        m->filter_uptodate = false;
+
+        return 1;
+}
+#endif // 1
+
 _public_ int sd_device_monitor_filter_add_match_sysattr(sd_device_monitor *m, const char *sysattr, const char *value, int match) {
         Hashmap **hashmap;
 
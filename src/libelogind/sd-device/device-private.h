@@ -83,3 +83,18 @@ const char *device_action_to_string(sd_device_action_t a) _const_;
 #if 0 /// UNNEEDED by elogind
 void dump_device_action_table(void);
 #endif // 0
+
+#if 1 /// elogind can cache devices, see device_cache_enable()
+typedef struct DeviceCacheStats {
+        uint64_t n_hits;          /* lookups answered from the cache */
+        uint64_t n_misses;        /* lookups that had to read sysfs, while the cache was enabled */
+        uint64_t n_invalidations; /* devices dropped from the cache because of a uevent */
+} DeviceCacheStats;
+
+int device_cache_enable(sd_device_monitor *m);
+void device_cache_disable(void);
+void device_cache_invalidate(const char *syspath);
+void device_cache_get_stats(DeviceCacheStats *ret);
+
+int device_read_sysattrs(sd_device *device, char **sysattrs);
+#endif // 1
@@ -9,6 +9,7 @@
 
 #include "alloc-util.h"
 #include "device-internal.h"
+#include "device-monitor-private.h"
 #include "device-private.h"
 #include "device-util.h"
 #include "dirent-util.h"
@@ -214,6 +215,161 @@ int device_set_syspath(sd_device *device, const char *_syspath, bool verify) {
         return 0;
 }
 
+#if 1 /// elogind can cache devices, see device_cache_enable()
+typedef struct DeviceCache {
+        sd_device_monitor *monitor;
+        Hashmap *devices; /* path → sd_device, by syspath and by any other path the device was looked up with */
+        DeviceCacheStats stats;
+} DeviceCache;
+
+DEFINE_PRIVATE_HASH_OPS_FULL(device_cache_hash_ops, char, string_hash_func, string_compare_func, free,
+                             sd_device, sd_device_unref);
+
+static thread_local DeviceCache *device_cache = NULL;
+
+int device_cache_enable(sd_device_monitor *m) {
+        assert(m);
+
+        /* Makes sd_device_new_from_syspath() and everything built on it (sd_device_new_from_devnum(),
+         * sd_device_get_parent(), the enumerator, …) hand out shared, previously read sd_device objects
+         * rather than reading sysfs and the udev database again. A device is kept only if its uevents reach
+         * the passed monitor, so that device_monitor_parse_message() can drop it again once it changed.
+         * Hence, the cache is only as current as the monitor: uevents that are queued but not yet received
+         * are not taken into account. The same goes for sysattrs, which are read once per device, like for
+         * any sd_device object, and read again only after a uevent dropped the device. Sysattrs that change
+         * without a uevent have to be dropped with sd_device_set_sysattr_value(device, sysattr, NULL) before
+         * they are read. Callers must not modify the devices they get otherwise, as they are shared, and other
+         * holders may still use the sysattr values they got from them. */
+
+        if (device_cache) {
+                if (device_cache->monitor == m)
+                        return 0;
+
+                device_cache_disable();
+        }
+
+        device_cache = new(DeviceCache, 1);
+        if (!device_cache)
+                return -ENOMEM;
+
+        *device_cache = (DeviceCache) {
+                .monitor = sd_device_monitor_ref(m),
+        };
+
+        return 1;
+}
+
+void device_cache_disable(void) {
+        if (!device_cache)
+                return;
+
+        hashmap_free(device_cache->devices);
+        sd_device_monitor_unref(device_cache->monitor);
+        device_cache = mfree(device_cache);
+}
+
+void device_cache_invalidate(const char *syspath) {
+        sd_device *device;
+        char *path;
+
+        if (!device_cache)
+                return;
+
+        /* Drops the device and everything below it, as children keep a reference to their parent. NULL drops
+         * all devices. */
+        HASHMAP_FOREACH_KEY(device, path, device_cache->devices) {
+                if (syspath && !path_startswith(device->syspath, syspath))
+                        continue;
+
+                /* Count each device once, not once for each path it is known by */
+                if (streq(path, device->syspath))
+                        device_cache->stats.n_invalidations++;
+
+                assert_se(hashmap_remove(device_cache->devices, path) == device);
+                free(path);
+                sd_device_unref(device);
+        }
+}
+
+void device_cache_get_stats(DeviceCacheStats *ret) {
+        assert(ret);
+
+        *ret = device_cache ? device_cache->stats : (DeviceCacheStats) {};
+}
+
+static sd_device *device_cache_get(const char *path) {
+        sd_device *device;
+
+        if (!device_cache)
+                return NULL;
+
+        device = hashmap_get(device_cache->devices, path);
+        if (!device) {
+                device_cache->stats.n_misses++;
+                return NULL;
+        }
+
+        device_cache->stats.n_hits++;
+
+        return sd_device_ref(device);
+}
+
+static int device_cache_put_one(const char *path, sd_device *device) {
+        _cleanup_free_ char *p = NULL;
+        int r;
+
+        p = strdup(path);
+        if (!p)
+                return -ENOMEM;
+
+        r = hashmap_ensure_put(&device_cache->devices, &device_cache_hash_ops, p, device);
+        if (r == -EEXIST)
+                return 0;
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(p);
+        sd_device_ref(device);
+        return 1;
+}
+
+static void device_cache_put(const char *path, sd_device **device) {
+        sd_device *cached;
+        int r;
+
+        assert(path);
+        assert(device);
+        assert(*device);
+
+        if (!device_cache)
+                return;
+
+        /* The path may be an alias of a device that is cached by its syspath already, e.g. a devnum link. */
+        cached = hashmap_get(device_cache->devices, (*device)->syspath);
+        if (cached) {
+                sd_device_unref(*device);
+                *device = sd_device_ref(cached);
+        } else {
+                r = device_monitor_covers_device(device_cache->monitor, *device);
+                if (r < 0)
+                        log_device_debug_errno(*device, r, "sd-device: Failed to check whether device can be cached, ignoring: %m");
+                if (r <= 0)
+                        return;
+
+                r = device_cache_put_one((*device)->syspath, *device);
+                if (r < 0)
+                        return (void) log_device_debug_errno(*device, r, "sd-device: Failed to cache device, ignoring: %m");
+        }
+
+        if (streq(path, (*device)->syspath))
+                return;
+
+        r = device_cache_put_one(path, *device);
+        if (r < 0)
+                log_device_debug_errno(*device, r, "sd-device: Failed to cache device by '%s', ignoring: %m", path);
+}
+#endif // 1
+
 _public_ int sd_device_new_from_syspath(sd_device **ret, const char *syspath) {
         _cleanup_(sd_device_unrefp) sd_device *device = NULL;
         int r;
@@ -221,6 +377,14 @@ _public_ int sd_device_new_from_syspath(sd_device **ret, const char *syspath) {
         assert_return(ret, -EINVAL);
         assert_return(syspath, -EINVAL);
 
+#if 1 /// elogind can cache devices, see device_cache_enable()
+        device = device_cache_get(syspath);
+        if (device) {
+                *ret = TAKE_PTR(device);
+                return 0;
+        }
+#endif // 1
+
         r = device_new_aux(&device);
         if (r < 0)
                 return r;
@@ -229,6 +393,10 @@ _public_ int sd_device_new_from_syspath(sd_device **ret, const char *syspath) {
         if (r < 0)
                 return r;
 
+#if 1 /// elogind can cache devices, see device_cache_enable()
+        device_cache_put(syspath, &device);
+#endif // 1
+
         *ret = TAKE_PTR(device);
         return 0;
 }
@@ -2053,6 +2221,68 @@ _public_ int sd_device_get_sysattr_value(sd_device *device, const char *sysattr,
         return 0;
 }
 
+#if 1 /// elogind can read several sysattrs in one go
+/* Reads all of the given attributes that are not cached yet, opening each relative to the device's
+ * directory, and caches the results for sd_device_get_sysattr_value(). Symlinks, directories and
+ * attributes that cannot be read are left alone: sd_device_get_sysattr_value() resolves or reports those
+ * as usual. */
+int device_read_sysattrs(sd_device *device, char **sysattrs) {
+        _cleanup_close_ int dir_fd = -1;
+        const char *syspath;
+        char **a;
+        int r;
+
+        assert(device);
+
+        STRV_FOREACH(a, sysattrs) {
+                _cleanup_free_ char *value = NULL;
+                struct stat statbuf;
+                size_t size;
+
+                if (device_get_cached_sysattr_value(device, *a, NULL) != -ENOENT)
+                        continue;
+
+                if (dir_fd < 0) {
+                        r = sd_device_get_syspath(device, &syspath);
+                        if (r < 0)
+                                return r;
+
+                        dir_fd = open(syspath, O_PATH|O_DIRECTORY|O_CLOEXEC);
+                        if (dir_fd < 0)
+                                return -errno;
+                }
+
+                if (fstatat(dir_fd, *a, &statbuf, AT_SYMLINK_NOFOLLOW) < 0) {
+                        /* remember that we could not access the sysattr */
+                        r = device_cache_sysattr_value(device, *a, NULL);
+                        if (r < 0)
+                                return r;
+
+                        continue;
+                }
+
+                if (!S_ISREG(statbuf.st_mode) || !(statbuf.st_mode & S_IRUSR))
+                        continue;
+
+                /* Attributes may contain embedded '\0', see sd_device_get_sysattr_value() */
+                if (read_virtual_file_at(dir_fd, *a, SIZE_MAX, &value, &size) < 0)
+                        continue;
+
+                /* drop trailing newlines */
+                while (size > 0 && strchr(NEWLINE, value[--size]))
+                        value[size] = '\0';
+
+                r = device_cache_sysattr_value(device, *a, value);
+                if (r < 0)
+                        return r;
+
+                TAKE_PTR(value);
+        }
+
+        return 0;
+}
+#endif // 1
+
 static void device_remove_cached_sysattr_value(sd_device *device, const char *_key) {
         _cleanup_free_ char *key = NULL;
 
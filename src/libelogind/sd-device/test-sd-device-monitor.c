@@ -10,6 +10,7 @@
 #include "device-private.h"
 #include "device-util.h"
 #include "macro.h"
+#include "stdio-util.h"
 #include "string-util.h"
 #include "tests.h"
 #include "util.h"
@@ -166,6 +167,280 @@ static void test_tag_filter(sd_device *device) {
 
 }
 
+#if 1 /// elogind allows matching tags and subsystems as alternatives
+static void test_match_either_filter(sd_device *device, bool by_tag, bool use_bpf) {
+        _cleanup_(sd_device_monitor_unrefp) sd_device_monitor *monitor_server = NULL, *monitor_client = NULL;
+        _cleanup_(sd_device_enumerator_unrefp) sd_device_enumerator *e = NULL;
+        const char *syspath, *subsystem;
+        sd_device *d;
+
+        log_device_info(device, "/* %s(by_tag=%s, use_bpf=%s) */", __func__, true_false(by_tag), true_false(use_bpf));
+
+        assert_se(sd_device_get_syspath(device, &syspath) >= 0);
+        assert_se(sd_device_get_subsystem(device, &subsystem) >= 0);
+
+        assert_se(device_monitor_new_full(&monitor_server, MONITOR_GROUP_NONE, -1) >= 0);
+        assert_se(sd_device_monitor_start(monitor_server, NULL, NULL) >= 0);
+        assert_se(sd_event_source_set_description(sd_device_monitor_get_event_source(monitor_server), "sender") >= 0);
+
+        /* The device matches only one of the two filters, which is enough now */
+        assert_se(device_monitor_new_full(&monitor_client, MONITOR_GROUP_NONE, -1) >= 0);
+        assert_se(device_monitor_allow_unicast_sender(monitor_client, monitor_server) >= 0);
+        assert_se(device_monitor_filter_match_either(monitor_client, true) > 0);
+        assert_se(device_monitor_filter_match_either(monitor_client, true) == 0);
+        assert_se(sd_device_monitor_filter_add_match_tag(monitor_client, by_tag ? "TEST_SD_DEVICE_MONITOR" : "TEST_SD_DEVICE_MONITOR_NONE") >= 0);
+        assert_se(sd_device_monitor_filter_add_match_subsystem_devtype(monitor_client, by_tag ? "hoge" : subsystem, NULL) >= 0);
+        if (use_bpf)
+                assert_se(sd_device_monitor_filter_update(monitor_client) >= 0);
+        assert_se(sd_device_monitor_start(monitor_client, monitor_handler, (void *) syspath) >= 0);
+        assert_se(sd_event_source_set_description(sd_device_monitor_get_event_source(monitor_client), "receiver") >= 0);
+
+        /* None of these match either filter, hence they must not be received */
+        assert_se(sd_device_enumerator_new(&e) >= 0);
+        if (!by_tag)
+                assert_se(sd_device_enumerator_add_match_subsystem(e, subsystem, false) >= 0);
+        FOREACH_DEVICE(e, d) {
+                const char *p;
+
+                assert_se(sd_device_get_syspath(d, &p) >= 0);
+
+                log_device_debug(d, "Sending device syspath:%s", p);
+                assert_se(device_monitor_send_device(monitor_server, monitor_client, d) >= 0);
+        }
+
+        log_device_info(device, "Sending device syspath:%s", syspath);
+        assert_se(device_monitor_send_device(monitor_server, monitor_client, device) >= 0);
+        assert_se(sd_event_loop(sd_device_monitor_get_event(monitor_client)) == 100);
+}
+#endif // 1
+
+#if 1 /// elogind can receive uevents in batches
+typedef struct BatchData {
+        uint64_t next_seqnum;
+        uint64_t last_seqnum;
+} BatchData;
+
+static int monitor_batch_handler(sd_device_monitor *m, sd_device *d, void *userdata) {
+        BatchData *data = userdata;
+        uint64_t seqnum;
+
+        /* Devices must be handed to us in the order they were sent */
+        assert_se(sd_device_get_seqnum(d, &seqnum) >= 0);
+        assert_se(seqnum == data->next_seqnum);
+
+        if (data->next_seqnum++ == data->last_seqnum)
+                return sd_event_exit(sd_device_monitor_get_event(m), 100);
+
+        return 0;
+}
+
+static void test_receive_batch(sd_device *device, bool batch) {
+        _cleanup_(sd_device_monitor_unrefp) sd_device_monitor *monitor_server = NULL, *monitor_client = NULL;
+        DeviceMonitorStats stats;
+        BatchData data = {
+                .next_seqnum = 1000,
+                .last_seqnum = 1099,
+        };
+
+        log_device_info(device, "/* %s(batch=%s) */", __func__, true_false(batch));
+
+        assert_se(device_monitor_new_full(&monitor_server, MONITOR_GROUP_NONE, -1) >= 0);
+        assert_se(sd_device_monitor_start(monitor_server, NULL, NULL) >= 0);
+        assert_se(sd_event_source_set_description(sd_device_monitor_get_event_source(monitor_server), "sender") >= 0);
+
+        assert_se(device_monitor_new_full(&monitor_client, MONITOR_GROUP_NONE, -1) >= 0);
+        assert_se(device_monitor_allow_unicast_sender(monitor_client, monitor_server) >= 0);
+        assert_se(sd_device_monitor_set_receive_batch(monitor_client, batch) >= 0);
+        assert_se(sd_device_monitor_start(monitor_client, monitor_batch_handler, &data) >= 0);
+        assert_se(sd_event_source_set_description(sd_device_monitor_get_event_source(monitor_client), "receiver") >= 0);
+
+        /* Queue all of them before the receiver gets a chance to run */
+        for (uint64_t i = data.next_seqnum; i <= data.last_seqnum; i++) {
+                char seqnum[DECIMAL_STR_MAX(uint64_t)];
+
+                xsprintf(seqnum, "%" PRIu64, i);
+                assert_se(device_add_property(device, "SEQNUM", seqnum) >= 0);
+                assert_se(device_monitor_send_device(monitor_server, monitor_client, device) >= 0);
+        }
+
+        assert_se(sd_event_loop(sd_device_monitor_get_event(monitor_client)) == 100);
+
+        device_monitor_get_stats(monitor_client, &stats);
+        log_info("received %" PRIu64 " messages in %" PRIu64 " wakeups, %" PRIu64 " overflows",
+                 stats.n_received, stats.n_wakeups, stats.n_overflows);
+
+        assert_se(stats.n_received == 100);
+        assert_se(stats.n_overflows == 0);
+        if (batch)
+                assert_se(stats.n_wakeups < stats.n_received);
+        else
+                assert_se(stats.n_wakeups == stats.n_received);
+}
+#endif // 1
+
+#if 1 /// elogind can cache devices, see device_cache_enable()
+static void assert_device_equal(sd_device *a, sd_device *b) {
+        const char *x, *y, *key, *value;
+        dev_t n, m;
+
+        assert_se(sd_device_get_syspath(a, &x) >= 0);
+        assert_se(sd_device_get_syspath(b, &y) >= 0);
+        assert_se(streq(x, y));
+
+        assert_se(sd_device_get_subsystem(a, &x) == sd_device_get_subsystem(b, &y));
+        assert_se(sd_device_get_devname(a, &x) == sd_device_get_devname(b, &y));
+        assert_se(sd_device_get_devnum(a, &n) == sd_device_get_devnum(b, &m));
+
+        FOREACH_DEVICE_PROPERTY(a, key, value) {
+                assert_se(sd_device_get_property_value(b, key, &x) >= 0);
+                assert_se(streq(value, x));
+        }
+        FOREACH_DEVICE_PROPERTY(b, key, value) {
+                assert_se(sd_device_get_property_value(a, key, &x) >= 0);
+                assert_se(streq(value, x));
+        }
+}
+
+static void test_device_cache(sd_device *device) {
+        _cleanup_(sd_device_monitor_unrefp) sd_device_monitor *monitor_server = NULL, *monitor_client = NULL;
+        _cleanup_(sd_device_enumerator_unrefp) sd_device_enumerator *e = NULL;
+        _cleanup_(sd_device_unrefp) sd_device *first = NULL, *second = NULL;
+        const char *syspath, *value;
+        DeviceCacheStats stats;
+        uint64_t n = 0;
+        sd_device *d;
+
+        log_device_info(device, "/* %s */", __func__);
+
+        assert_se(sd_device_get_syspath(device, &syspath) >= 0);
+
+        assert_se(device_monitor_new_full(&monitor_server, MONITOR_GROUP_NONE, -1) >= 0);
+        assert_se(sd_device_monitor_start(monitor_server, NULL, NULL) >= 0);
+        assert_se(sd_event_source_set_description(sd_device_monitor_get_event_source(monitor_server), "sender") >= 0);
+
+        assert_se(device_monitor_new_full(&monitor_client, MONITOR_GROUP_NONE, -1) >= 0);
+        assert_se(device_monitor_allow_unicast_sender(monitor_client, monitor_server) >= 0);
+        assert_se(sd_device_monitor_start(monitor_client, monitor_handler, (void *) syspath) >= 0);
+        assert_se(sd_event_source_set_description(sd_device_monitor_get_event_source(monitor_client), "receiver") >= 0);
+
+        /* Enumerate before enabling the cache, so that these are all read freshly */
+        assert_se(sd_device_enumerator_new(&e) >= 0);
+        assert_se(sd_device_enumerator_allow_uninitialized(e) >= 0);
+        assert_se(sd_device_enumerator_get_device_first(e));
+
+        assert_se(device_cache_enable(monitor_client) > 0);
+        assert_se(device_cache_enable(monitor_client) == 0);
+
+        /* The first lookup reads the device, the second one must return the very same object, and both
+         * must be identical to what was read freshly. */
+        FOREACH_DEVICE(e, d) {
+                _cleanup_(sd_device_unrefp) sd_device *a = NULL, *b = NULL;
+                const char *p;
+
+                assert_se(sd_device_get_syspath(d, &p) >= 0);
+                assert_se(sd_device_new_from_syspath(&a, p) >= 0);
+                assert_se(sd_device_new_from_syspath(&b, p) >= 0);
+                assert_se(a == b);
+                assert_se(a != d);
+                assert_device_equal(a, d);
+                n++;
+        }
+
+        device_cache_get_stats(&stats);
+        log_info("%" PRIu64 " devices: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " invalidations",
+                 n, stats.n_hits, stats.n_misses, stats.n_invalidations);
+        assert_se(stats.n_hits == n);
+        assert_se(stats.n_misses == n);
+        assert_se(stats.n_invalidations == 0);
+
+        /* Aliases are cached too, and resolve to the same object as the syspath */
+        if (sd_device_new_from_devnum(&first, 'c', makedev(1, 3)) >= 0) {
+                assert_se(sd_device_new_from_devnum(&second, 'c', makedev(1, 3)) >= 0);
+                assert_se(first == second);
+                second = sd_device_unref(second);
+                assert_se(sd_device_get_syspath(first, &syspath) >= 0);
+                assert_se(sd_device_new_from_syspath(&second, syspath) >= 0);
+                assert_se(first == second);
+                first = sd_device_unref(first);
+                second = sd_device_unref(second);
+                assert_se(sd_device_get_syspath(device, &syspath) >= 0);
+        }
+
+        /* A cache hit must leave the sysattr values handed out before alone, as other holders of the shared
+         * device may still use them */
+        assert_se(sd_device_new_from_syspath(&first, syspath) >= 0);
+        if (sd_device_get_sysattr_value(first, "uevent", &value) >= 0) {
+                const char *again;
+
+                assert_se(sd_device_new_from_syspath(&second, syspath) >= 0);
+                assert_se(first == second);
+                second = sd_device_unref(second);
+
+                assert_se(sd_device_get_sysattr_value(first, "uevent", &again) >= 0);
+                assert_se(again == value);
+        }
+
+        /* A uevent drops the device from the cache */
+        assert_se(device_monitor_send_device(monitor_server, monitor_client, device) >= 0);
+        assert_se(sd_event_loop(sd_device_monitor_get_event(monitor_client)) == 100);
+
+        device_cache_get_stats(&stats);
+        assert_se(stats.n_invalidations == 1);
+
+        assert_se(sd_device_new_from_syspath(&second, syspath) >= 0);
+        assert_se(first != second);
+        assert_device_equal(first, second);
+
+        device_cache_disable();
+        device_cache_get_stats(&stats);
+        assert_se(stats.n_hits == 0);
+}
+
+static void test_device_cache_filtered(sd_device *device) {
+        _cleanup_(sd_device_monitor_unrefp) sd_device_monitor *monitor = NULL;
+        _cleanup_(sd_device_unrefp) sd_device *a = NULL, *b = NULL;
+        const char *syspath, *subsystem;
+        DeviceCacheStats stats;
+
+        log_device_info(device, "/* %s */", __func__);
+
+        assert_se(sd_device_get_syspath(device, &syspath) >= 0);
+        assert_se(sd_device_get_subsystem(device, &subsystem) >= 0);
+
+        /* Devices whose uevents do not reach the monitor must not be cached, as nothing would ever drop them
+         * again. Neither must anything be cached while the monitor is not running. */
+        assert_se(device_monitor_new_full(&monitor, MONITOR_GROUP_NONE, -1) >= 0);
+        assert_se(sd_device_monitor_filter_add_match_subsystem_devtype(monitor, "hoge", NULL) >= 0);
+        assert_se(device_cache_enable(monitor) > 0);
+
+        assert_se(sd_device_new_from_syspath(&a, syspath) >= 0);
+        assert_se(sd_device_new_from_syspath(&b, syspath) >= 0);
+        assert_se(a != b);
+        a = sd_device_unref(a);
+        b = sd_device_unref(b);
+
+        assert_se(sd_device_monitor_start(monitor, NULL, NULL) >= 0);
+
+        assert_se(sd_device_new_from_syspath(&a, syspath) >= 0);
+        assert_se(sd_device_new_from_syspath(&b, syspath) >= 0);
+        assert_se(a != b);
+        a = sd_device_unref(a);
+        b = sd_device_unref(b);
+
+        assert_se(sd_device_monitor_filter_add_match_subsystem_devtype(monitor, subsystem, NULL) >= 0);
+
+        assert_se(sd_device_new_from_syspath(&a, syspath) >= 0);
+        assert_se(sd_device_new_from_syspath(&b, syspath) >= 0);
+        assert_se(a == b);
+
+        device_cache_get_stats(&stats);
+        assert_se(stats.n_hits == 1);
+        assert_se(stats.n_misses == 5);
+
+        device_cache_disable();
+}
+#endif // 1
+
 static void test_sysattr_filter(sd_device *device, const char *sysattr) {
         _cleanup_(sd_device_monitor_unrefp) sd_device_monitor *monitor_server = NULL, *monitor_client = NULL;
         _cleanup_(sd_device_enumerator_unrefp) sd_device_enumerator *e = NULL;
@@ -320,9 +595,23 @@ int main(int argc, char *argv[]) {
 
         test_subsystem_filter(loopback);
         test_tag_filter(loopback);
+#if 1 /// elogind allows matching tags and subsystems as alternatives
+        test_match_either_filter(loopback,  true, false);
+        test_match_either_filter(loopback, false, false);
+        test_match_either_filter(loopback,  true,  true);
+        test_match_either_filter(loopback, false,  true);
+#endif // 1
         test_sysattr_filter(loopback, "ifindex");
         test_sd_device_monitor_filter_remove(loopback);
         test_device_copy_properties(loopback);
+#if 1 /// elogind can receive uevents in batches
+        test_receive_batch(loopback, false);
+        test_receive_batch(loopback, true);
+#endif // 1
+#if 1 /// elogind can cache devices, see device_cache_enable()
+        test_device_cache(loopback);
+        test_device_cache_filtered(loopback);
+#endif // 1
 
         r = sd_device_new_from_subsystem_sysname(&sda, "block", "sda");
         if (r < 0) {
@@ -1,15 +1,26 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include <sys/mount.h>
+#include <unistd.h>
+
 #include "device-enumerator-private.h"
 #include "device-internal.h"
 #include "device-private.h"
 #include "device-util.h"
 #include "errno-util.h"
+#include "fileio.h"
 #include "hashmap.h"
+#include "mkdir.h"
 #include "nulstr-util.h"
+#include "process-util.h"
+#include "rm-rf.h"
+#include "set.h"
+#include "stdio-util.h"
 #include "string-util.h"
+#include "strv.h"
 #include "tests.h"
 #include "time-util.h"
+#include "tmpfile-util.h"
 
 static void test_sd_device_one(sd_device *d) {
         const char *syspath, *subsystem, *val;
@@ -164,6 +175,186 @@ static void test_sd_device_enumerator_filter_subsystem(void) {
         assert_se(n_new_dev <= 10);
 }
 
+static void test_sd_device_enumerator_unsorted(void) {
+        _cleanup_(sd_device_enumerator_unrefp) sd_device_enumerator *e = NULL;
+        _cleanup_set_free_ Set *sorted = NULL;
+        size_t n_sorted, n_unsorted = 0;
+        sd_device *d;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_device_enumerator_new(&e) >= 0);
+        assert_se(sd_device_enumerator_allow_uninitialized(e) >= 0);
+        FOREACH_DEVICE(e, d) {
+                const char *syspath;
+
+                assert_se(sd_device_get_syspath(d, &syspath) >= 0);
+                assert_se(set_put_strdup(&sorted, syspath) > 0);
+        }
+        n_sorted = set_size(sorted);
+
+        /* The same devices, each of them once, only possibly in a different order */
+        assert_se(device_enumerator_set_unsorted(e, true) > 0);
+        assert_se(device_enumerator_set_unsorted(e, true) == 0);
+        FOREACH_DEVICE(e, d) {
+                const char *syspath;
+
+                assert_se(sd_device_get_syspath(d, &syspath) >= 0);
+                assert_se(set_contains(sorted, syspath));
+                n_unsorted++;
+        }
+
+        log_info("%zu devices sorted, %zu devices unsorted", n_sorted, n_unsorted);
+        /* Assume that not so many devices are plugged or unplugged. */
+        assert_se(n_unsorted <= n_sorted + 10);
+        assert_se(n_unsorted + 10 >= n_sorted);
+}
+
+static void create_synthetic_sysfs(const char *root, unsigned n_subsystems, unsigned n_devices) {
+        char path[PATH_MAX], target[PATH_MAX];
+
+        xsprintf(path, "%s/bus", root);
+        assert_se(mkdir_p(path, 0755) >= 0);
+
+        for (unsigned i = 0; i < n_subsystems; i++) {
+                xsprintf(path, "%s/class/bench%u", root, i);
+                assert_se(mkdir_p(path, 0755) >= 0);
+
+                /* A parent device for all devices of the subsystem */
+                xsprintf(path, "%s/devices/virtual/bench%u", root, i);
+                assert_se(mkdir_p(path, 0755) >= 0);
+
+                xsprintf(path, "%s/devices/virtual/bench%u/uevent", root, i);
+                assert_se(write_string_file(path, "", WRITE_STRING_FILE_CREATE) >= 0);
+
+                for (unsigned j = 0; j < n_devices; j++) {
+                        /* The device, with a subdirectory that is not a device, as most devices have */
+                        xsprintf(path, "%s/devices/virtual/bench%u/bench%u_%u/power", root, i, i, j);
+                        assert_se(mkdir_p(path, 0755) >= 0);
+
+                        xsprintf(path, "%s/devices/virtual/bench%u/bench%u_%u/uevent", root, i, i, j);
+                        assert_se(write_string_file(path, "", WRITE_STRING_FILE_CREATE) >= 0);
+
+                        xsprintf(path, "%s/devices/virtual/bench%u/bench%u_%u/subsystem", root, i, i, j);
+                        xsprintf(target, "../../../../class/bench%u", i);
+                        assert_se(symlink(target, path) >= 0);
+
+                        xsprintf(path, "%s/class/bench%u/bench%u_%u", root, i, i, j);
+                        xsprintf(target, "../../devices/virtual/bench%u/bench%u_%u", i, i, j);
+                        assert_se(symlink(target, path) >= 0);
+                }
+        }
+}
+
+static size_t enumerate_synthetic_sysfs(unsigned n_iterations, const char *description,
+                                        bool unsorted, const char *sysname, const char *parent) {
+        usec_t t;
+        size_t n = 0;
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (unsigned i = 0; i < n_iterations; i++) {
+                _cleanup_(sd_device_enumerator_unrefp) sd_device_enumerator *e = NULL;
+                _cleanup_(sd_device_unrefp) sd_device *p = NULL;
+                sd_device *d;
+
+                assert_se(sd_device_enumerator_new(&e) >= 0);
+                assert_se(sd_device_enumerator_allow_uninitialized(e) >= 0);
+                assert_se(device_enumerator_set_unsorted(e, unsorted) >= 0);
+                if (sysname)
+                        assert_se(sd_device_enumerator_add_match_sysname(e, sysname) >= 0);
+                if (parent) {
+                        assert_se(sd_device_new_from_syspath(&p, parent) >= 0);
+                        assert_se(sd_device_enumerator_add_match_parent(e, p) >= 0);
+                }
+
+                n = 0;
+                FOREACH_DEVICE(e, d)
+                        n++;
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("%-24s %6zu devices, %u iterations: %8.3f ms per iteration",
+                 description, n, n_iterations, (double) t / USEC_PER_MSEC / n_iterations);
+        return n;
+}
+
+static void test_sd_device_enumerator_benchmark(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmpdir = NULL;
+        unsigned n_subsystems, n_devices, n_iterations;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        if (getuid() != 0)
+                return (void) log_info("Not root, skipping.");
+
+        n_subsystems = slow_tests_enabled() ? 8 : 4;
+        n_devices = slow_tests_enabled() ? 1000 : 100;
+        n_iterations = slow_tests_enabled() ? 10 : 1;
+
+        assert_se(mkdtemp_malloc("/tmp/test-sd-device-XXXXXX", &tmpdir) >= 0);
+        create_synthetic_sysfs(tmpdir, n_subsystems, n_devices);
+
+        /* Enumerate the synthetic tree in place of the real one */
+        r = safe_fork_with_mount("(enumerator-benchmark)", tmpdir, "/sys", NULL, MS_BIND, NULL);
+        assert_se(r >= 0);
+        if (r == 0) {
+                assert_se(enumerate_synthetic_sysfs(n_iterations, "all, sorted:", false, NULL, NULL) == n_subsystems * n_devices);
+                assert_se(enumerate_synthetic_sysfs(n_iterations, "all, unsorted:", true, NULL, NULL) == n_subsystems * n_devices);
+                assert_se(enumerate_synthetic_sysfs(n_iterations, "by sysname:", false, "bench0_0", NULL) == 1);
+                assert_se(enumerate_synthetic_sysfs(n_iterations, "by parent:", false, NULL, "/sys/devices/virtual/bench0") == n_devices);
+                assert_se(enumerate_synthetic_sysfs(n_iterations, "by parent and sysname:", false, "bench0_0", "/sys/devices/virtual/bench0") == 1);
+
+                _exit(EXIT_SUCCESS);
+        }
+}
+
+static void test_device_read_sysattrs(void) {
+        _cleanup_(sd_device_enumerator_unrefp) sd_device_enumerator *e = NULL;
+        char **sysattrs = STRV_MAKE("uevent", "dev", "name", "modalias", "subsystem", "power", "hopefully-does-not-exist");
+        unsigned n = 0;
+        sd_device *d;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_device_enumerator_new(&e) >= 0);
+        assert_se(sd_device_enumerator_allow_uninitialized(e) >= 0);
+        FOREACH_DEVICE(e, d) {
+                _cleanup_(sd_device_unrefp) sd_device *batch = NULL, *single = NULL;
+                const char *syspath;
+                char **a;
+
+                if (n >= 100)
+                        break;
+
+                assert_se(sd_device_get_syspath(d, &syspath) >= 0);
+                assert_se(sd_device_new_from_syspath(&batch, syspath) >= 0);
+                assert_se(sd_device_new_from_syspath(&single, syspath) >= 0);
+
+                /* Whatever was read in one go must be the same as when reading one attribute at a time */
+                assert_se(device_read_sysattrs(batch, sysattrs) >= 0);
+                STRV_FOREACH(a, sysattrs) {
+                        const char *v = NULL, *w = NULL;
+                        int r, k;
+
+                        r = sd_device_get_sysattr_value(batch, *a, &v);
+                        k = sd_device_get_sysattr_value(single, *a, &w);
+                        if (r != k || !streq_ptr(v, w))
+                                log_error("%s/%s: %i '%s' vs. %i '%s'", syspath, *a, r, strnull(v), k, strnull(w));
+                        assert_se(r == k);
+                        assert_se(streq_ptr(v, w));
+                }
+
+                /* And a second batch read does not touch what is cached already */
+                assert_se(device_read_sysattrs(batch, sysattrs) >= 0);
+                n++;
+        }
+
+        log_info("Compared attributes of %u devices", n);
+}
+
 static void test_sd_device_new_from_nulstr(void) {
         const char *devlinks =
                 "/dev/disk/by-partuuid/1290d63a-42cc-4c71-b87c-xxxxxxxxxxxx\0"
@@ -211,6 +402,10 @@ int main(int argc, char **argv) {
         test_sd_device_enumerator_devices();
         test_sd_device_enumerator_subsystems();
         test_sd_device_enumerator_filter_subsystem();
+        test_sd_device_enumerator_unsorted();
+        test_sd_device_enumerator_benchmark();
+
+        test_device_read_sysattrs();
 
         test_sd_device_new_from_nulstr();
 
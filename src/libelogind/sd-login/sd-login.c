@@ -16,6 +16,7 @@
 #include "fd-util.h"
 #include "format-util.h"
 #include "fs-util.h"
+#include "hashmap.h"
 #include "hostname-util.h"
 #include "io-util.h"
 #include "login-util.h"
@@ -28,6 +29,8 @@
 #include "strv.h"
 #include "user-util.h"
 #include "util.h"
+/// Additional includes needed by elogind
+#include "login-shm.h"
 
 /* Error codes:
  *
@@ -127,6 +130,140 @@ _public_ int sd_pid_get_owner_uid(pid_t pid, uid_t *uid) {
         return IN_SET(r, -ENXIO, -ENOMEDIUM) ? -ENODATA : r;
 }
 
+#if 1 /// elogind resolves many PIDs in one go
+typedef struct CgroupSession {
+        char *session;
+        uid_t uid;
+        char path[];
+} CgroupSession;
+
+static CgroupSession* cgroup_session_free(CgroupSession *c) {
+        if (!c)
+                return NULL;
+
+        free(c->session);
+        return mfree(c);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(CgroupSession*, cgroup_session_free);
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(cgroup_session_hash_ops, char, string_hash_func, string_compare_func,
+                                              CgroupSession, cgroup_session_free);
+
+static int cgroup_session_get(Hashmap **cache, const char *path, CgroupSession **ret) {
+        _cleanup_(cgroup_session_freep) CgroupSession *c = NULL;
+        CgroupSession *found;
+        size_t l;
+        int r;
+
+        assert(cache);
+        assert(path);
+        assert(ret);
+
+        found = hashmap_get(*cache, path);
+        if (found) {
+                *ret = found;
+                return 0;
+        }
+
+        l = strlen(path);
+        c = malloc0(offsetof(CgroupSession, path) + l + 1);
+        if (!c)
+                return -ENOMEM;
+        memcpy(c->path, path, l + 1);
+        c->uid = UID_INVALID;
+
+        r = cg_path_get_session(path, &c->session);
+        if (r == -ENOMEM)
+                return r;
+        if (r >= 0) {
+                r = cg_path_get_owner_uid(path, &c->uid);
+                if (r == -ENOMEM)
+                        return r;
+                if (r < 0)
+                        c->uid = UID_INVALID;
+        }
+
+        r = hashmap_ensure_put(cache, &cgroup_session_hash_ops, c->path, c);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(c);
+        return 0;
+}
+
+_public_ int sd_pids_get_sessions(const pid_t *pids, size_t n_pids, char **sessions, uid_t *uids) {
+        _cleanup_hashmap_free_ Hashmap *cache = NULL;
+        _cleanup_free_ char *root = NULL, *buffer = NULL;
+        size_t i, n_found = 0;
+        int r;
+
+        assert_return(pids || n_pids == 0, -EINVAL);
+        assert_return(n_pids <= INT_MAX, -EINVAL);
+        for (i = 0; i < n_pids; i++)
+                assert_return(pids[i] >= 0, -EINVAL);
+
+        if (n_pids == 0)
+                return 0;
+
+        /* The root of our hierarchy is looked up once, rather than once per PID, and the session and
+         * its owner are looked up once per distinct cgroup, which is what makes this cheaper than calling
+         * sd_pid_get_session() and sd_pid_get_owner_uid() for each PID. */
+
+        r = cg_get_root_path(&root);
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < n_pids; i++) {
+                CgroupSession *c = NULL;
+                const char *raw, *path;
+
+                if (sessions)
+                        sessions[i] = NULL;
+                if (uids)
+                        uids[i] = UID_INVALID;
+
+                r = cg_pid_get_path_buffered(pids[i], &buffer, &raw);
+                if (r == -ENOMEM)
+                        goto fail;
+                if (r < 0)
+                        continue;
+
+                r = cg_shift_path(raw, root, &path);
+                if (r < 0)
+                        goto fail;
+
+                r = cgroup_session_get(&cache, path, &c);
+                if (r < 0)
+                        goto fail;
+
+                if (!c->session)
+                        continue;
+
+                if (sessions) {
+                        sessions[i] = strdup(c->session);
+                        if (!sessions[i]) {
+                                r = -ENOMEM;
+                                goto fail;
+                        }
+                }
+                if (uids)
+                        uids[i] = c->uid;
+
+                n_found++;
+        }
+
+        return (int) n_found;
+
+fail:
+        /* Don't hand out half of the result */
+        if (sessions)
+                for (size_t j = 0; j <= i; j++)
+                        sessions[j] = mfree(sessions[j]);
+        return r;
+}
+#endif // 1
+
 _public_ int sd_pid_get_cgroup(pid_t pid, char **cgroup) {
         char *c;
         int r;
@@ -298,7 +435,11 @@ _public_ int sd_uid_get_state(uid_t uid, char**state) {
         if (r < 0)
                 return r;
 
+#if 0 /// elogind reads from the shared memory snapshot of the state files where it can, see login-shm.c
         r = parse_env_file(NULL, p, "STATE", &s);
+#else // 0
+        r = login_shm_parse_env_file(p, "STATE", &s);
+#endif // 0
         if (r == -ENOENT) {
                 r = free_and_strdup(&s, "offline");
                 if (r < 0)
@@ -322,7 +463,11 @@ _public_ int sd_uid_get_display(uid_t uid, char **session) {
         if (r < 0)
                 return r;
 
+#if 0 /// elogind reads from the shared memory snapshot of the state files where it can, see login-shm.c
         r = parse_env_file(NULL, p, "DISPLAY", &s);
+#else // 0
+        r = login_shm_parse_env_file(p, "DISPLAY", &s);
+#endif // 0
         if (r == -ENOENT)
                 return -ENODATA;
         if (r < 0)
@@ -372,9 +517,15 @@ _public_ int sd_uid_is_on_seat(uid_t uid, int require_active, const char *seat)
         if (r < 0)
                 return r;
 
+#if 0 /// elogind reads from the shared memory snapshot of the state files where it can, see login-shm.c
         r = parse_env_file(NULL, filename,
                            require_active ? "ACTIVE_UID" : "UIDS",
                            &content);
+#else // 0
+        r = login_shm_parse_env_file(filename,
+                                     require_active ? "ACTIVE_UID" : "UIDS",
+                                     &content);
+#endif // 0
         if (r == -ENOENT)
                 return 0;
         if (r < 0)
@@ -399,7 +550,11 @@ static int uid_get_array(uid_t uid, const char *variable, char ***array) {
         if (r < 0)
                 return r;
 
+#if 0 /// elogind reads from the shared memory snapshot of the state files where it can, see login-shm.c
         r = parse_env_file(NULL, p, variable, &s);
+#else // 0
+        r = login_shm_parse_env_file(p, variable, &s);
+#endif // 0
         if (r == -ENOENT || (r >= 0 && isempty(s))) {
                 if (array)
                         *array = NULL;
@@ -477,7 +632,11 @@ _public_ int sd_session_is_active(const char *session) {
         if (r < 0)
                 return r;
 
+#if 0 /// elogind reads from the shared memory snapshot of the state files where it can, see login-shm.c
         r = parse_env_file(NULL, p, "ACTIVE", &s);
+#else // 0
+        r = login_shm_parse_env_file(p, "ACTIVE", &s);
+#endif // 0
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -496,7 +655,11 @@ _public_ int sd_session_is_remote(const char *session) {
         if (r < 0)
                 return r;
 
+#if 0 /// elogind reads from the shared memory snapshot of the state files where it can, see login-shm.c
         r = parse_env_file(NULL, p, "REMOTE", &s);
+#else // 0
+        r = login_shm_parse_env_file(p, "REMOTE", &s);
+#endif // 0
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -517,7 +680,11 @@ _public_ int sd_session_get_state(const char *session, char **state) {
         if (r < 0)
                 return r;
 
+#if 0 /// elogind reads from the shared memory snapshot of the state files where it can, see login-shm.c
         r = parse_env_file(NULL, p, "STATE", &s);
+#else // 0
+        r = login_shm_parse_env_file(p, "STATE", &s);
+#endif // 0
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -540,7 +707,11 @@ _public_ int sd_session_get_uid(const char *session, uid_t *uid) {
         if (r < 0)
                 return r;
 
+#if 0 /// elogind reads from the shared memory snapshot of the state files where it can, see login-shm.c
         r = parse_env_file(NULL, p, "UID", &s);
+#else // 0
+        r = login_shm_parse_env_file(p, "UID", &s);
+#endif // 0
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -562,7 +733,11 @@ static int session_get_string(const char *session, const char *field, char **val
         if (r < 0)
                 return r;
 
+#if 0 /// elogind reads from the shared memory snapshot of the state files where it can, see login-shm.c
         r = parse_env_file(NULL, p, field, &s);
+#else // 0
+        r = login_shm_parse_env_file(p, field, &s);
+#endif // 0
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -654,9 +829,15 @@ _public_ int sd_seat_get_active(const char *seat, char **session, uid_t *uid) {
         if (r < 0)
                 return r;
 
+#if 0 /// elogind reads from the shared memory snapshot of the state files where it can, see login-shm.c
         r = parse_env_file(NULL, p,
                            "ACTIVE", &s,
                            "ACTIVE_UID", &t);
+#else // 0
+        r = login_shm_parse_env_file(p,
+                                     "ACTIVE", &s,
+                                     "ACTIVE_UID", &t);
+#endif // 0
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -696,9 +877,15 @@ _public_ int sd_seat_get_sessions(
         if (r < 0)
                 return r;
 
+#if 0 /// elogind reads from the shared memory snapshot of the state files where it can, see login-shm.c
         r = parse_env_file(NULL, fname,
                            "SESSIONS", &session_line,
                            "UIDS", &uid_line);
+#else // 0
+        r = login_shm_parse_env_file(fname,
+                                     "SESSIONS", &session_line,
+                                     "UIDS", &uid_line);
+#endif // 0
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -756,8 +943,13 @@ static int seat_get_can(const char *seat, const char *variable) {
         if (r < 0)
                 return r;
 
+#if 0 /// elogind reads from the shared memory snapshot of the state files where it can, see login-shm.c
         r = parse_env_file(NULL, p,
                            variable, &s);
+#else // 0
+        r = login_shm_parse_env_file(p,
+                                     variable, &s);
+#endif // 0
         if (r == -ENOENT)
                 return -ENXIO;
         if (r < 0)
@@ -783,7 +975,11 @@ _public_ int sd_seat_can_graphical(const char *seat) {
 _public_ int sd_get_seats(char ***seats) {
         int r;
 
+#if 0 /// elogind reads from the shared memory snapshot of the state files where it can, see login-shm.c
         r = get_files_in_directory("/run/systemd/seats/", seats);
+#else // 0
+        r = login_shm_get_files_in_directory("/run/systemd/seats/", seats);
+#endif // 0
         if (r == -ENOENT) {
                 if (seats)
                         *seats = NULL;
@@ -795,7 +991,11 @@ _public_ int sd_get_seats(char ***seats) {
 _public_ int sd_get_sessions(char ***sessions) {
         int r;
 
+#if 0 /// elogind reads from the shared memory snapshot of the state files where it can, see login-shm.c
         r = get_files_in_directory("/run/systemd/sessions/", sessions);
+#else // 0
+        r = login_shm_get_files_in_directory("/run/systemd/sessions/", sessions);
+#endif // 0
         if (r == -ENOENT) {
                 if (sessions)
                         *sessions = NULL;
@@ -971,6 +1171,67 @@ _public_ int sd_machine_get_ifindices(const char *machine, int **ret_ifindices)
         return n;
 }
 
+#if 1 /// elogind watches the generation files it maintains where they exist, see login-shm.h
+static const struct {
+        const char *name;
+        const char *directory;
+        const char *generation;
+} login_monitor_categories[] = {
+        { "seat",    "/run/systemd/seats/",    LOGIN_GENERATION_SEAT    },
+        { "session", "/run/systemd/sessions/", LOGIN_GENERATION_SESSION },
+        { "uid",     "/run/systemd/users/",    LOGIN_GENERATION_UID     },
+        { "machine", "/run/systemd/machines/", NULL                     },
+};
+
+struct sd_login_monitor {
+        int fd;
+
+        bool watched[ELEMENTSOF(login_monitor_categories)];
+        int directory_wd[ELEMENTSOF(login_monitor_categories)];
+        int generation_wd[ELEMENTSOF(login_monitor_categories)];
+};
+
+static int login_monitor_watch(sd_login_monitor *m) {
+        int wd;
+
+        assert(m);
+
+        /* elogind rewrites the generation file of a category once for each burst of changes, while the
+         * state directories see several changes for every login. Hence we watch the former while elogind
+         * maintains them, and the latter otherwise. This is called again whenever the monitor is flushed,
+         * to switch over when elogind started or went away. */
+
+        for (size_t i = 0; i < ELEMENTSOF(login_monitor_categories); i++) {
+                if (!m->watched[i])
+                        continue;
+
+                if (login_monitor_categories[i].generation && m->generation_wd[i] < 0) {
+                        wd = inotify_add_watch(m->fd, login_monitor_categories[i].generation, IN_CLOSE_WRITE|IN_DELETE_SELF);
+                        if (wd >= 0) {
+                                m->generation_wd[i] = wd;
+
+                                if (m->directory_wd[i] >= 0) {
+                                        (void) inotify_rm_watch(m->fd, m->directory_wd[i]);
+                                        m->directory_wd[i] = -1;
+                                }
+                        } else if (errno != ENOENT)
+                                return -errno;
+                }
+
+                if (m->generation_wd[i] < 0 && m->directory_wd[i] < 0) {
+                        wd = inotify_add_watch(m->fd, login_monitor_categories[i].directory, IN_MOVED_TO|IN_DELETE);
+                        if (wd < 0)
+                                return -errno;
+
+                        m->directory_wd[i] = wd;
+                }
+        }
+
+        return 0;
+}
+#endif // 1
+
+#if 0 /// elogind keeps more than the inotify fd around, see login_monitor_watch()
 static int MONITOR_TO_FD(sd_login_monitor *m) {
         return (int) (unsigned long) m - 1;
 }
@@ -978,8 +1239,10 @@ static int MONITOR_TO_FD(sd_login_monitor *m) {
 static sd_login_monitor* FD_TO_MONITOR(int fd) {
         return (sd_login_monitor*) (unsigned long) (fd + 1);
 }
+#endif // 0
 
 _public_ int sd_login_monitor_new(const char *category, sd_login_monitor **m) {
+#if 0 /// elogind keeps more than the inotify fd around, see login_monitor_watch()
         _cleanup_close_ int fd = -1;
         bool good = false;
         int k;
@@ -1027,16 +1290,62 @@ _public_ int sd_login_monitor_new(const char *category, sd_login_monitor **m) {
 
         *m = FD_TO_MONITOR(TAKE_FD(fd));
         return 0;
+#else // 0
+        _cleanup_(sd_login_monitor_unrefp) sd_login_monitor *n = NULL;
+        bool good = false;
+        int r;
+
+        assert_return(m, -EINVAL);
+
+        n = new(sd_login_monitor, 1);
+        if (!n)
+                return -ENOMEM;
+
+        *n = (sd_login_monitor) {
+                .fd = -1,
+        };
+
+        for (size_t i = 0; i < ELEMENTSOF(login_monitor_categories); i++) {
+                n->watched[i] = !category || streq(category, login_monitor_categories[i].name);
+                n->directory_wd[i] = n->generation_wd[i] = -1;
+
+                good = good || n->watched[i];
+        }
+
+        if (!good)
+                return -EINVAL;
+
+        n->fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+        if (n->fd < 0)
+                return -errno;
+
+        r = login_monitor_watch(n);
+        if (r < 0)
+                return r;
+
+        *m = TAKE_PTR(n);
+        return 0;
+#endif // 0
 }
 
 _public_ sd_login_monitor* sd_login_monitor_unref(sd_login_monitor *m) {
+#if 0 /// elogind keeps more than the inotify fd around, see login_monitor_watch()
         if (m)
                 close_nointr(MONITOR_TO_FD(m));
 
         return NULL;
+#else // 0
+        if (!m)
+                return NULL;
+
+        safe_close(m->fd);
+
+        return mfree(m);
+#endif // 0
 }
 
 _public_ int sd_login_monitor_flush(sd_login_monitor *m) {
+#if 0 /// elogind keeps more than the inotify fd around, see login_monitor_watch()
         int r;
 
         assert_return(m, -EINVAL);
@@ -1046,13 +1355,48 @@ _public_ int sd_login_monitor_flush(sd_login_monitor *m) {
                 return r;
 
         return 0;
+#else // 0
+        assert_return(m, -EINVAL);
+
+        for (;;) {
+                union inotify_event_buffer buffer;
+                struct inotify_event *e;
+                ssize_t l;
+
+                l = read(m->fd, &buffer, sizeof(buffer));
+                if (l < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        if (errno == EAGAIN)
+                                break;
+
+                        return -errno;
+                }
+
+                /* A generation file went away with elogind */
+                FOREACH_INOTIFY_EVENT(e, buffer, l) {
+                        if (!FLAGS_SET(e->mask, IN_IGNORED))
+                                continue;
+
+                        for (size_t i = 0; i < ELEMENTSOF(login_monitor_categories); i++)
+                                if (m->generation_wd[i] == e->wd)
+                                        m->generation_wd[i] = -1;
+                }
+        }
+
+        return login_monitor_watch(m);
+#endif // 0
 }
 
 _public_ int sd_login_monitor_get_fd(sd_login_monitor *m) {
 
         assert_return(m, -EINVAL);
 
+#if 0 /// elogind keeps more than the inotify fd around, see login_monitor_watch()
         return MONITOR_TO_FD(m);
+#else // 0
+        return m->fd;
+#endif // 0
 }
 
 _public_ int sd_login_monitor_get_events(sd_login_monitor *m) {
@@ -28,6 +28,8 @@
 #include "user-util.h"
 #include "userdb.h"
 /// Additional includes needed by elogind
+#include "device-enumerator-private.h"
+#include "device-private.h"
 #include "elogind.h"
 #include "sleep-config.h"
 #include "utmp-wtmp.h"
@@ -85,6 +87,9 @@ void elogind_manager_reset_config(Manager* m) {
 
         (void)parse_sleep_config(&m);
 
+        /* Whether a tty is idle depends on IdleActionSec= */
+        manager_drop_tty_atimes(m);
+
 #if ENABLE_DEBUG_ELOGIND
         dbg_cnt = -1;
         while (m->modes[SLEEP_SUSPEND] && m->modes[SLEEP_SUSPEND][++dbg_cnt])
@@ -371,6 +376,38 @@ int manager_process_seat_device(Manager *m, sd_device *d) {
         return 0;
 }
 
+#if 1 /// elogind keeps an index of each seat's uaccess device nodes, see seat_apply_acls()
+int manager_process_uaccess_device(Manager *m, sd_device *d) {
+        const char *node, *sn;
+        Seat *seat = NULL, *s;
+
+        assert(m);
+        assert(d);
+
+        if (sd_device_get_devname(d, &node) < 0)
+                return 0;
+
+        if (!device_for_action(d, SD_DEVICE_REMOVE) &&
+            sd_device_has_current_tag(d, "uaccess") > 0) {
+
+                if (sd_device_get_property_value(d, "ID_SEAT", &sn) < 0 || isempty(sn))
+                        sn = "seat0";
+
+                seat = hashmap_get(m->seats, sn);
+        }
+
+        /* The device may have been moved to another seat, or may have lost its tag */
+        HASHMAP_FOREACH(s, m->seats)
+                if (s != seat)
+                        seat_remove_uaccess_node(s, node);
+
+        if (!seat)
+                return 0;
+
+        return seat_add_uaccess_node(seat, node);
+}
+#endif // 1
+
 int manager_process_button_device(Manager *m, sd_device *d) {
         const char *sysname;
         Button *b;
@@ -490,6 +527,16 @@ int manager_get_idle_hint(Manager *m, dual_timestamp *t) {
 
         idle_hint = !manager_is_inhibited(m, INHIBIT_IDLE, INHIBIT_BLOCK, t, false, false, 0, NULL);
 
+#if 1 /// elogind keeps the idle hint gathered from the sessions, see session_invalidate_idle_hint()
+        /* While an inhibitor is taken, the sessions would not change the outcome */
+        if (!idle_hint || m->idle_hint_cached) {
+                if (t)
+                        *t = idle_hint ? m->idle_hint_timestamp : DUAL_TIMESTAMP_NULL;
+
+                return idle_hint && m->idle_hint;
+        }
+#endif // 1
+
         HASHMAP_FOREACH(s, m->sessions) {
                 dual_timestamp k;
                 int ih;
@@ -516,9 +563,99 @@ int manager_get_idle_hint(Manager *m, dual_timestamp *t) {
         if (t)
                 *t = ts;
 
+#if 1 /// see above
+        m->idle_hint = idle_hint;
+        m->idle_hint_timestamp = ts;
+        m->idle_hint_cached = true;
+#endif // 1
         return idle_hint;
 }
 
+#if 1 /// elogind caches the tty atime of non-graphical sessions
+/* Whether a non-graphical session is idle is told by the atime of its tty, and for sessions without an
+ * explicitly configured tty, finding that involves looking up the controlling tty of the leader in /proc.
+ * Doing so for every session on every read of an IdleHint property adds up, with many ssh sessions. Hence
+ * the atimes are cached, and refreshed for all sessions in one go every TTY_ATIME_REFRESH_USEC, for as long
+ * as anybody keeps looking at them. Users, seats and the manager in turn keep the idle hint they gathered
+ * from their sessions, until a refresh, or some other change of one of these, tells otherwise. */
+#define TTY_ATIME_REFRESH_USEC (5 * USEC_PER_SEC)
+
+void manager_refresh_tty_atimes(Manager *m) {
+        Session *s;
+        usec_t t;
+
+        assert(m);
+
+        t = now(CLOCK_MONOTONIC);
+
+        HASHMAP_FOREACH(s, m->sessions)
+                if (s->tty_atime_cached && !SESSION_TYPE_IS_GRAPHICAL(s->type))
+                        session_refresh_tty_atime(s);
+
+        m->tty_atime_n_passes++;
+        m->tty_atime_refresh_usec += now(CLOCK_MONOTONIC) - t;
+}
+
+void manager_drop_tty_atimes(Manager *m) {
+        Session *s;
+
+        assert(m);
+
+        HASHMAP_FOREACH(s, m->sessions)
+                if (s->tty_atime_cached) {
+                        s->tty_atime_cached = false;
+                        session_invalidate_idle_hint(s);
+                }
+}
+
+static int manager_dispatch_tty_atime_refresh(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        if (!m->tty_atime_used) {
+                /* Nobody looked since the last refresh, so forget about the atimes until somebody does */
+                manager_drop_tty_atimes(m);
+                return 0;
+        }
+
+        m->tty_atime_used = false;
+        manager_refresh_tty_atimes(m);
+
+        return manager_schedule_tty_atime_refresh(m);
+}
+
+int manager_schedule_tty_atime_refresh(Manager *m) {
+        int enabled, r;
+
+        assert(m);
+
+        if (m->tty_atime_event_source) {
+                r = sd_event_source_get_enabled(m->tty_atime_event_source, &enabled);
+                if (r < 0)
+                        return r;
+                if (enabled != SD_EVENT_OFF)
+                        return 0;
+
+                r = sd_event_source_set_time_relative(m->tty_atime_event_source, TTY_ATIME_REFRESH_USEC);
+                if (r < 0)
+                        return log_warning_errno(r, "Failed to reschedule tty atime refresh: %m");
+
+                return sd_event_source_set_enabled(m->tty_atime_event_source, SD_EVENT_ONESHOT);
+        }
+
+        r = sd_event_add_time_relative(m->event, &m->tty_atime_event_source,
+                                       CLOCK_MONOTONIC, TTY_ATIME_REFRESH_USEC, USEC_PER_SEC,
+                                       manager_dispatch_tty_atime_refresh, m);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to add tty atime refresh timer: %m");
+
+        (void) sd_event_source_set_description(m->tty_atime_event_source, "tty-atime-refresh");
+
+        return 0;
+}
+#endif // 1
+
 bool manager_shall_kill(Manager *m, const char *user) {
         assert(m);
         assert(user);
@@ -680,7 +817,14 @@ static int manager_count_external_displays(Manager *m) {
         if (r < 0)
                 return r;
 
+#if 1 /// elogind only counts, hence the order is of no concern
+        r = device_enumerator_set_unsorted(e, true);
+        if (r < 0)
+                return r;
+#endif // 1
+
         FOREACH_DEVICE(e, d) {
+#if 0 /// elogind shares these checks with the table of external displays, see logind-drm.c
                 const char *status, *enabled, *dash, *nn, *subsys;
                 sd_device *p;
 
@@ -719,6 +863,18 @@ static int manager_count_external_displays(Manager *m) {
                  * "disconnected" as connected. */
                 if (sd_device_get_sysattr_value(d, "status", &status) < 0 || !streq(status, "disconnected"))
                         n++;
+#else // 0
+                if (!drm_device_is_external_connector(d))
+                        continue;
+
+                /* Both attributes are needed, read them in one go */
+                drm_connector_device_forget_enabled(d);
+                (void) device_read_sysattrs(d, STRV_MAKE("enabled", "status"));
+
+                if (drm_connector_device_is_enabled(d) &&
+                    drm_connector_device_is_connected(d))
+                        n++;
+#endif // 0
         }
 
         return n;
@@ -735,7 +891,13 @@ bool manager_is_docked_or_external_displays(Manager *m) {
 
         /* If we have more than one display connected,
          * assume that we are docked. */
+#if 0 /// elogind keeps track of external displays, and only enumerates them if that failed
         n = manager_count_external_displays(m);
+#else // 0
+        n = m->drm_connectors_enumerated ?
+                manager_count_drm_connectors_in_use(m) :
+                manager_count_external_displays(m);
+#endif // 0
         if (n < 0)
                 log_warning_errno(n, "Display counting failed: %m");
         else if (n >= 1) {
@@ -359,6 +359,18 @@ static BUS_DEFINE_PROPERTY_GET(property_get_lid_closed, "b", Manager, manager_is
 static BUS_DEFINE_PROPERTY_GET_GLOBAL(property_get_on_external_power, "b", manager_is_on_external_power);
 static BUS_DEFINE_PROPERTY_GET_GLOBAL(property_get_compat_user_tasks_max, "t", CGROUP_LIMIT_MAX);
 static BUS_DEFINE_PROPERTY_GET_REF(property_get_hashmap_size, "t", Hashmap *, (uint64_t) hashmap_size);
+#if 1 /// elogind remembers polkit decisions for a short while, see bus_polkit_cache_new()
+static uint64_t polkit_cache_n_hits(BusPolkitCache *c) {
+        return c ? c->n_hits : 0;
+}
+
+static uint64_t polkit_cache_n_misses(BusPolkitCache *c) {
+        return c ? c->n_misses : 0;
+}
+
+static BUS_DEFINE_PROPERTY_GET_REF(property_get_polkit_cache_hits, "t", BusPolkitCache *, polkit_cache_n_hits);
+static BUS_DEFINE_PROPERTY_GET_REF(property_get_polkit_cache_misses, "t", BusPolkitCache *, polkit_cache_n_misses);
+#endif // 1
 
 static int method_get_session(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         _cleanup_free_ char *p = NULL;
@@ -1105,7 +1117,11 @@ static int method_lock_sessions(sd_bus_message *message, void *userdata, sd_bus_
         assert(message);
         assert(m);
 
+#if 0 /// elogind can cache polkit decisions, see bus_polkit_cache_new()
         r = bus_verify_polkit_async(
+#else // 0
+        r = bus_verify_polkit_async_full(
+#endif // 0
                         message,
                         CAP_SYS_ADMIN,
                         "org.freedesktop.login1.lock-sessions",
@@ -1113,6 +1129,9 @@ static int method_lock_sessions(sd_bus_message *message, void *userdata, sd_bus_
                         false,
                         UID_INVALID,
                         &m->polkit_registry,
+#if 1 /// see above
+                        m->polkit_cache,
+#endif // 1
                         error);
         if (r < 0)
                 return r;
@@ -2588,7 +2607,11 @@ static int method_can_shutdown_or_sleep(
         }
 
         if (multiple_sessions) {
+#if 0 /// elogind can cache polkit decisions, see bus_polkit_cache_new()
                 r = bus_test_polkit(message, CAP_SYS_BOOT, action_multiple_sessions, NULL, UID_INVALID, &challenge, error);
+#else // 0
+                r = bus_test_polkit_full(message, CAP_SYS_BOOT, action_multiple_sessions, NULL, UID_INVALID, &challenge, m->polkit_cache, error);
+#endif // 0
                 if (r < 0)
                         return r;
 
@@ -2603,7 +2626,11 @@ static int method_can_shutdown_or_sleep(
         }
 
         if (blocked) {
+#if 0 /// elogind can cache polkit decisions, see bus_polkit_cache_new()
                 r = bus_test_polkit(message, CAP_SYS_BOOT, action_ignore_inhibit, NULL, UID_INVALID, &challenge, error);
+#else // 0
+                r = bus_test_polkit_full(message, CAP_SYS_BOOT, action_ignore_inhibit, NULL, UID_INVALID, &challenge, m->polkit_cache, error);
+#endif // 0
                 if (r < 0)
                         return r;
 
@@ -2623,7 +2650,11 @@ static int method_can_shutdown_or_sleep(
                 /* If neither inhibit nor multiple sessions
                  * apply then just check the normal policy */
 
+#if 0 /// elogind can cache polkit decisions, see bus_polkit_cache_new()
                 r = bus_test_polkit(message, CAP_SYS_BOOT, action, NULL, UID_INVALID, &challenge, error);
+#else // 0
+                r = bus_test_polkit_full(message, CAP_SYS_BOOT, action, NULL, UID_INVALID, &challenge, m->polkit_cache, error);
+#endif // 0
                 if (r < 0)
                         return r;
 
@@ -3483,7 +3514,11 @@ static int method_inhibit(sd_bus_message *message, void *userdata, sd_bus_error
                 return sd_bus_error_setf(error, BUS_ERROR_OPERATION_IN_PROGRESS,
                                          "The operation inhibition has been requested for is already running");
 
+#if 0 /// elogind can cache polkit decisions, see bus_polkit_cache_new()
         r = bus_verify_polkit_async(
+#else // 0
+        r = bus_verify_polkit_async_full(
+#endif // 0
                         message,
                         CAP_SYS_BOOT,
                         w == INHIBIT_SHUTDOWN             ? (mm == INHIBIT_BLOCK ? "org.freedesktop.login1.inhibit-block-shutdown" : "org.freedesktop.login1.inhibit-delay-shutdown") :
@@ -3498,6 +3533,9 @@ static int method_inhibit(sd_bus_message *message, void *userdata, sd_bus_error
                         false,
                         UID_INVALID,
                         &m->polkit_registry,
+#if 1 /// see above
+                        m->polkit_cache,
+#endif // 1
                         error);
         if (r < 0)
                 return r;
@@ -3544,7 +3582,11 @@ static int method_inhibit(sd_bus_message *message, void *userdata, sd_bus_error
         if (!i->why || !i->who)
                 return -ENOMEM;
 
+#if 0 /// elogind hands out pipes rather than FIFOs for delay inhibitors, see inhibitor_create_pipe()
         fifo_fd = inhibitor_create_fifo(i);
+#else // 0
+        fifo_fd = mm == INHIBIT_DELAY ? inhibitor_create_pipe(i) : inhibitor_create_fifo(i);
+#endif // 0
         if (fifo_fd < 0)
                 return fifo_fd;
 
@@ -3603,6 +3645,20 @@ static const sd_bus_vtable manager_vtable[] = {
         SD_BUS_PROPERTY("SessionsMax", "t", NULL, offsetof(Manager, sessions_max), SD_BUS_VTABLE_PROPERTY_CONST),
         SD_BUS_PROPERTY("NCurrentSessions", "t", property_get_hashmap_size, offsetof(Manager, sessions), 0),
         SD_BUS_PROPERTY("UserTasksMax", "t", property_get_compat_user_tasks_max, 0, SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_HIDDEN),
+#if 1 /// elogind tears down users in worker processes, see user_teardown_start()
+        SD_BUS_PROPERTY("NUserTeardowns", "t", property_get_hashmap_size, offsetof(Manager, user_teardowns), 0),
+        SD_BUS_PROPERTY("UserTeardownLastUSec", "t", NULL, offsetof(Manager, user_teardown_last_usec), 0),
+        SD_BUS_PROPERTY("UserTeardownMaxUSec", "t", NULL, offsetof(Manager, user_teardown_max_usec), 0),
+#endif // 1
+#if 1 /// elogind caches the tty atime of non-graphical sessions, see manager_refresh_tty_atimes()
+        SD_BUS_PROPERTY("NTTYAtimeRefreshes", "t", NULL, offsetof(Manager, tty_atime_n_refreshes), 0),
+        SD_BUS_PROPERTY("NTTYAtimeRefreshPasses", "t", NULL, offsetof(Manager, tty_atime_n_passes), 0),
+        SD_BUS_PROPERTY("TTYAtimeRefreshUSec", "t", NULL, offsetof(Manager, tty_atime_refresh_usec), 0),
+#endif // 1
+#if 1 /// elogind remembers polkit decisions for a short while, see bus_polkit_cache_new()
+        SD_BUS_PROPERTY("NPolkitCacheHits", "t", property_get_polkit_cache_hits, offsetof(Manager, polkit_cache), 0),
+        SD_BUS_PROPERTY("NPolkitCacheMisses", "t", property_get_polkit_cache_misses, offsetof(Manager, polkit_cache), 0),
+#endif // 1
 
 #if 1 /// Add a reload command for reloading the elogind configuration, like systemctl has it.
         SD_BUS_METHOD("ReloadConfig", NULL, NULL, method_reload_config, SD_BUS_VTABLE_UNPRIVILEGED),
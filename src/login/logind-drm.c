@@ -0,0 +1,297 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "device-enumerator-private.h"
+#include "device-util.h"
+#include "hashmap.h"
+#include "logind-drm.h"
+#include "path-util.h"
+#include "string-util.h"
+#include "udev-util.h"
+
+/* Deciding whether the lid switch is to be handled as docked requires knowing whether external displays are
+ * in use. Rather than enumerating the whole drm subsystem for each lid switch event, we keep a table of
+ * external connectors, and whether a display is plugged into them. It is filled on startup, and then kept
+ * up to date with the uevents of the manager's device monitor:
+ *
+ *   - connectors are added and removed with their cards, or on their own with DP MST hubs,
+ *   - a display being plugged or unplugged is announced by a "change" uevent of the card (HOTPLUG=1), upon
+ *     which we check the connectors of that card again.
+ *
+ * Whether a connector is enabled is a different story: that changes whenever a compositor sets a mode, and
+ * that's not announced by uevents. Hence, that is only checked for the connectors with a display plugged
+ * in, when asked. Usually that's none at all, when the lid is closed. */
+
+static int drm_connector_new(Manager *m, const char *syspath, DrmConnector **ret) {
+        _cleanup_(drm_connector_freep) DrmConnector *c = NULL;
+        int r;
+
+        assert(m);
+        assert(syspath);
+        assert(ret);
+
+        c = new(DrmConnector, 1);
+        if (!c)
+                return -ENOMEM;
+
+        *c = (DrmConnector) {
+                .syspath = strdup(syspath),
+        };
+        if (!c->syspath)
+                return -ENOMEM;
+
+        r = hashmap_ensure_put(&m->drm_connectors, &path_hash_ops, c->syspath, c);
+        if (r < 0)
+                return r;
+
+        c->manager = m;
+
+        *ret = TAKE_PTR(c);
+        return 0;
+}
+
+static void drm_connector_set_connected(DrmConnector *c, bool b) {
+        assert(c);
+        assert(c->manager);
+
+        if (c->connected == b)
+                return;
+
+        c->connected = b;
+
+        if (b)
+                c->manager->n_drm_connectors_connected++;
+        else {
+                assert(c->manager->n_drm_connectors_connected > 0);
+                c->manager->n_drm_connectors_connected--;
+        }
+
+        log_debug("Display %s %s.", c->syspath, b ? "connected" : "disconnected");
+}
+
+DrmConnector* drm_connector_free(DrmConnector *c) {
+        if (!c)
+                return NULL;
+
+        if (c->manager) {
+                if (c->connected)
+                        c->manager->n_drm_connectors_connected--;
+
+                hashmap_remove(c->manager->drm_connectors, c->syspath);
+        }
+
+        free(c->syspath);
+        return mfree(c);
+}
+
+bool drm_device_is_external_connector(sd_device *d) {
+        const char *dash, *nn, *subsys;
+        sd_device *p;
+
+        assert(d);
+
+        if (sd_device_get_parent(d, &p) < 0)
+                return false;
+
+        /* If the parent shares the same subsystem as the
+         * device we are looking at then it is a connector,
+         * which is what we are interested in. */
+        if (sd_device_get_subsystem(p, &subsys) < 0 || !streq(subsys, "drm"))
+                return false;
+
+        if (sd_device_get_sysname(d, &nn) < 0)
+                return false;
+
+        /* Ignore internal displays: the type is encoded in the sysfs name, as the second dash
+         * separated item (the first is the card name, the last the connector number). We implement a
+         * deny list of external displays here, rather than an allow list of internal ones, to ensure
+         * we don't block suspends too eagerly. */
+        dash = strchr(nn, '-');
+        if (!dash)
+                return false;
+
+        dash++;
+        return STARTSWITH_SET(dash,
+                              "VGA-", "DVI-I-", "DVI-D-", "DVI-A-"
+                              "Composite-", "SVIDEO-", "Component-",
+                              "DIN-", "DP-", "HDMI-A-", "HDMI-B-", "TV-");
+}
+
+bool drm_connector_device_is_connected(sd_device *d) {
+        const char *status;
+
+        assert(d);
+
+        /* We count any connector which is not explicitly
+         * "disconnected" as connected. */
+        return sd_device_get_sysattr_value(d, "status", &status) < 0 || !streq(status, "disconnected");
+}
+
+void drm_connector_device_forget_enabled(sd_device *d) {
+        assert(d);
+
+        /* Setting a mode is not announced through a uevent, hence a device from the device cache may still
+         * know the value of "enabled" from before. Drop it, so that it is read again. */
+        (void) sd_device_set_sysattr_value(d, "enabled", NULL);
+}
+
+bool drm_connector_device_is_enabled(sd_device *d) {
+        const char *enabled;
+
+        assert(d);
+
+        return sd_device_get_sysattr_value(d, "enabled", &enabled) >= 0 && streq(enabled, "enabled");
+}
+
+static int manager_update_drm_connector(Manager *m, sd_device *d) {
+        DrmConnector *c;
+        const char *syspath;
+        int r;
+
+        assert(m);
+        assert(d);
+
+        r = sd_device_get_syspath(d, &syspath);
+        if (r < 0)
+                return r;
+
+        c = hashmap_get(m->drm_connectors, syspath);
+        if (!c) {
+                r = drm_connector_new(m, syspath, &c);
+                if (r < 0)
+                        return r;
+        }
+
+        drm_connector_set_connected(c, drm_connector_device_is_connected(d));
+        return 0;
+}
+
+static int manager_recheck_drm_connectors(Manager *m, const char *card) {
+        DrmConnector *c;
+        int r = 0;
+
+        assert(m);
+        assert(card);
+
+        HASHMAP_FOREACH(c, m->drm_connectors) {
+                _cleanup_(sd_device_unrefp) sd_device *d = NULL;
+                int k;
+
+                if (!path_startswith(c->syspath, card))
+                        continue;
+
+                k = sd_device_new_from_syspath(&d, c->syspath);
+                if (k == -ENODEV) {
+                        /* Gone already, we'll see the uevent about that later */
+                        drm_connector_free(c);
+                        continue;
+                }
+                if (k < 0) {
+                        r = log_debug_errno(k, "Failed to read display connector %s: %m", c->syspath);
+                        continue;
+                }
+
+                drm_connector_set_connected(c, drm_connector_device_is_connected(d));
+        }
+
+        return r;
+}
+
+int manager_process_drm_device(Manager *m, sd_device *d) {
+        const char *syspath;
+        DrmConnector *c;
+        int r;
+
+        assert(m);
+        assert(d);
+
+        r = sd_device_get_syspath(d, &syspath);
+        if (r < 0)
+                return r;
+
+        if (device_for_action(d, SD_DEVICE_REMOVE)) {
+                /* A connector, or a card with all of its connectors. Neither can be told apart anymore
+                 * by looking at the device, as its parents may be gone already. */
+                HASHMAP_FOREACH(c, m->drm_connectors)
+                        if (path_startswith(c->syspath, syspath))
+                                drm_connector_free(c);
+
+                return 0;
+        }
+
+        if (drm_device_is_external_connector(d))
+                return manager_update_drm_connector(m, d);
+
+        /* Anything else is a card, or a device of some other drm thing we don't care about. Displays being
+         * plugged or unplugged are announced by the card, so check its connectors again. */
+        return manager_recheck_drm_connectors(m, syspath);
+}
+
+int manager_enumerate_drm_connectors(Manager *m) {
+        _cleanup_(sd_device_enumerator_unrefp) sd_device_enumerator *e = NULL;
+        sd_device *d;
+        int r;
+
+        assert(m);
+
+        r = sd_device_enumerator_new(&e);
+        if (r < 0)
+                return r;
+
+        r = sd_device_enumerator_allow_uninitialized(e);
+        if (r < 0)
+                return r;
+
+        r = sd_device_enumerator_add_match_subsystem(e, "drm", true);
+        if (r < 0)
+                return r;
+
+        r = device_enumerator_set_unsorted(e, true);
+        if (r < 0)
+                return r;
+
+        FOREACH_DEVICE(e, d) {
+                int k;
+
+                if (!drm_device_is_external_connector(d))
+                        continue;
+
+                k = manager_update_drm_connector(m, d);
+                if (k < 0)
+                        r = k;
+        }
+        if (r < 0)
+                return r;
+
+        /* From now on, manager_count_drm_connectors_in_use() may be used */
+        m->drm_connectors_enumerated = true;
+        return 0;
+}
+
+int manager_count_drm_connectors_in_use(Manager *m) {
+        DrmConnector *c;
+        int n = 0;
+
+        assert(m);
+        assert(m->drm_connectors_enumerated);
+
+        if (m->n_drm_connectors_connected == 0)
+                return 0;
+
+        HASHMAP_FOREACH(c, m->drm_connectors) {
+                _cleanup_(sd_device_unrefp) sd_device *d = NULL;
+
+                if (!c->connected)
+                        continue;
+
+                if (sd_device_new_from_syspath(&d, c->syspath) < 0)
+                        continue;
+
+                /* Ignore ports that are not enabled */
+                drm_connector_device_forget_enabled(d);
+                if (drm_connector_device_is_enabled(d))
+                        n++;
+        }
+
+        return n;
+}
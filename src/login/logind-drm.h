@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+typedef struct DrmConnector DrmConnector;
+
+#include "sd-device.h"
+
+#include "logind.h"
+
+/* An external display connector, e.g. "card0-HDMI-A-1". Internal ones (eDP, LVDS, DSI, …) are not tracked. */
+struct DrmConnector {
+        Manager *manager;
+
+        char *syspath;
+        bool connected;
+};
+
+DrmConnector* drm_connector_free(DrmConnector *c);
+DEFINE_TRIVIAL_CLEANUP_FUNC(DrmConnector*, drm_connector_free);
+
+bool drm_device_is_external_connector(sd_device *d);
+bool drm_connector_device_is_connected(sd_device *d);
+void drm_connector_device_forget_enabled(sd_device *d);
+bool drm_connector_device_is_enabled(sd_device *d);
+
+int manager_process_drm_device(Manager *m, sd_device *d);
+int manager_enumerate_drm_connectors(Manager *m);
+int manager_count_drm_connectors_in_use(Manager *m);
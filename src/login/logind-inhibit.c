@@ -24,8 +24,17 @@
 #include "tmpfile-util.h"
 #include "user-util.h"
 #include "util.h"
+/// Additional includes needed by elogind
+#include <poll.h>
+
+#include "missing_syscall.h"
+#include "process-util.h"
+#include "socket-util.h"
 
 static void inhibitor_remove_fifo(Inhibitor *i);
+#if 1 /// elogind writes the state files of inhibitors held through a pipe in batches
+static int inhibitor_schedule_save(Inhibitor *i);
+#endif // 1
 
 int inhibitor_new(Inhibitor **ret, Manager *m, const char* id) {
         _cleanup_(inhibitor_freep) Inhibitor *i = NULL;
@@ -45,6 +54,9 @@ int inhibitor_new(Inhibitor **ret, Manager *m, const char* id) {
                 .mode = _INHIBIT_MODE_INVALID,
                 .uid = UID_INVALID,
                 .fifo_fd = -1,
+#if 1 /// elogind watches the processes of inhibitors through pidfds, see inhibitor_watch_pid()
+                .pidfd = -1,
+#endif // 1
         };
 
         i->state_file = path_join("/run/systemd/inhibit", id);
@@ -75,6 +87,11 @@ Inhibitor* inhibitor_free(Inhibitor *i) {
 #endif // 1
         sd_event_source_unref(i->event_source);
         safe_close(i->fifo_fd);
+#if 1 /// elogind watches the processes of inhibitors through pidfds, see inhibitor_watch_pid()
+        sd_event_source_unref(i->pidfd_event_source);
+        safe_close(i->pidfd);
+        free(i->session_id);
+#endif // 1
 
         hashmap_remove(i->manager->inhibitors, i->id);
 
@@ -150,10 +167,16 @@ static int inhibitor_save(Inhibitor *i) {
                 goto fail;
         }
 
+#if 1 /// elogind writes the state files of inhibitors held through a pipe in batches, see inhibitor_schedule_save()
+        i->state_file_written = true;
+#endif // 1
         return 0;
 
 fail:
         (void) unlink(i->state_file);
+#if 1 /// elogind writes the state files of inhibitors held through a pipe in batches, see inhibitor_schedule_save()
+        i->state_file_written = false;
+#endif // 1
 
         if (temp_path)
                 (void) unlink(temp_path);
@@ -171,6 +194,68 @@ static int bus_manager_send_inhibited_change(Inhibitor *i) {
         return manager_send_changed(i->manager, property, NULL);
 }
 
+#if 1 /// elogind watches the processes of inhibitors through pidfds
+static int inhibitor_dispatch_pidfd(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        Inhibitor *i = userdata;
+
+        assert(i);
+        assert(i->pidfd == fd);
+
+        /* The inhibitor itself goes away with its FIFO, which the process may have passed on. But its PID is
+         * free for reuse now, so don't look at it anymore. */
+        log_debug("Process " PID_FMT " of inhibitor %s exited.", i->pid, i->id);
+
+        i->pid_exited = true;
+        i->pidfd_event_source = sd_event_source_unref(i->pidfd_event_source);
+        i->pidfd = safe_close(i->pidfd);
+
+        /* Unless it lost its pipe when we crashed, and so is held by nothing but the process, see
+         * inhibitor_is_orphan() */
+        if (i->mode == INHIBIT_DELAY && !i->fifo_path && i->fifo_fd < 0) {
+                inhibitor_stop(i);
+                inhibitor_free(i);
+        }
+
+        return 1;
+}
+
+static int inhibitor_watch_pid(Inhibitor *i) {
+        _cleanup_close_ int fd = -1;
+        Session *s;
+        int r;
+
+        assert(i);
+
+        if (!pid_is_valid(i->pid) || i->pidfd >= 0)
+                return 0;
+
+        /* Whether an inhibitor is active depends on the session of its process. With a pidfd pinning the
+         * process, it's enough to look that up once, rather than for each check, where the PID might refer
+         * to another process by then. */
+        fd = pidfd_open(i->pid, 0);
+        if (fd < 0)
+                return log_debug_errno(errno, "Failed to open pidfd of inhibitor %s, not watching it: %m", i->id);
+
+        r = manager_get_session_by_pid(i->manager, i->pid, &s);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to determine session of inhibitor %s, not watching it: %m", i->id);
+        if (r > 0) {
+                r = free_and_strdup(&i->session_id, s->id);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_event_add_io(i->manager->event, &i->pidfd_event_source, fd, EPOLLIN, inhibitor_dispatch_pidfd, i);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to watch pidfd of inhibitor %s: %m", i->id);
+
+        (void) sd_event_source_set_description(i->pidfd_event_source, "inhibitor-pid");
+
+        i->pidfd = TAKE_FD(fd);
+        return 0;
+}
+#endif // 1
+
 int inhibitor_start(Inhibitor *i) {
         assert(i);
 
@@ -185,8 +270,18 @@ int inhibitor_start(Inhibitor *i) {
                   inhibit_mode_to_string(i->mode));
 
         i->started = true;
+#if 1 /// elogind watches the processes of inhibitors through pidfds, see inhibitor_watch_pid()
+        (void) inhibitor_watch_pid(i);
+#endif // 1
 
+#if 0 /// elogind writes the state files of inhibitors held through a pipe in batches, see inhibitor_schedule_save()
         inhibitor_save(i);
+#else // 0
+        if (i->fifo_path)
+                inhibitor_save(i);
+        else if (!i->state_file_written)
+                (void) inhibitor_schedule_save(i);
+#endif // 0
 
         bus_manager_send_inhibited_change(i);
 
@@ -205,8 +300,16 @@ void inhibitor_stop(Inhibitor *i) {
 
         inhibitor_remove_fifo(i);
 
+#if 0 /// elogind writes the state files of inhibitors held through a pipe in batches, see inhibitor_schedule_save()
         if (i->state_file)
                 (void) unlink(i->state_file);
+#else // 0
+        if (i->state_file && i->state_file_written)
+                (void) unlink(i->state_file);
+
+        i->state_file_written = false;
+        i->save_pending = false;
+#endif // 0
 
         i->started = false;
 
@@ -228,7 +331,16 @@ int inhibitor_load(Inhibitor *i) {
         char *cc;
         int r;
 
+#if 1 /// elogind writes the state files of inhibitors held through a pipe in batches, see inhibitor_schedule_save()
+        /* It was there, and has to go once we are done with the inhibitor, whatever we find in it */
+        i->state_file_written = true;
+#endif // 1
+
+#if 0 /// elogind serves the state file from its snapshot where it can, see logind-snapshot.c
         r = parse_env_file(NULL, i->state_file,
+#else // 0
+        r = manager_parse_state_file(i->manager, i->state_file,
+#endif // 0
                            "WHAT", &what,
                            "UID", &uid,
                            "PID", &pid,
@@ -398,14 +510,318 @@ static void inhibitor_remove_fifo(Inhibitor *i) {
         }
 }
 
+#if 1 /// elogind hands out pipes rather than FIFOs for delay inhibitors
+/* Delay inhibitors taken through Inhibit() are held through a pipe: the caller gets its writing end, we keep
+ * the reading end, and the inhibitor is released once it hangs up. Contrary to a FIFO in /run/systemd/inhibit,
+ * nothing of that touches the file system. Their state files are written in batches, a moment after they were
+ * taken, see inhibitor_schedule_save(), hence those that are dropped right away, as they usually are, never
+ * get one at all.
+ *
+ * As a pipe cannot be reopened by path, the reading ends are handed over to the next instance on restart,
+ * see manager_hand_over_inhibitors(). Should we crash instead, the pipes are gone, but the state files are
+ * not: an inhibitor is then held for as long as its process is around, see inhibitor_is_orphan(). Block
+ * inhibitors keep their FIFO, and survive a crash as they always did. */
+
+#define INHIBITOR_SAVE_DELAY_USEC (1 * USEC_PER_SEC)
+#define INHIBITOR_HANDOVER_SOCKET "/run/systemd/inhibit/.handover"
+#define INHIBITOR_HANDOVER_TIMEOUT_USEC (2 * USEC_PER_MINUTE)
+/* How long we wait for the next inhibitor while taking them over, before we give up on the rest */
+#define INHIBITOR_TAKEOVER_TIMEOUT_USEC (5 * USEC_PER_SEC)
+
+/* Takes possession of fd on success */
+static int inhibitor_watch_pipe(Inhibitor *i, int fd) {
+        int r;
+
+        assert(i);
+        assert(fd >= 0);
+        assert(i->fifo_fd < 0);
+        assert(!i->event_source);
+
+        r = sd_event_add_io(i->manager->event, &i->event_source, fd, 0, inhibitor_dispatch_fifo, i);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_priority(i->event_source, SD_EVENT_PRIORITY_IDLE-10);
+        if (r < 0) {
+                i->event_source = sd_event_source_unref(i->event_source);
+                return r;
+        }
+
+        (void) sd_event_source_set_description(i->event_source, "inhibitor-ref");
+
+        i->fifo_fd = fd;
+        return 0;
+}
+
+static int manager_dispatch_save_inhibitors(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        manager_save_inhibitors(m);
+        return 0;
+}
+
+void manager_save_inhibitors(Manager *m) {
+        Inhibitor *i;
+
+        assert(m);
+
+        /* Writes the state files of all inhibitors that are waiting for it */
+
+        HASHMAP_FOREACH(i, m->inhibitors)
+                if (i->save_pending) {
+                        i->save_pending = false;
+                        (void) inhibitor_save(i);
+                }
+}
+
+static int inhibitor_schedule_save(Inhibitor *i) {
+        Manager *m;
+        int r;
+
+        assert(i);
+
+        m = i->manager;
+        i->save_pending = true;
+
+        /* Once the timer is armed, further inhibitors ride along, rather than pushing it back */
+        if (m->inhibitor_save_event_source) {
+                r = sd_event_source_get_enabled(m->inhibitor_save_event_source, NULL);
+                if (r > 0)
+                        return 0;
+
+                r = sd_event_source_set_time_relative(m->inhibitor_save_event_source, INHIBITOR_SAVE_DELAY_USEC);
+                if (r < 0)
+                        return log_warning_errno(r, "Failed to reschedule inhibitor saving timer: %m");
+
+                return sd_event_source_set_enabled(m->inhibitor_save_event_source, SD_EVENT_ONESHOT);
+        }
+
+        r = sd_event_add_time_relative(m->event, &m->inhibitor_save_event_source,
+                                       CLOCK_MONOTONIC, INHIBITOR_SAVE_DELAY_USEC, USEC_PER_MSEC,
+                                       manager_dispatch_save_inhibitors, m);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to add inhibitor saving timer: %m");
+
+        (void) sd_event_source_set_description(m->inhibitor_save_event_source, "inhibitor-save");
+
+        return 0;
+}
+
+int inhibitor_create_pipe(Inhibitor *i) {
+        _cleanup_close_pair_ int pipe_fds[2] = { -1, -1 };
+        int r;
+
+        assert(i);
+        assert(i->mode == INHIBIT_DELAY);
+        assert(!i->fifo_path);
+
+        if (pipe2(pipe_fds, O_CLOEXEC) < 0)
+                return -errno;
+
+        r = fd_nonblock(pipe_fds[0], true);
+        if (r < 0)
+                return r;
+
+        r = inhibitor_watch_pipe(i, pipe_fds[0]);
+        if (r < 0)
+                return r;
+
+        pipe_fds[0] = -1;
+        return TAKE_FD(pipe_fds[1]);
+}
+
+static void inhibitor_hand_over_serve(int fd, Inhibitor **inhibitors, size_t n_inhibitors) {
+        _cleanup_close_ int conn_fd = -1;
+
+        assert(fd >= 0);
+        assert(inhibitors || n_inhibitors == 0);
+
+        /* Runs in the process keeping the pipes open, until the next instance connected and took them, or
+         * until none showed up in time. */
+
+        if (fd_wait_for_event(fd, POLLIN, INHIBITOR_HANDOVER_TIMEOUT_USEC) > 0) {
+                conn_fd = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+                if (conn_fd >= 0)
+                        for (size_t k = 0; k < n_inhibitors; k++) {
+                                struct iovec iov = IOVEC_MAKE_STRING(inhibitors[k]->id);
+
+                                if (send_one_fd_iov(conn_fd, inhibitors[k]->fifo_fd, &iov, 1, 0) < 0)
+                                        break;
+                        }
+        }
+
+        (void) unlink(INHIBITOR_HANDOVER_SOCKET);
+}
+
+int manager_hand_over_inhibitors(Manager *m) {
+        _cleanup_free_ Inhibitor **inhibitors = NULL;
+        union sockaddr_union sa = {};
+        _cleanup_close_ int fd = -1;
+        _cleanup_free_ int *fds = NULL;
+        size_t n_fds = 0;
+        Inhibitor *i;
+        int r, salen;
+
+        assert(m);
+
+        /* Called when we are about to be restarted. Forks off a process that keeps the reading ends of the
+         * pipes open, and passes them on to the next instance through a socket, see
+         * manager_take_over_inhibitors(). Only inhibitors with a state file can be handed over, hence the
+         * caller has to write the pending ones first, see manager_save_inhibitors(). */
+
+        inhibitors = new(Inhibitor*, hashmap_size(m->inhibitors));
+        fds = new(int, hashmap_size(m->inhibitors) + 1);
+        if (!inhibitors || !fds)
+                return log_oom();
+
+        HASHMAP_FOREACH(i, m->inhibitors) {
+                if (i->fifo_path || i->fifo_fd < 0 || !i->started || !i->state_file_written)
+                        continue;
+
+                inhibitors[n_fds] = i;
+                fds[n_fds++] = i->fifo_fd;
+        }
+
+        if (n_fds == 0)
+                return 0;
+
+        salen = sockaddr_un_set_path(&sa.un, INHIBITOR_HANDOVER_SOCKET);
+        if (salen < 0)
+                return log_error_errno(salen, "Failed to set up socket address: %m");
+
+        fd = socket(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0);
+        if (fd < 0)
+                return log_error_errno(errno, "Failed to create inhibitor handover socket: %m");
+
+        (void) unlink(INHIBITOR_HANDOVER_SOCKET);
+
+        if (bind(fd, &sa.sa, salen) < 0)
+                return log_error_errno(errno, "Failed to bind inhibitor handover socket: %m");
+
+        if (listen(fd, 1) < 0) {
+                r = log_error_errno(errno, "Failed to listen on inhibitor handover socket: %m");
+                goto fail;
+        }
+
+        fds[n_fds] = fd;
+
+        r = safe_fork_full("(sd-inhibit)", fds, n_fds + 1, FORK_RESET_SIGNALS|FORK_CLOSE_ALL_FDS|FORK_LOG, NULL);
+        if (r < 0)
+                goto fail;
+        if (r == 0) {
+                /* Child */
+                inhibitor_hand_over_serve(fd, inhibitors, n_fds);
+                _exit(EXIT_SUCCESS);
+        }
+
+        log_debug("Handing over %zu inhibitors to the next instance.", n_fds);
+        return 0;
+
+fail:
+        (void) unlink(INHIBITOR_HANDOVER_SOCKET);
+        return r;
+}
+
+int manager_take_over_inhibitors(Manager *m) {
+        union sockaddr_union sa = {};
+        _cleanup_close_ int fd = -1;
+        struct timeval tv;
+        unsigned n = 0;
+        int r, salen;
+
+        assert(m);
+
+        salen = sockaddr_un_set_path(&sa.un, INHIBITOR_HANDOVER_SOCKET);
+        if (salen < 0)
+                return log_error_errno(salen, "Failed to set up socket address: %m");
+
+        fd = socket(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0);
+        if (fd < 0)
+                return log_error_errno(errno, "Failed to create inhibitor handover socket: %m");
+
+        /* We are starting up, and nobody is served until we are done here, hence do not wait for a
+         * process that got stuck forever */
+        timeval_store(&tv, INHIBITOR_TAKEOVER_TIMEOUT_USEC);
+        if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
+                return log_error_errno(errno, "Failed to set receive timeout on inhibitor handover socket: %m");
+
+        if (connect(fd, &sa.sa, salen) < 0) {
+                if (errno == ENOENT)
+                        return 0;
+
+                /* Whoever was to hand the inhibitors over is gone. Inhibitors without their pipe are held by
+                 * their processes only, see inhibitor_is_orphan(). */
+                r = log_warning_errno(errno, "Failed to connect to inhibitor handover socket, ignoring: %m");
+                (void) unlink(INHIBITOR_HANDOVER_SOCKET);
+                return r;
+        }
+
+        for (;;) {
+                char id[NAME_MAX + 1];
+                struct iovec iov = IOVEC_MAKE(id, sizeof(id) - 1);
+                _cleanup_close_ int pipe_fd = -1;
+                Inhibitor *i;
+                ssize_t l;
+
+                l = receive_one_fd_iov(fd, &iov, 1, 0, &pipe_fd);
+                if (l == -EIO) /* EOF */
+                        break;
+                if (l == -EAGAIN) {
+                        /* Inhibitors we did not get by now are held by their processes only, see
+                         * inhibitor_is_orphan() */
+                        log_warning("Timed out while taking over inhibitors, took over %u, ignoring the rest.", n);
+                        (void) unlink(INHIBITOR_HANDOVER_SOCKET);
+                        return -ETIMEDOUT;
+                }
+                if (l < 0)
+                        return log_warning_errno(l, "Failed to receive inhibitor, ignoring: %m");
+                if (pipe_fd < 0)
+                        continue;
+
+                id[l] = 0;
+
+                i = hashmap_get(m->inhibitors, id);
+                if (!i || i->fifo_path || i->fifo_fd >= 0)
+                        continue;
+
+                r = inhibitor_watch_pipe(i, pipe_fd);
+                if (r < 0) {
+                        log_warning_errno(r, "Failed to watch pipe of inhibitor %s, ignoring: %m", i->id);
+                        continue;
+                }
+
+                TAKE_FD(pipe_fd);
+                n++;
+        }
+
+        log_debug("Took over %u inhibitors.", n);
+        return 0;
+}
+#endif // 1
+
 bool inhibitor_is_orphan(Inhibitor *i) {
         assert(i);
 
         if (!i->started)
                 return true;
 
+#if 0 /// elogind hands out pipes rather than FIFOs, which have no path, see inhibitor_create_pipe()
         if (!i->fifo_path)
                 return true;
+#else // 0
+        /* An inhibitor that lost its pipe when we crashed or timed out while taking it over. Nobody can
+         * release it anymore, so keep it until its process is gone. Make sure the PID is still the
+         * inhibitor's process: inhibitor_watch_pid() pinned whatever process has that PID now. */
+        if (i->mode == INHIBIT_DELAY && !i->fifo_path && i->fifo_fd < 0) {
+                uid_t uid;
+
+                return i->pidfd < 0 ||
+                        get_process_uid(i->pid, &uid) < 0 ||
+                        uid != i->uid;
+        }
+#endif // 0
 
         if (i->fifo_fd < 0)
                 return true;
@@ -447,6 +863,30 @@ static int pid_is_active(Manager *m, pid_t pid) {
         return session_is_active(s);
 }
 
+#if 1 /// elogind watches the processes of inhibitors through pidfds, see inhibitor_watch_pid()
+static int inhibitor_is_active(Inhibitor *i) {
+        Session *s;
+
+        assert(i);
+
+        if (i->pid_exited)
+                return 0;
+
+        if (i->pidfd < 0)
+                return pid_is_active(i->manager, i->pid);
+
+        /* If there's no session assigned to it, then it's globally active on all ttys */
+        if (!i->session_id)
+                return 1;
+
+        s = hashmap_get(i->manager->sessions, i->session_id);
+        if (!s)
+                return 1;
+
+        return session_is_active(s);
+}
+#endif // 1
+
 bool manager_is_inhibited(
                 Manager *m,
                 InhibitWhat w,
@@ -474,7 +914,11 @@ bool manager_is_inhibited(
                 if (i->mode != mm)
                         continue;
 
+#if 0 /// elogind watches the processes of inhibitors through pidfds, see inhibitor_watch_pid()
                 if (ignore_inactive && pid_is_active(m, i->pid) <= 0)
+#else // 0
+                if (ignore_inactive && inhibitor_is_active(i) <= 0)
+#endif // 0
                         continue;
 
                 if (ignore_uid && i->uid == uid)
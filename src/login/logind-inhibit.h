@@ -42,11 +42,21 @@ struct Inhibitor {
 
         pid_t pid;
         uid_t uid;
+#if 1 /// elogind watches the processes of inhibitors through pidfds, see inhibitor_watch_pid()
+        int pidfd;
+        sd_event_source *pidfd_event_source;
+        bool pid_exited;
+        char *session_id; /* the session of the process, NULL if it is in none */
+#endif // 1
 
         dual_timestamp since;
 
         char *fifo_path;
         int fifo_fd;
+#if 1 /// elogind writes the state files of inhibitors held through a pipe in batches, see inhibitor_schedule_save()
+        bool state_file_written;
+        bool save_pending;
+#endif // 1
 };
 
 int inhibitor_new(Inhibitor **ret, Manager *m, const char* id);
@@ -60,6 +70,13 @@ int inhibitor_start(Inhibitor *i);
 void inhibitor_stop(Inhibitor *i);
 
 int inhibitor_create_fifo(Inhibitor *i);
+#if 1 /// elogind hands out pipes rather than FIFOs, see logind-inhibit.c
+int inhibitor_create_pipe(Inhibitor *i);
+
+void manager_save_inhibitors(Manager *m);
+int manager_hand_over_inhibitors(Manager *m);
+int manager_take_over_inhibitors(Manager *m);
+#endif // 1
 
 bool inhibitor_is_orphan(Inhibitor *i);
 
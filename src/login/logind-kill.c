@@ -0,0 +1,353 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <signal.h>
+
+#include "alloc-util.h"
+#include "cgroup-setup.h"
+#include "cgroup-util.h"
+#include "dirent-util.h"
+#include "errno-util.h"
+#include "fd-util.h"
+#include "hashmap.h"
+#include "logind-kill.h"
+#include "missing_syscall.h"
+#include "path-util.h"
+#include "process-util.h"
+#include "string-util.h"
+
+/* When a session is stopped, and its processes are to be killed, we used to do that right away, with
+ * cg_kill_recursive(), which re-reads cgroup.procs of each cgroup until no new process shows up. Terminating a
+ * user or seat with hundreds of sessions did that once per session, one after the other, all on the event
+ * loop.
+ *
+ * Instead, stopped sessions are queued here, and a single timer takes care of all of them: each time it
+ * fires, it makes one pass over the sessions that are due, signalling the processes it has not signalled
+ * yet, for a few milliseconds at most. Sessions in which new processes showed up are looked at again
+ * shortly after, the others with an increasing delay, until their cgroup ran empty, which is when we
+ * remove it. Processes that are still around after the timeout are left alone, as before.
+ *
+ * Signals are sent through pidfds where available. The pidfds of the processes we signalled are kept until
+ * the processes are gone, so that a process that got the PID of one of them is not mistaken for it. */
+
+#define SESSION_KILL_PASS_USEC (10 * USEC_PER_MSEC)
+#define SESSION_KILL_PASS_MAX_USEC (1 * USEC_PER_SEC)
+#define SESSION_KILL_BUDGET_USEC (5 * USEC_PER_MSEC)
+
+struct SessionKill {
+        Manager *manager;
+
+        char *id; /* The session ID, which also names the session cgroup */
+        Hashmap *pidfds; /* PID → pidfd (-1 without pidfd support) of the processes already signalled */
+
+        usec_t started;
+        usec_t deadline;
+        usec_t next;
+        usec_t interval;
+};
+
+SessionKill* session_kill_free(SessionKill *k) {
+        if (!k)
+                return NULL;
+
+        if (k->manager)
+                (void) hashmap_remove_value(k->manager->session_kills, k->id, k);
+
+        hashmap_free(k->pidfds);
+        free(k->id);
+
+        return mfree(k);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(
+                session_kill_hash_ops,
+                char,
+                string_hash_func,
+                string_compare_func,
+                SessionKill,
+                session_kill_free);
+
+static void pidfd_free(void *p) {
+        safe_close(PTR_TO_FD(p));
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(
+                pidfd_hash_ops,
+                void,
+                trivial_hash_func,
+                trivial_compare_func,
+                void,
+                pidfd_free);
+
+static int signal_process(pid_t pid, int sig, int *ret_pidfd) {
+        _cleanup_close_ int fd = -1;
+
+        /* Returns 0 if the process was gone already, > 0 if it was signalled. In the latter case, the pidfd
+         * it was signalled through is returned, or -1 if we had to do without one. */
+
+        fd = pidfd_open(pid, 0);
+        if (fd < 0) {
+                if (errno == ESRCH)
+                        return 0;
+                /* Sessions with lots of processes may well exhaust our fd limit, do without a pidfd then */
+                if (!ERRNO_IS_NOT_SUPPORTED(errno) && !IN_SET(errno, EMFILE, ENFILE))
+                        return -errno;
+
+                if (kill(pid, sig) < 0)
+                        return errno == ESRCH ? 0 : -errno;
+
+                *ret_pidfd = -1;
+                return 1;
+        }
+
+        if (pidfd_send_signal(fd, sig, NULL, 0) < 0)
+                return errno == ESRCH ? 0 : -errno;
+
+        *ret_pidfd = TAKE_FD(fd);
+        return 1;
+}
+
+static bool pidfd_is_alive(int fd) {
+        /* Without a pidfd, we cannot tell a process from one that got its PID later on */
+        if (fd < 0)
+                return true;
+
+        return pidfd_send_signal(fd, 0, NULL, 0) >= 0 || errno != ESRCH;
+}
+
+/* Signals the processes in the cgroup 'path' and below. Those that were signalled on an earlier pass are
+ * moved over from 'signalled' to k->pidfds, the others are signalled and added there. */
+static int session_kill_signal_cgroup(SessionKill *k, const char *path, Hashmap *signalled, unsigned *n_seen, unsigned *n_new) {
+        _cleanup_closedir_ DIR *d = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        int r, ret = 0;
+        pid_t pid;
+        char *fn;
+
+        assert(k);
+        assert(path);
+        assert(n_seen);
+        assert(n_new);
+
+        r = cg_enumerate_processes(SYSTEMD_CGROUP_CONTROLLER, path, &f);
+        if (r == -ENOENT)
+                return 0;
+        if (r < 0)
+                return r;
+
+        while ((r = cg_read_pid(f, &pid)) > 0) {
+                void *key, *v;
+                int fd = -1;
+
+                if (pid == getpid_cached())
+                        continue;
+
+                (*n_seen)++;
+
+                v = hashmap_remove2(signalled, PID_TO_PTR(pid), &key);
+                if (key) {
+                        if (pidfd_is_alive(PTR_TO_FD(v))) {
+                                r = hashmap_ensure_put(&k->pidfds, &pidfd_hash_ops, key, v);
+                                if (r < 0) {
+                                        pidfd_free(v);
+                                        return r;
+                                }
+
+                                continue;
+                        }
+
+                        /* The process we signalled is gone, and this one got its PID */
+                        pidfd_free(v);
+                }
+
+                r = signal_process(pid, SIGTERM, &fd);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to send SIGTERM to process " PID_FMT " of session %s: %m",
+                                        pid, k->id);
+                        if (ret >= 0)
+                                ret = r;
+                }
+                if (r <= 0)
+                        continue;
+
+                r = hashmap_ensure_put(&k->pidfds, &pidfd_hash_ops, PID_TO_PTR(pid), FD_TO_PTR(fd));
+                if (r < 0) {
+                        safe_close(fd);
+                        return r;
+                }
+
+                (*n_new)++;
+        }
+        if (r < 0)
+                return r;
+
+        r = cg_enumerate_subgroups(SYSTEMD_CGROUP_CONTROLLER, path, &d);
+        if (r == -ENOENT)
+                return ret;
+        if (r < 0)
+                return r;
+
+        while ((r = cg_read_subgroup(d, &fn)) > 0) {
+                _cleanup_free_ char *p = NULL;
+
+                p = path_join(path, fn);
+                free(fn);
+                if (!p)
+                        return -ENOMEM;
+
+                r = session_kill_signal_cgroup(k, p, signalled, n_seen, n_new);
+                if (r < 0 && ret >= 0)
+                        ret = r;
+        }
+        if (r < 0)
+                return r;
+
+        return ret;
+}
+
+/* Returns > 0 once we are done with the session */
+static int session_kill_pass(SessionKill *k, usec_t n) {
+        _cleanup_hashmap_free_ Hashmap *signalled = NULL;
+        unsigned n_seen = 0, n_new = 0;
+        int r;
+
+        assert(k);
+
+        /* Whatever is left in here afterwards is gone, and its pidfd is closed */
+        signalled = TAKE_PTR(k->pidfds);
+
+        r = session_kill_signal_cgroup(k, k->id, signalled, &n_seen, &n_new);
+        if (r < 0)
+                log_debug_errno(r, "Failed to kill all processes of session %s, ignoring: %m", k->id);
+
+        if (n_seen == 0) {
+                char ts[FORMAT_TIMESPAN_MAX];
+                usec_t d = usec_sub_unsigned(n, k->started);
+
+                log_full(d >= USEC_PER_SEC ? LOG_INFO : LOG_DEBUG,
+                         "Processes of session %s are gone, took %s.",
+                         k->id, format_timespan(ts, sizeof(ts), d, USEC_PER_MSEC));
+
+                r = cg_trim(SYSTEMD_CGROUP_CONTROLLER, k->id, true);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to remove cgroup of session %s, ignoring: %m", k->id);
+
+                return 1;
+        }
+
+        if (n_new > 0) {
+                /* Something forked while we were at it, or this is the first pass. Look again soon. */
+                k->interval = SESSION_KILL_PASS_USEC;
+                k->next = usec_add(n, k->interval);
+                return 0;
+        }
+
+        if (n >= k->deadline) {
+                log_debug("%u processes of session %s still around, leaving them alone.", n_seen, k->id);
+                (void) cg_trim(SYSTEMD_CGROUP_CONTROLLER, k->id, false);
+                return 1;
+        }
+
+        k->interval = MIN(k->interval * 2, SESSION_KILL_PASS_MAX_USEC);
+        k->next = MIN(usec_add(n, k->interval), k->deadline);
+        return 0;
+}
+
+static int manager_schedule_session_kills(Manager *m);
+
+static int manager_dispatch_session_kills(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *m = userdata;
+        SessionKill *k;
+        usec_t n;
+
+        assert(m);
+
+        n = now(CLOCK_MONOTONIC);
+
+        /* One pass over every session that is due. If there are many, we stop once we ran out of our time
+         * budget, so that other events get their turn, and go on with the rest right after. */
+        HASHMAP_FOREACH(k, m->session_kills) {
+                if (k->next > n)
+                        continue;
+
+                if (now(CLOCK_MONOTONIC) >= usec_add(n, SESSION_KILL_BUDGET_USEC))
+                        break;
+
+                if (session_kill_pass(k, n) > 0)
+                        session_kill_free(k);
+        }
+
+        (void) manager_schedule_session_kills(m);
+        return 0;
+}
+
+static int manager_schedule_session_kills(Manager *m) {
+        usec_t next = USEC_INFINITY;
+        SessionKill *k;
+        int r;
+
+        assert(m);
+
+        HASHMAP_FOREACH(k, m->session_kills)
+                next = MIN(next, k->next);
+
+        if (next == USEC_INFINITY) {
+                if (m->session_kill_event_source)
+                        return sd_event_source_set_enabled(m->session_kill_event_source, SD_EVENT_OFF);
+                return 0;
+        }
+
+        if (m->session_kill_event_source) {
+                r = sd_event_source_set_time(m->session_kill_event_source, next);
+                if (r < 0)
+                        return log_warning_errno(r, "Failed to reschedule session kill timer: %m");
+
+                return sd_event_source_set_enabled(m->session_kill_event_source, SD_EVENT_ONESHOT);
+        }
+
+        r = sd_event_add_time(m->event, &m->session_kill_event_source,
+                              CLOCK_MONOTONIC, next, USEC_PER_MSEC,
+                              manager_dispatch_session_kills, m);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to add session kill timer: %m");
+
+        (void) sd_event_source_set_description(m->session_kill_event_source, "session-kill");
+
+        return 0;
+}
+
+int manager_kill_session_cgroup(Manager *m, const char *id) {
+        _cleanup_(session_kill_freep) SessionKill *k = NULL;
+        int r;
+
+        assert(m);
+        assert(id);
+
+        /* Queues the processes of a session for SIGTERM. The first pass is made on the next event loop
+         * iteration, together with all other sessions stopped until then. */
+
+        if (hashmap_contains(m->session_kills, id))
+                return manager_schedule_session_kills(m);
+
+        k = new(SessionKill, 1);
+        if (!k)
+                return log_oom();
+
+        *k = (SessionKill) {
+                .id = strdup(id),
+                .started = now(CLOCK_MONOTONIC),
+                .interval = SESSION_KILL_PASS_USEC,
+        };
+        if (!k->id)
+                return log_oom();
+
+        k->deadline = usec_add(k->started, m->session_kill_timeout_usec);
+
+        r = hashmap_ensure_put(&m->session_kills, &session_kill_hash_ops, k->id, k);
+        if (r < 0)
+                return log_error_errno(r, "Failed to queue processes of session %s for killing: %m", id);
+
+        k->manager = m;
+        TAKE_PTR(k);
+
+        return manager_schedule_session_kills(m);
+}
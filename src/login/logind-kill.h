@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+typedef struct SessionKill SessionKill;
+
+#include "logind.h"
+
+/* How long to wait for the processes of a stopped session, like DefaultTimeoutStopSec= of systemd */
+#define SESSION_KILL_TIMEOUT_USEC (90 * USEC_PER_SEC)
+
+SessionKill* session_kill_free(SessionKill *k);
+DEFINE_TRIVIAL_CLEANUP_FUNC(SessionKill*, session_kill_free);
+
+int manager_kill_session_cgroup(Manager *m, const char *id);
@@ -23,6 +23,7 @@
 #include "string-util.h"
 #include "terminal-util.h"
 #include "tmpfile-util.h"
+#include "user-util.h"
 #include "util.h"
 
 int seat_new(Seat** ret, Manager *m, const char *id) {
@@ -76,6 +77,9 @@ Seat* seat_free(Seat *s) {
 
         hashmap_remove(s->manager->seats, s->id);
 
+#if 1 /// elogind keeps an index of the seat's uaccess device nodes
+        hashmap_free(s->uaccess_nodes);
+#endif // 1
         free(s->positions);
         free(s->state_file);
 
@@ -92,6 +96,10 @@ int seat_save(Seat *s) {
         if (!s->started)
                 return 0;
 
+#if 1 /// elogind publishes its state files for sd-login in shared memory, see logind-shm.c
+        manager_login_shm_file_changed(s->manager, s->state_file);
+#endif // 1
+
         r = mkdir_safe_label("/run/systemd/seats", 0755, 0, 0, MKDIR_WARN_MODE);
         if (r < 0)
                 goto fail;
@@ -211,7 +219,79 @@ int seat_preallocate_vts(Seat *s) {
 }
 #endif // 0
 
+#if 1 /// elogind keeps an index of the seat's uaccess device nodes
+/* Enumerating all devices tagged "uaccess" means reading the udev database of each of them, on every
+ * switch. Hence the nodes are enumerated once, and the device monitor keeps the index up to date from
+ * then on, see manager_process_uaccess_device(). The index also remembers whom each node's ACL was last
+ * set up for, so that nodes already set up for the new user, e.g. when switching between two sessions of
+ * the same user, are left alone. */
+static int seat_enumerate_uaccess_nodes(Seat *s) {
+        _cleanup_set_free_free_ Set *nodes = NULL;
+        char *n;
+        int r;
+
+        assert(s);
+
+        if (s->uaccess_enumerated)
+                return 0;
+
+        r = devnode_acl_find_nodes(s->id, &nodes);
+        if (r < 0)
+                return r;
+
+        while ((n = set_steal_first(nodes))) {
+                r = hashmap_ensure_put(&s->uaccess_nodes, &path_hash_ops_free, n, UID_TO_PTR(UID_INVALID));
+                if (r < 0) {
+                        free(n);
+                        return r;
+                }
+        }
+
+        s->uaccess_enumerated = true;
+        return 0;
+}
+
+int seat_add_uaccess_node(Seat *s, const char *node) {
+        _cleanup_free_ char *n = NULL;
+        int r;
+
+        assert(s);
+        assert(node);
+
+        /* Not enumerated yet? Then the node will be found when it is */
+        if (!s->uaccess_enumerated)
+                return 0;
+
+        /* udev ran the uaccess command for this node, so we can't tell for whom its ACL is set up now */
+        if (s->uaccess_nodes &&
+            hashmap_update(s->uaccess_nodes, node, UID_TO_PTR(UID_INVALID)) >= 0)
+                return 0;
+
+        n = strdup(node);
+        if (!n)
+                return -ENOMEM;
+
+        r = hashmap_ensure_put(&s->uaccess_nodes, &path_hash_ops_free, n, UID_TO_PTR(UID_INVALID));
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(n);
+        return 0;
+}
+
+void seat_remove_uaccess_node(Seat *s, const char *node) {
+        void *n = NULL;
+
+        assert(s);
+        assert(node);
+
+        (void) hashmap_remove2(s->uaccess_nodes, node, &n);
+        free(n);
+}
+#endif // 1
+
 int seat_apply_acls(Seat *s, Session *old_active) {
+#if 0 /// elogind only touches the nodes in its index whose ACLs are not already set up for the new user
         int r;
 
         assert(s);
@@ -225,6 +305,73 @@ int seat_apply_acls(Seat *s, Session *old_active) {
                 return log_error_errno(r, "Failed to apply ACLs: %m");
 
         return 0;
+#else // 0
+        char ts[FORMAT_TIMESPAN_MAX];
+        unsigned n_changed = 0, n_unchanged = 0;
+        uid_t old_uid, new_uid;
+        const char *n;
+        usec_t start;
+        void *v;
+        int r;
+
+        assert(s);
+
+        if (!old_active && !s->active)
+                return 0;
+
+        old_uid = old_active ? old_active->user->user_record->uid : 0;
+        new_uid = s->active ? s->active->user->user_record->uid : 0;
+
+        start = now(CLOCK_MONOTONIC);
+
+        r = seat_enumerate_uaccess_nodes(s);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to enumerate device nodes of seat %s, falling back to a full scan: %m", s->id);
+
+                r = devnode_acl_all(s->id,
+                                    false,
+                                    !!old_active, old_uid,
+                                    !!s->active, new_uid);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to apply ACLs: %m");
+
+                return 0;
+        }
+
+        HASHMAP_FOREACH_KEY(v, n, s->uaccess_nodes) {
+                int k;
+
+                /* Nodes are recorded as owned by UID_INVALID while nobody is active, so that a later
+                 * session of root is not mistaken for already being set up */
+                if (s->active && PTR_TO_UID(v) == new_uid) {
+                        n_unchanged++;
+                        continue;
+                }
+
+                log_debug("Changing ACLs at %s for seat %s (uid "UID_FMT"→"UID_FMT"%s%s)",
+                          n, s->id, old_uid, new_uid,
+                          old_active ? " del" : "", s->active ? " add" : "");
+
+                k = devnode_acl(n, false, !!old_active, old_uid, !!s->active, new_uid);
+                if (k == -ENOENT)
+                        log_debug("Device %s disappeared while setting ACLs", n);
+                else if (k < 0 && r == 0)
+                        r = k;
+
+                /* Values are replaced in place, which is safe while iterating */
+                (void) hashmap_update(s->uaccess_nodes, n, UID_TO_PTR(k >= 0 && s->active ? new_uid : UID_INVALID));
+                n_changed++;
+        }
+
+        log_debug("Applied ACLs for seat %s in %s, %u device nodes changed, %u already set up.",
+                  s->id, format_timespan(ts, sizeof(ts), usec_sub_unsigned(now(CLOCK_MONOTONIC), start), 1),
+                  n_changed, n_unchanged);
+
+        if (r < 0)
+                return log_error_errno(r, "Failed to apply ACLs: %m");
+
+        return 0;
+#endif // 0
 }
 
 int seat_set_active(Seat *s, Session *session) {
@@ -246,6 +393,10 @@ int seat_set_active(Seat *s, Session *session) {
 
         (void) seat_apply_acls(s, old_active);
 
+#if 1 /// elogind remembers polkit decisions, which may depend on whether the session is active
+        bus_polkit_cache_flush(s->manager->polkit_cache);
+#endif // 1
+
         if (session && session->started) {
                 session_send_changed(session, "Active", NULL);
                 session_device_resume_all(session);
@@ -462,6 +613,9 @@ int seat_stop(Seat *s, bool force) {
 
         r = seat_stop_sessions(s, force);
 
+#if 1 /// elogind publishes its state files for sd-login in shared memory, see logind-shm.c
+        manager_login_shm_file_changed(s->manager, s->state_file);
+#endif // 1
         (void) unlink(s->state_file);
         seat_add_to_gc_queue(s);
 
@@ -552,6 +706,9 @@ int seat_attach_session(Seat *s, Session *session) {
 
         session->seat = s;
         LIST_PREPEND(sessions_by_seat, s->sessions, session);
+#if 1 /// elogind keeps the idle hint of seats, see session_invalidate_idle_hint()
+        session_invalidate_idle_hint(session);
+#endif // 1
         seat_assign_position(s, session);
 
         /* On seats with VTs, the VT logic defines which session is active. On
@@ -614,6 +771,15 @@ int seat_get_idle_hint(Seat *s, dual_timestamp *t) {
 
         assert(s);
 
+#if 1 /// elogind keeps the idle hint gathered from the sessions, see session_invalidate_idle_hint()
+        if (s->idle_hint_cached) {
+                if (t)
+                        *t = s->idle_hint_timestamp;
+
+                return s->idle_hint;
+        }
+#endif // 1
+
         LIST_FOREACH(sessions_by_seat, session, s->sessions) {
                 dual_timestamp k;
                 int ih;
@@ -640,6 +806,11 @@ int seat_get_idle_hint(Seat *s, dual_timestamp *t) {
         if (t)
                 *t = ts;
 
+#if 1 /// see above
+        s->idle_hint = idle_hint;
+        s->idle_hint_timestamp = ts;
+        s->idle_hint_cached = true;
+#endif // 1
         return idle_hint;
 }
 
@@ -20,8 +20,20 @@ struct Seat {
 
         Session **positions;
 
+#if 1 /// elogind keeps an index of the seat's uaccess device nodes, see seat_apply_acls()
+        Hashmap *uaccess_nodes; /* node path → uid the ACL was last set up for, UID_INVALID if unknown or nobody */
+#endif // 1
+#if 1 /// elogind keeps the idle hint gathered from the sessions, see session_invalidate_idle_hint()
+        bool idle_hint_cached;
+        bool idle_hint;
+        dual_timestamp idle_hint_timestamp;
+#endif // 1
+
         bool in_gc_queue:1;
         bool started:1;
+#if 1 /// see above
+        bool uaccess_enumerated:1;
+#endif // 1
 
         LIST_FIELDS(Seat, gc_queue);
 };
@@ -35,6 +47,10 @@ int seat_save(Seat *s);
 int seat_load(Seat *s);
 
 int seat_apply_acls(Seat *s, Session *old_active);
+#if 1 /// elogind keeps an index of the seat's uaccess device nodes
+int seat_add_uaccess_node(Seat *s, const char *node);
+void seat_remove_uaccess_node(Seat *s, const char *node);
+#endif // 1
 int seat_set_active(Seat *s, Session *session);
 int seat_switch_to(Seat *s, unsigned num);
 int seat_switch_to_next(Seat *s);
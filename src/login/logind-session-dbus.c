@@ -215,7 +215,11 @@ int bus_session_method_lock(sd_bus_message *message, void *userdata, sd_bus_erro
         assert(message);
         assert(s);
 
+#if 0 /// elogind can cache polkit decisions, see bus_polkit_cache_new()
         r = bus_verify_polkit_async(
+#else // 0
+        r = bus_verify_polkit_async_full(
+#endif // 0
                         message,
                         CAP_SYS_ADMIN,
                         "org.freedesktop.login1.lock-sessions",
@@ -223,6 +227,9 @@ int bus_session_method_lock(sd_bus_message *message, void *userdata, sd_bus_erro
                         false,
                         s->user->user_record->uid,
                         &s->manager->polkit_registry,
+#if 1 /// see above
+                        s->manager->polkit_cache,
+#endif // 1
                         error);
         if (r < 0)
                 return r;
@@ -465,6 +472,107 @@ error:
         return r;
 }
 
+#if 1 /// elogind can hand out many devices in one go
+static int method_take_devices(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_free_ SessionDevice **taken = NULL;
+        _cleanup_free_ dev_t *devs = NULL;
+        size_t n_devs = 0, n_taken = 0;
+        Session *s = userdata;
+        int r;
+
+        assert(message);
+        assert(s);
+
+        /* The same as TakeDevice, for each of the devices. Either all of them are taken, or none. */
+
+        r = sd_bus_message_enter_container(message, 'a', "(uu)");
+        if (r < 0)
+                return r;
+
+        for (;;) {
+                uint32_t major, minor;
+
+                r = sd_bus_message_read(message, "(uu)", &major, &minor);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                if (!DEVICE_MAJOR_VALID(major) || !DEVICE_MINOR_VALID(minor))
+                        return sd_bus_error_set(error, SD_BUS_ERROR_INVALID_ARGS, "Device major/minor is not valid.");
+
+                if (!GREEDY_REALLOC(devs, n_devs + 1))
+                        return -ENOMEM;
+
+                devs[n_devs++] = makedev(major, minor);
+        }
+
+        r = sd_bus_message_exit_container(message);
+        if (r < 0)
+                return r;
+
+        if (!session_is_controller(s, sd_bus_message_get_sender(message)))
+                return sd_bus_error_set(error, BUS_ERROR_NOT_IN_CONTROL, "You are not in control of this session");
+
+        taken = new(SessionDevice*, n_devs);
+        if (!taken)
+                return -ENOMEM;
+
+        for (size_t i = 0; i < n_devs; i++) {
+                SessionDevice *sd;
+
+                /* This also refuses devices listed twice, see method_take_device() */
+                if (hashmap_get(s->devices, &devs[i])) {
+                        r = sd_bus_error_setf(error, BUS_ERROR_DEVICE_IS_TAKEN, "Device %u:%u already taken",
+                                              major(devs[i]), minor(devs[i]));
+                        goto error;
+                }
+
+                r = session_device_new(s, devs[i], true, &sd);
+                if (r < 0)
+                        goto error;
+
+                taken[n_taken++] = sd;
+
+                r = session_device_save(sd);
+                if (r < 0)
+                        goto error;
+        }
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                goto error;
+
+        r = sd_bus_message_open_container(reply, 'a', "(hb)");
+        if (r < 0)
+                goto error;
+
+        for (size_t i = 0; i < n_taken; i++) {
+                r = sd_bus_message_append(reply, "(hb)", taken[i]->fd, !taken[i]->active);
+                if (r < 0)
+                        goto error;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                goto error;
+
+        r = sd_bus_send(NULL, reply, NULL);
+        if (r < 0)
+                goto error;
+
+        session_save(s);
+        return 1;
+
+error:
+        while (n_taken > 0)
+                session_device_free(taken[--n_taken]);
+
+        return r;
+}
+#endif // 1
+
 static int method_release_device(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         Session *s = userdata;
         uint32_t major, minor;
@@ -792,6 +900,10 @@ int session_send_create_reply(Session *s, sd_bus_error *error) {
 #if 0 /// elogind does not support scope and service jobs
         if (!sd_bus_error_is_set(error) && !session_ready(s))
                 return 0;
+#else // 0
+        /* The runtime directory might wait for a teardown of the user to finish, see user_teardown_start() */
+        if (!sd_bus_error_is_set(error) && s->user->runtime_dir_pending)
+                return 0;
 #endif // 0
 
         c = TAKE_PTR(s->create_message);
@@ -928,6 +1040,15 @@ static const sd_bus_vtable session_vtable[] = {
                                  SD_BUS_PARAM(inactive),
                                  method_take_device,
                                  SD_BUS_VTABLE_UNPRIVILEGED),
+#if 1 /// elogind can hand out many devices in one go
+        SD_BUS_METHOD_WITH_NAMES("TakeDevices",
+                                 "a(uu)",
+                                 SD_BUS_PARAM(devices),
+                                 "a(hb)",
+                                 SD_BUS_PARAM(fds),
+                                 method_take_devices,
+                                 SD_BUS_VTABLE_UNPRIVILEGED),
+#endif // 1
         SD_BUS_METHOD_WITH_NAMES("ReleaseDevice",
                                  "uu",
                                  SD_BUS_PARAM(major)
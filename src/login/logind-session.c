@@ -40,6 +40,7 @@
 /// Additional includes needed by elogind
 #include "cgroup-setup.h"
 #include "extract-word.h"
+#include "missing_syscall.h"
 
 #define RELEASE_USEC (20*USEC_PER_SEC)
 
@@ -65,6 +66,9 @@ int session_new(Session **ret, Manager *m, const char *id) {
                 .manager = m,
                 .fifo_fd = -1,
                 .vtfd = -1,
+#if 1 /// elogind watches session leaders through pidfds, see session_watch_leader()
+                .leader_pidfd = -1,
+#endif // 1
                 .audit_id = AUDIT_SESSION_INVALID,
                 .tty_validity = _TTY_VALIDITY_INVALID,
         };
@@ -82,11 +86,73 @@ int session_new(Session **ret, Manager *m, const char *id) {
         r = hashmap_put(m->sessions, s->id, s);
         if (r < 0)
                 return r;
+#if 1 /// elogind keeps the idle hint of the manager, see session_invalidate_idle_hint()
+        session_invalidate_idle_hint(s);
+#endif // 1
 
         *ret = TAKE_PTR(s);
         return 0;
 }
 
+#if 1 /// elogind watches session leaders through pidfds
+static void session_unwatch_leader(Session *s) {
+        assert(s);
+
+        s->leader_pidfd_event_source = sd_event_source_unref(s->leader_pidfd_event_source);
+        s->leader_pidfd = safe_close(s->leader_pidfd);
+}
+
+static int session_dispatch_leader_pidfd(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        Session *s = userdata;
+
+        assert(s);
+        assert(s->leader_pidfd == fd);
+
+        /* The leader exited, and its PID may be reused any time now. Make sure it's not mistaken for the
+         * leader of this session anymore, and begin with tearing the session down, like on EOF on the
+         * FIFO. */
+        log_debug("Leader " PID_FMT " of session %s exited.", s->leader, s->id);
+
+        (void) hashmap_remove_value(s->manager->sessions_by_leader, PID_TO_PTR(s->leader), s);
+        session_unwatch_leader(s);
+
+        (void) session_stop(s, /* force = */ false);
+        session_add_to_gc_queue(s);
+
+        return 1;
+}
+
+static int session_watch_leader(Session *s) {
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(s);
+        assert(pid_is_valid(s->leader));
+
+        /* A pidfd refers to the process itself rather than to its PID, and becomes readable once the process
+         * exited. Watching that tells us about the exit of the leader right away, instead of whenever the
+         * FIFO or the cgroup of the session are looked at next, and without confusing the leader with a
+         * later process of the same PID. Where pidfds are not available, we keep going without. */
+        session_unwatch_leader(s);
+
+        fd = pidfd_open(s->leader, 0);
+        if (fd < 0)
+                return log_debug_errno(errno, "Failed to open pidfd of leader " PID_FMT " of session %s, not watching it: %m",
+                                       s->leader, s->id);
+
+        r = sd_event_add_io(s->manager->event, &s->leader_pidfd_event_source, fd, EPOLLIN,
+                            session_dispatch_leader_pidfd, s);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to watch pidfd of leader " PID_FMT " of session %s: %m",
+                                       s->leader, s->id);
+
+        (void) sd_event_source_set_description(s->leader_pidfd_event_source, "session-leader");
+
+        s->leader_pidfd = TAKE_FD(fd);
+        return 0;
+}
+#endif // 1
+
 Session* session_free(Session *s) {
         SessionDevice *sd;
 
@@ -106,6 +172,9 @@ Session* session_free(Session *s) {
 
         hashmap_free(s->devices);
 
+#if 1 /// elogind keeps the idle hint of users, seats and the manager, see session_invalidate_idle_hint()
+        session_invalidate_idle_hint(s);
+#endif // 1
         if (s->user) {
                 LIST_REMOVE(sessions_by_user, s->user->sessions, s);
 
@@ -134,6 +203,9 @@ Session* session_free(Session *s) {
 
         if (pid_is_valid(s->leader))
                 (void) hashmap_remove_value(s->manager->sessions_by_leader, PID_TO_PTR(s->leader), s);
+#if 1 /// elogind watches session leaders through pidfds, see session_watch_leader()
+        session_unwatch_leader(s);
+#endif // 1
 
 #if 0 /// elogind does not support systemd scope_jobs
         free(s->scope_job);
@@ -167,6 +239,9 @@ void session_set_user(Session *s, User *u) {
 
         s->user = u;
         LIST_PREPEND(sessions_by_user, u->sessions, s);
+#if 1 /// elogind keeps the idle hint of users, see session_invalidate_idle_hint()
+        session_invalidate_idle_hint(s);
+#endif // 1
 
         user_update_last_session_timer(u);
 }
@@ -191,6 +266,9 @@ int session_set_leader(Session *s, pid_t pid) {
 
         s->leader = pid;
         (void) audit_session_from_pid(pid, &s->audit_id);
+#if 1 /// elogind watches session leaders through pidfds, see session_watch_leader()
+        (void) session_watch_leader(s);
+#endif // 1
 
         return 1;
 }
@@ -219,6 +297,10 @@ int session_save(Session *s) {
         if (!s->started)
                 return 0;
 
+#if 1 /// elogind publishes its state files for sd-login in shared memory, see logind-shm.c
+        manager_login_shm_file_changed(s->manager, s->state_file);
+#endif // 1
+
         r = mkdir_safe_label("/run/systemd/sessions", 0755, 0, 0, MKDIR_WARN_MODE);
         if (r < 0)
                 goto fail;
@@ -428,7 +510,11 @@ int session_load(Session *s) {
 
         assert(s);
 
+#if 0 /// elogind serves the state file from its snapshot where it can, see logind-snapshot.c
         r = parse_env_file(NULL, s->state_file,
+#else // 0
+        r = manager_parse_state_file(s->manager, s->state_file,
+#endif // 0
                            "REMOTE",         &remote,
                            "SCOPE",          &s->scope,
 #if 0 /// elogind does not support systemd scope_jobs
@@ -857,7 +943,8 @@ static int session_stop_cgroup(Session *s, bool force) {
         // elogind must not kill lingering user processes alive
         if ( (force || manager_shall_kill(s->manager, s->user->user_record->user_name) )
             && (user_check_linger_file(s->user) < 1) ) {
-                r = session_kill(s, KILL_ALL, SIGTERM);
+                /* Queued, so that all sessions stopped in one go are killed in one go */
+                r = manager_kill_session_cgroup(s->manager, s->id);
                 if (r < 0)
                         return r;
         }
@@ -939,6 +1026,9 @@ int session_finalize(Session *s) {
         while ((sd = hashmap_first(s->devices)))
                 session_device_free(sd);
 
+#if 1 /// elogind publishes its state files for sd-login in shared memory, see logind-shm.c
+        manager_login_shm_file_changed(s->manager, s->state_file);
+#endif // 1
         (void) unlink(s->state_file);
         session_add_to_gc_queue(s);
         user_add_to_gc_queue(s->user);
@@ -1040,9 +1130,49 @@ static int get_process_ctty_atime(pid_t pid, usec_t *atime) {
         return get_tty_atime(p, atime);
 }
 
+#if 1 /// elogind caches the tty atime of non-graphical sessions, see manager_refresh_tty_atimes()
+void session_refresh_tty_atime(Session *s) {
+        usec_t atime;
+        bool idle = false;
+
+        assert(s);
+
+        /* For sessions with an explicitly configured tty, let's check its atime, and for sessions with a
+         * leader but no explicitly configured tty, let's check the controlling tty of the leader */
+        if ((s->tty && get_tty_atime(s->tty, &atime) >= 0) ||
+            (pid_is_valid(s->leader) && get_process_ctty_atime(s->leader, &atime) >= 0))
+                idle = s->manager->idle_action_usec > 0 &&
+                        usec_add(atime, s->manager->idle_action_usec) <= now(CLOCK_REALTIME);
+        else
+                atime = USEC_INFINITY;
+
+        if (!s->tty_atime_cached || s->tty_atime != atime || s->tty_idle != idle)
+                session_invalidate_idle_hint(s);
+
+        s->tty_atime = atime;
+        s->tty_idle = idle;
+        s->tty_atime_cached = true;
+        s->manager->tty_atime_n_refreshes++;
+}
+
+void session_invalidate_idle_hint(Session *s) {
+        assert(s);
+
+        /* Users, seats and the manager keep the idle hint they gathered from their sessions, until one of
+         * these comes, goes, or changes its own idle hint */
+        if (s->user)
+                s->user->idle_hint_cached = false;
+        if (s->seat)
+                s->seat->idle_hint_cached = false;
+        s->manager->idle_hint_cached = false;
+}
+#endif // 1
+
 int session_get_idle_hint(Session *s, dual_timestamp *t) {
         usec_t atime = 0;
+#if 0 /// elogind serves the tty atime from its cache, see manager_refresh_tty_atimes()
         int r;
+#endif // 0
 
         assert(s);
 
@@ -1054,6 +1184,7 @@ int session_get_idle_hint(Session *s, dual_timestamp *t) {
                 return s->idle_hint;
         }
 
+#if 0 /// elogind serves the tty atime from its cache, see manager_refresh_tty_atimes()
         /* For sessions with an explicitly configured tty, let's check its atime */
         if (s->tty) {
                 r = get_tty_atime(s->tty, &atime);
@@ -1075,13 +1206,32 @@ int session_get_idle_hint(Session *s, dual_timestamp *t) {
         return false;
 
 found_atime:
+#else // 0
+        if (!s->tty_atime_cached) {
+                session_refresh_tty_atime(s);
+                (void) manager_schedule_tty_atime_refresh(s->manager);
+        }
+        s->manager->tty_atime_used = true;
+
+        atime = s->tty_atime;
+        if (atime == USEC_INFINITY) {
+                if (t)
+                        *t = DUAL_TIMESTAMP_NULL;
+
+                return false;
+        }
+#endif // 0
         if (t)
                 dual_timestamp_from_realtime(t, atime);
 
+#if 0 /// elogind tells whether the tty was idle as of the last refresh, so that users, seats and the manager agree
         if (s->manager->idle_action_usec <= 0)
                 return false;
 
         return usec_add(atime, s->manager->idle_action_usec) <= now(CLOCK_REALTIME);
+#else // 0
+        return s->tty_idle;
+#endif // 0
 }
 
 int session_set_idle_hint(Session *s, bool b) {
@@ -1095,6 +1245,9 @@ int session_set_idle_hint(Session *s, bool b) {
 
         s->idle_hint = b;
         dual_timestamp_get(&s->idle_hint_timestamp);
+#if 1 /// elogind keeps the idle hint of users, seats and the manager, see session_invalidate_idle_hint()
+        session_invalidate_idle_hint(s);
+#endif // 1
 
         session_send_changed(s, "IdleHint", "IdleSinceHint", "IdleSinceHintMonotonic", NULL);
 
@@ -1132,6 +1285,9 @@ void session_set_type(Session *s, SessionType t) {
 
         s->type = t;
         session_save(s);
+#if 1 /// elogind keeps the idle hint of users, seats and the manager, see session_invalidate_idle_hint()
+        session_invalidate_idle_hint(s);
+#endif // 1
 
         session_send_changed(s, "Type", NULL);
 }
@@ -1331,10 +1487,15 @@ int session_kill(Session *s, KillWho who, int signo) {
                         return log_error_errno(errno, "Failed to kill process leader %d for session %s: %m", s->leader, s->id);
                 }
                 return 0;
-        } else
-                return cg_kill_recursive (SYSTEMD_CGROUP_CONTROLLER, s->id, signo,
-                                          CGROUP_IGNORE_SELF | CGROUP_REMOVE,
-                                          NULL, NULL, NULL);
+        }
+
+        /* With cgroup.kill, the kernel takes care of the whole tree at once */
+        if (signo == SIGKILL && cg_kill_kernel_sigkill(SYSTEMD_CGROUP_CONTROLLER, s->id) >= 0)
+                return 0;
+
+        return cg_kill_recursive (SYSTEMD_CGROUP_CONTROLLER, s->id, signo,
+                                  CGROUP_IGNORE_SELF | CGROUP_REMOVE,
+                                  NULL, NULL, NULL);
 #endif // 0
 }
 
@@ -91,6 +91,10 @@ struct Session {
 
         pid_t leader;
         uint32_t audit_id;
+#if 1 /// elogind watches session leaders through pidfds, see session_watch_leader()
+        int leader_pidfd;
+        sd_event_source *leader_pidfd_event_source;
+#endif // 1
 
         int fifo_fd;
         char *fifo_path;
@@ -99,6 +103,11 @@ struct Session {
 
         bool idle_hint;
         dual_timestamp idle_hint_timestamp;
+#if 1 /// elogind caches the tty atime of non-graphical sessions, see manager_refresh_tty_atimes()
+        usec_t tty_atime; /* USEC_INFINITY if there is no tty to look at */
+        bool tty_atime_cached;
+        bool tty_idle;    /* Whether the tty was idle as of the last refresh */
+#endif // 1
 
         bool locked_hint;
 
@@ -135,6 +144,10 @@ void session_add_to_gc_queue(Session *s);
 int session_activate(Session *s);
 bool session_is_active(Session *s);
 int session_get_idle_hint(Session *s, dual_timestamp *t);
+#if 1 /// elogind caches the tty atime of non-graphical sessions, see manager_refresh_tty_atimes()
+void session_refresh_tty_atime(Session *s);
+void session_invalidate_idle_hint(Session *s);
+#endif // 1
 int session_set_idle_hint(Session *s, bool b);
 int session_get_locked_hint(Session *s);
 void session_set_locked_hint(Session *s, bool b);
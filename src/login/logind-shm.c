@@ -0,0 +1,273 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "dirent-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "hashmap.h"
+#include "login-shm.h"
+#include "logind-shm.h"
+#include "mkdir.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "set.h"
+#include "stdio-util.h"
+#include "string-util.h"
+
+/* sd-login used to open and parse a state file below /run/systemd/ for each question asked, and to read a
+ * whole directory for each list of sessions, users or seats. We keep the contents of all of these state
+ * files in memory, and publish them in a single file sd-login maps, see login-shm.c.
+ *
+ * Whenever a state file is about to change, the published copy is marked invalid right away, so that
+ * readers go to the state files until we caught up. We catch up on a timer, so that a burst of changes is
+ * published once, re-reading only the state files that changed.
+ *
+ * Once published, we also rewrite the generation file of each category that changed, which is what
+ * sd_login_monitor watches where it exists. A login writes the session, user and seat state files several
+ * times each, every write waking up every monitor watching the state directories, while the generation
+ * files are written once per burst. */
+
+#define LOGIN_SHM_PUBLISH_INTERVAL_USEC (10 * USEC_PER_MSEC)
+
+static const struct {
+        const char *directory;
+        const char *generation;
+} login_shm_categories[] = {
+        { "/run/systemd/seats/",    LOGIN_GENERATION_SEAT    },
+        { "/run/systemd/sessions/", LOGIN_GENERATION_SESSION },
+        { "/run/systemd/users/",    LOGIN_GENERATION_UID     },
+};
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(
+                login_shm_file_hash_ops,
+                char,
+                string_hash_func,
+                string_compare_func,
+                LoginShmFile,
+                login_shm_file_free);
+
+static int manager_login_shm_read(Manager *m, const char *path) {
+        _cleanup_(login_shm_file_freep) LoginShmFile *f = NULL;
+        int r;
+
+        assert(m);
+        assert(path);
+
+        r = login_shm_file_read(path, &f);
+        if (r == -ENOENT) {
+                login_shm_file_free(hashmap_remove(m->login_shm_files, path));
+                return 0;
+        }
+        if (r < 0)
+                return log_debug_errno(r, "Failed to read %s: %m", path);
+
+        login_shm_file_free(hashmap_remove(m->login_shm_files, path));
+
+        r = hashmap_ensure_put(&m->login_shm_files, &login_shm_file_hash_ops, f->path, f);
+        if (r < 0)
+                return log_oom();
+
+        TAKE_PTR(f);
+        return 0;
+}
+
+static void manager_drop_login_shm(Manager *m) {
+        assert(m);
+
+        m->login_shm = login_shm_free(m->login_shm);
+        m->login_shm_files = hashmap_free(m->login_shm_files);
+        m->login_shm_dirty = set_free(m->login_shm_dirty);
+}
+
+static void manager_bump_login_generations(Manager *m, unsigned mask) {
+        char buf[DECIMAL_STR_MAX(usec_t) + 1];
+        int r;
+
+        assert(m);
+
+        xsprintf(buf, USEC_FMT "\n", now(CLOCK_MONOTONIC));
+
+        for (size_t i = 0; i < ELEMENTSOF(login_shm_categories); i++) {
+                if (!FLAGS_SET(mask, 1U << i))
+                        continue;
+
+                /* Written in place, so that watches on the file stay put */
+                r = write_string_file(login_shm_categories[i].generation, buf, WRITE_STRING_FILE_CREATE);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to update %s, ignoring: %m", login_shm_categories[i].generation);
+        }
+}
+
+static int manager_login_shm_publish(Manager *m) {
+        char *path;
+        int r;
+
+        assert(m);
+
+        if (!m->login_shm)
+                return 0;
+
+        /* A state file we failed to read stays dirty, and so does the published copy stay invalid */
+        SET_FOREACH(path, m->login_shm_dirty)
+                if (manager_login_shm_read(m, path) >= 0)
+                        free(set_remove(m->login_shm_dirty, path));
+
+        if (!set_isempty(m->login_shm_dirty))
+                return -EAGAIN;
+
+        r = login_shm_publish(m->login_shm, m->login_shm_files);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to publish state files for sd-login: %m");
+
+        return 0;
+}
+
+static int manager_dispatch_login_shm(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        /* If that fails, readers keep going to the state files, until the next change gives us another go */
+        (void) manager_login_shm_publish(m);
+
+        if (m->login_generation_created)
+                manager_bump_login_generations(m, m->login_generation_dirty);
+        m->login_generation_dirty = 0;
+
+        m->login_shm_last_publish = now(CLOCK_MONOTONIC);
+
+        return 0;
+}
+
+static int manager_schedule_login_shm(Manager *m) {
+        usec_t next;
+        int r;
+
+        assert(m);
+
+        /* Once the timer is armed, further changes ride along, rather than pushing it back */
+        if (m->login_shm_event_source) {
+                r = sd_event_source_get_enabled(m->login_shm_event_source, NULL);
+                if (r > 0)
+                        return 0;
+        }
+
+        next = MAX(now(CLOCK_MONOTONIC), usec_add(m->login_shm_last_publish, LOGIN_SHM_PUBLISH_INTERVAL_USEC));
+
+        if (m->login_shm_event_source) {
+                r = sd_event_source_set_time(m->login_shm_event_source, next);
+                if (r < 0)
+                        return log_warning_errno(r, "Failed to reschedule sd-login publishing timer: %m");
+
+                return sd_event_source_set_enabled(m->login_shm_event_source, SD_EVENT_ONESHOT);
+        }
+
+        r = sd_event_add_time(m->event, &m->login_shm_event_source,
+                              CLOCK_MONOTONIC, next, USEC_PER_MSEC,
+                              manager_dispatch_login_shm, m);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to add sd-login publishing timer: %m");
+
+        (void) sd_event_source_set_description(m->login_shm_event_source, "login-shm");
+
+        return 0;
+}
+
+void manager_login_shm_file_changed(Manager *m, const char *path) {
+        int r;
+
+        assert(m);
+        assert(path);
+
+        /* Called before a state file is written or removed */
+
+        for (size_t i = 0; i < ELEMENTSOF(login_shm_categories); i++)
+                if (path_startswith(path, login_shm_categories[i].directory))
+                        m->login_generation_dirty |= 1U << i;
+
+        if (m->login_shm) {
+                login_shm_invalidate(m->login_shm);
+
+                r = set_put_strdup(&m->login_shm_dirty, path);
+                if (r < 0) {
+                        /* Without knowing what changed, we cannot publish anything anymore */
+                        log_oom();
+                        manager_drop_login_shm(m);
+                }
+        }
+
+        (void) manager_schedule_login_shm(m);
+}
+
+int manager_start_login_shm(Manager *m) {
+        int r;
+
+        assert(m);
+
+        /* Anything may have changed while we were gone */
+        r = mkdir_safe_label(LOGIN_GENERATION_DIR, 0755, 0, 0, MKDIR_WARN_MODE);
+        if (r < 0)
+                log_warning_errno(r, "Failed to create %s, ignoring: %m", LOGIN_GENERATION_DIR);
+        else {
+                m->login_generation_created = true;
+                manager_bump_login_generations(m, (1U << ELEMENTSOF(login_shm_categories)) - 1);
+        }
+
+        r = login_shm_new(LOGIN_SHM_PATH, &m->login_shm);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to create %s, sd-login will read the state files: %m", LOGIN_SHM_PATH);
+
+        for (size_t i = 0; i < ELEMENTSOF(login_shm_categories); i++) {
+                const char *dir = login_shm_categories[i].directory;
+                _cleanup_closedir_ DIR *d = NULL;
+                struct dirent *de;
+
+                d = opendir(dir);
+                if (!d) {
+                        if (errno == ENOENT)
+                                continue;
+
+                        log_warning_errno(errno, "Failed to open %s: %m", dir);
+                        goto fail;
+                }
+
+                FOREACH_DIRENT(de, d, goto fail) {
+                        _cleanup_free_ char *p = NULL;
+
+                        if (!dirent_is_file(de))
+                                continue;
+
+                        p = path_join(dir, de->d_name);
+                        if (!p) {
+                                log_oom();
+                                goto fail;
+                        }
+
+                        r = manager_login_shm_read(m, p);
+                        if (r < 0)
+                                goto fail;
+                }
+        }
+
+        r = manager_login_shm_publish(m);
+        if (r < 0)
+                goto fail;
+
+        log_debug("Published %u state files for sd-login in %s.", hashmap_size(m->login_shm_files), LOGIN_SHM_PATH);
+        return 0;
+
+fail:
+        manager_drop_login_shm(m);
+        return -EIO;
+}
+
+void manager_stop_login_shm(Manager *m) {
+        assert(m);
+
+        manager_drop_login_shm(m);
+        m->login_shm_event_source = sd_event_source_unref(m->login_shm_event_source);
+
+        /* Monitors go back to watching the state directories */
+        if (m->login_generation_created)
+                (void) rm_rf(LOGIN_GENERATION_DIR, REMOVE_ROOT|REMOVE_PHYSICAL);
+}
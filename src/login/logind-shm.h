@@ -0,0 +1,8 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include "logind.h"
+
+int manager_start_login_shm(Manager *m);
+void manager_stop_login_shm(Manager *m);
+void manager_login_shm_file_changed(Manager *m, const char *path);
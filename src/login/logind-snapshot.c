@@ -0,0 +1,442 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "alloc-util.h"
+#include "env-file.h"
+#include "escape.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "hashmap.h"
+#include "logind-snapshot.h"
+#include "serialize.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tmpfile-util.h"
+
+/* On startup, we deserialize the state of each user, session and inhibitor from its own state file. With
+ * many sessions, opening and parsing all of them takes a while, during which nobody can log in. Hence we
+ * additionally keep the contents of all state files in a single snapshot file, written when we go down
+ * cleanly, and every few minutes while we run.
+ *
+ * The snapshot is never trusted on its own: each entry records the inode number, modification time and size
+ * of the state file it was taken from, and is only used if a stat() of that file still matches, at the time
+ * the object is loaded. Otherwise, and for state files the snapshot knows nothing about, we parse the state
+ * file as before. A stale or missing snapshot hence only costs time, never correctness.
+ *
+ * The snapshot uses the text format of serialize.c: a "version" line, followed by one "file" line per state
+ * file, each followed by the (C-escaped) assignments of that file. */
+
+#define STATE_SNAPSHOT_PATH "/run/systemd/elogind.snapshot"
+#define STATE_SNAPSHOT_VERSION "1"
+#define STATE_SNAPSHOT_INTERVAL_USEC (5 * USEC_PER_MINUTE)
+
+typedef struct StateSnapshotEntry {
+        ino_t ino;
+        usec_t mtime;
+        uint64_t size;
+
+        /* The NUL separated assignment lines of this entry, within StateSnapshot.buffer */
+        const char *begin;
+        const char *end;
+} StateSnapshotEntry;
+
+struct StateSnapshot {
+        char *buffer;
+        Hashmap *entries; /* state file path → StateSnapshotEntry */
+
+        unsigned n_hits;
+        unsigned n_misses;
+};
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(state_snapshot_entry_hash_ops,
+                                              char, string_hash_func, string_compare_func,
+                                              StateSnapshotEntry, free);
+
+StateSnapshot* state_snapshot_free(StateSnapshot *s) {
+        if (!s)
+                return NULL;
+
+        hashmap_free(s->entries);
+        free(s->buffer);
+
+        return mfree(s);
+}
+
+static bool state_snapshot_entry_matches(const StateSnapshotEntry *e, const struct stat *st) {
+        assert(e);
+        assert(st);
+
+        return e->ino == st->st_ino &&
+               e->mtime == timespec_load(&st->st_mtim) &&
+               e->size == (uint64_t) st->st_size;
+}
+
+static int state_snapshot_parse_file_line(char *value, char **ret_path, StateSnapshotEntry *ret) {
+        uint64_t ino, mtime, size;
+        char *space;
+
+        assert(value);
+        assert(ret_path);
+        assert(ret);
+
+        /* "<path> <ino> <mtime> <size>", state file paths never contain spaces */
+        space = strchr(value, ' ');
+        if (!space)
+                return -EBADMSG;
+        *space = 0;
+
+        if (sscanf(space + 1, "%" SCNu64 " %" SCNu64 " %" SCNu64, &ino, &mtime, &size) != 3)
+                return -EBADMSG;
+
+        *ret_path = value;
+        *ret = (StateSnapshotEntry) {
+                .ino = (ino_t) ino,
+                .mtime = (usec_t) mtime,
+                .size = size,
+        };
+
+        return 0;
+}
+
+static int state_snapshot_load(StateSnapshot **ret) {
+        _cleanup_(state_snapshot_freep) StateSnapshot *s = NULL;
+        StateSnapshotEntry *current = NULL;
+        char *p, *eol;
+        size_t size;
+        int r;
+
+        assert(ret);
+
+        s = new0(StateSnapshot, 1);
+        if (!s)
+                return -ENOMEM;
+
+        r = read_full_file(STATE_SNAPSHOT_PATH, &s->buffer, &size);
+        if (r < 0)
+                return r;
+
+        /* Split the buffer into lines in place, the entries then just point into it */
+        for (p = s->buffer; p < s->buffer + size; p = eol + 1) {
+                char *value;
+
+                eol = strchrnul(p, '\n');
+                *eol = 0;
+
+                if (isempty(p))
+                        continue;
+
+                value = strchr(p, '=');
+                if (!value)
+                        return -EBADMSG;
+                *value++ = 0;
+
+                if (p == s->buffer) {
+                        if (!streq(p, "version") || !streq(value, STATE_SNAPSHOT_VERSION))
+                                return -EPROTONOSUPPORT;
+
+                        continue;
+                }
+
+                if (streq(p, "file")) {
+                        _cleanup_free_ StateSnapshotEntry *e = NULL;
+                        char *path;
+
+                        e = new(StateSnapshotEntry, 1);
+                        if (!e)
+                                return -ENOMEM;
+
+                        r = state_snapshot_parse_file_line(value, &path, e);
+                        if (r < 0)
+                                return r;
+
+                        e->begin = e->end = eol + 1;
+
+                        r = hashmap_ensure_put(&s->entries, &state_snapshot_entry_hash_ops, path, e);
+                        if (r < 0)
+                                return r;
+
+                        current = TAKE_PTR(e);
+                        continue;
+                }
+
+                if (!current)
+                        return -EBADMSG;
+
+                /* Restore the separator, the line is handed out as a whole */
+                value[-1] = '=';
+                current->end = eol + 1;
+        }
+
+        *ret = TAKE_PTR(s);
+        return 0;
+}
+
+int manager_load_state_snapshot(Manager *m) {
+        int r;
+
+        assert(m);
+
+        m->state_snapshot = state_snapshot_free(m->state_snapshot);
+
+        r = state_snapshot_load(&m->state_snapshot);
+        if (r == -ENOENT)
+                return 0;
+        if (r < 0)
+                return log_warning_errno(r, "Failed to load state snapshot %s, ignoring: %m", STATE_SNAPSHOT_PATH);
+
+        log_debug("Loaded state snapshot with %u entries.", hashmap_size(m->state_snapshot->entries));
+        return 1;
+}
+
+void manager_drop_state_snapshot(Manager *m) {
+        assert(m);
+
+        if (!m->state_snapshot)
+                return;
+
+        log_debug("State snapshot: %u files served from the snapshot, %u files read from disk.",
+                  m->state_snapshot->n_hits, m->state_snapshot->n_misses);
+
+        m->state_snapshot = state_snapshot_free(m->state_snapshot);
+}
+
+static int state_snapshot_entry_parse(const StateSnapshotEntry *e, va_list ap) {
+        assert(e);
+
+        for (const char *line = e->begin; line < e->end; line += strlen(line) + 1) {
+                const char *eq;
+                va_list aq;
+                char *key;
+
+                eq = strchr(line, '=');
+                if (!eq)
+                        continue;
+
+                va_copy(aq, ap);
+                while ((key = va_arg(aq, char *))) {
+                        char **v = va_arg(aq, char **);
+                        _cleanup_free_ char *value = NULL;
+                        ssize_t l;
+
+                        if (strncmp(line, key, eq - line) != 0 || key[eq - line] != 0)
+                                continue;
+
+                        l = cunescape(eq + 1, 0, &value);
+                        if (l < 0) {
+                                va_end(aq);
+                                return l;
+                        }
+
+                        free_and_replace(*v, value);
+                        break;
+                }
+                va_end(aq);
+        }
+
+        return 0;
+}
+
+int manager_parse_state_file_sentinel(Manager *m, const char *path, ...) {
+        StateSnapshotEntry *e;
+        struct stat st;
+        va_list ap;
+        int r;
+
+        assert(m);
+        assert(path);
+
+        /* Like parse_env_file(), but serves the state file from the snapshot, if it still matches */
+
+        va_start(ap, path);
+
+        if (m->state_snapshot) {
+                e = hashmap_get(m->state_snapshot->entries, path);
+                if (e && stat(path, &st) >= 0 && state_snapshot_entry_matches(e, &st)) {
+                        r = state_snapshot_entry_parse(e, ap);
+                        if (r >= 0) {
+                                m->state_snapshot->n_hits++;
+                                va_end(ap);
+                                return r;
+                        }
+
+                        log_debug_errno(r, "Failed to parse snapshot of %s, reading the file instead: %m", path);
+
+                        /* The values parsed so far are simply overwritten by the file below */
+                        va_end(ap);
+                        va_start(ap, path);
+                }
+
+                m->state_snapshot->n_misses++;
+        }
+
+        r = parse_env_filev(NULL, path, ap);
+        va_end(ap);
+
+        return r;
+}
+
+static int state_snapshot_serialize_file(FILE *f, StateSnapshot *old, const char *path, bool *changed) {
+        _cleanup_strv_free_ char **pairs = NULL;
+        StateSnapshotEntry *e;
+        struct stat st;
+        char **k, **v;
+        int r;
+
+        assert(f);
+        assert(path);
+        assert(changed);
+
+        /* Take the identity of the file first: should it be replaced while we read it, the entry will just
+         * not match on the next startup */
+        if (stat(path, &st) < 0) {
+                if (errno == ENOENT)
+                        return 0;
+
+                return -errno;
+        }
+
+        r = serialize_item_format(f, "file", "%s %" PRIu64 " %" PRIu64 " %" PRIu64,
+                                  path, (uint64_t) st.st_ino, (uint64_t) timespec_load(&st.st_mtim), (uint64_t) st.st_size);
+        if (r < 0)
+                return r;
+
+        e = old ? hashmap_get(old->entries, path) : NULL;
+        if (e && state_snapshot_entry_matches(e, &st)) {
+                for (const char *line = e->begin; line < e->end; line += strlen(line) + 1) {
+                        fputs(line, f);
+                        fputc('\n', f);
+                }
+
+                return 1;
+        }
+
+        r = load_env_file_pairs(NULL, path, &pairs);
+        if (r == -ENOENT)
+                return 0;
+        if (r < 0)
+                return r;
+
+        STRV_FOREACH_PAIR(k, v, pairs) {
+                r = serialize_item_escaped(f, *k, *v);
+                if (r < 0)
+                        return r;
+        }
+
+        *changed = true;
+        return 1;
+}
+
+int manager_write_state_snapshot(Manager *m) {
+        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_(state_snapshot_freep) StateSnapshot *old = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        unsigned n_entries = 0;
+        bool changed = false;
+        Inhibitor *inhibitor;
+        Session *session;
+        User *user;
+        int r;
+
+        assert(m);
+
+        /* Entries of unchanged state files are copied over from the previous snapshot, so that only the
+         * files changed since then need to be read */
+        r = state_snapshot_load(&old);
+        if (r < 0 && r != -ENOENT)
+                log_debug_errno(r, "Failed to load previous state snapshot, ignoring: %m");
+
+        r = fopen_temporary(STATE_SNAPSHOT_PATH, &f, &temp_path);
+        if (r < 0)
+                goto fail;
+
+        (void) fchmod(fileno(f), 0600);
+
+        r = serialize_item(f, "version", STATE_SNAPSHOT_VERSION);
+        if (r < 0)
+                goto fail;
+
+        HASHMAP_FOREACH(user, m->users) {
+                r = state_snapshot_serialize_file(f, old, user->state_file, &changed);
+                if (r < 0)
+                        goto fail;
+                n_entries += r;
+        }
+
+        HASHMAP_FOREACH(session, m->sessions) {
+                r = state_snapshot_serialize_file(f, old, session->state_file, &changed);
+                if (r < 0)
+                        goto fail;
+                n_entries += r;
+        }
+
+        HASHMAP_FOREACH(inhibitor, m->inhibitors) {
+                r = state_snapshot_serialize_file(f, old, inhibitor->state_file, &changed);
+                if (r < 0)
+                        goto fail;
+                n_entries += r;
+        }
+
+        /* Nothing new, and nothing went away? Then leave the old snapshot be */
+        if (!changed && old && n_entries == hashmap_size(old->entries)) {
+                (void) unlink(temp_path);
+                return 0;
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(temp_path, STATE_SNAPSHOT_PATH) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        log_debug("Wrote state snapshot with %u entries.", n_entries);
+        return 1;
+
+fail:
+        if (temp_path)
+                (void) unlink(temp_path);
+
+        /* A snapshot we could not bring up to date is worse than none */
+        (void) unlink(STATE_SNAPSHOT_PATH);
+
+        return log_warning_errno(r, "Failed to write state snapshot %s: %m", STATE_SNAPSHOT_PATH);
+}
+
+static int manager_dispatch_state_snapshot(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        (void) manager_write_state_snapshot(m);
+        (void) manager_schedule_state_snapshot(m);
+
+        return 0;
+}
+
+int manager_schedule_state_snapshot(Manager *m) {
+        int r;
+
+        assert(m);
+
+        if (m->state_snapshot_event_source) {
+                r = sd_event_source_set_time_relative(m->state_snapshot_event_source, STATE_SNAPSHOT_INTERVAL_USEC);
+                if (r < 0)
+                        return log_warning_errno(r, "Failed to reschedule state snapshot timer: %m");
+
+                return sd_event_source_set_enabled(m->state_snapshot_event_source, SD_EVENT_ONESHOT);
+        }
+
+        r = sd_event_add_time_relative(m->event, &m->state_snapshot_event_source,
+                                       CLOCK_MONOTONIC, STATE_SNAPSHOT_INTERVAL_USEC, USEC_PER_MINUTE,
+                                       manager_dispatch_state_snapshot, m);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to add state snapshot timer: %m");
+
+        (void) sd_event_source_set_description(m->state_snapshot_event_source, "state-snapshot");
+
+        return 0;
+}
@@ -0,0 +1,17 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+typedef struct StateSnapshot StateSnapshot;
+
+#include "logind.h"
+
+StateSnapshot* state_snapshot_free(StateSnapshot *s);
+DEFINE_TRIVIAL_CLEANUP_FUNC(StateSnapshot*, state_snapshot_free);
+
+int manager_load_state_snapshot(Manager *m);
+void manager_drop_state_snapshot(Manager *m);
+int manager_write_state_snapshot(Manager *m);
+int manager_schedule_state_snapshot(Manager *m);
+
+int manager_parse_state_file_sentinel(Manager *m, const char *path, ...) _sentinel_;
+#define manager_parse_state_file(m, path, ...) manager_parse_state_file_sentinel(m, path, __VA_ARGS__, NULL)
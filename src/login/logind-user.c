@@ -156,6 +156,10 @@ static int user_save_internal(User *u) {
         assert(u);
         assert(u->state_file);
 
+#if 1 /// elogind publishes its state files for sd-login in shared memory, see logind-shm.c
+        manager_login_shm_file_changed(u->manager, u->state_file);
+#endif // 1
+
         r = mkdir_safe_label("/run/systemd/users", 0755, 0, 0, MKDIR_WARN_MODE);
         if (r < 0)
                 goto fail;
@@ -320,7 +324,11 @@ int user_load(User *u) {
 
         assert(u);
 
+#if 0 /// elogind serves the state file from its snapshot where it can, see logind-snapshot.c
         r = parse_env_file(NULL, u->state_file,
+#else // 0
+        r = manager_parse_state_file(u->manager, u->state_file,
+#endif // 0
 #if 0 /// elogind neither supports service jobs
                            "SERVICE_JOB",            &u->service_job,
 #endif // 0
@@ -474,9 +482,15 @@ int user_start(User *u) {
 
 #if 1 /// elogind has to prepare the XDG_RUNTIME_DIR by itself
         int r;
-        r = user_runtime_dir("start", u);
-        if (r < 0)
-                return r;
+        /* The user might still be torn down from logging out a moment ago. Then the runtime directory is set
+         * up once that is done, and replies to CreateSession() are held back until then. */
+        if (user_teardown_pending(u))
+                u->runtime_dir_pending = true;
+        else if (!u->runtime_dir_pending) {
+                r = user_runtime_dir("start", u);
+                if (r < 0)
+                        return r;
+        }
 #endif // 1
         /* Save the user data so far, because pam_elogind will read the XDG_RUNTIME_DIR out of it while starting up
          * systemd --user.  We need to do user_save_internal() because we have not "officially" started yet. */
@@ -585,11 +599,12 @@ int user_finalize(User *u) {
         }
 
 #if 1 /// elogind has to remove the XDG_RUNTIME_DIR by itself
-        /* Kill XDG_RUNTIME_DIR */
-        k = user_runtime_dir("stop", u);
+        /* Kill XDG_RUNTIME_DIR, and clean up IPC objects (see below), in a worker process */
+        k = user_teardown_start(u);
         if (k < 0)
                 r = k;
 #endif // 1
+#if 0 /// elogind cleans IPC objects in the teardown worker, see user_teardown_start()
         /* Clean SysV + POSIX IPC objects, but only if this is not a system user. Background: in many setups cronjobs
          * are run in full PAM and thus logind sessions, even if the code run doesn't belong to actual users but to
          * system components. Since enable RemoveIPC= globally for all users, we need to be a bit careful with such
@@ -601,7 +616,11 @@ int user_finalize(User *u) {
                 if (k < 0)
                         r = k;
         }
+#endif // 0
 
+#if 1 /// elogind publishes its state files for sd-login in shared memory, see logind-shm.c
+        manager_login_shm_file_changed(u->manager, u->state_file);
+#endif // 1
         (void) unlink(u->state_file);
         user_add_to_gc_queue(u);
 
@@ -620,6 +639,15 @@ int user_get_idle_hint(User *u, dual_timestamp *t) {
 
         assert(u);
 
+#if 1 /// elogind keeps the idle hint gathered from the sessions, see session_invalidate_idle_hint()
+        if (u->idle_hint_cached) {
+                if (t)
+                        *t = u->idle_hint_timestamp;
+
+                return u->idle_hint;
+        }
+#endif // 1
+
         LIST_FOREACH(sessions_by_user, s, u->sessions) {
                 dual_timestamp k;
                 int ih;
@@ -646,6 +674,11 @@ int user_get_idle_hint(User *u, dual_timestamp *t) {
         if (t)
                 *t = ts;
 
+#if 1 /// see above
+        u->idle_hint = idle_hint;
+        u->idle_hint_timestamp = ts;
+        u->idle_hint_cached = true;
+#endif // 1
         return idle_hint;
 }
 
@@ -43,10 +43,19 @@ struct User {
         /* Set up when the last session of the user logs out */
         sd_event_source *timer_event_source;
 
+#if 1 /// elogind keeps the idle hint gathered from the sessions, see session_invalidate_idle_hint()
+        bool idle_hint_cached;
+        bool idle_hint;
+        dual_timestamp idle_hint_timestamp;
+#endif // 1
+
         bool in_gc_queue:1;
 
         bool started:1;       /* Whenever the user being started, has been started or is being stopped again. */
         bool stopping:1;      /* Whenever the user is being stopped or has been stopped. */
+#if 1 /// elogind tears down users in worker processes, see user_teardown_start()
+        bool runtime_dir_pending:1; /* Whenever the runtime directory waits for a teardown to finish */
+#endif // 1
 
         LIST_HEAD(Session, sessions);
         LIST_FIELDS(User, gc_queue);
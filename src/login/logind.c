@@ -36,11 +36,17 @@
 #include "terminal-util.h"
 /// Additional includes needed by elogind
 #include "cgroup.h"       // From src/core/
+#include "device-monitor-private.h"
+#include "device-private.h"
 #include "label.h"
 #include "musl_missing.h"
 #include "udev-util.h"
 #include "user-util.h"
 
+#if 1 /// elogind remembers polkit decisions for a short while, see bus_polkit_cache_new()
+#define POLKIT_CACHE_TTL_USEC (5 * USEC_PER_SEC)
+#endif // 1
+
 static Manager* manager_unref(Manager *m);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Manager*, manager_unref);
 
@@ -60,6 +66,9 @@ static int manager_new(Manager **ret) {
                 .reserve_vt_fd = -1,
                 .idle_action_not_before_usec = now(CLOCK_MONOTONIC),
 #endif // 0
+#if 1 /// elogind kills the processes of stopped sessions in bulk, see logind-kill.c
+                .session_kill_timeout_usec = SESSION_KILL_TIMEOUT_USEC,
+#endif // 1
         };
 
         m->devices = hashmap_new(&string_hash_ops);
@@ -132,9 +141,21 @@ static Manager* manager_unref(Manager *m) {
         while ((s = hashmap_first(m->seats)))
                 seat_free(s);
 
+#if 1 /// elogind hands out pipes rather than FIFOs, which have to be passed on when restarting
+        /* Inhibitors held through a pipe that have no state file yet get one now, so that the next instance
+         * knows about them */
+        manager_save_inhibitors(m);
+        sd_event_source_unref(m->inhibitor_save_event_source);
+        if (m->do_interrupt)
+                (void) manager_hand_over_inhibitors(m);
+#endif // 1
         while ((i = hashmap_first(m->inhibitors)))
                 inhibitor_free(i);
 
+#if 1 /// elogind keeps track of external displays, see logind-drm.c
+        hashmap_free_with_destructor(m->drm_connectors, drm_connector_free);
+#endif // 1
+
         while ((b = hashmap_first(m->buttons)))
                 button_free(b);
 
@@ -146,6 +167,20 @@ static Manager* manager_unref(Manager *m) {
         hashmap_free(m->inhibitors);
         hashmap_free(m->buttons);
         hashmap_free(m->brightness_writers);
+#if 1 /// elogind tears down users in worker processes, see user_teardown_start()
+        hashmap_free(m->user_teardowns);
+#endif // 1
+#if 1 /// elogind restores its state from a single snapshot where it can, see logind-snapshot.c
+        state_snapshot_free(m->state_snapshot);
+        sd_event_source_unref(m->state_snapshot_event_source);
+#endif // 1
+#if 1 /// elogind kills the processes of stopped sessions in bulk, see logind-kill.c
+        hashmap_free(m->session_kills);
+        sd_event_source_unref(m->session_kill_event_source);
+#endif // 1
+#if 1 /// elogind publishes its state files for sd-login in shared memory, see logind-shm.c
+        manager_stop_login_shm(m);
+#endif // 1
 
 #if 0 /// elogind does not support systemd units.
         hashmap_free(m->user_units);
@@ -153,6 +188,9 @@ static Manager* manager_unref(Manager *m) {
 #endif // 0
 
         sd_event_source_unref(m->idle_action_event_source);
+#if 1 /// elogind caches the tty atime of non-graphical sessions, see manager_refresh_tty_atimes()
+        sd_event_source_unref(m->tty_atime_event_source);
+#endif // 1
         sd_event_source_unref(m->inhibit_timeout_source);
         sd_event_source_unref(m->scheduled_shutdown_timeout_source);
         sd_event_source_unref(m->nologin_timeout_source);
@@ -167,15 +205,42 @@ static Manager* manager_unref(Manager *m) {
 
         safe_close(m->console_active_fd);
 
+#if 0 /// elogind receives all uevents on one monitor
         sd_device_monitor_unref(m->device_seat_monitor);
         sd_device_monitor_unref(m->device_monitor);
         sd_device_monitor_unref(m->device_vcsa_monitor);
         sd_device_monitor_unref(m->device_button_monitor);
+#else // 0
+        if (m->device_monitor) {
+                DeviceMonitorStats stats;
+                DeviceCacheStats cache_stats;
+
+                device_monitor_get_stats(m->device_monitor, &stats);
+                log_debug("Received %" PRIu64 " uevents in %" PRIu64 " wakeups, %" PRIu64 " receive buffer overruns.",
+                          stats.n_received, stats.n_wakeups, stats.n_overflows);
+
+                device_cache_get_stats(&cache_stats);
+                log_debug("Device cache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " invalidations.",
+                          cache_stats.n_hits, cache_stats.n_misses, cache_stats.n_invalidations);
+                device_cache_disable();
+                log_debug("Dispatched %" PRIu64 " uevents: %" PRIu64 " to seats, %" PRIu64 " to devices, %" PRIu64 " to buttons, %" PRIu64 " to displays, %" PRIu64 " to device ACLs.",
+                          m->udev_n_received,
+                          m->udev_n_dispatched[MANAGER_UDEV_SEAT],
+                          m->udev_n_dispatched[MANAGER_UDEV_DEVICE],
+                          m->udev_n_dispatched[MANAGER_UDEV_BUTTON],
+                          m->udev_n_dispatched[MANAGER_UDEV_DRM],
+                          m->udev_n_dispatched[MANAGER_UDEV_UACCESS]);
+        }
+        sd_device_monitor_unref(m->device_monitor);
+#endif // 0
 
         if (m->unlink_nologin)
                 (void) unlink_or_warn("/run/nologin");
 
         bus_verify_polkit_async_registry_free(m->polkit_registry);
+#if 1 /// elogind remembers polkit decisions for a short while, see bus_polkit_cache_new()
+        bus_polkit_cache_free(m->polkit_cache);
+#endif // 1
 
         sd_bus_flush_close_unref(m->bus);
         sd_event_unref(m->event);
@@ -629,6 +694,98 @@ static int manager_dispatch_button_udev(sd_device_monitor *monitor, sd_device *d
         return 0;
 }
 
+#if 1 /// elogind keeps track of external displays, see logind-drm.c
+static int manager_dispatch_drm_udev(sd_device_monitor *monitor, sd_device *device, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+        assert(device);
+
+        (void) manager_process_drm_device(m, device);
+        return 0;
+}
+#endif // 1
+
+#if 1 /// elogind keeps an index of each seat's uaccess device nodes, see seat_apply_acls()
+static int manager_dispatch_uaccess_udev(sd_device_monitor *monitor, sd_device *device, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+        assert(device);
+
+        (void) manager_process_uaccess_device(m, device);
+        return 0;
+}
+#endif // 1
+
+#if 1 /// elogind receives all uevents on one monitor, and routes them to their handlers itself
+static const sd_device_monitor_handler_t manager_udev_handlers[_MANAGER_UDEV_HANDLER_MAX] = {
+        [MANAGER_UDEV_SEAT]    = manager_dispatch_seat_udev,
+        [MANAGER_UDEV_DEVICE]  = manager_dispatch_device_udev,
+        [MANAGER_UDEV_BUTTON]  = manager_dispatch_button_udev,
+        [MANAGER_UDEV_DRM]     = manager_dispatch_drm_udev,
+        [MANAGER_UDEV_UACCESS] = manager_dispatch_uaccess_udev,
+};
+
+static bool manager_udev_handler_wants(Manager *m, ManagerUdevHandler h, sd_device *d) {
+        const char *subsystem;
+
+        assert(m);
+        assert(d);
+
+        /* These mirror the filters the separate monitors used to have */
+        switch (h) {
+
+        case MANAGER_UDEV_SEAT:
+                return sd_device_has_tag(d, "master-of-seat") > 0;
+
+        case MANAGER_UDEV_DEVICE:
+                /* The seat handler processes a device in exactly the same way, don't do that twice */
+                return sd_device_get_subsystem(d, &subsystem) >= 0 &&
+                       STR_IN_SET(subsystem, "input", "graphics", "drm") &&
+                       !manager_udev_handler_wants(m, MANAGER_UDEV_SEAT, d);
+
+        case MANAGER_UDEV_BUTTON:
+                /* Don't watch keys if nobody cares */
+                return !manager_all_buttons_ignored(m) &&
+                       sd_device_get_subsystem(d, &subsystem) >= 0 &&
+                       streq(subsystem, "input") &&
+                       sd_device_has_tag(d, "power-switch") > 0;
+
+        case MANAGER_UDEV_DRM:
+                /* Cards and their connectors, for the table of external displays */
+                return sd_device_get_subsystem(d, &subsystem) >= 0 &&
+                       streq(subsystem, "drm");
+
+        case MANAGER_UDEV_UACCESS:
+                /* Not only the current tag: a device that just lost it must be dropped from the index */
+                return sd_device_has_tag(d, "uaccess") > 0;
+
+        default:
+                assert_not_reached("Unknown udev handler");
+        }
+}
+
+static int manager_dispatch_udev(sd_device_monitor *monitor, sd_device *device, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+        assert(device);
+
+        m->udev_n_received++;
+
+        for (ManagerUdevHandler h = 0; h < _MANAGER_UDEV_HANDLER_MAX; h++) {
+                if (!manager_udev_handler_wants(m, h, device))
+                        continue;
+
+                m->udev_n_dispatched[h]++;
+                (void) manager_udev_handlers[h](monitor, device, m);
+        }
+
+        return 0;
+}
+#endif // 1
+
 static int manager_dispatch_console(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         Manager *m = userdata;
 
@@ -712,6 +869,12 @@ static int manager_connect_bus(Manager *m) {
                 return log_error_errno(r, "Failed to enable subscription: %m");
 #endif // 0
 
+#if 1 /// elogind remembers polkit decisions for a short while, see bus_polkit_cache_new()
+        r = bus_polkit_cache_new(&m->polkit_cache, m->bus, POLKIT_CACHE_TTL_USEC);
+        if (r < 0)
+                return log_error_errno(r, "Failed to set up polkit decision cache: %m");
+#endif // 1
+
         r = sd_bus_request_name_async(m->bus, NULL, "org.freedesktop.login1", 0, NULL, NULL);
         if (r < 0)
                 return log_error_errno(r, "Failed to request name: %m");
@@ -843,6 +1006,7 @@ static int manager_connect_console(Manager *m) {
         return 0;
 }
 
+#if 0 /// elogind receives all uevents on one monitor, and routes them to their handlers itself
 static int manager_connect_udev(Manager *m) {
         int r;
 
@@ -947,6 +1111,65 @@ static int manager_connect_udev(Manager *m) {
 
         return 0;
 }
+#else // 0
+static int manager_connect_udev(Manager *m) {
+        const char *subsystem;
+        int r;
+
+        assert(m);
+        assert(!m->device_monitor);
+
+        /* One socket, one receive and one parse per uevent, instead of one for each monitor the uevent
+         * matches. The filter is the union of what the handlers in manager_udev_handlers[] want: everything
+         * tagged "master-of-seat" or "uaccess", and everything of the subsystems below. Power switches are
+         * input devices, hence covered already. manager_dispatch_udev() then picks the handlers for each
+         * device. */
+        r = sd_device_monitor_new(&m->device_monitor);
+        if (r < 0)
+                return r;
+
+        r = device_monitor_filter_match_either(m->device_monitor, true);
+        if (r < 0)
+                return r;
+
+        /* A dock or hub being plugged in results in bursts of uevents, don't wake up for each of them */
+        r = sd_device_monitor_set_receive_batch(m->device_monitor, true);
+        if (r < 0)
+                return r;
+
+        r = sd_device_monitor_filter_add_match_tag(m->device_monitor, "master-of-seat");
+        if (r < 0)
+                return r;
+
+        r = sd_device_monitor_filter_add_match_tag(m->device_monitor, "uaccess");
+        if (r < 0)
+                return r;
+
+        FOREACH_STRING(subsystem, "input", "graphics", "drm") {
+                r = sd_device_monitor_filter_add_match_subsystem_devtype(m->device_monitor, subsystem, NULL);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_device_monitor_attach_event(m->device_monitor, m->event);
+        if (r < 0)
+                return r;
+
+        r = sd_device_monitor_start(m->device_monitor, manager_dispatch_udev, m);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(sd_device_monitor_get_event_source(m->device_monitor), "logind-device-monitor");
+
+        /* Seats, their devices and the lid and docking state are looked up over and over again, let's only
+         * do so again when the monitor above tells us something changed. */
+        r = device_cache_enable(m->device_monitor);
+        if (r < 0)
+                return r;
+
+        return 0;
+}
+#endif // 0
 
 static void manager_gc(Manager *m, bool drop_not_started) {
         Seat *seat;
@@ -1123,6 +1346,9 @@ static int manager_startup(Manager *m) {
                 log_warning_errno(r, "Failed to set up lid switch ignore event source: %m");
 
         /* Deserialize state */
+#if 1 /// elogind restores its state from a single snapshot where it can, see logind-snapshot.c
+        (void) manager_load_state_snapshot(m);
+#endif // 1
         r = manager_enumerate_devices(m);
         if (r < 0)
                 log_warning_errno(r, "Device enumeration failed: %m");
@@ -1143,10 +1369,25 @@ static int manager_startup(Manager *m) {
         if (r < 0)
                 log_warning_errno(r, "Inhibitor enumeration failed: %m");
 
+#if 1 /// elogind hands out pipes rather than FIFOs, which are passed on when restarting
+        (void) manager_take_over_inhibitors(m);
+#endif // 1
+
+#if 1 /// elogind restores its state from a single snapshot where it can, see logind-snapshot.c
+        manager_drop_state_snapshot(m);
+        (void) manager_schedule_state_snapshot(m);
+#endif // 1
+
         r = manager_enumerate_buttons(m);
         if (r < 0)
                 log_warning_errno(r, "Button enumeration failed: %m");
 
+#if 1 /// elogind keeps track of external displays, see logind-drm.c
+        r = manager_enumerate_drm_connectors(m);
+        if (r < 0)
+                log_warning_errno(r, "Display connector enumeration failed, counting displays on demand: %m");
+#endif // 1
+
         /* Remove stale objects before we start them */
         manager_gc(m, false);
 
@@ -1181,6 +1422,10 @@ static int manager_startup(Manager *m) {
         HASHMAP_FOREACH(button, m->buttons)
                 button_check_switches(button);
 
+#if 1 /// elogind publishes its state files for sd-login in shared memory, see logind-shm.c
+        (void) manager_start_login_shm(m);
+#endif // 1
+
         manager_dispatch_idle_action(NULL, 0, m);
 
         return 0;
@@ -1206,6 +1451,9 @@ static int manager_run(Manager *m) {
                 if (r > 0)
                         continue;
 
+#if 1 /// elogind writes out queued log messages before the event loop goes idle
+                log_flush();
+#endif // 1
                 r = sd_event_run(m->event, UINT64_MAX);
                 if (r < 0)
                         return r;
@@ -1229,6 +1477,11 @@ static int run(int argc, char *argv[]) {
                 return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
         }
         // If we forked, we are in the grandchild, the daemon, now.
+
+        /* Only the daemon queues its log messages, and only if asked to. Errors are never delayed. */
+        const char *e = getenv("SYSTEMD_LOG_BUFFER");
+        if (e && log_set_buffered_from_string(e) < 0)
+                log_warning("Failed to parse log buffer setting '%s'. Ignoring.", e);
 #endif // 1
 
 #if 0 /// This is elogind
@@ -1321,7 +1574,15 @@ static int run(int argc, char *argv[]) {
 #endif // 1
 
         notify_message = notify_start(NOTIFY_READY, NOTIFY_STOPPING);
+#if 0 /// elogind leaves a snapshot of its state behind, to start up faster next time
         return manager_run(m);
+#else // 0
+        r = manager_run(m);
+
+        (void) manager_write_state_snapshot(m);
+
+        return r;
+#endif // 0
 }
 
 DEFINE_MAIN_FUNCTION(run);
@@ -24,8 +24,14 @@ typedef struct Manager Manager;
 #include "logind-inhibit.h"
 
 /// Additional includes needed by elogind
+#include "bus-polkit.h"
 #include "cgroup-util.h"
 #include "elogind.h"
+#include "login-shm.h"
+#include "logind-drm.h"
+#include "logind-kill.h"
+#include "logind-shm.h"
+#include "logind-snapshot.h"
 #include "musl_missing.h"
 #include "sleep-config.h"
 
@@ -35,6 +41,17 @@ typedef struct Manager Manager;
 #define MANAGER_IS_TEST_RUN(m) (  (m)->test_run_flags != 0)
 #define MANAGER_IS_USER(m)     (!((m)->is_system))
 #endif // 1
+
+#if 1 /// elogind receives all uevents on one monitor, and routes them to these handlers itself
+typedef enum ManagerUdevHandler {
+        MANAGER_UDEV_SEAT,
+        MANAGER_UDEV_DEVICE,
+        MANAGER_UDEV_BUTTON,
+        MANAGER_UDEV_DRM,
+        MANAGER_UDEV_UACCESS,
+        _MANAGER_UDEV_HANDLER_MAX,
+} ManagerUdevHandler;
+#endif // 1
 struct Manager {
         sd_event *event;
         sd_bus *bus;
@@ -47,12 +64,49 @@ struct Manager {
         Hashmap *inhibitors;
         Hashmap *buttons;
         Hashmap *brightness_writers;
+#if 1 /// elogind keeps track of external displays, see logind-drm.c
+        Hashmap *drm_connectors;
+        unsigned n_drm_connectors_connected;
+        bool drm_connectors_enumerated;
+#endif // 1
+#if 1 /// elogind tears down users in worker processes, see user_teardown_start()
+        Hashmap *user_teardowns; /* indexed by UID */
+        usec_t user_teardown_last_usec;
+        usec_t user_teardown_max_usec;
+#endif // 1
+#if 1 /// elogind writes the state files of inhibitors held through a pipe in batches, see logind-inhibit.c
+        sd_event_source *inhibitor_save_event_source;
+#endif // 1
+#if 1 /// elogind restores its state from a single snapshot where it can, see logind-snapshot.c
+        StateSnapshot *state_snapshot;
+        sd_event_source *state_snapshot_event_source;
+#endif // 1
+#if 1 /// elogind kills the processes of stopped sessions in bulk, see logind-kill.c
+        Hashmap *session_kills; /* indexed by session ID */
+        sd_event_source *session_kill_event_source;
+        usec_t session_kill_timeout_usec;
+#endif // 1
+#if 1 /// elogind publishes its state files for sd-login in shared memory, see logind-shm.c
+        LoginShm *login_shm;
+        Hashmap *login_shm_files; /* indexed by path */
+        Set *login_shm_dirty;
+        sd_event_source *login_shm_event_source;
+        usec_t login_shm_last_publish;
+        unsigned login_generation_dirty; /* mask of categories, see logind-shm.c */
+        bool login_generation_created;
+#endif // 1
 
         LIST_HEAD(Seat, seat_gc_queue);
         LIST_HEAD(Session, session_gc_queue);
         LIST_HEAD(User, user_gc_queue);
 
+#if 0 /// elogind receives all uevents on one monitor, and routes them to their handlers itself
         sd_device_monitor *device_seat_monitor, *device_monitor, *device_vcsa_monitor, *device_button_monitor;
+#else // 0
+        sd_device_monitor *device_monitor;
+        uint64_t udev_n_received;
+        uint64_t udev_n_dispatched[_MANAGER_UDEV_HANDLER_MAX];
+#endif // 0
 
         sd_event_source *console_active_event_source;
 
@@ -161,6 +215,18 @@ struct Manager {
         usec_t idle_action_usec;
         usec_t idle_action_not_before_usec;
         HandleAction idle_action;
+#if 1 /// elogind caches the tty atime of non-graphical sessions, see manager_refresh_tty_atimes()
+        sd_event_source *tty_atime_event_source;
+        bool tty_atime_used;
+        uint64_t tty_atime_n_passes;
+        uint64_t tty_atime_n_refreshes;
+        usec_t tty_atime_refresh_usec;
+
+        /* The idle hint gathered from the sessions, without looking at inhibitors */
+        bool idle_hint_cached;
+        bool idle_hint;
+        dual_timestamp idle_hint_timestamp;
+#endif // 1
 
         HandleAction handle_power_key;
         HandleAction handle_suspend_key;
@@ -179,6 +245,9 @@ struct Manager {
         bool remove_ipc;
 
         Hashmap *polkit_registry;
+#if 1 /// elogind remembers polkit decisions for a short while, see bus_polkit_cache_new()
+        BusPolkitCache *polkit_cache;
+#endif // 1
 
         usec_t holdoff_timeout_usec;
         sd_event_source *lid_switch_ignore_event_source;
@@ -209,12 +278,20 @@ int manager_add_inhibitor(Manager *m, const char* id, Inhibitor **ret_inhibitor)
 
 int manager_process_seat_device(Manager *m, sd_device *d);
 int manager_process_button_device(Manager *m, sd_device *d);
+#if 1 /// elogind keeps an index of each seat's uaccess device nodes, see seat_apply_acls()
+int manager_process_uaccess_device(Manager *m, sd_device *d);
+#endif // 1
 
 int manager_spawn_autovt(Manager *m, unsigned vtnr);
 
 bool manager_shall_kill(Manager *m, const char *user);
 
 int manager_get_idle_hint(Manager *m, dual_timestamp *t);
+#if 1 /// elogind caches the tty atime of non-graphical sessions, see manager_refresh_tty_atimes()
+void manager_refresh_tty_atimes(Manager *m);
+void manager_drop_tty_atimes(Manager *m);
+int manager_schedule_tty_atime_refresh(Manager *m);
+#endif // 1
 
 int manager_get_user_by_pid(Manager *m, pid_t pid, User **user);
 int manager_get_session_by_pid(Manager *m, pid_t pid, Session **session);
@@ -0,0 +1,164 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <unistd.h>
+
+#include "acl-util.h"
+#include "device-private.h"
+#include "fileio.h"
+#include "logind.h"
+#include "logind-seat.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "user-util.h"
+
+static void send_event(Manager *m, const char *action, const char *name, const char *seat) {
+        _cleanup_(sd_device_unrefp) sd_device *d = NULL;
+        _cleanup_free_ char *nulstr = NULL;
+        size_t len;
+
+        /* The same as what the device monitor would pass on */
+        assert_se(asprintf(&nulstr,
+                           "ACTION=%s|DEVPATH=/devices/virtual/misc/%s|SUBSYSTEM=misc|DEVNAME=%s|SEQNUM=1|"
+                           "TAGS=:uaccess:|CURRENT_TAGS=:uaccess:|%s%s%s",
+                           action, name, name,
+                           seat ? "ID_SEAT=" : "", strempty(seat), seat ? "|" : "") >= 0);
+        len = strlen(nulstr);
+        for (char *p = nulstr; *p; p++)
+                if (*p == '|')
+                        *p = '\0';
+
+        assert_se(device_new_from_nulstr(&d, (uint8_t*) nulstr, len) >= 0);
+        assert_se(manager_process_uaccess_device(m, d) >= 0);
+}
+
+static bool node_has_acl(const char *name, uid_t uid) {
+        _cleanup_(acl_freep) acl_t acl = NULL;
+        char path[PATH_MAX];
+        acl_entry_t entry;
+        int r;
+
+        xsprintf(path, "/dev/%s", name);
+        assert_se(acl = acl_get_file(path, ACL_TYPE_ACCESS));
+        r = acl_find_uid(acl, uid, &entry);
+        assert_se(r >= 0);
+
+        return r > 0;
+}
+
+static void assert_index(Seat *s, unsigned n_nodes, uid_t uid) {
+        const char *n;
+        void *v;
+
+        assert_se(hashmap_size(s->uaccess_nodes) == n_nodes);
+        HASHMAP_FOREACH_KEY(v, n, s->uaccess_nodes)
+                assert_se(PTR_TO_UID(v) == uid);
+}
+
+static void test_seat_acls(void) {
+        _cleanup_(user_record_unrefp) UserRecord *ra = NULL, *rb = NULL, *rr = NULL;
+        Manager m = {};
+        User a = {}, b = {}, root = {};
+        Session sa = { .user = &a }, sb = { .user = &b }, sb2 = { .user = &b }, sr = { .user = &root };
+        Seat *s;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(ra = user_record_new());
+        ra->uid = 1000;
+        a.user_record = ra;
+        assert_se(rb = user_record_new());
+        rb->uid = 1001;
+        b.user_record = rb;
+        assert_se(rr = user_record_new());
+        rr->uid = 0;
+        root.user_record = rr;
+
+        assert_se(m.seats = hashmap_new(&string_hash_ops));
+        assert_se(seat_new(&s, &m, "seat0") >= 0);
+
+        /* As if enumerated on a system without any uaccess devices */
+        s->uaccess_enumerated = true;
+
+        assert_se(write_string_file("/dev/test-uaccess0", "", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(write_string_file("/dev/test-uaccess1", "", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(write_string_file("/dev/test-uaccess2", "", WRITE_STRING_FILE_CREATE) >= 0);
+
+        send_event(&m, "add", "test-uaccess0", NULL);
+        send_event(&m, "add", "test-uaccess1", "seat0");
+        send_event(&m, "add", "test-uaccess2", "seat1");
+        assert_index(s, 2, UID_INVALID);
+
+        s->active = &sa;
+        assert_se(seat_apply_acls(s, NULL) >= 0);
+        assert_index(s, 2, 1000);
+        assert_se(node_has_acl("test-uaccess0", 1000));
+        assert_se(node_has_acl("test-uaccess1", 1000));
+        assert_se(!node_has_acl("test-uaccess2", 1000));
+
+        s->active = &sb;
+        assert_se(seat_apply_acls(s, &sa) >= 0);
+        assert_index(s, 2, 1001);
+        assert_se(!node_has_acl("test-uaccess0", 1000));
+        assert_se(node_has_acl("test-uaccess0", 1001));
+        assert_se(!node_has_acl("test-uaccess1", 1000));
+        assert_se(node_has_acl("test-uaccess1", 1001));
+
+        /* Another session of the same user: nodes already set up are not touched, so a node that
+         * disappeared behind our back keeps its state */
+        assert_se(unlink("/dev/test-uaccess1") >= 0);
+        s->active = &sb2;
+        assert_se(seat_apply_acls(s, &sb) >= 0);
+        assert_index(s, 2, 1001);
+
+        /* udev ran its rules for a node again, so we no longer know about its ACL */
+        send_event(&m, "change", "test-uaccess0", NULL);
+        assert_se(PTR_TO_UID(hashmap_get(s->uaccess_nodes, "/dev/test-uaccess0")) == UID_INVALID);
+
+        s->active = &sa;
+        assert_se(seat_apply_acls(s, &sb2) >= 0);
+        assert_se(node_has_acl("test-uaccess0", 1000));
+        assert_se(!node_has_acl("test-uaccess0", 1001));
+
+        /* Nobody active, and then root: devnode_acl() leaves root alone, but the nodes must not be taken
+         * to be set up for root already while nobody was active */
+        assert_se(write_string_file("/dev/test-uaccess1", "", WRITE_STRING_FILE_CREATE) >= 0);
+        s->active = NULL;
+        assert_se(seat_apply_acls(s, &sa) >= 0);
+        assert_index(s, 2, UID_INVALID);
+        assert_se(!node_has_acl("test-uaccess0", 1000));
+
+        s->active = &sr;
+        assert_se(seat_apply_acls(s, NULL) >= 0);
+        assert_index(s, 2, 0);
+
+        /* Removed nodes, and nodes moved to another seat, leave the index */
+        send_event(&m, "remove", "test-uaccess1", NULL);
+        assert_se(hashmap_size(s->uaccess_nodes) == 1);
+        send_event(&m, "change", "test-uaccess0", "seat1");
+        assert_se(hashmap_isempty(s->uaccess_nodes));
+        send_event(&m, "change", "test-uaccess2", NULL);
+        assert_se(hashmap_size(s->uaccess_nodes) == 1);
+
+        s->active = NULL;
+        seat_free(s);
+        hashmap_free(m.seats);
+}
+
+int main(int argc, char *argv[]) {
+        int r;
+
+        test_setup_logging(LOG_DEBUG);
+
+        /* Run on a /dev of our own */
+        r = safe_fork_with_mount("(test-logind-acl)", "tmpfs", "/dev", "tmpfs", 0, "mode=0755");
+        if (r == -EPERM)
+                return log_tests_skipped("not root");
+        assert_se(r >= 0);
+        if (r == 0) {
+                test_seat_acls();
+                _exit(EXIT_SUCCESS);
+        }
+
+        return 0;
+}
@@ -0,0 +1,199 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <sys/mount.h>
+#include <unistd.h>
+
+#include "device-private.h"
+#include "fileio.h"
+#include "logind-drm.h"
+#include "logind.h"
+#include "mkdir.h"
+#include "process-util.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+#define CARD "/devices/pci0000:00/0000:00:02.0/drm/card0"
+
+static void create_device(const char *root, const char *devpath, const char *status, const char *enabled) {
+        char path[PATH_MAX];
+
+        xsprintf(path, "%s%s", root, devpath);
+        assert_se(mkdir_p(path, 0755) >= 0);
+
+        xsprintf(path, "%s%s/uevent", root, devpath);
+        assert_se(write_string_file(path, "", WRITE_STRING_FILE_CREATE) >= 0);
+
+        xsprintf(path, "%s%s/subsystem", root, devpath);
+        (void) unlink(path);
+        assert_se(symlink("/sys/class/drm", path) >= 0);
+
+        if (status) {
+                xsprintf(path, "%s%s/status", root, devpath);
+                assert_se(write_string_file(path, status, WRITE_STRING_FILE_CREATE) >= 0);
+        }
+
+        if (enabled) {
+                xsprintf(path, "%s%s/enabled", root, devpath);
+                assert_se(write_string_file(path, enabled, WRITE_STRING_FILE_CREATE) >= 0);
+        }
+}
+
+static void create_connector(const char *root, const char *name, const char *status, const char *enabled) {
+        char devpath[PATH_MAX], link[PATH_MAX], target[PATH_MAX];
+
+        xsprintf(devpath, CARD "/%s", name);
+        create_device(root, devpath, status, enabled);
+
+        xsprintf(link, "%s/class/drm/%s", root, name);
+        xsprintf(target, "../../devices/pci0000:00/0000:00:02.0/drm/card0/%s", name);
+        assert_se(symlink(target, link) >= 0);
+}
+
+static void send_event(Manager *m, const char *action, const char *devpath) {
+        _cleanup_(sd_device_unrefp) sd_device *d = NULL;
+        _cleanup_free_ char *nulstr = NULL;
+        size_t len;
+
+        /* The same as what the device monitor would pass on */
+        assert_se(asprintf(&nulstr, "ACTION=%s|DEVPATH=%s|SUBSYSTEM=drm|SEQNUM=1|", action, devpath) >= 0);
+        len = strlen(nulstr);
+        for (char *p = nulstr; *p; p++)
+                if (*p == '|')
+                        *p = '\0';
+
+        assert_se(device_new_from_nulstr(&d, (uint8_t*) nulstr, len) >= 0);
+
+        /* As the device monitor would, if the device cache is enabled */
+        device_cache_invalidate(strjoina("/sys", devpath));
+
+        assert_se(manager_process_drm_device(m, d) >= 0);
+}
+
+static void assert_displays(Manager *m, unsigned n_connectors, unsigned n_connected, int n_in_use) {
+        log_info("%u connectors, %u connected, %i in use",
+                 hashmap_size(m->drm_connectors), m->n_drm_connectors_connected, manager_count_drm_connectors_in_use(m));
+
+        assert_se(hashmap_size(m->drm_connectors) == n_connectors);
+        assert_se(m->n_drm_connectors_connected == n_connected);
+        assert_se(manager_count_drm_connectors_in_use(m) == n_in_use);
+
+        /* The table must agree with enumerating everything */
+        m->drm_connectors_enumerated = false;
+        assert_se(manager_is_docked_or_external_displays(m) == (n_in_use > 0));
+        m->drm_connectors_enumerated = true;
+        assert_se(manager_is_docked_or_external_displays(m) == (n_in_use > 0));
+}
+
+static void test_drm_connectors(const char *root, bool cached) {
+        _cleanup_(sd_device_monitor_unrefp) sd_device_monitor *monitor = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *event = NULL;
+        Manager m = {};
+        char path[PATH_MAX];
+
+        log_info("/* %s(%s) */", __func__, cached ? "cached" : "uncached");
+
+        assert_se(rm_rf(root, REMOVE_PHYSICAL) >= 0);
+
+        /* As logind does, see manager_connect_udev() */
+        if (cached) {
+                assert_se(sd_event_default(&event) >= 0);
+                assert_se(sd_device_monitor_new(&monitor) >= 0);
+                assert_se(sd_device_monitor_filter_add_match_subsystem_devtype(monitor, "drm", NULL) >= 0);
+                assert_se(sd_device_monitor_attach_event(monitor, event) >= 0);
+                assert_se(sd_device_monitor_start(monitor, NULL, NULL) >= 0);
+                assert_se(device_cache_enable(monitor) > 0);
+        }
+
+        /* A card with an internal display, and two external connectors with nothing plugged in */
+        xsprintf(path, "%s/bus", root);
+        assert_se(mkdir_p(path, 0755) >= 0);
+        xsprintf(path, "%s/class/drm", root);
+        assert_se(mkdir_p(path, 0755) >= 0);
+
+        create_device(root, CARD, NULL, NULL);
+        assert_se(symlink("../../devices/pci0000:00/0000:00:02.0/drm/card0", strjoina(root, "/class/drm/card0")) >= 0);
+        create_connector(root, "card0-eDP-1", "connected", "enabled");
+        create_connector(root, "card0-HDMI-A-1", "disconnected", "disabled");
+        create_connector(root, "card0-DP-1", "disconnected", "disabled");
+
+        assert_se(manager_enumerate_drm_connectors(&m) >= 0);
+        assert_se(m.drm_connectors_enumerated);
+        assert_displays(&m, 2, 0, 0);
+
+        /* A display is plugged in, the card tells us, but it is not used yet */
+        xsprintf(path, "%s" CARD "/card0-HDMI-A-1/status", root);
+        assert_se(write_string_file(path, "connected", 0) >= 0);
+        send_event(&m, "change", CARD);
+        assert_displays(&m, 2, 1, 0);
+
+        /* Setting a mode is not announced, but must be noticed nonetheless */
+        xsprintf(path, "%s" CARD "/card0-HDMI-A-1/enabled", root);
+        assert_se(write_string_file(path, "enabled", 0) >= 0);
+        assert_displays(&m, 2, 1, 1);
+
+        /* A DP MST hub adds a connector of its own */
+        create_connector(root, "card0-DP-2", "connected", "enabled");
+        send_event(&m, "add", CARD "/card0-DP-2");
+        assert_displays(&m, 3, 2, 2);
+
+        /* Events of the internal display are of no concern */
+        send_event(&m, "change", CARD "/card0-eDP-1");
+        assert_displays(&m, 3, 2, 2);
+
+        /* The hub is unplugged again */
+        xsprintf(path, "%s/class/drm/card0-DP-2", root);
+        assert_se(unlink(path) >= 0);
+        xsprintf(path, "%s" CARD "/card0-DP-2", root);
+        assert_se(rm_rf(path, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        send_event(&m, "remove", CARD "/card0-DP-2");
+        assert_displays(&m, 2, 1, 1);
+
+        /* And so is the display */
+        xsprintf(path, "%s" CARD "/card0-HDMI-A-1/status", root);
+        assert_se(write_string_file(path, "disconnected", 0) >= 0);
+        send_event(&m, "change", CARD);
+        assert_displays(&m, 2, 0, 0);
+
+        /* The card goes away, with all of its connectors */
+        send_event(&m, "remove", CARD);
+        assert_se(hashmap_isempty(m.drm_connectors));
+        assert_se(m.n_drm_connectors_connected == 0);
+
+        hashmap_free(m.drm_connectors);
+
+        if (cached) {
+                DeviceCacheStats stats;
+
+                /* Make sure the cache was in use at all */
+                device_cache_get_stats(&stats);
+                log_info("%" PRIu64 " cache hits, %" PRIu64 " misses", stats.n_hits, stats.n_misses);
+                assert_se(stats.n_hits > 0);
+                device_cache_disable();
+        }
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmpdir = NULL;
+        int r;
+
+        test_setup_logging(LOG_INFO);
+
+        if (getuid() != 0)
+                return log_tests_skipped("not root");
+
+        assert_se(mkdtemp_malloc("/tmp/test-logind-drm-XXXXXX", &tmpdir) >= 0);
+
+        /* Run on a synthetic sysfs */
+        r = safe_fork_with_mount("(test-logind-drm)", tmpdir, "/sys", NULL, MS_BIND, NULL);
+        assert_se(r >= 0);
+        if (r == 0) {
+                test_drm_connectors("/sys", false);
+                test_drm_connectors("/sys", true);
+                _exit(EXIT_SUCCESS);
+        }
+
+        return 0;
+}
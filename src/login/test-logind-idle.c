@@ -0,0 +1,178 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logind.h"
+#include "logind-session.h"
+#include "process-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "user-record.h"
+
+static Session *add_session(Manager *m, const char *id, SessionType type) {
+        Session *s;
+
+        assert_se(session_new(&s, m, id) >= 0);
+        s->type = type;
+
+        return s;
+}
+
+static void test_tty_atime_cache(void) {
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        unsigned n_sessions = slow_tests_enabled() ? 10000 : 1000;
+        Session *tty, *leader, *none, *x11, *s;
+        usec_t t_uncached, t_cached;
+        dual_timestamp ts;
+        Manager m = {
+                .idle_action_usec = 30 * USEC_PER_MINUTE,
+        };
+        struct stat st;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_event_default(&m.event) >= 0);
+        assert_se(m.sessions = hashmap_new(&string_hash_ops));
+
+        tty = add_session(&m, "tty", SESSION_TTY);
+        assert_se(tty->tty = strdup("null"));
+        leader = add_session(&m, "leader", SESSION_TTY);
+        leader->leader = getpid_cached();
+        none = add_session(&m, "none", SESSION_TTY);
+        x11 = add_session(&m, "x11", SESSION_X11);
+        x11->idle_hint = true;
+
+        /* The first look fills the cache, and arms the refresh timer */
+        assert_se(manager_get_idle_hint(&m, NULL) >= 0);
+        assert_se(m.tty_atime_n_refreshes == 3);
+        assert_se(m.tty_atime_event_source);
+        assert_se(tty->tty_atime_cached && leader->tty_atime_cached && none->tty_atime_cached);
+        assert_se(!x11->tty_atime_cached);
+        assert_se(none->tty_atime == USEC_INFINITY);
+
+        /* Later looks are served from it */
+        assert_se(manager_get_idle_hint(&m, NULL) >= 0);
+        assert_se(session_get_idle_hint(tty, &ts) >= 0);
+        assert_se(session_get_idle_hint(none, &ts) == 0);
+        assert_se(ts.realtime == 0);
+        assert_se(m.tty_atime_n_refreshes == 3);
+
+        assert_se(stat("/dev/null", &st) >= 0);
+        assert_se(session_get_idle_hint(tty, &ts) >= 0);
+        assert_se(ts.realtime == timespec_load(&st.st_atim));
+
+        /* Until the timer refreshes all of them at once */
+        manager_refresh_tty_atimes(&m);
+        assert_se(m.tty_atime_n_refreshes == 6);
+        assert_se(m.tty_atime_n_passes == 1);
+
+        while ((s = hashmap_first(m.sessions)))
+                session_free(s);
+
+        /* Many sessions whose leader's controlling tty has to be looked up */
+        for (unsigned i = 0; i < n_sessions; i++) {
+                char id[DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(id, "%u", i);
+                s = add_session(&m, id, SESSION_TTY);
+                s->leader = getpid_cached();
+        }
+
+        t_uncached = now(CLOCK_MONOTONIC);
+        assert_se(manager_get_idle_hint(&m, NULL) >= 0);
+        t_uncached = now(CLOCK_MONOTONIC) - t_uncached;
+
+        t_cached = now(CLOCK_MONOTONIC);
+        assert_se(manager_get_idle_hint(&m, NULL) >= 0);
+        t_cached = now(CLOCK_MONOTONIC) - t_cached;
+
+        log_info("IdleHint of %u tty sessions: %s uncached, %s cached.",
+                 n_sessions,
+                 format_timespan(a, sizeof(a), t_uncached, 1),
+                 format_timespan(b, sizeof(b), t_cached, 1));
+
+        while ((s = hashmap_first(m.sessions)))
+                session_free(s);
+
+        hashmap_free(m.sessions);
+        sd_event_source_unref(m.tty_atime_event_source);
+        sd_event_unref(m.event);
+}
+
+static void test_idle_hint_aggregates(void) {
+        _cleanup_(user_record_unrefp) UserRecord *ur = NULL;
+        Session *x11, *tty, *s;
+        dual_timestamp ts;
+        Manager m = {
+                .idle_action_usec = USEC_INFINITY,
+        };
+        User *u;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_event_default(&m.event) >= 0);
+        assert_se(m.users = hashmap_new(NULL));
+        assert_se(m.sessions = hashmap_new(&string_hash_ops));
+
+        assert_se(ur = user_record_new());
+        ur->uid = 4711;
+        assert_se(ur->user_name = strdup("test-user"));
+        assert_se(user_new(&u, &m, ur) >= 0);
+
+        x11 = add_session(&m, "x11", SESSION_X11);
+        session_set_user(x11, u);
+        tty = add_session(&m, "tty", SESSION_TTY);
+        assert_se(tty->tty = strdup("null"));
+        session_set_user(tty, u);
+
+        assert_se(user_get_idle_hint(u, NULL) == 0);
+        assert_se(manager_get_idle_hint(&m, NULL) == 0);
+        assert_se(u->idle_hint_cached && m.idle_hint_cached);
+
+        /* A session changing its idle hint is picked up by its user and the manager */
+        assert_se(session_set_idle_hint(x11, true) > 0);
+        assert_se(!u->idle_hint_cached && !m.idle_hint_cached);
+        assert_se(user_get_idle_hint(u, NULL) == 0);
+        assert_se(manager_get_idle_hint(&m, NULL) == 0);
+
+        /* As is a different IdleActionSec=, which makes the tty idle */
+        m.idle_action_usec = 1;
+        manager_drop_tty_atimes(&m);
+        assert_se(!u->idle_hint_cached && !m.idle_hint_cached);
+        assert_se(user_get_idle_hint(u, &ts) > 0);
+        assert_se(ts.realtime == MAX(x11->idle_hint_timestamp.realtime, tty->tty_atime));
+        assert_se(manager_get_idle_hint(&m, NULL) > 0);
+
+        /* As is a refresh of the tty atimes that tells otherwise */
+        m.idle_action_usec = USEC_INFINITY;
+        manager_refresh_tty_atimes(&m);
+        assert_se(!u->idle_hint_cached && !m.idle_hint_cached);
+        assert_se(user_get_idle_hint(u, NULL) == 0);
+        assert_se(manager_get_idle_hint(&m, NULL) == 0);
+
+        /* And a session that goes away */
+        session_free(tty);
+        assert_se(!u->idle_hint_cached && !m.idle_hint_cached);
+        assert_se(user_get_idle_hint(u, NULL) > 0);
+        assert_se(manager_get_idle_hint(&m, NULL) > 0);
+
+        while ((s = hashmap_first(m.sessions)))
+                session_free(s);
+
+        user_free(u);
+        hashmap_free(m.sessions);
+        hashmap_free(m.users);
+        sd_event_source_unref(m.tty_atime_event_source);
+        sd_event_unref(m.event);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_INFO);
+
+        test_tty_atime_cache();
+        test_idle_hint_aggregates();
+
+        return 0;
+}
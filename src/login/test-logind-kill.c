@@ -0,0 +1,255 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <signal.h>
+#include <sys/mount.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+#include "cgroup-setup.h"
+#include "cgroup-util.h"
+#include "fd-util.h"
+#include "logind.h"
+#include "logind-kill.h"
+#include "path-util.h"
+#include "process-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+
+#define N_PROCESSES 2
+
+static char *arg_parent = NULL;
+
+static char *session_cgroup(unsigned i) {
+        char *p;
+
+        assert_se(asprintf(&p, "%s/%u", arg_parent, i) >= 0);
+        assert_se(cg_create(SYSTEMD_CGROUP_CONTROLLER, p) >= 0);
+
+        return p;
+}
+
+static pid_t spawn_into(const char *cgroup, bool ignore_sigterm) {
+        _cleanup_close_pair_ int pipe_fds[2] = { -1, -1 };
+        pid_t pid;
+        char c;
+        int r;
+
+        assert_se(pipe2(pipe_fds, O_CLOEXEC) >= 0);
+
+        r = safe_fork("(test-process)", FORK_DEATHSIG, &pid);
+        assert_se(r >= 0);
+        if (r == 0) {
+                if (ignore_sigterm) {
+                        (void) prctl(PR_SET_PDEATHSIG, SIGKILL);
+                        assert_se(signal(SIGTERM, SIG_IGN) != SIG_ERR);
+                }
+
+                if (cg_attach(SYSTEMD_CGROUP_CONTROLLER, cgroup, 0) < 0)
+                        _exit(EXIT_FAILURE);
+
+                assert_se(write(pipe_fds[1], "x", 1) == 1);
+                for (;;)
+                        pause();
+        }
+
+        pipe_fds[1] = safe_close(pipe_fds[1]);
+        assert_se(read(pipe_fds[0], &c, 1) == 1);
+
+        return pid;
+}
+
+static void assert_killed_by(pid_t pid, int sig) {
+        siginfo_t si;
+
+        assert_se(wait_for_terminate(pid, &si) >= 0);
+        assert_se(si.si_code == CLD_KILLED);
+        assert_se(si.si_status == sig);
+}
+
+static bool cgroup_exists(const char *cgroup) {
+        _cleanup_free_ char *p = NULL;
+
+        assert_se(cg_get_path(SYSTEMD_CGROUP_CONTROLLER, cgroup, NULL, &p) >= 0);
+
+        return access(p, F_OK) >= 0;
+}
+
+/* Dispatches events until all queued sessions are done with, and returns the longest time a single dispatch
+ * kept the event loop busy */
+static usec_t run_session_kills(Manager *m, usec_t *ret_busy) {
+        usec_t busy = 0, longest = 0;
+
+        while (!hashmap_isempty(m->session_kills)) {
+                usec_t t;
+                int r;
+
+                r = sd_event_prepare(m->event);
+                assert_se(r >= 0);
+                if (r == 0) {
+                        r = sd_event_wait(m->event, UINT64_MAX);
+                        assert_se(r >= 0);
+                }
+                if (r == 0)
+                        continue;
+
+                t = now(CLOCK_MONOTONIC);
+                assert_se(sd_event_dispatch(m->event) >= 0);
+                t = now(CLOCK_MONOTONIC) - t;
+
+                busy += t;
+                longest = MAX(longest, t);
+        }
+
+        if (ret_busy)
+                *ret_busy = busy;
+
+        return longest;
+}
+
+static void test_bulk(Manager *m) {
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX], c[FORMAT_TIMESPAN_MAX];
+        unsigned n_sessions = slow_tests_enabled() ? 1000 : 100;
+        _cleanup_free_ pid_t *pids = NULL;
+        usec_t t_sequential, t_busy, t_longest;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(pids = new(pid_t, n_sessions * N_PROCESSES));
+
+        /* One by one, as session_stop() did before */
+        for (unsigned i = 0; i < n_sessions; i++) {
+                _cleanup_free_ char *cgroup = session_cgroup(i);
+
+                for (unsigned j = 0; j < N_PROCESSES; j++)
+                        pids[i * N_PROCESSES + j] = spawn_into(cgroup, false);
+        }
+
+        t_sequential = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_sessions; i++) {
+                char id[DECIMAL_STR_MAX(unsigned)];
+                _cleanup_free_ char *cgroup = NULL;
+
+                xsprintf(id, "%u", i);
+                assert_se(cgroup = path_join(arg_parent, id));
+                assert_se(cg_kill_recursive(SYSTEMD_CGROUP_CONTROLLER, cgroup, SIGTERM,
+                                            CGROUP_IGNORE_SELF|CGROUP_REMOVE, NULL, NULL, NULL) > 0);
+        }
+        t_sequential = now(CLOCK_MONOTONIC) - t_sequential;
+
+        for (unsigned i = 0; i < n_sessions * N_PROCESSES; i++)
+                assert_killed_by(pids[i], SIGTERM);
+        assert_se(cg_trim(SYSTEMD_CGROUP_CONTROLLER, arg_parent, false) >= 0);
+
+        /* All of them queued, like user_stop() or seat_stop_sessions() do now */
+        for (unsigned i = 0; i < n_sessions; i++) {
+                _cleanup_free_ char *cgroup = session_cgroup(i);
+
+                for (unsigned j = 0; j < N_PROCESSES; j++)
+                        pids[i * N_PROCESSES + j] = spawn_into(cgroup, false);
+
+                assert_se(manager_kill_session_cgroup(m, cgroup) >= 0);
+        }
+        assert_se(hashmap_size(m->session_kills) == n_sessions);
+
+        t_longest = run_session_kills(m, &t_busy);
+
+        for (unsigned i = 0; i < n_sessions * N_PROCESSES; i++)
+                assert_killed_by(pids[i], SIGTERM);
+
+        for (unsigned i = 0; i < n_sessions; i++) {
+                char id[DECIMAL_STR_MAX(unsigned)];
+                _cleanup_free_ char *cgroup = NULL;
+
+                xsprintf(id, "%u", i);
+                assert_se(cgroup = path_join(arg_parent, id));
+                assert_se(!cgroup_exists(cgroup));
+        }
+
+        log_info("Killed %u sessions: one by one blocking for %s, in bulk blocking for %s in total, at most %s at once.",
+                 n_sessions,
+                 format_timespan(a, sizeof(a), t_sequential, 1),
+                 format_timespan(b, sizeof(b), t_busy, 1),
+                 format_timespan(c, sizeof(c), t_longest, 1));
+}
+
+static void test_stubborn(Manager *m) {
+        _cleanup_free_ char *cgroup = NULL;
+        pid_t stubborn, polite;
+
+        log_info("/* %s */", __func__);
+
+        cgroup = session_cgroup(0);
+        stubborn = spawn_into(cgroup, true);
+        polite = spawn_into(cgroup, false);
+
+        /* A session that was stopped, and then terminated explicitly, is queued once */
+        assert_se(manager_kill_session_cgroup(m, cgroup) >= 0);
+        assert_se(manager_kill_session_cgroup(m, cgroup) >= 0);
+        assert_se(hashmap_size(m->session_kills) == 1);
+
+        /* What ignores SIGTERM is left alone after the timeout */
+        run_session_kills(m, NULL);
+        assert_killed_by(polite, SIGTERM);
+
+        assert_se(cgroup_exists(cgroup));
+        assert_se(kill(stubborn, 0) >= 0);
+
+        assert_se(kill(stubborn, SIGKILL) >= 0);
+        assert_killed_by(stubborn, SIGKILL);
+        assert_se(cg_trim(SYSTEMD_CGROUP_CONTROLLER, cgroup, true) >= 0);
+}
+
+static void run(const char *hierarchy) {
+        Manager m = {
+                .session_kill_timeout_usec = 200 * USEC_PER_MSEC,
+        };
+
+        log_info("Running on the %s hierarchy.", hierarchy);
+
+        assert_se(asprintf(&arg_parent, "test-logind-kill-" PID_FMT, getpid_cached()) >= 0);
+        assert_se(cg_create(SYSTEMD_CGROUP_CONTROLLER, arg_parent) >= 0);
+        assert_se(sd_event_default(&m.event) >= 0);
+
+        test_bulk(&m);
+        test_stubborn(&m);
+
+        assert_se(cg_trim(SYSTEMD_CGROUP_CONTROLLER, arg_parent, true) >= 0);
+        arg_parent = mfree(arg_parent);
+
+        hashmap_free(m.session_kills);
+        sd_event_source_unref(m.session_kill_event_source);
+        sd_event_unref(m.event);
+}
+
+int main(int argc, char *argv[]) {
+        int r;
+
+        test_setup_logging(LOG_INFO);
+
+        /* Run on cgroup hierarchies of our own, once on a named legacy hierarchy, where signals are sent one
+         * by one, and once on the unified hierarchy, where there is cgroup.kill. */
+        r = safe_fork_with_mount("(test-logind-kill)", "tmpfs", "/sys/fs/cgroup", "tmpfs", 0, "mode=0755");
+        if (r == -EPERM)
+                return log_tests_skipped("not root");
+        assert_se(r >= 0);
+        if (r == 0) {
+                if (mkdir("/sys/fs/cgroup/elogind", 0755) < 0 ||
+                    mount("cgroup", "/sys/fs/cgroup/elogind", "cgroup", 0, "none,name=elogind") < 0) {
+                        log_info_errno(errno, "Failed to mount a legacy cgroup hierarchy, skipping: %m");
+                        _exit(EXIT_SUCCESS);
+                }
+
+                run("legacy");
+                _exit(EXIT_SUCCESS);
+        }
+
+        r = safe_fork_with_mount("(test-logind-kill)", "cgroup2", "/sys/fs/cgroup", "cgroup2", 0, NULL);
+        assert_se(r >= 0);
+        if (r == 0) {
+                run("unified");
+                _exit(EXIT_SUCCESS);
+        }
+
+        return 0;
+}
@@ -0,0 +1,616 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+/* Puts load on a running elogind, and reports how it copes: throughput and latencies of the calls of a
+ * session's life cycle, the memory each session costs, and how often a login wakes up those who watch for
+ * changes. It talks to whatever the system bus is, so to
+ * benchmark a scratch instance rather than the one of the host, point $DBUS_SYSTEM_BUS_ADDRESS to a private
+ * bus it is running on. Needs to run as root.
+ *
+ *     test-logind-load [WORKERS [ITERATIONS [HELD_SESSIONS]]]
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "sd-bus.h"
+#include "sd-login.h"
+
+#include "alloc-util.h"
+#include "bus-error.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "format-util.h"
+#include "hash-funcs.h"
+#include "io-util.h"
+#include "parse-util.h"
+#include "process-util.h"
+#include "sort-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+
+typedef enum LoadOp {
+        LOAD_CREATE_SESSION,
+        LOAD_GET_SESSION_BY_PID,
+        LOAD_SET_IDLE_HINT,
+        LOAD_INHIBIT,
+        LOAD_RELEASE_SESSION,
+        _LOAD_OP_MAX,
+} LoadOp;
+
+static const char* const load_op_name[_LOAD_OP_MAX] = {
+        [LOAD_CREATE_SESSION]     = "CreateSession",
+        [LOAD_GET_SESSION_BY_PID] = "GetSessionByPID",
+        [LOAD_SET_IDLE_HINT]      = "SetIdleHint",
+        [LOAD_INHIBIT]            = "Inhibit",
+        [LOAD_RELEASE_SESSION]    = "ReleaseSession",
+};
+
+static unsigned arg_n_workers = 8;
+static unsigned arg_n_iterations = 100;
+static unsigned arg_n_held = 1000;
+
+/* Shared with the workers: one latency per worker, iteration and call, USEC_INFINITY for failed calls */
+static usec_t *latencies = NULL;
+
+static usec_t *latency_slot(LoadOp op, unsigned worker, unsigned iteration) {
+        return latencies + ((size_t) op * arg_n_workers + worker) * arg_n_iterations + iteration;
+}
+
+static int spawn_leader(pid_t *ret) {
+        int r;
+
+        /* Each session needs a leader process of its own, that is not in a session yet */
+        r = safe_fork("(sd-leader)", FORK_DEATHSIG, ret);
+        if (r < 0)
+                return r;
+        if (r == 0) {
+                for (;;)
+                        pause();
+        }
+
+        return 0;
+}
+
+static void kill_leader(pid_t pid) {
+        (void) kill(pid, SIGKILL);
+        (void) wait_for_terminate(pid, NULL);
+}
+
+static int create_session(sd_bus *bus, pid_t leader, char **ret_id, char **ret_path, int *ret_fifo_fd) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        const char *id, *path;
+        int fifo_fd, r;
+
+        r = sd_bus_message_new_method_call(bus, &m,
+                                           "org.freedesktop.login1",
+                                           "/org/freedesktop/login1",
+                                           "org.freedesktop.login1.Manager",
+                                           "CreateSession");
+        if (r < 0)
+                return r;
+
+        /* A remote graphical session, so that it needs neither seat nor VT, but takes idle hints */
+        r = sd_bus_message_append(m, "uusssssussbss",
+                                  (uint32_t) 0, (uint32_t) leader,
+                                  "test-logind-load", "x11", "user", "", "", (uint32_t) 0, "", ":99",
+                                  true, "root", "load.example.com");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(m, "a(sv)", 0);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_call(bus, m, 0, &error, &reply);
+        if (r < 0)
+                return log_error_errno(r, "CreateSession() failed: %s", bus_error_message(&error, r));
+
+        r = sd_bus_message_read(reply, "so", &id, &path);
+        if (r < 0)
+                return r;
+        r = sd_bus_message_skip(reply, "s");
+        if (r < 0)
+                return r;
+        r = sd_bus_message_read(reply, "h", &fifo_fd);
+        if (r < 0)
+                return r;
+
+        fifo_fd = fcntl(fifo_fd, F_DUPFD_CLOEXEC, 3);
+        if (fifo_fd < 0)
+                return -errno;
+
+        *ret_id = strdup(id);
+        *ret_path = strdup(path);
+        if (!*ret_id || !*ret_path) {
+                *ret_id = mfree(*ret_id);
+                *ret_path = mfree(*ret_path);
+                safe_close(fifo_fd);
+                return -ENOMEM;
+        }
+
+        *ret_fifo_fd = fifo_fd;
+        return 0;
+}
+
+static int release_session(sd_bus *bus, const char *id) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        int r;
+
+        r = sd_bus_call_method(bus,
+                               "org.freedesktop.login1",
+                               "/org/freedesktop/login1",
+                               "org.freedesktop.login1.Manager",
+                               "ReleaseSession",
+                               &error, NULL,
+                               "s", id);
+        if (r < 0)
+                return log_error_errno(r, "ReleaseSession() failed: %s", bus_error_message(&error, r));
+
+        return 0;
+}
+
+static int get_session_by_pid(sd_bus *bus, pid_t pid) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        int r;
+
+        r = sd_bus_call_method(bus,
+                               "org.freedesktop.login1",
+                               "/org/freedesktop/login1",
+                               "org.freedesktop.login1.Manager",
+                               "GetSessionByPID",
+                               &error, NULL,
+                               "u", (uint32_t) pid);
+        if (r < 0)
+                return log_error_errno(r, "GetSessionByPID() failed: %s", bus_error_message(&error, r));
+
+        return 0;
+}
+
+static int set_idle_hint(sd_bus *bus, const char *path, bool b) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        int r;
+
+        r = sd_bus_call_method(bus,
+                               "org.freedesktop.login1",
+                               path,
+                               "org.freedesktop.login1.Session",
+                               "SetIdleHint",
+                               &error, NULL,
+                               "b", b);
+        if (r < 0)
+                return log_error_errno(r, "SetIdleHint() failed: %s", bus_error_message(&error, r));
+
+        return 0;
+}
+
+static int inhibit(sd_bus *bus, const char *what, const char *mode, int *ret_fd) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        int fd, r;
+
+        r = sd_bus_call_method(bus,
+                               "org.freedesktop.login1",
+                               "/org/freedesktop/login1",
+                               "org.freedesktop.login1.Manager",
+                               "Inhibit",
+                               &error, &reply,
+                               "ssss", what, "test-logind-load", "Just load", mode);
+        if (r < 0)
+                return log_error_errno(r, "Inhibit() failed: %s", bus_error_message(&error, r));
+
+        r = sd_bus_message_read_basic(reply, SD_BUS_TYPE_UNIX_FD, &fd);
+        if (r < 0)
+                return r;
+
+        /* Unless taken, the inhibitor goes away with the reply, and its fd */
+        if (ret_fd) {
+                fd = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+                if (fd < 0)
+                        return -errno;
+
+                *ret_fd = fd;
+        }
+
+        return 0;
+}
+
+static int count_inhibitors(sd_bus *bus) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        int r, n = 0;
+
+        r = sd_bus_call_method(bus,
+                               "org.freedesktop.login1",
+                               "/org/freedesktop/login1",
+                               "org.freedesktop.login1.Manager",
+                               "ListInhibitors",
+                               &error, &reply,
+                               NULL);
+        if (r < 0)
+                return log_error_errno(r, "ListInhibitors() failed: %s", bus_error_message(&error, r));
+
+        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(ssssuu)");
+        if (r < 0)
+                return r;
+
+        while ((r = sd_bus_message_skip(reply, "(ssssuu)")) > 0)
+                n++;
+        if (r < 0)
+                return r;
+
+        return n;
+}
+
+#define TIMED(op, worker, iteration, call)                              \
+        ({                                                              \
+                usec_t _t = now(CLOCK_MONOTONIC);                       \
+                int _r = (call);                                        \
+                *latency_slot(op, worker, iteration) =                  \
+                        _r < 0 ? USEC_INFINITY : now(CLOCK_MONOTONIC) - _t; \
+                _r;                                                     \
+        })
+
+static void run_worker(unsigned worker) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+
+        assert_se(sd_bus_open_system(&bus) >= 0);
+
+        for (unsigned i = 0; i < arg_n_iterations; i++) {
+                _cleanup_free_ char *id = NULL, *path = NULL;
+                _cleanup_close_ int fifo_fd = -1;
+                pid_t leader;
+
+                if (spawn_leader(&leader) < 0)
+                        continue;
+
+                if (TIMED(LOAD_CREATE_SESSION, worker, i, create_session(bus, leader, &id, &path, &fifo_fd)) >= 0) {
+                        (void) TIMED(LOAD_GET_SESSION_BY_PID, worker, i, get_session_by_pid(bus, leader));
+                        (void) TIMED(LOAD_SET_IDLE_HINT, worker, i, set_idle_hint(bus, path, i % 2 == 0));
+                        (void) TIMED(LOAD_INHIBIT, worker, i, inhibit(bus, "idle", "block", NULL));
+                        (void) TIMED(LOAD_RELEASE_SESSION, worker, i, release_session(bus, id));
+                }
+
+                kill_leader(leader);
+        }
+}
+
+static int get_logind_rss(sd_bus *bus, uint64_t *ret) {
+        _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *creds = NULL;
+        _cleanup_free_ char *v = NULL;
+        const char *p;
+        pid_t pid;
+        int r;
+
+        r = sd_bus_get_name_creds(bus, "org.freedesktop.login1", SD_BUS_CREDS_PID, &creds);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_creds_get_pid(creds, &pid);
+        if (r < 0)
+                return r;
+
+        p = procfs_file_alloca(pid, "status");
+        r = get_proc_field(p, "VmRSS", WHITESPACE, &v);
+        if (r < 0)
+                return r;
+
+        r = safe_atou64(v, ret);
+        if (r < 0)
+                return r;
+
+        *ret *= 1024;
+        return 0;
+}
+
+static void test_throughput(void) {
+        size_t n_slots = (size_t) _LOAD_OP_MAX * arg_n_workers * arg_n_iterations;
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX], c[FORMAT_TIMESPAN_MAX];
+        usec_t t;
+        int r;
+
+        log_info("/* %s: %u workers, %u iterations each */", __func__, arg_n_workers, arg_n_iterations);
+
+        latencies = mmap(NULL, n_slots * sizeof(usec_t), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+        assert_se(latencies != MAP_FAILED);
+        for (size_t i = 0; i < n_slots; i++)
+                latencies[i] = USEC_INFINITY;
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned w = 0; w < arg_n_workers; w++) {
+                r = safe_fork("(load-worker)", FORK_DEATHSIG|FORK_LOG, NULL);
+                assert_se(r >= 0);
+                if (r == 0) {
+                        run_worker(w);
+                        _exit(EXIT_SUCCESS);
+                }
+        }
+
+        while (wait(NULL) >= 0)
+                ;
+        assert_se(errno == ECHILD);
+        t = now(CLOCK_MONOTONIC) - t;
+
+        for (LoadOp op = 0; op < _LOAD_OP_MAX; op++) {
+                usec_t *l = latency_slot(op, 0, 0);
+                size_t n = (size_t) arg_n_workers * arg_n_iterations, n_ok;
+
+                /* Failed calls sort last */
+                typesafe_qsort(l, n, uint64_compare_func);
+                for (n_ok = 0; n_ok < n && l[n_ok] != USEC_INFINITY; n_ok++)
+                        ;
+
+                if (n_ok == 0) {
+                        log_info("%-16s no successful calls", load_op_name[op]);
+                        continue;
+                }
+
+                log_info("%-16s %8zu ok %6zu failed %10.1f/s   p50 %s   p99 %s   max %s",
+                         load_op_name[op], n_ok, n - n_ok,
+                         (double) n_ok * USEC_PER_SEC / t,
+                         format_timespan(a, sizeof(a), l[n_ok / 2], 1),
+                         format_timespan(b, sizeof(b), l[n_ok * 99 / 100], 1),
+                         format_timespan(c, sizeof(c), l[n_ok - 1], 1));
+        }
+
+        log_info("Total: %s", format_timespan(a, sizeof(a), t, USEC_PER_MSEC));
+
+        assert_se(munmap(latencies, n_slots * sizeof(usec_t)) >= 0);
+        latencies = NULL;
+}
+
+static void test_memory(void) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        char a[FORMAT_BYTES_MAX], b[FORMAT_BYTES_MAX];
+        _cleanup_free_ pid_t *leaders = NULL;
+        _cleanup_free_ char **ids = NULL;
+        _cleanup_free_ int *fifo_fds = NULL;
+        uint64_t before, after;
+        unsigned n = 0;
+
+        log_info("/* %s: %u sessions */", __func__, arg_n_held);
+
+        assert_se(sd_bus_open_system(&bus) >= 0);
+        assert_se(leaders = new(pid_t, arg_n_held));
+        assert_se(ids = new0(char*, arg_n_held));
+        assert_se(fifo_fds = new(int, arg_n_held));
+
+        if (get_logind_rss(bus, &before) < 0) {
+                log_info("Cannot determine the memory use of elogind, skipping.");
+                return;
+        }
+
+        for (; n < arg_n_held; n++) {
+                _cleanup_free_ char *path = NULL;
+
+                assert_se(spawn_leader(leaders + n) >= 0);
+                if (create_session(bus, leaders[n], ids + n, &path, fifo_fds + n) < 0) {
+                        kill_leader(leaders[n]);
+                        break;
+                }
+        }
+
+        assert_se(get_logind_rss(bus, &after) >= 0);
+
+        log_info("%u sessions: RSS %s → %s, %.1f KiB per thousand sessions",
+                 n, format_bytes(a, sizeof(a), before), format_bytes(b, sizeof(b), after),
+                 n > 0 && after > before ? (double) (after - before) / 1024 * 1000 / n : 0.0);
+
+        for (unsigned i = 0; i < n; i++) {
+                (void) release_session(bus, ids[i]);
+                safe_close(fifo_fds[i]);
+                kill_leader(leaders[i]);
+                free(ids[i]);
+        }
+}
+
+/* Counts how often something watching for changes is woken up: once through sd_login_monitor, and once
+ * through inotify watches on the state directories, which is what sd_login_monitor used to be */
+static void run_watcher(int ready_fd, unsigned *wakeups) {
+        _cleanup_(sd_login_monitor_unrefp) sd_login_monitor *m = NULL;
+        _cleanup_close_ int fd = -1;
+
+        assert_se(sd_login_monitor_new(NULL, &m) >= 0);
+
+        assert_se((fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC)) >= 0);
+        assert_se(inotify_add_watch(fd, "/run/systemd/seats/", IN_MOVED_TO|IN_DELETE) >= 0);
+        assert_se(inotify_add_watch(fd, "/run/systemd/sessions/", IN_MOVED_TO|IN_DELETE) >= 0);
+        assert_se(inotify_add_watch(fd, "/run/systemd/users/", IN_MOVED_TO|IN_DELETE) >= 0);
+
+        assert_se(write(ready_fd, "x", 1) == 1);
+
+        for (;;) {
+                struct pollfd p[] = {
+                        { .fd = sd_login_monitor_get_fd(m), .events = sd_login_monitor_get_events(m) },
+                        { .fd = fd,                         .events = POLLIN                          },
+                };
+
+                if (poll(p, ELEMENTSOF(p), -1) < 0) {
+                        assert_se(errno == EINTR);
+                        continue;
+                }
+
+                if (p[0].revents != 0) {
+                        __atomic_add_fetch(wakeups + 0, 1, __ATOMIC_RELAXED);
+                        assert_se(sd_login_monitor_flush(m) >= 0);
+                }
+
+                if (p[1].revents != 0) {
+                        __atomic_add_fetch(wakeups + 1, 1, __ATOMIC_RELAXED);
+                        assert_se(flush_fd(fd) >= 0);
+                }
+        }
+}
+
+static void test_monitor_wakeups(void) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_close_pair_ int pipe_fds[2] = { -1, -1 };
+        unsigned n = MIN(arg_n_iterations, 20U), n_ok = 0, *wakeups;
+        pid_t watcher;
+        char c;
+        int r;
+
+        log_info("/* %s: %u logins */", __func__, n);
+
+        assert_se(sd_bus_open_system(&bus) >= 0);
+
+        wakeups = mmap(NULL, 2 * sizeof(unsigned), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+        assert_se(wakeups != MAP_FAILED);
+        wakeups[0] = wakeups[1] = 0;
+
+        assert_se(pipe2(pipe_fds, O_CLOEXEC) >= 0);
+
+        r = safe_fork("(load-watcher)", FORK_DEATHSIG|FORK_LOG, &watcher);
+        assert_se(r >= 0);
+        if (r == 0) {
+                run_watcher(pipe_fds[1], wakeups);
+                _exit(EXIT_SUCCESS);
+        }
+
+        assert_se(read(pipe_fds[0], &c, 1) == 1);
+
+        /* One login after the other, each running its course, as they come in on a real system */
+        for (unsigned i = 0; i < n; i++) {
+                _cleanup_free_ char *id = NULL, *path = NULL;
+                _cleanup_close_ int fifo_fd = -1;
+                pid_t leader;
+
+                assert_se(spawn_leader(&leader) >= 0);
+
+                if (create_session(bus, leader, &id, &path, &fifo_fd) >= 0 &&
+                    release_session(bus, id) >= 0)
+                        n_ok++;
+
+                fifo_fd = safe_close(fifo_fd);
+                kill_leader(leader);
+
+                (void) usleep(100 * USEC_PER_MSEC);
+        }
+
+        kill_leader(watcher);
+
+        if (n_ok == 0)
+                log_info("No successful logins.");
+        else
+                log_info("%u logins: %.1f wakeups per login through sd_login_monitor, %.1f watching the state directories",
+                         n_ok, (double) wakeups[0] / n_ok, (double) wakeups[1] / n_ok);
+
+        assert_se(munmap(wakeups, 2 * sizeof(unsigned)) >= 0);
+}
+
+/* Waits until elogind noticed that all inhibitors we dropped are gone */
+static void wait_for_inhibitors(sd_bus *bus, int n) {
+        int r;
+
+        for (;;) {
+                r = count_inhibitors(bus);
+                assert_se(r >= 0);
+                if (r <= n)
+                        return;
+
+                (void) usleep(USEC_PER_MSEC);
+        }
+}
+
+/* Returns the FIFO an inhibitor is held through, or NULL if it is held through a pipe */
+static char* inhibitor_fifo(int fd) {
+        char *p;
+
+        assert_se(fd_get_path(fd, &p) >= 0);
+        if (startswith(p, "pipe:"))
+                return mfree(p);
+
+        return p;
+}
+
+static void test_inhibitors(void) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        unsigned n = MIN(arg_n_held, 500U);
+        _cleanup_free_ int *fds = NULL;
+        int n_before;
+        usec_t t, u;
+
+        log_info("/* %s: %u inhibitors */", __func__, n);
+
+        assert_se(sd_bus_open_system(&bus) >= 0);
+        assert_se(fds = new(int, n));
+
+        n_before = count_inhibitors(bus);
+        assert_se(n_before >= 0);
+
+        /* Block inhibitors keep their FIFO, so that they survive elogind crashing, delay inhibitors do not */
+        {
+                _cleanup_free_ char *fifo = NULL;
+                _cleanup_close_ int fd = -1;
+
+                assert_se(inhibit(bus, "sleep", "delay", &fd) >= 0);
+                assert_se(!inhibitor_fifo(fd));
+                fd = safe_close(fd);
+
+                assert_se(inhibit(bus, "sleep", "block", &fd) >= 0);
+                assert_se(fifo = inhibitor_fifo(fd));
+                assert_se(startswith(fifo, "/run/systemd/inhibit/"));
+                fd = safe_close(fd);
+
+                wait_for_inhibitors(bus, n_before);
+                assert_se(access(fifo, F_OK) < 0 && errno == ENOENT);
+        }
+
+        /* Taken and dropped right away, like applications do around each suspend */
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n; i++) {
+                assert_se(inhibit(bus, "sleep", "delay", fds + i) >= 0);
+                safe_close(fds[i]);
+        }
+        wait_for_inhibitors(bus, n_before);
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("Taking and dropping one inhibitor at a time: %s per inhibitor",
+                 format_timespan(a, sizeof(a), t / n, 1));
+
+        /* All held at once, then all dropped at once */
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n; i++)
+                assert_se(inhibit(bus, "sleep", "delay", fds + i) >= 0);
+        t = now(CLOCK_MONOTONIC) - t;
+
+        assert_se(count_inhibitors(bus) == n_before + (int) n);
+
+        for (unsigned i = 0; i < n; i++)
+                safe_close(fds[i]);
+
+        u = now(CLOCK_MONOTONIC);
+        wait_for_inhibitors(bus, n_before);
+        u = now(CLOCK_MONOTONIC) - u;
+
+        log_info("Taking %u inhibitors: %s per inhibitor, dropping them: %s per inhibitor",
+                 n, format_timespan(a, sizeof(a), t / n, 1), format_timespan(b, sizeof(b), u / n, 1));
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_INFO);
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &arg_n_workers) >= 0 && arg_n_workers > 0);
+        if (argc > 2)
+                assert_se(safe_atou(argv[2], &arg_n_iterations) >= 0);
+        if (argc > 3)
+                assert_se(safe_atou(argv[3], &arg_n_held) >= 0);
+
+        if (getuid() != 0)
+                return log_tests_skipped("not root");
+
+        test_throughput();
+        test_memory();
+        test_monitor_wakeups();
+        test_inhibitors();
+
+        return 0;
+}
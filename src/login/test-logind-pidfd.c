@@ -0,0 +1,164 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <signal.h>
+#include <unistd.h>
+
+#include "fd-util.h"
+#include "logind.h"
+#include "logind-inhibit.h"
+#include "logind-session.h"
+#include "missing_syscall.h"
+#include "process-util.h"
+#include "tests.h"
+
+static pid_t spawn(void) {
+        pid_t pid;
+        int r;
+
+        r = safe_fork("(test-process)", FORK_DEATHSIG, &pid);
+        assert_se(r >= 0);
+        if (r == 0) {
+                for (;;)
+                        pause();
+        }
+
+        return pid;
+}
+
+static void test_session_leader(Manager *m) {
+        Session *s, *found;
+        pid_t pid;
+
+        log_info("/* %s */", __func__);
+
+        pid = spawn();
+
+        assert_se(session_new(&s, m, "1") >= 0);
+        assert_se(session_set_leader(s, pid) > 0);
+        assert_se(s->leader_pidfd >= 0);
+        assert_se(manager_get_session_by_pid(m, pid, &found) > 0 && found == s);
+
+        /* Exit of the leader is noticed right away, and its PID no longer leads to the session */
+        assert_se(kill(pid, SIGKILL) >= 0);
+        assert_se(sd_event_run(m->event, 5 * USEC_PER_SEC) > 0);
+        assert_se(s->leader_pidfd < 0);
+        assert_se(!hashmap_get(m->sessions_by_leader, PID_TO_PTR(pid)));
+        assert_se(s->in_gc_queue);
+        assert_se(wait_for_terminate(pid, NULL) >= 0);
+
+        session_free(s);
+}
+
+static void test_inhibitor_pid(Manager *m) {
+        Inhibitor *i;
+        pid_t pid;
+
+        log_info("/* %s */", __func__);
+
+        pid = spawn();
+
+        assert_se(inhibitor_new(&i, m, "1") >= 0);
+        i->what = INHIBIT_IDLE;
+        i->mode = INHIBIT_BLOCK;
+        i->pid = pid;
+        i->uid = 0;
+        assert_se(inhibitor_start(i) >= 0);
+        assert_se(i->pidfd >= 0);
+
+        /* A process outside of any session inhibits on all ttys, as long as it is around */
+        assert_se(manager_is_inhibited(m, INHIBIT_IDLE, INHIBIT_BLOCK, NULL, true, false, 0, NULL));
+
+        assert_se(kill(pid, SIGKILL) >= 0);
+        assert_se(sd_event_run(m->event, 5 * USEC_PER_SEC) > 0);
+        assert_se(i->pid_exited);
+        assert_se(i->pidfd < 0);
+        assert_se(wait_for_terminate(pid, NULL) >= 0);
+
+        assert_se(!manager_is_inhibited(m, INHIBIT_IDLE, INHIBIT_BLOCK, NULL, true, false, 0, NULL));
+        assert_se(manager_is_inhibited(m, INHIBIT_IDLE, INHIBIT_BLOCK, NULL, false, false, 0, NULL));
+
+        inhibitor_free(i);
+}
+
+static void test_inhibitor_pipe_recovery(Manager *m) {
+        _cleanup_close_ int fd = -1;
+        _cleanup_free_ char *state_file = NULL;
+        Inhibitor *i;
+        pid_t pid;
+
+        log_info("/* %s */", __func__);
+
+        pid = spawn();
+
+        assert_se(inhibitor_new(&i, m, "2") >= 0);
+        i->what = INHIBIT_SLEEP;
+        i->mode = INHIBIT_DELAY;
+        i->pid = pid;
+        i->uid = 0;
+        assert_se((fd = inhibitor_create_pipe(i)) >= 0);
+        assert_se(inhibitor_start(i) >= 0);
+        assert_se(state_file = strdup(i->state_file));
+
+        /* The state file is written a moment later, rather than right away */
+        assert_se(access(state_file, F_OK) < 0 && errno == ENOENT);
+        assert_se(sd_event_run(m->event, 5 * USEC_PER_SEC) > 0);
+        assert_se(access(state_file, F_OK) >= 0);
+
+        /* Pretend we crashed: the pipe is gone, the state file is not */
+        inhibitor_free(i);
+        fd = safe_close(fd);
+
+        assert_se(inhibitor_new(&i, m, "2") >= 0);
+        assert_se(inhibitor_load(i) >= 0);
+        assert_se(inhibitor_start(i) >= 0);
+        assert_se(i->fifo_fd < 0);
+        assert_se(!inhibitor_is_orphan(i));
+        assert_se(manager_is_inhibited(m, INHIBIT_SLEEP, INHIBIT_DELAY, NULL, false, false, 0, NULL));
+
+        /* Nothing but the process holds it now */
+        assert_se(kill(pid, SIGKILL) >= 0);
+        assert_se(sd_event_run(m->event, 5 * USEC_PER_SEC) > 0);
+        assert_se(wait_for_terminate(pid, NULL) >= 0);
+
+        assert_se(!hashmap_get(m->inhibitors, "2"));
+        assert_se(access(state_file, F_OK) < 0 && errno == ENOENT);
+        assert_se(!manager_is_inhibited(m, INHIBIT_SLEEP, INHIBIT_DELAY, NULL, false, false, 0, NULL));
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        test_setup_logging(LOG_DEBUG);
+
+        fd = pidfd_open(getpid_cached(), 0);
+        if (fd < 0)
+                return log_tests_skipped_errno(errno, "pidfd_open() not supported");
+
+        /* Inhibitors write state files, let them do so on a /run/systemd of our own */
+        r = safe_fork_with_mount("(test-logind-pidfd)", "tmpfs", "/run/systemd", "tmpfs", 0, "mode=0755");
+        if (r == -EPERM)
+                return log_tests_skipped("not root");
+        assert_se(r >= 0);
+        if (r == 0) {
+                Manager m = {};
+
+                assert_se(sd_event_default(&m.event) >= 0);
+                assert_se(m.sessions = hashmap_new(&string_hash_ops));
+                assert_se(m.sessions_by_leader = hashmap_new(NULL));
+                assert_se(m.inhibitors = hashmap_new(&string_hash_ops));
+
+                test_session_leader(&m);
+                test_inhibitor_pid(&m);
+                test_inhibitor_pipe_recovery(&m);
+
+                sd_event_source_unref(m.inhibitor_save_event_source);
+                hashmap_free(m.inhibitors);
+                hashmap_free(m.sessions_by_leader);
+                hashmap_free(m.sessions);
+                sd_event_unref(m.event);
+                _exit(EXIT_SUCCESS);
+        }
+
+        return 0;
+}
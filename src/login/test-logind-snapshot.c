@@ -0,0 +1,205 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fileio.h"
+#include "logind.h"
+#include "logind-session.h"
+#include "logind-snapshot.h"
+#include "logind-user.h"
+#include "mkdir.h"
+#include "process-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+
+static unsigned arg_n_sessions = 1000;
+
+static void write_session_file(unsigned i, const char *desktop) {
+        _cleanup_free_ char *p = NULL, *s = NULL;
+
+        assert_se(asprintf(&p, "/run/systemd/sessions/%u", i) >= 0);
+        assert_se(asprintf(&s,
+                           "# This is private data. Do not parse.\n"
+                           "UID=4711\n"
+                           "USER=test-user\n"
+                           "ACTIVE=1\n"
+                           "IS_DISPLAY=0\n"
+                           "STATE=online\n"
+                           "REMOTE=1\n"
+                           "TYPE=tty\n"
+                           "ORIGINAL_TYPE=tty\n"
+                           "CLASS=user\n"
+                           "REMOTE_HOST=\"host with \\\"quotes\\\" and spaces\"\n"
+                           "SERVICE=test\n"
+                           "DESKTOP=%s\n"
+                           "POSITION=%u\n"
+                           "REALTIME=1234567890\n"
+                           "MONOTONIC=12345\n",
+                           desktop, i) >= 0);
+        assert_se(write_string_file(p, s, WRITE_STRING_FILE_CREATE) >= 0);
+}
+
+static usec_t load_sessions(Manager *m) {
+        char id[DECIMAL_STR_MAX(unsigned)];
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < arg_n_sessions; i++) {
+                Session *s;
+
+                xsprintf(id, "%u", i);
+                assert_se(manager_add_session(m, id, &s) >= 0);
+                assert_se(session_load(s) >= 0);
+        }
+        t = now(CLOCK_MONOTONIC) - t;
+
+        /* Everything makes it over, whichever way it was read */
+        xsprintf(id, "%u", arg_n_sessions / 2);
+        assert_se(hashmap_size(m->sessions) == arg_n_sessions);
+        assert_se(hashmap_get(m->sessions, id));
+        assert_se(streq(((Session*) hashmap_get(m->sessions, id))->remote_host, "host with \"quotes\" and spaces"));
+        assert_se(((Session*) hashmap_get(m->sessions, id))->timestamp.realtime == 1234567890);
+
+        return t;
+}
+
+static void free_sessions(Manager *m) {
+        Session *s;
+
+        while ((s = hashmap_first(m->sessions)))
+                session_free(s);
+}
+
+static const char *desktop_of(Manager *m, unsigned i) {
+        char id[DECIMAL_STR_MAX(unsigned)];
+        Session *s;
+
+        xsprintf(id, "%u", i);
+        assert_se(s = hashmap_get(m->sessions, id));
+
+        return s->desktop;
+}
+
+static void test_state_snapshot(void) {
+        _cleanup_(user_record_unrefp) UserRecord *ur = NULL;
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        struct timespec ts[2];
+        Manager m = {};
+        usec_t t_files, t_snapshot;
+        struct stat st;
+        User *u;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_event_default(&m.event) >= 0);
+        assert_se(m.users = hashmap_new(NULL));
+        assert_se(m.sessions = hashmap_new(&string_hash_ops));
+
+        assert_se(ur = user_record_new());
+        ur->uid = 4711;
+        assert_se(ur->user_name = strdup("test-user"));
+        assert_se(user_new(&u, &m, ur) >= 0);
+
+        assert_se(mkdir_p("/run/systemd/sessions", 0755) >= 0);
+        for (unsigned i = 0; i < arg_n_sessions; i++)
+                write_session_file(i, "AAAA");
+
+        /* Without a snapshot, every state file is read */
+        assert_se(manager_load_state_snapshot(&m) == 0);
+        t_files = load_sessions(&m);
+
+        assert_se(manager_write_state_snapshot(&m) > 0);
+        /* Nothing changed since, so nothing is written */
+        assert_se(manager_write_state_snapshot(&m) == 0);
+        free_sessions(&m);
+
+        assert_se(manager_load_state_snapshot(&m) > 0);
+        t_snapshot = load_sessions(&m);
+        manager_drop_state_snapshot(&m);
+        assert_se(streq(desktop_of(&m, 0), "AAAA"));
+        free_sessions(&m);
+
+        log_info("Loaded %u sessions from their state files in %s, from the snapshot in %s.",
+                 arg_n_sessions,
+                 format_timespan(a, sizeof(a), t_files, USEC_PER_MSEC),
+                 format_timespan(b, sizeof(b), t_snapshot, USEC_PER_MSEC));
+
+        /* A state file that changed behind the back of the snapshot, but kept its identity: the snapshot
+         * is used, which shows it really is */
+        assert_se(stat("/run/systemd/sessions/0", &st) >= 0);
+        write_session_file(0, "BBBB");
+        ts[0] = st.st_atim;
+        ts[1] = st.st_mtim;
+        assert_se(utimensat(AT_FDCWD, "/run/systemd/sessions/0", ts, 0) >= 0);
+
+        assert_se(manager_load_state_snapshot(&m) > 0);
+        load_sessions(&m);
+        manager_drop_state_snapshot(&m);
+        assert_se(streq(desktop_of(&m, 0), "AAAA"));
+        free_sessions(&m);
+
+        /* A state file that changed for real is read from disk */
+        write_session_file(1, "CCCCCC");
+
+        assert_se(manager_load_state_snapshot(&m) > 0);
+        load_sessions(&m);
+        manager_drop_state_snapshot(&m);
+        assert_se(streq(desktop_of(&m, 1), "CCCCCC"));
+        assert_se(streq(desktop_of(&m, 2), "AAAA"));
+
+        /* And is taken up into the next snapshot, as are sessions that went away */
+        assert_se(manager_write_state_snapshot(&m) > 0);
+        free_sessions(&m);
+        assert_se(unlink("/run/systemd/sessions/2") >= 0);
+
+        assert_se(manager_load_state_snapshot(&m) > 0);
+        arg_n_sessions--;
+        for (unsigned i = 0; i <= arg_n_sessions; i++) {
+                char id[DECIMAL_STR_MAX(unsigned)];
+                Session *s;
+
+                if (i == 2)
+                        continue;
+
+                xsprintf(id, "%u", i);
+                assert_se(manager_add_session(&m, id, &s) >= 0);
+                assert_se(session_load(s) >= 0);
+        }
+        manager_drop_state_snapshot(&m);
+        assert_se(streq(desktop_of(&m, 1), "CCCCCC"));
+        assert_se(hashmap_size(m.sessions) == arg_n_sessions);
+        free_sessions(&m);
+
+        /* A snapshot in a format we don't know is ignored */
+        assert_se(write_string_file("/run/systemd/elogind.snapshot", "version=0\n", WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_TRUNCATE) >= 0);
+        assert_se(manager_load_state_snapshot(&m) < 0);
+        assert_se(!m.state_snapshot);
+
+        user_free(u);
+        hashmap_free(m.sessions);
+        hashmap_free(m.users);
+        sd_event_unref(m.event);
+}
+
+int main(int argc, char *argv[]) {
+        int r;
+
+        test_setup_logging(LOG_INFO);
+
+        if (slow_tests_enabled())
+                arg_n_sessions = 10000;
+
+        /* Run on a /run/systemd of our own */
+        r = safe_fork_with_mount("(test-logind-snapshot)", "tmpfs", "/run/systemd", "tmpfs", 0, "mode=0755");
+        if (r == -EPERM)
+                return log_tests_skipped("not root");
+        assert_se(r >= 0);
+        if (r == 0) {
+                test_state_snapshot();
+                _exit(EXIT_SUCCESS);
+        }
+
+        return 0;
+}
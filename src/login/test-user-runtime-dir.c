@@ -0,0 +1,108 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <unistd.h>
+
+#include "fileio.h"
+#include "logind.h"
+#include "logind-user.h"
+#include "mountpoint-util.h"
+#include "path-util.h"
+#include "signal-util.h"
+#include "stdio-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+#include "user-runtime-dir.h"
+#include "user-util.h"
+
+static void make_runtime_dir(User *u) {
+        _cleanup_free_ char *p = NULL;
+
+        assert_se(mkdtemp_malloc("/tmp/test-user-runtime-dir.XXXXXX", &u->runtime_path) >= 0);
+
+        for (unsigned i = 0; i < 100; i++) {
+                char name[DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(name, "%u", i);
+                assert_se(p = path_join(u->runtime_path, name));
+                assert_se(write_string_file(p, "foo", WRITE_STRING_FILE_CREATE) >= 0);
+                p = mfree(p);
+        }
+}
+
+static void run_teardowns(Manager *m) {
+        while (!hashmap_isempty(m->user_teardowns))
+                assert_se(sd_event_run(m->event, UINT64_MAX) >= 0);
+}
+
+static void test_user_teardown(void) {
+        _cleanup_(user_record_unrefp) UserRecord *ur = NULL;
+        Manager m = {
+                .runtime_dir_size = 4 * 1024 * 1024,
+                .runtime_dir_inodes = 1024,
+        };
+        User u = { .manager = &m };
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_event_default(&m.event) >= 0);
+
+        assert_se(ur = user_record_new());
+        ur->uid = 4711;
+        ur->gid = 4711;
+        assert_se(ur->user_name = strdup("test-user"));
+        u.user_record = ur;
+        assert_se(hashmap_ensure_put(&m.users, NULL, UID_TO_PTR(ur->uid), &u) > 0);
+
+        /* The worker removes the runtime directory, and is forgotten once done */
+        make_runtime_dir(&u);
+        assert_se(user_teardown_start(&u) >= 0);
+        assert_se(hashmap_size(m.user_teardowns) == 1);
+        assert_se(user_teardown_pending(&u));
+        run_teardowns(&m);
+        assert_se(!user_teardown_pending(&u));
+        assert_se(access(u.runtime_path, F_OK) < 0 && errno == ENOENT);
+        assert_se(m.user_teardown_last_usec > 0);
+        assert_se(m.user_teardown_max_usec >= m.user_teardown_last_usec);
+
+        /* A login of the same user in the meantime does not wait for the worker, but gets its runtime
+         * directory set up once the worker is done, as user_start() arranges it */
+        make_runtime_dir(&u);
+        assert_se(user_teardown_start(&u) >= 0);
+        assert_se(user_teardown_pending(&u));
+        u.runtime_dir_pending = true;
+        run_teardowns(&m);
+        assert_se(!u.runtime_dir_pending);
+        assert_se(path_is_mount_point(u.runtime_path, NULL, 0) > 0);
+
+        /* And a second logout is taken care of once the first one is done */
+        assert_se(user_teardown_start(&u) >= 0);
+        assert_se(user_teardown_start(&u) >= 0);
+        assert_se(hashmap_size(m.user_teardowns) == 1);
+        run_teardowns(&m);
+        assert_se(access(u.runtime_path, F_OK) < 0 && errno == ENOENT);
+        u.runtime_path = mfree(u.runtime_path);
+
+        hashmap_free(m.users);
+        hashmap_free(m.user_teardowns);
+        sd_event_unref(m.event);
+}
+
+int main(int argc, char *argv[]) {
+        int r;
+
+        test_setup_logging(LOG_DEBUG);
+
+        /* rm_rf() only removes runtime directories on a tmpfs, so provide one */
+        r = safe_fork_with_mount("(test-user-runtime-dir)", "tmpfs", "/tmp", "tmpfs", 0, "mode=1777");
+        if (r == -EPERM)
+                return log_tests_skipped("not root");
+        assert_se(r >= 0);
+        if (r == 0) {
+                assert_se(sigprocmask_many(SIG_BLOCK, NULL, SIGCHLD, -1) >= 0);
+
+                test_user_teardown();
+                _exit(EXIT_SUCCESS);
+        }
+
+        return 0;
+}
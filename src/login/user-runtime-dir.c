@@ -24,7 +24,12 @@
 #include "strv.h"
 #include "user-util.h"
 /// Additional includes needed by elogind
+#include "clean-ipc.h"
+#include "hashmap.h"
 #include "log.h"
+#include "logind-session-dbus.h"
+#include "logind-user.h"
+#include "process-util.h"
 #include "user-runtime-dir.h"
 
 #if 0 /// UNNEEDED by elogind
@@ -249,3 +254,274 @@ int user_runtime_dir(const char *verb, User *u) {
 #if 0 /// No main function needed in elogind
 DEFINE_MAIN_FUNCTION(run);
 #endif // 0
+
+#if 1 /// elogind tears down the runtime directory and IPC objects of users in a worker process
+/* Removing a runtime directory with lots of files in it, and walking all SysV and POSIX IPC objects of the
+ * system, can take seconds. Hence, when a user logs out, we do that in a forked off process, and watch it
+ * to know when it is done. If the same user logs in again before the worker finished, setting up the runtime
+ * directory, and with it the reply to CreateSession(), is put off until the worker exited, as the worker
+ * might otherwise remove what was just set up for the new session. If the user logs out again in the
+ * meantime, another worker is started once the current one is done. Nothing of that blocks the event
+ * loop. The duration of teardowns is exposed on the bus, see UserTeardownLastUSec and
+ * UserTeardownMaxUSec. */
+
+typedef struct UserTeardown {
+        Manager *manager;
+
+        uid_t uid;
+        char *user_name;
+        char *runtime_path;
+        bool remove_ipc;
+        bool again; /* the user logged out once more while we were busy */
+
+        pid_t child;
+        usec_t started;
+
+        sd_event_source *child_event_source;
+} UserTeardown;
+
+static UserTeardown* user_teardown_free(UserTeardown *t) {
+        if (!t)
+                return NULL;
+
+        if (t->manager)
+                (void) hashmap_remove_value(t->manager->user_teardowns, UID_TO_PTR(t->uid), t);
+
+        t->child_event_source = sd_event_source_unref(t->child_event_source);
+        free(t->user_name);
+        free(t->runtime_path);
+
+        return mfree(t);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(UserTeardown*, user_teardown_free);
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(
+                user_teardown_hash_ops,
+                void,
+                trivial_hash_func,
+                trivial_compare_func,
+                UserTeardown,
+                user_teardown_free);
+
+static int user_teardown_run(const char *runtime_path, uid_t uid, bool remove_ipc) {
+        int r = 0, k;
+
+        if (runtime_path) {
+                k = do_umount(runtime_path);
+                if (k < 0)
+                        r = k;
+        }
+
+        if (remove_ipc) {
+                k = clean_ipc_by_uid(uid);
+                if (k < 0)
+                        r = k;
+        }
+
+        return r;
+}
+
+static void user_teardown_done(UserTeardown *t, int error) {
+        char ts[FORMAT_TIMESPAN_MAX];
+        usec_t d;
+
+        assert(t);
+
+        d = usec_sub_unsigned(now(CLOCK_MONOTONIC), t->started);
+        format_timespan(ts, sizeof(ts), d, USEC_PER_MSEC);
+
+        t->manager->user_teardown_last_usec = d;
+        t->manager->user_teardown_max_usec = MAX(t->manager->user_teardown_max_usec, d);
+
+        if (error < 0)
+                log_warning_errno(error, "Teardown of user %s failed after %s.", t->user_name, ts);
+        else
+                log_full(d >= USEC_PER_SEC ? LOG_INFO : LOG_DEBUG,
+                         "Teardown of user %s finished, took %s.", t->user_name, ts);
+}
+
+static void user_teardown_finish(Manager *m, uid_t uid) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        Session *s;
+        User *u;
+        int r;
+
+        assert(m);
+
+        /* Sets up the runtime directory of a user who logged in again while being torn down, and sends the
+         * replies to CreateSession() held back until now */
+
+        u = hashmap_get(m->users, UID_TO_PTR(uid));
+        if (!u || !u->runtime_dir_pending)
+                return;
+
+        u->runtime_dir_pending = false;
+
+        r = user_runtime_dir("start", u);
+        if (r < 0)
+                sd_bus_error_set_errnof(&error, r, "Failed to set up runtime directory of user %s: %m",
+                                        u->user_record->user_name);
+
+        (void) user_save(u);
+
+        LIST_FOREACH(sessions_by_user, s, u->sessions)
+                (void) session_send_create_reply(s, r < 0 ? &error : NULL);
+}
+
+static int user_teardown_fork(UserTeardown *t);
+
+static void user_teardown_wait_one(UserTeardown *t) {
+        int r;
+
+        assert(t);
+
+        /* Only used if we cannot watch the worker through the event loop */
+        log_debug("Waiting for teardown of user %s to finish...", t->user_name);
+
+        t->child_event_source = sd_event_source_unref(t->child_event_source);
+        r = wait_for_terminate_and_check("(sd-teardown)", t->child, 0);
+        t->child = 0;
+
+        user_teardown_done(t, r < 0 ? r : r != EXIT_SUCCESS ? -EPROTO : 0);
+}
+
+static void user_teardown_next(UserTeardown *t) {
+        Manager *m;
+        uid_t uid;
+
+        assert(t);
+
+        /* The worker is done. Either tear down once more, or let a new login of the user go ahead. */
+        if (t->again) {
+                t->again = false;
+                (void) user_teardown_fork(t);
+                return;
+        }
+
+        m = t->manager;
+        uid = t->uid;
+        user_teardown_free(t);
+
+        user_teardown_finish(m, uid);
+}
+
+static int on_user_teardown_exit(sd_event_source *s, const siginfo_t *si, void *userdata) {
+        UserTeardown *t = userdata;
+
+        assert(s);
+        assert(si);
+        assert(t);
+
+        assert(si->si_pid == t->child);
+        t->child = 0;
+        t->child_event_source = sd_event_source_unref(t->child_event_source);
+
+        user_teardown_done(t,
+                           si->si_code == CLD_EXITED &&
+                           si->si_status == EXIT_SUCCESS ? 0 : -EPROTO);
+
+        user_teardown_next(t);
+        return 0;
+}
+
+/* Returns < 0 if the teardown could not be run at all, and was freed */
+static int user_teardown_fork(UserTeardown *t) {
+        int r;
+
+        assert(t);
+
+        t->started = now(CLOCK_MONOTONIC);
+
+        /* No FORK_DEATHSIG here: if we go down in the meantime, the worker may as well finish its job */
+        r = safe_fork("(sd-teardown)", FORK_NULL_STDIO|FORK_CLOSE_ALL_FDS|FORK_LOG|FORK_REOPEN_LOG, &t->child);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to fork off teardown worker for user %s, tearing down synchronously: %m",
+                                  t->user_name);
+                r = user_teardown_run(t->runtime_path, t->uid, t->remove_ipc);
+                user_teardown_done(t, r);
+                user_teardown_next(t);
+                return -ECHILD;
+        }
+        if (r == 0) {
+                /* Child */
+                r = user_teardown_run(t->runtime_path, t->uid, t->remove_ipc);
+                _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+
+        r = sd_event_add_child(t->manager->event, &t->child_event_source, t->child, WEXITED, on_user_teardown_exit, t);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to watch teardown worker " PID_FMT " of user %s, waiting for it: %m",
+                                  t->child, t->user_name);
+                user_teardown_wait_one(t);
+                user_teardown_next(t);
+                return -ECHILD;
+        }
+
+        log_debug("Tearing down user %s in worker " PID_FMT ".", t->user_name, t->child);
+        return 0;
+}
+
+bool user_teardown_pending(User *u) {
+        assert(u);
+        assert(u->manager);
+        assert(u->user_record);
+
+        return hashmap_contains(u->manager->user_teardowns, UID_TO_PTR(u->user_record->uid));
+}
+
+int user_teardown_start(User *u) {
+        _cleanup_(user_teardown_freep) UserTeardown *t = NULL;
+        UserTeardown *busy;
+        bool remove_ipc;
+        uid_t uid;
+        int r;
+
+        assert(u);
+        assert(u->manager);
+        assert(u->user_record);
+
+        uid = u->user_record->uid;
+
+        /* Only clean IPC objects of normal users, see user_finalize() for the reasons */
+        remove_ipc = u->manager->remove_ipc && !uid_is_system(uid);
+
+        /* A previous worker for this user might still be busy, if the user logged in and out again
+         * quickly. Then go once more when it is done. */
+        busy = hashmap_get(u->manager->user_teardowns, UID_TO_PTR(uid));
+        if (busy) {
+                busy->again = true;
+                busy->remove_ipc = busy->remove_ipc || remove_ipc;
+                return 0;
+        }
+
+        t = new(UserTeardown, 1);
+        if (!t)
+                return log_oom();
+
+        *t = (UserTeardown) {
+                .uid = uid,
+                .user_name = strdup(u->user_record->user_name),
+                .remove_ipc = remove_ipc,
+        };
+
+        if (!t->user_name)
+                return log_oom();
+
+        if (u->runtime_path) {
+                t->runtime_path = strdup(u->runtime_path);
+                if (!t->runtime_path)
+                        return log_oom();
+        }
+
+        r = hashmap_ensure_put(&u->manager->user_teardowns, &user_teardown_hash_ops, UID_TO_PTR(uid), t);
+        if (r < 0)
+                return log_error_errno(r, "Failed to add teardown of user %s to hashmap: %m", t->user_name);
+
+        t->manager = u->manager;
+
+        /* From here on, the teardown frees itself once done */
+        (void) user_teardown_fork(TAKE_PTR(t));
+        return 0;
+}
+#endif // 1
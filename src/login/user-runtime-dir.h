@@ -25,4 +25,7 @@
 
 int user_runtime_dir(const char *verb, User *u);
 
+int user_teardown_start(User *u);
+bool user_teardown_pending(User *u);
+
 #endif // ELOGIND_SRC_LOGIN_USER_RUNTIME_DIR_H_INCLUDED
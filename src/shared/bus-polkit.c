@@ -6,6 +6,8 @@
 #include "bus-util.h"
 #include "strv.h"
 #include "user-util.h"
+/// Additional includes needed by elogind
+#include "siphash24.h"
 
 static int check_good_user(sd_bus_message *m, uid_t good_user) {
         _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *creds = NULL;
@@ -31,6 +33,333 @@ static int check_good_user(sd_bus_message *m, uid_t good_user) {
         return sender_uid == good_user;
 }
 
+#if 1 /// elogind can cache polkit decisions, see bus_polkit_cache_new()
+/* Most callers ask polkit the very same question over and over again, e.g. a session manager checking
+ * whether it may suspend, or taking the same inhibitor lock again. If a BusPolkitCache is passed to
+ * bus_test_polkit_full() or bus_verify_polkit_async_full(), plain "yes" and "no" answers to non-interactive
+ * queries are remembered for a short while, per sender, action and details. Answers that need a
+ * challenge, and temporary authorizations (which polkit may revoke at any time) are never cached. The
+ * cache is flushed whenever polkit announces a change of its configuration, and the answers for a sender
+ * are dropped when it disconnects. Since a decision may also depend on whether the session of the sender
+ * is active, callers should flush the cache when that changes. */
+
+#define POLKIT_CACHE_MAX 1024U
+
+typedef struct PolkitDecision {
+        char *sender;
+        char *action;
+        char **details;
+
+        bool authorized;
+        usec_t until;
+} PolkitDecision;
+
+static PolkitDecision* polkit_decision_free(PolkitDecision *d) {
+        if (!d)
+                return NULL;
+
+        free(d->sender);
+        free(d->action);
+        strv_free(d->details);
+
+        return mfree(d);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(PolkitDecision*, polkit_decision_free);
+
+static void polkit_decision_hash_func(const PolkitDecision *d, struct siphash *state) {
+        char **i;
+
+        assert(d);
+
+        string_hash_func(d->sender, state);
+        string_hash_func(d->action, state);
+        STRV_FOREACH(i, d->details)
+                string_hash_func(*i, state);
+}
+
+static int polkit_decision_compare_func(const PolkitDecision *x, const PolkitDecision *y) {
+        int r;
+
+        r = strcmp(x->sender, y->sender);
+        if (r != 0)
+                return r;
+
+        r = strcmp(x->action, y->action);
+        if (r != 0)
+                return r;
+
+        return strv_compare(x->details, y->details);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_KEY_DESTRUCTOR(
+                polkit_decision_hash_ops,
+                PolkitDecision,
+                polkit_decision_hash_func,
+                polkit_decision_compare_func,
+                polkit_decision_free);
+
+DEFINE_PRIVATE_HASH_OPS_FULL(
+                owner_slot_hash_ops,
+                char,
+                string_hash_func,
+                string_compare_func,
+                free,
+                sd_bus_slot,
+                sd_bus_slot_unref);
+
+void bus_polkit_cache_flush(BusPolkitCache *c) {
+        if (!c)
+                return;
+
+        set_clear(c->decisions);
+}
+
+static int on_name_owner_changed(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        BusPolkitCache *c = userdata;
+        const char *name, *old_owner, *new_owner;
+        _cleanup_free_ char *key = NULL;
+        PolkitDecision *d;
+        int r;
+
+        assert(message);
+        assert(c);
+
+        r = sd_bus_message_read(message, "sss", &name, &old_owner, &new_owner);
+        if (r < 0) {
+                bus_log_parse_error(r);
+                return 0;
+        }
+
+        /* Only disconnecting clients are of interest, everything they asked about is moot now */
+        if (!isempty(new_owner))
+                return 0;
+
+        SET_FOREACH(d, c->decisions)
+                if (streq(d->sender, name))
+                        polkit_decision_free(set_remove(c->decisions, d));
+
+        /* This drops the slot we are called from, which sd-bus keeps a reference to until we return */
+        sd_bus_slot_unref(hashmap_remove2(c->owner_slots, name, (void**) &key));
+        return 0;
+}
+
+static int on_name_owner_changed_installed(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        /* Unique names are never reused, so if we can't tell when a sender disconnects, its decisions merely
+         * stay around until they expire */
+        if (sd_bus_message_is_method_error(message, NULL))
+                log_debug_errno(sd_bus_message_get_errno(message),
+                                "Failed to watch a sender of cached polkit decisions, ignoring: %m");
+
+        return 0;
+}
+
+static int bus_polkit_cache_watch_owner(BusPolkitCache *c, const char *sender) {
+        _cleanup_(sd_bus_slot_unrefp) sd_bus_slot *slot = NULL;
+        _cleanup_free_ char *match = NULL, *s = NULL;
+        int r;
+
+        assert(c);
+        assert(sender);
+
+        /* Instead of being woken up by every client of the bus coming and going, only listen for those that
+         * we have cached decisions for */
+        if (sender[0] != ':' || hashmap_contains(c->owner_slots, sender))
+                return 0;
+
+        match = strjoin("type='signal',"
+                        "sender='org.freedesktop.DBus',"
+                        "path='/org/freedesktop/DBus',"
+                        "interface='org.freedesktop.DBus',"
+                        "member='NameOwnerChanged',"
+                        "arg0='", sender, "'");
+        if (!match)
+                return -ENOMEM;
+
+        s = strdup(sender);
+        if (!s)
+                return -ENOMEM;
+
+        r = sd_bus_add_match_async(c->bus, &slot, match, on_name_owner_changed, on_name_owner_changed_installed, c);
+        if (r < 0)
+                return r;
+
+        r = hashmap_ensure_put(&c->owner_slots, &owner_slot_hash_ops, s, slot);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(s);
+        TAKE_PTR(slot);
+        return 1;
+}
+
+static int on_polkit_changed(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        BusPolkitCache *c = userdata;
+
+        assert(c);
+
+        log_debug("polkit configuration changed, flushing cached decisions.");
+        bus_polkit_cache_flush(c);
+        return 0;
+}
+
+int bus_polkit_cache_new(BusPolkitCache **ret, sd_bus *bus, usec_t ttl) {
+        _cleanup_(bus_polkit_cache_freep) BusPolkitCache *c = NULL;
+        int r;
+
+        assert(ret);
+        assert(bus);
+        assert(ttl > 0);
+
+        c = new(BusPolkitCache, 1);
+        if (!c)
+                return -ENOMEM;
+
+        *c = (BusPolkitCache) {
+                .bus = sd_bus_ref(bus),
+                .ttl = ttl,
+        };
+
+        r = sd_bus_match_signal_async(
+                        bus,
+                        &c->polkit_changed_slot,
+                        "org.freedesktop.PolicyKit1",
+                        "/org/freedesktop/PolicyKit1/Authority",
+                        "org.freedesktop.PolicyKit1.Authority",
+                        "Changed",
+                        on_polkit_changed, NULL, c);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(c);
+        return 0;
+}
+
+BusPolkitCache* bus_polkit_cache_free(BusPolkitCache *c) {
+        if (!c)
+                return NULL;
+
+        hashmap_free(c->owner_slots);
+        sd_bus_slot_unref(c->polkit_changed_slot);
+        sd_bus_unref(c->bus);
+
+        set_free(c->decisions);
+
+        return mfree(c);
+}
+
+int bus_polkit_cache_lookup(BusPolkitCache *c, const char *sender, const char *action, const char **details) {
+        PolkitDecision *d;
+
+        /* Returns > 0 if the sender is authorized, 0 if it is not, and -ENOENT if we have to ask polkit */
+
+        if (!c)
+                return -ENOENT;
+
+        d = set_get(c->decisions, &(PolkitDecision) {
+                        .sender = (char*) sender,
+                        .action = (char*) action,
+                        .details = (char**) details,
+                });
+        if (d && d->until <= now(CLOCK_MONOTONIC)) {
+                polkit_decision_free(set_remove(c->decisions, d));
+                d = NULL;
+        }
+        if (!d) {
+                c->n_misses++;
+                return -ENOENT;
+        }
+
+        c->n_hits++;
+        log_debug("Using cached polkit decision for action %s of %s, %" PRIu64 " polkit round trips avoided so far.",
+                  action, sender, c->n_hits);
+
+        return d->authorized;
+}
+
+int bus_polkit_cache_put(BusPolkitCache *c, const char *sender, const char *action, const char **details, bool authorized) {
+        _cleanup_(polkit_decision_freep) PolkitDecision *d = NULL;
+        int r;
+
+        assert(c);
+        assert(sender);
+        assert(action);
+
+        if (set_size(c->decisions) >= POLKIT_CACHE_MAX)
+                bus_polkit_cache_flush(c);
+
+        d = new(PolkitDecision, 1);
+        if (!d)
+                return -ENOMEM;
+
+        *d = (PolkitDecision) {
+                .sender = strdup(sender),
+                .action = strdup(action),
+                .details = strv_copy((char**) details),
+                .authorized = authorized,
+                .until = usec_add(now(CLOCK_MONOTONIC), c->ttl),
+        };
+
+        if (!d->sender || !d->action || (details && !d->details))
+                return -ENOMEM;
+
+        r = bus_polkit_cache_watch_owner(c, sender);
+        if (r < 0)
+                return r;
+
+        /* A decision made in the meantime replaces the old one */
+        polkit_decision_free(set_remove(c->decisions, d));
+
+        r = set_ensure_put(&c->decisions, &polkit_decision_hash_ops, d);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(d);
+        return 0;
+}
+
+#if ENABLE_POLKIT
+static void bus_polkit_cache_put_reply(
+                BusPolkitCache *c,
+                sd_bus_message *reply,
+                const char *sender,
+                const char *action,
+                const char **details,
+                bool authorized,
+                bool challenge) {
+
+        int r;
+
+        /* Expects the reply to be positioned right after the "bb" of the CheckAuthorization() result */
+
+        if (!c || challenge)
+                return;
+
+        r = sd_bus_message_enter_container(reply, 'a', "{ss}");
+        if (r < 0)
+                return;
+
+        for (;;) {
+                const char *k, *v;
+
+                r = sd_bus_message_read(reply, "{ss}", &k, &v);
+                if (r <= 0)
+                        break;
+
+                /* The user authenticated a while ago, which polkit may forget at any time */
+                if (streq(k, "polkit.temporary_authorization_id"))
+                        return;
+        }
+        if (r < 0)
+                return;
+
+        r = bus_polkit_cache_put(c, sender, action, details, authorized);
+        if (r < 0)
+                log_debug_errno(r, "Failed to cache polkit decision for action %s of %s, ignoring: %m", action, sender);
+}
+#endif
+#endif // 1
+
 #if ENABLE_POLKIT
 static int bus_message_append_strv_key_value(
                 sd_bus_message *m,
@@ -59,13 +388,20 @@ static int bus_message_append_strv_key_value(
 }
 #endif
 
+#if 0 /// elogind can cache polkit decisions, see bus_polkit_cache_new()
 int bus_test_polkit(
+#else // 0
+int bus_test_polkit_full(
+#endif // 0
                 sd_bus_message *call,
                 int capability,
                 const char *action,
                 const char **details,
                 uid_t good_user,
                 bool *_challenge,
+#if 1 /// see above
+                BusPolkitCache *cache,
+#endif // 1
                 sd_bus_error *ret_error) {
 
         int r;
@@ -95,6 +431,19 @@ int bus_test_polkit(
                 if (!sender)
                         return -EBADMSG;
 
+#if 1 /// elogind can cache polkit decisions, see bus_polkit_cache_new()
+                r = bus_polkit_cache_lookup(cache, sender, action, details);
+                if (r > 0)
+                        return 1;
+                if (r == 0) {
+                        if (_challenge) {
+                                *_challenge = false;
+                                return 0;
+                        }
+
+                        return -EACCES;
+                }
+#endif // 1
                 r = sd_bus_message_new_method_call(
                                 call->bus,
                                 &request,
@@ -140,6 +489,9 @@ int bus_test_polkit(
                 if (r < 0)
                         return r;
 
+#if 1 /// elogind can cache polkit decisions, see bus_polkit_cache_new()
+                bus_polkit_cache_put_reply(cache, reply, sender, action, details, authorized, challenge);
+#endif // 1
                 if (authorized)
                         return 1;
 
@@ -164,6 +516,9 @@ typedef struct AsyncPolkitQuery {
 
         Hashmap *registry;
         sd_event_source *defer_event_source;
+#if 1 /// elogind only caches answers to non-interactive queries, see bus_polkit_cache_put_reply()
+        bool interactive;
+#endif // 1
 } AsyncPolkitQuery;
 
 static void async_polkit_query_free(AsyncPolkitQuery *q) {
@@ -249,7 +604,11 @@ fail:
 
 #endif
 
+#if 0 /// elogind can cache polkit decisions, see bus_polkit_cache_new()
 int bus_verify_polkit_async(
+#else // 0
+int bus_verify_polkit_async_full(
+#endif // 0
                 sd_bus_message *call,
                 int capability,
                 const char *action,
@@ -257,6 +616,9 @@ int bus_verify_polkit_async(
                 bool interactive,
                 uid_t good_user,
                 Hashmap **registry,
+#if 1 /// see above
+                BusPolkitCache *cache,
+#endif // 1
                 sd_bus_error *ret_error) {
 
 #if ENABLE_POLKIT
@@ -311,6 +673,12 @@ int bus_verify_polkit_async(
                 if (r < 0)
                         return r;
 
+#if 1 /// elogind can cache polkit decisions, see bus_polkit_cache_new()
+                if (!q->interactive && sd_bus_message_get_sender(call))
+                        bus_polkit_cache_put_reply(cache, q->reply, sd_bus_message_get_sender(call), action, details,
+                                                   authorized, challenge);
+#endif // 1
+
                 if (authorized)
                         return 1;
 
@@ -338,6 +706,16 @@ int bus_verify_polkit_async(
         if (c > 0)
                 interactive = true;
 
+#if 1 /// elogind can cache polkit decisions, see bus_polkit_cache_new()
+        if (!interactive) {
+                r = bus_polkit_cache_lookup(cache, sender, action, details);
+                if (r > 0)
+                        return 1;
+                if (r == 0)
+                        return -EACCES;
+        }
+#endif // 1
+
         r = hashmap_ensure_allocated(registry, NULL);
         if (r < 0)
                 return r;
@@ -374,6 +752,9 @@ int bus_verify_polkit_async(
 
         *q = (AsyncPolkitQuery) {
                 .request = sd_bus_message_ref(call),
+#if 1 /// see above
+                .interactive = interactive,
+#endif // 1
         };
 
         q->action = strdup(action);
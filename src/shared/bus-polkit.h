@@ -4,8 +4,45 @@
 #include "sd-bus.h"
 
 #include "hashmap.h"
+#if 1 /// elogind can cache polkit decisions, see bus_polkit_cache_new()
+#include "set.h"
+#include "time-util.h"
 
+typedef struct BusPolkitCache {
+        sd_bus *bus;
+
+        Set *decisions;
+        usec_t ttl;
+
+        Hashmap *owner_slots; /* sender → slot of the match telling us about it disconnecting */
+        sd_bus_slot *polkit_changed_slot;
+
+        uint64_t n_hits;   /* polkit round trips avoided */
+        uint64_t n_misses; /* polkit round trips made, despite the cache */
+} BusPolkitCache;
+
+int bus_polkit_cache_new(BusPolkitCache **ret, sd_bus *bus, usec_t ttl);
+BusPolkitCache* bus_polkit_cache_free(BusPolkitCache *c);
+void bus_polkit_cache_flush(BusPolkitCache *c);
+int bus_polkit_cache_lookup(BusPolkitCache *c, const char *sender, const char *action, const char **details);
+int bus_polkit_cache_put(BusPolkitCache *c, const char *sender, const char *action, const char **details, bool authorized);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(BusPolkitCache*, bus_polkit_cache_free);
+#endif // 1
+
+#if 0 /// elogind can cache polkit decisions, see bus_polkit_cache_new()
 int bus_test_polkit(sd_bus_message *call, int capability, const char *action, const char **details, uid_t good_user, bool *_challenge, sd_bus_error *e);
 
 int bus_verify_polkit_async(sd_bus_message *call, int capability, const char *action, const char **details, bool interactive, uid_t good_user, Hashmap **registry, sd_bus_error *error);
+#else // 0
+int bus_test_polkit_full(sd_bus_message *call, int capability, const char *action, const char **details, uid_t good_user, bool *_challenge, BusPolkitCache *cache, sd_bus_error *e);
+static inline int bus_test_polkit(sd_bus_message *call, int capability, const char *action, const char **details, uid_t good_user, bool *_challenge, sd_bus_error *e) {
+        return bus_test_polkit_full(call, capability, action, details, good_user, _challenge, NULL, e);
+}
+
+int bus_verify_polkit_async_full(sd_bus_message *call, int capability, const char *action, const char **details, bool interactive, uid_t good_user, Hashmap **registry, BusPolkitCache *cache, sd_bus_error *error);
+static inline int bus_verify_polkit_async(sd_bus_message *call, int capability, const char *action, const char **details, bool interactive, uid_t good_user, Hashmap **registry, sd_bus_error *error) {
+        return bus_verify_polkit_async_full(call, capability, action, details, interactive, good_user, registry, NULL, error);
+}
+#endif // 0
 void bus_verify_polkit_async_registry_free(Hashmap *registry);
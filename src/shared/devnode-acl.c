@@ -158,11 +158,15 @@ finish:
         return r;
 }
 
+#if 0 /// elogind keeps an index of each seat's nodes, and needs to find them separately
 int devnode_acl_all(const char *seat,
                     bool flush,
                     bool del, uid_t old_uid,
                     bool add, uid_t new_uid) {
 
+#else // 0
+int devnode_acl_find_nodes(const char *seat, Set **ret) {
+#endif // 0
         _cleanup_(sd_device_enumerator_unrefp) sd_device_enumerator *e = NULL;
         _cleanup_set_free_free_ Set *nodes = NULL;
         _cleanup_closedir_ DIR *dir = NULL;
@@ -171,6 +175,10 @@ int devnode_acl_all(const char *seat,
         char *n;
         int r;
 
+#if 1 /// see above
+        assert(ret);
+#endif // 1
+
         nodes = set_new(&path_hash_ops);
         if (!nodes)
                 return -ENOMEM;
@@ -237,7 +245,30 @@ int devnode_acl_all(const char *seat,
                 }
         }
 
+#if 0 /// see above
         r = 0;
+#else // 0
+        *ret = TAKE_PTR(nodes);
+        return 0;
+}
+
+int devnode_acl_all(const char *seat,
+                    bool flush,
+                    bool del, uid_t old_uid,
+                    bool add, uid_t new_uid) {
+
+        _cleanup_set_free_free_ Set *nodes = NULL;
+        char *n;
+        int r;
+
+        if (isempty(seat))
+                seat = "seat0";
+
+        r = devnode_acl_find_nodes(seat, &nodes);
+        if (r < 0)
+                return r;
+#endif // 0
+
         SET_FOREACH(n, nodes) {
                 int k;
 
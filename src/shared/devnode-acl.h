@@ -4,6 +4,10 @@
 #include <stdbool.h>
 #include <sys/types.h>
 
+#if 1 /// elogind needs Set for devnode_acl_find_nodes()
+#include "set.h"
+#endif // 1
+
 #if HAVE_ACL
 
 int devnode_acl(const char *path,
@@ -11,6 +15,10 @@ int devnode_acl(const char *path,
                 bool del, uid_t old_uid,
                 bool add, uid_t new_uid);
 
+#if 1 /// elogind keeps an index of each seat's nodes
+int devnode_acl_find_nodes(const char *seat, Set **ret);
+#endif // 1
+
 int devnode_acl_all(const char *seat,
                     bool flush,
                     bool del, uid_t old_uid,
@@ -24,6 +32,13 @@ static inline int devnode_acl(const char *path,
         return 0;
 }
 
+#if 1 /// elogind keeps an index of each seat's nodes
+static inline int devnode_acl_find_nodes(const char *seat, Set **ret) {
+        *ret = NULL;
+        return 0;
+}
+#endif // 1
+
 static inline int devnode_acl_all(const char *seat,
                                   bool flush,
                                   bool del, uid_t old_uid,
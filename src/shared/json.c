@@ -19,6 +19,7 @@
 #include "json.h"
 #include "macro.h"
 #include "memory-util.h"
+#include "sort-util.h"
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
@@ -90,6 +91,12 @@ struct JsonVariant {
         /* If in addition to this object all objects referenced by it are also ordered strictly by name */
         bool normalized:1;
 
+#if 1 /// elogind can allocate a whole parse tree in one go, see JSON_PARSE_ARENA
+        /* If this variant lives in a parse arena. If it is not embedded, it is the arena's root, and the whole arena
+         * is released together with it. */
+        bool is_arena:1;
+#endif // 1
+
         union {
                 /* For simple types we store the value in-line. */
                 JsonValue value;
@@ -157,6 +164,41 @@ static bool json_source_equal(JsonSource *a, JsonSource *b) {
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(JsonSource*, json_source_unref);
 
+#if 1 /// elogind can allocate a whole parse tree in one go, see JSON_PARSE_ARENA
+/* When parsing with JSON_PARSE_ARENA all variants of the resulting tree are placed in a single allocation: this
+ * header, followed by the root variant, followed by the arrays, objects and long strings referenced from it. The
+ * root is the only variant in the arena that is reference counted, all others are embedded, and forward their
+ * references to it. The arena's variants don't own references to the JsonSource they were parsed from, only the
+ * root does. */
+typedef struct JsonArena {
+        size_t size;
+        size_t reserved;
+} JsonArena;
+
+assert_cc(sizeof(JsonArena) % __alignof(JsonVariant) == 0);
+
+static JsonVariant *json_arena_root(void *arena) {
+        return (JsonVariant*) ((uint8_t*) arena + sizeof(JsonArena));
+}
+
+static void json_arena_free(JsonVariant *root) {
+        JsonArena *a;
+
+        assert(root);
+        assert(root->is_arena);
+        assert(!root->is_embedded);
+
+        a = (JsonArena*) ((uint8_t*) root - sizeof(JsonArena));
+
+        json_source_unref(root->source);
+
+        if (root->sensitive)
+                explicit_bzero_safe(a, a->size);
+
+        free(a);
+}
+#endif // 1
+
 /* There are four kind of JsonVariant* pointers:
  *
  *    1. NULL
@@ -827,6 +869,12 @@ JsonVariant *json_variant_unref(JsonVariant *v) {
                 v->n_ref--;
 
                 if (v->n_ref == 0) {
+#if 1 /// elogind: parse arenas are released in one go
+                        if (v->is_arena) {
+                                json_arena_free(v);
+                                return NULL;
+                        }
+#endif // 1
                         json_variant_free_inner(v, false);
                         free(v);
                 }
@@ -1419,6 +1467,15 @@ void json_variant_sensitive(JsonVariant *v) {
                 return;
 
         v->sensitive = true;
+
+#if 1 /// elogind: parse arenas are erased as a whole, hence mark the arena's root too
+        if (v->is_arena) {
+                while (v->is_embedded)
+                        v = v->parent;
+
+                v->sensitive = true;
+        }
+#endif // 1
 }
 
 bool json_variant_is_sensitive(JsonVariant *v) {
@@ -2838,6 +2895,568 @@ static void json_stack_release(JsonStack *s) {
         s->elements = mfree(s->elements);
 }
 
+#if 1 /// elogind can sort objects while parsing them, see JSON_PARSE_SORTED
+static int json_cmp_strings(const void *x, const void *y);
+
+static int json_cmp_pair_indexes(const void *x, const void *y, void *userdata) {
+        const size_t *a = x, *b = y;
+        JsonVariant **elements = userdata;
+        int r;
+
+        r = json_cmp_strings(elements + *a * 2, elements + *b * 2);
+        if (r != 0)
+                return r;
+
+        /* Keep duplicate keys in the order they were parsed in */
+        return CMP(*a, *b);
+}
+
+static int json_sort_pairs(JsonVariant **elements, size_t n_elements) {
+        _cleanup_free_ JsonVariant **sorted = NULL;
+        _cleanup_free_ size_t *indexes = NULL;
+        size_t n = n_elements / 2;
+
+        /* qsort() is not stable, and the keys have nothing we could tell their original position from, hence
+         * sort their indexes instead */
+
+        indexes = new(size_t, n);
+        sorted = new(JsonVariant*, n_elements);
+        if (!indexes || !sorted)
+                return -ENOMEM;
+
+        for (size_t i = 0; i < n; i++)
+                indexes[i] = i;
+
+        qsort_r_safe(indexes, n, sizeof(size_t), json_cmp_pair_indexes, elements);
+
+        for (size_t i = 0; i < n; i++) {
+                sorted[i * 2] = elements[indexes[i] * 2];
+                sorted[i * 2 + 1] = elements[indexes[i] * 2 + 1];
+        }
+
+        memcpy(elements, sorted, n_elements * sizeof(JsonVariant*));
+        return 0;
+}
+
+#endif // 1
+#if 1 /// elogind can allocate a whole parse tree in one go, see JSON_PARSE_ARENA
+typedef struct JsonArenaStack {
+        JsonExpect expect;
+        JsonVariantType type;
+        JsonVariant *items; /* The elements collected so far, already in the form they are embedded in the arena */
+        size_t n_items;
+        uint16_t depth;
+        bool normalized;
+        unsigned line_before;
+        unsigned column_before;
+} JsonArenaStack;
+
+/* While the arena is built it is grown with realloc(), and hence might move around. References between its
+ * variants are hence stored as offsets from its start first, and turned into pointers once it is complete. No
+ * offset is ever smaller than the root's, hence they never collide with the magic pointers. */
+assert_cc((size_t) __JSON_VARIANT_MAGIC_MAX < sizeof(JsonArena) + sizeof(JsonVariant));
+
+static JsonVariant *json_arena_at(uint8_t *buf, JsonVariant *reference) {
+        return (JsonVariant*) (buf + (uintptr_t) reference);
+}
+
+static const char *json_arena_string(uint8_t *buf, JsonVariant *w) {
+        return w->is_reference ? json_arena_at(buf, w->reference)->string : w->string;
+}
+
+static size_t json_arena_string_size(size_t n) {
+        return ALIGN_TO(MAX(sizeof(JsonVariant), offsetof(JsonVariant, string) + n + 1), __alignof(JsonVariant));
+}
+
+static int json_arena_cmp_pairs(const void *x, const void *y, void *userdata) {
+        const JsonVariant *a = x, *b = y;
+        int r;
+
+        r = strcmp(json_arena_string(userdata, (JsonVariant*) a),
+                   json_arena_string(userdata, (JsonVariant*) b));
+        if (r != 0)
+                return r;
+
+        /* Keep duplicate keys in the order they were parsed in, see json_arena_close() */
+        return CMP(a->n_ref, b->n_ref);
+}
+
+static int json_arena_alloc(uint8_t **buf, size_t *used, size_t size, JsonVariant **ret, size_t *ret_offset) {
+        assert(buf);
+        assert(used);
+        assert(size % __alignof(JsonVariant) == 0);
+
+        if (size > SIZE_MAX - *used)
+                return -ENOMEM;
+
+        if (!GREEDY_REALLOC(*buf, *used + size))
+                return -ENOMEM;
+
+        *ret = (JsonVariant*) (*buf + *used);
+        *ret_offset = *used;
+        *used += size;
+
+        return 0;
+}
+
+static void json_arena_stack_release(JsonArenaStack *s) {
+        assert(s);
+
+        s->items = mfree(s->items);
+        s->n_items = 0;
+}
+
+static void json_arena_stack_expect_next(JsonArenaStack *s) {
+        assert(s);
+
+        if (s->expect == EXPECT_TOPLEVEL)
+                s->expect = EXPECT_END;
+        else if (s->expect == EXPECT_OBJECT_VALUE)
+                s->expect = EXPECT_OBJECT_COMMA;
+        else {
+                assert(IN_SET(s->expect, EXPECT_ARRAY_FIRST_ELEMENT, EXPECT_ARRAY_NEXT_ELEMENT));
+                s->expect = EXPECT_ARRAY_COMMA;
+        }
+}
+
+static JsonVariant *json_arena_stack_push(
+                JsonArenaStack *s,
+                JsonParseFlags flags,
+                JsonSource *source,
+                unsigned line,
+                unsigned column) {
+
+        JsonVariant *w;
+
+        assert(s);
+
+        if (!GREEDY_REALLOC(s->items, s->n_items + 1))
+                return NULL;
+
+        w = s->items + s->n_items++;
+        *w = (JsonVariant) {
+                .is_embedded = true,
+                .is_arena = true,
+        };
+
+        /* Recording the location is opt-in, see JSON_PARSE_LOCATION */
+        if (FLAGS_SET(flags, JSON_PARSE_LOCATION)) {
+                w->source = source;
+                w->line = line;
+                w->column = column;
+
+                if (source && line > source->max_line)
+                        source->max_line = line;
+                if (source && column > source->max_column)
+                        source->max_column = column;
+        }
+
+        if (s->depth < 1)
+                s->depth = 1;
+
+        return w;
+}
+
+static int json_arena_set_string(uint8_t **buf, size_t *used, JsonVariant *w, const char *s) {
+        JsonVariant *c;
+        size_t n, offset;
+        int r;
+
+        assert(w);
+        assert(s);
+
+        n = strlen(s);
+        if (!utf8_is_valid_n(s, n)) /* JSON strings must be valid UTF-8 */
+                return -EUCLEAN;
+
+        w->type = JSON_VARIANT_STRING;
+
+        /* Short strings we can store inline */
+        if (n <= INLINE_STRING_MAX) {
+                memcpy(w->string, s, n + 1);
+                return 0;
+        }
+
+        r = json_arena_alloc(buf, used, json_arena_string_size(n), &c, &offset);
+        if (r < 0)
+                return r;
+
+        *c = (JsonVariant) {
+                .is_embedded = true,
+                .is_arena = true,
+                .type = JSON_VARIANT_STRING,
+                .source = w->source,
+                .line = w->line,
+                .column = w->column,
+        };
+        memcpy(c->string, s, n + 1);
+
+        w->is_reference = true;
+        w->reference = (JsonVariant*) (uintptr_t) offset;
+
+        return 0;
+}
+
+static int json_arena_close(
+                uint8_t **buf,
+                size_t *used,
+                JsonArenaStack *child,
+                JsonArenaStack *parent,
+                JsonParseFlags flags,
+                JsonSource *source) {
+
+        JsonVariant *w, *c;
+        bool sorted = true;
+        size_t offset;
+        int r;
+
+        assert(child);
+        assert(parent);
+
+        w = json_arena_stack_push(parent, flags, source, child->line_before, child->column_before);
+        if (!w)
+                return -ENOMEM;
+
+        w->type = child->type;
+        w->is_reference = true;
+
+        if (child->n_items == 0) {
+                w->reference = child->type == JSON_VARIANT_OBJECT ? JSON_VARIANT_MAGIC_EMPTY_OBJECT : JSON_VARIANT_MAGIC_EMPTY_ARRAY;
+                return 0;
+        }
+
+        if (child->depth >= DEPTH_MAX) /* Refuse too deep nesting */
+                return -ELNRNG;
+
+        if (child->type == JSON_VARIANT_OBJECT) {
+                if (FLAGS_SET(flags, JSON_PARSE_SORTED)) {
+                        /* qsort() is not stable. The keys are not hooked up with their parent before
+                         * json_arena_relocate(), hence until then the field can record their position. */
+                        for (size_t i = 0; i < child->n_items; i += 2)
+                                child->items[i].n_ref = i;
+
+                        qsort_r_safe(child->items, child->n_items / 2, sizeof(JsonVariant) * 2, json_arena_cmp_pairs, *buf);
+                }
+
+                for (size_t i = 2; i < child->n_items; i += 2)
+                        if (strcmp(json_arena_string(*buf, child->items + i),
+                                   json_arena_string(*buf, child->items + i - 2)) <= 0) {
+                                sorted = child->normalized = false;
+                                break;
+                        }
+        }
+
+        r = json_arena_alloc(buf, used, (child->n_items + 1) * sizeof(JsonVariant), &c, &offset);
+        if (r < 0)
+                return r;
+
+        *c = (JsonVariant) {
+                .is_embedded = true,
+                .is_arena = true,
+                .type = child->type,
+                .n_elements = child->n_items,
+                .depth = child->depth,
+                .normalized = child->normalized,
+                .sorted = child->type == JSON_VARIANT_OBJECT && sorted,
+                .source = w->source,
+                .line = w->line,
+                .column = w->column,
+        };
+        memcpy(c + 1, child->items, child->n_items * sizeof(JsonVariant));
+
+        w->reference = (JsonVariant*) (uintptr_t) offset;
+
+        /* Some checks look at the referencing variant only, hence copy the flags */
+        w->normalized = c->normalized;
+        w->sorted = c->sorted;
+
+        if (child->depth >= parent->depth)
+                parent->depth = child->depth + 1;
+        if (!child->normalized)
+                parent->normalized = false;
+
+        return 0;
+}
+
+static void json_arena_relocate_one(uint8_t *buf, JsonVariant *w, JsonVariant *parent) {
+        if (!w->is_reference || json_variant_is_magic(w->reference))
+                return;
+
+        w->reference = json_arena_at(buf, w->reference);
+        w->reference->parent = parent;
+}
+
+static void json_arena_relocate(uint8_t *buf, size_t size) {
+        JsonVariant *root = json_arena_root(buf);
+        size_t offset;
+
+        /* Turns the offsets into pointers, and hooks up each variant with the variant it is embedded in */
+
+        json_arena_relocate_one(buf, root, root);
+
+        for (offset = sizeof(JsonArena) + sizeof(JsonVariant); offset < size;) {
+                JsonVariant *c = (JsonVariant*) (buf + offset);
+
+                if (c->type == JSON_VARIANT_STRING) {
+                        offset += json_arena_string_size(strlen(c->string));
+                        continue;
+                }
+
+                assert(IN_SET(c->type, JSON_VARIANT_ARRAY, JSON_VARIANT_OBJECT));
+
+                for (size_t i = 0; i < c->n_elements; i++) {
+                        c[1 + i].parent = c;
+                        json_arena_relocate_one(buf, c + 1 + i, c);
+                }
+
+                offset += (c->n_elements + 1) * sizeof(JsonVariant);
+        }
+}
+
+static int json_parse_arena(
+                const char **input,
+                JsonSource *source,
+                JsonParseFlags flags,
+                JsonVariant **ret,
+                unsigned *line,
+                unsigned *column,
+                bool continue_end) {
+
+        size_t n_stack = 1, used = sizeof(JsonArena) + sizeof(JsonVariant), i;
+        unsigned line_buffer = 0, column_buffer = 0;
+        _cleanup_free_ uint8_t *buf = NULL;
+        void *tokenizer_state = NULL;
+        JsonArenaStack *stack = NULL;
+        JsonVariant *root;
+        const char *p;
+        int r;
+
+        assert_return(input, -EINVAL);
+        assert_return(ret, -EINVAL);
+
+        p = *input;
+
+        /* Reserve room for the header and the root first, everything else is appended as it is completed */
+        if (!GREEDY_REALLOC(buf, used))
+                return -ENOMEM;
+
+        if (!GREEDY_REALLOC(stack, n_stack))
+                return -ENOMEM;
+
+        stack[0] = (JsonArenaStack) {
+                .expect = EXPECT_TOPLEVEL,
+                .normalized = true,
+        };
+
+        if (!line)
+                line = &line_buffer;
+        if (!column)
+                column = &column_buffer;
+
+        for (;;) {
+                _cleanup_free_ char *string = NULL;
+                unsigned line_token, column_token;
+                JsonArenaStack *current;
+                JsonVariant *w;
+                JsonValue value;
+                int token;
+
+                assert(n_stack > 0);
+                current = stack + n_stack - 1;
+
+                if (continue_end && current->expect == EXPECT_END)
+                        goto done;
+
+                token = json_tokenize(&p, &string, &value, &line_token, &column_token, &tokenizer_state, line, column);
+                if (token < 0) {
+                        r = token;
+                        goto finish;
+                }
+
+                switch (token) {
+
+                case JSON_TOKEN_END:
+                        if (current->expect != EXPECT_END) {
+                                r = -EINVAL;
+                                goto finish;
+                        }
+
+                        assert(current->n_items == 1);
+                        assert(n_stack == 1);
+                        goto done;
+
+                case JSON_TOKEN_COLON:
+                        if (current->expect != EXPECT_OBJECT_COLON) {
+                                r = -EINVAL;
+                                goto finish;
+                        }
+
+                        current->expect = EXPECT_OBJECT_VALUE;
+                        break;
+
+                case JSON_TOKEN_COMMA:
+                        if (current->expect == EXPECT_OBJECT_COMMA)
+                                current->expect = EXPECT_OBJECT_NEXT_KEY;
+                        else if (current->expect == EXPECT_ARRAY_COMMA)
+                                current->expect = EXPECT_ARRAY_NEXT_ELEMENT;
+                        else {
+                                r = -EINVAL;
+                                goto finish;
+                        }
+
+                        break;
+
+                case JSON_TOKEN_OBJECT_OPEN:
+                case JSON_TOKEN_ARRAY_OPEN:
+                        if (!IN_SET(current->expect, EXPECT_TOPLEVEL, EXPECT_OBJECT_VALUE, EXPECT_ARRAY_FIRST_ELEMENT, EXPECT_ARRAY_NEXT_ELEMENT)) {
+                                r = -EINVAL;
+                                goto finish;
+                        }
+
+                        if (!GREEDY_REALLOC(stack, n_stack+1)) {
+                                r = -ENOMEM;
+                                goto finish;
+                        }
+                        current = stack + n_stack - 1;
+
+                        /* Prepare the expect for when we return from the child */
+                        json_arena_stack_expect_next(current);
+
+                        stack[n_stack++] = (JsonArenaStack) {
+                                .expect = token == JSON_TOKEN_OBJECT_OPEN ? EXPECT_OBJECT_FIRST_KEY : EXPECT_ARRAY_FIRST_ELEMENT,
+                                .type = token == JSON_TOKEN_OBJECT_OPEN ? JSON_VARIANT_OBJECT : JSON_VARIANT_ARRAY,
+                                .normalized = true,
+                                .line_before = line_token,
+                                .column_before = column_token,
+                        };
+
+                        break;
+
+                case JSON_TOKEN_OBJECT_CLOSE:
+                case JSON_TOKEN_ARRAY_CLOSE:
+                        if (token == JSON_TOKEN_OBJECT_CLOSE ?
+                            !IN_SET(current->expect, EXPECT_OBJECT_FIRST_KEY, EXPECT_OBJECT_COMMA) :
+                            !IN_SET(current->expect, EXPECT_ARRAY_FIRST_ELEMENT, EXPECT_ARRAY_COMMA)) {
+                                r = -EINVAL;
+                                goto finish;
+                        }
+
+                        assert(n_stack > 1);
+
+                        r = json_arena_close(&buf, &used, current, current - 1, flags, source);
+                        if (r < 0)
+                                goto finish;
+
+                        json_arena_stack_release(current);
+                        n_stack--;
+                        break;
+
+                case JSON_TOKEN_STRING:
+                case JSON_TOKEN_REAL:
+                case JSON_TOKEN_INTEGER:
+                case JSON_TOKEN_UNSIGNED:
+                case JSON_TOKEN_BOOLEAN:
+                case JSON_TOKEN_NULL:
+                        if (!IN_SET(current->expect, EXPECT_TOPLEVEL, EXPECT_OBJECT_VALUE, EXPECT_ARRAY_FIRST_ELEMENT, EXPECT_ARRAY_NEXT_ELEMENT) &&
+                            !(token == JSON_TOKEN_STRING && IN_SET(current->expect, EXPECT_OBJECT_FIRST_KEY, EXPECT_OBJECT_NEXT_KEY))) {
+                                r = -EINVAL;
+                                goto finish;
+                        }
+
+                        w = json_arena_stack_push(current, flags, source, line_token, column_token);
+                        if (!w) {
+                                r = -ENOMEM;
+                                goto finish;
+                        }
+
+                        switch (token) {
+
+                        case JSON_TOKEN_STRING:
+                                r = json_arena_set_string(&buf, &used, w, string);
+                                if (r < 0)
+                                        goto finish;
+                                break;
+
+                        case JSON_TOKEN_REAL:
+                                w->type = JSON_VARIANT_REAL;
+                                w->value.real = value.real;
+                                break;
+
+                        case JSON_TOKEN_INTEGER:
+                                w->type = JSON_VARIANT_INTEGER;
+                                w->value.integer = value.integer;
+                                break;
+
+                        case JSON_TOKEN_UNSIGNED:
+                                w->type = JSON_VARIANT_UNSIGNED;
+                                w->value.unsig = value.unsig;
+                                break;
+
+                        case JSON_TOKEN_BOOLEAN:
+                                w->type = JSON_VARIANT_BOOLEAN;
+                                w->value.boolean = value.boolean;
+                                break;
+
+                        case JSON_TOKEN_NULL:
+                                w->type = JSON_VARIANT_NULL;
+                                break;
+                        }
+
+                        if (!w->is_reference && !json_variant_is_normalized(w))
+                                current->normalized = false;
+
+                        if (IN_SET(current->expect, EXPECT_OBJECT_FIRST_KEY, EXPECT_OBJECT_NEXT_KEY))
+                                current->expect = EXPECT_OBJECT_COLON;
+                        else
+                                json_arena_stack_expect_next(current);
+
+                        break;
+
+                default:
+                        assert_not_reached("Unexpected token");
+                }
+        }
+
+done:
+        assert(n_stack == 1);
+        assert(stack[0].n_items == 1);
+
+        /* Hand back what we over-allocated. It's fine if this moves the arena, nothing points into it yet. */
+        if (used < MALLOC_SIZEOF_SAFE(buf)) {
+                uint8_t *q;
+
+                q = realloc(buf, used);
+                if (q)
+                        buf = q;
+        }
+
+        *(JsonArena*) buf = (JsonArena) {
+                .size = used,
+        };
+
+        root = json_arena_root(buf);
+        *root = stack[0].items[0];
+        root->is_embedded = false;
+        root->n_ref = 1;
+        root->source = json_source_ref(root->source); /* The root owns the reference to the source */
+
+        json_arena_relocate(buf, used);
+
+        TAKE_PTR(buf);
+        *ret = root;
+        *input = p;
+        r = 0;
+
+finish:
+        for (i = 0; i < n_stack; i++)
+                json_arena_stack_release(stack + i);
+
+        free(stack);
+
+        return r;
+}
+
+#endif // 1
 static int json_parse_internal(
                 const char **input,
                 JsonSource *source,
@@ -2857,6 +3476,13 @@ static int json_parse_internal(
         assert_return(input, -EINVAL);
         assert_return(ret, -EINVAL);
 
+#if 1 /// elogind can allocate a whole parse tree in one go, see JSON_PARSE_ARENA
+        /* The arena is grown with realloc() while parsing, which would leave unerased copies of secrets
+         * behind. Hence sensitive input is always parsed into individually allocated variants. */
+        if (FLAGS_SET(flags, JSON_PARSE_ARENA) && !FLAGS_SET(flags, JSON_PARSE_SENSITIVE))
+                return json_parse_arena(input, source, flags, ret, line, column, continue_end);
+
+#endif // 1
         p = *input;
 
         if (!GREEDY_REALLOC(stack, n_stack))
@@ -2966,6 +3592,19 @@ static int json_parse_internal(
 
                         assert(n_stack > 1);
 
+#if 1 /// elogind can sort objects while parsing them, see JSON_PARSE_SORTED
+                        /* Sort the key/value pairs, so that json_variant_new_object() marks the object as
+                         * sorted, and lookups by key can bisect. If a key is used more than once, the
+                         * object is not marked sorted, and lookups fall back to a linear search. Such keys
+                         * stay in the order they were parsed in, and the same one is found as without
+                         * sorting. */
+                        if (FLAGS_SET(flags, JSON_PARSE_SORTED) && current->n_elements > 2) {
+                                r = json_sort_pairs(current->elements, current->n_elements);
+                                if (r < 0)
+                                        goto finish;
+                        }
+
+#endif // 1
                         r = json_variant_new_object(&add, current->elements, current->n_elements);
                         if (r < 0)
                                 goto finish;
@@ -3922,11 +4561,57 @@ int json_log_internal(
                                 NULL);
 }
 
+#if 1 /// elogind looks up dispatch table entries by bisection
+static int json_dispatch_index_compare(const size_t *a, const size_t *b, JsonDispatch *table) {
+        int r;
+
+        r = strcmp(table[*a].name, table[*b].name);
+        if (r != 0)
+                return r;
+
+        /* If a name is listed twice, the first entry wins, as with a linear search */
+        return CMP(*a, *b);
+}
+
+static const JsonDispatch *json_dispatch_find(
+                const JsonDispatch table[],
+                const size_t *index,
+                size_t n_index,
+                const JsonDispatch *wildcard,
+                const char *key) {
+
+        size_t a = 0, b = n_index;
+
+        if (!key)
+                return wildcard;
+
+        /* Find the first entry not ordered before the key */
+        while (b > a) {
+                size_t i = (a + b) / 2;
+
+                if (strcmp(table[index[i]].name, key) < 0)
+                        a = i + 1;
+                else
+                        b = i;
+        }
+
+        if (a < n_index && streq(table[index[a]].name, key))
+                return table + index[a];
+
+        return wildcard;
+}
+
+#endif // 1
 int json_dispatch(JsonVariant *v, const JsonDispatch table[], JsonDispatchCallback bad, JsonDispatchFlags flags, void *userdata) {
         const JsonDispatch *p;
         size_t i, n, m;
         int r, done = 0;
         bool *found;
+#if 1 /// elogind looks up dispatch table entries by bisection
+        const JsonDispatch *wildcard = NULL;
+        size_t *index, n_index = 0;
+        bool sorted = true;
+#endif // 1
 
         if (!json_variant_is_object(v)) {
                 json_log(v, flags, 0, "JSON variant is not an object.");
@@ -3942,6 +4627,27 @@ int json_dispatch(JsonVariant *v, const JsonDispatch table[], JsonDispatchCallba
 
         found = newa0(bool, m);
 
+#if 1 /// elogind looks up dispatch table entries by bisection
+        /* Instead of scanning the whole table for each field of the object, build a sorted index of the
+         * entries once. Entries listed after a catch-all entry can never match, so they are left out. Most
+         * tables are short, and if they are sorted by name already, sorting the index is a no-op. */
+        index = newa(size_t, m);
+        for (p = table; p->name; p++) {
+                if (p->name == POINTER_MAX) {
+                        wildcard = p;
+                        break;
+                }
+
+                if (n_index > 0 && strcmp(table[index[n_index-1]].name, p->name) >= 0)
+                        sorted = false;
+
+                index[n_index++] = p - table;
+        }
+
+        if (!sorted)
+                typesafe_qsort_r(index, n_index, json_dispatch_index_compare, (JsonDispatch*) table);
+
+#endif // 1
         n = json_variant_elements(v);
         for (i = 0; i < n; i += 2) {
                 JsonVariant *key, *value;
@@ -3949,12 +4655,17 @@ int json_dispatch(JsonVariant *v, const JsonDispatch table[], JsonDispatchCallba
                 assert_se(key = json_variant_by_index(v, i));
                 assert_se(value = json_variant_by_index(v, i+1));
 
+#if 0 /// elogind looks up dispatch table entries by bisection
                 for (p = table; p->name; p++)
                         if (p->name == POINTER_MAX ||
                             streq_ptr(json_variant_string(key), p->name))
                                 break;
 
                 if (p->name) { /* Found a matching entry! :-) */
+#else // 0
+                p = json_dispatch_find(table, index, n_index, wildcard, json_variant_string(key));
+                if (p) { /* Found a matching entry! :-) */
+#endif // 0
                         JsonDispatchFlags merged_flags;
 
                         merged_flags = flags | p->flags;
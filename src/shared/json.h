@@ -206,6 +206,13 @@ int json_variant_normalize(JsonVariant **v);
 
 typedef enum JsonParseFlags {
         JSON_PARSE_SENSITIVE = 1 << 0, /* mark variant as "sensitive", i.e. something containing secret key material or such */
+#if 1 /// elogind can sort objects while parsing them
+        JSON_PARSE_SORTED    = 1 << 1, /* sort the fields of all objects by name, so that lookups by key can bisect */
+#endif // 1
+#if 1 /// elogind can allocate a whole parse tree in one go
+        JSON_PARSE_ARENA     = 1 << 2, /* allocate the whole tree in one go, and release it in one go with the root */
+        JSON_PARSE_LOCATION  = 1 << 3, /* with JSON_PARSE_ARENA: record source, line and column of each variant */
+#endif // 1
 } JsonParseFlags;
 
 int json_parse(const char *string, JsonParseFlags flags, JsonVariant **ret, unsigned *ret_line, unsigned *ret_column);
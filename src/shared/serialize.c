@@ -14,7 +14,6 @@
 #include "strv.h"
 #include "tmpfile-util.h"
 
-#if 0 /// UNNEEDED by elogind
 int serialize_item(FILE *f, const char *key, const char *value) {
         assert(f);
         assert(key);
@@ -79,6 +78,7 @@ int serialize_item_format(FILE *f, const char *key, const char *format, ...) {
         return 1;
 }
 
+#if 0 /// UNNEEDED by elogind
 int serialize_fd(FILE *f, FDSet *fds, const char *key, int fd) {
         int copy;
 
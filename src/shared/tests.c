@@ -34,6 +34,9 @@
 #include "strv.h"
 #include "tests.h"
 
+/// Additional includes needed by elogind
+#include "mkdir.h"
+
 #if 0 /// UNNEEDED by elogind
 char* setup_fake_runtime_dir(void) {
         char t[] = "/tmp/fake-xdg-runtime-XXXXXX", *p;
@@ -165,6 +168,43 @@ bool have_namespaces(void) {
         assert_not_reached("unexpected exit code");
 }
 
+#if 1 /// elogind tests run on private mounts of the directories they write to
+int safe_fork_with_mount(
+                const char *name,
+                const char *what,
+                const char *where,
+                const char *type,
+                unsigned long flags,
+                const char *options) {
+
+        int r;
+
+        assert(name);
+        assert(what);
+        assert(where);
+
+        /* Forks off a child, with a mount namespace of its own, in which 'what' is mounted on 'where', see
+         * mount(2). Returns 0 in the child, and > 0 in the parent once the child exited successfully. If the
+         * mount cannot be set up, the child exits right away, and the tests it was meant for are skipped.
+         * Returns -EPERM without forking if not running as root. */
+
+        if (getuid() != 0)
+                return -EPERM;
+
+        r = safe_fork(name, FORK_DEATHSIG|FORK_LOG|FORK_WAIT|FORK_NEW_MOUNTNS|FORK_MOUNTNS_SLAVE, NULL);
+        if (r != 0)
+                return r < 0 ? r : 1;
+
+        (void) mkdir_p(where, 0755);
+        if (mount(what, where, type, flags, options) < 0) {
+                log_info_errno(errno, "Failed to mount %s on %s, skipping: %m", what, where);
+                _exit(EXIT_SUCCESS);
+        }
+
+        return 0;
+}
+#endif // 1
+
 #if 0 /// UNNEEDED by elogind
 bool can_memlock(void) {
         /* Let's see if we can mlock() a larger blob of memory. BPF programs are charged against
@@ -31,6 +31,15 @@ int log_tests_skipped(const char *message);
 int log_tests_skipped_errno(int r, const char *message);
 
 bool have_namespaces(void);
+#if 1 /// elogind tests run on private mounts of the directories they write to
+int safe_fork_with_mount(
+                const char *name,
+                const char *what,
+                const char *where,
+                const char *type,
+                unsigned long flags,
+                const char *options);
+#endif // 1
 
 #if 0 /// UNNEEDED by elogind
 /* We use the small but non-trivial limit here */
@@ -24,7 +24,11 @@ static int load_user(
 
         assert(f);
 
+#if 0 /// elogind sorts records while parsing, so that looking up their fields can bisect, and parses them into one allocation
         r = json_parse_file(f, path, 0, &v, NULL, NULL);
+#else // 0
+        r = json_parse_file(f, path, JSON_PARSE_SORTED|JSON_PARSE_ARENA|JSON_PARSE_LOCATION, &v, NULL, NULL);
+#endif // 0
         if (r < 0)
                 return r;
 
@@ -56,7 +60,11 @@ static int load_user(
                                 return -ENOMEM;
                 }
 
+#if 0 /// elogind sorts records while parsing, so that looking up their fields can bisect
                 r = json_parse_file(NULL, j, JSON_PARSE_SENSITIVE, &privileged_v, NULL, NULL);
+#else // 0
+                r = json_parse_file(NULL, j, JSON_PARSE_SENSITIVE|JSON_PARSE_SORTED, &privileged_v, NULL, NULL);
+#endif // 0
                 if (ERRNO_IS_PRIVILEGE(r))
                         have_privileged = false;
                 else if (r == -ENOENT)
@@ -177,7 +185,11 @@ static int load_group(
 
         assert(f);
 
+#if 0 /// elogind sorts records while parsing, so that looking up their fields can bisect, and parses them into one allocation
         r = json_parse_file(f, path, 0, &v, NULL, NULL);
+#else // 0
+        r = json_parse_file(f, path, JSON_PARSE_SORTED|JSON_PARSE_ARENA|JSON_PARSE_LOCATION, &v, NULL, NULL);
+#endif // 0
         if (r < 0)
                 return r;
 
@@ -201,7 +213,11 @@ static int load_group(
                                 return -ENOMEM;
                 }
 
+#if 0 /// elogind sorts records while parsing, so that looking up their fields can bisect
                 r = json_parse_file(NULL, j, JSON_PARSE_SENSITIVE, &privileged_v, NULL, NULL);
+#else // 0
+                r = json_parse_file(NULL, j, JSON_PARSE_SENSITIVE|JSON_PARSE_SORTED, &privileged_v, NULL, NULL);
+#endif // 0
                 if (ERRNO_IS_PRIVILEGE(r))
                         have_privileged = false;
                 else if (r == -ENOENT)
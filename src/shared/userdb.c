@@ -18,9 +18,170 @@
 #include "userdb-dropin.h"
 #include "userdb.h"
 #include "varlink.h"
+/// Additional includes needed by elogind
+#include <pthread.h>
+
+#include "process-util.h"
+#include "time-util.h"
 
 DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(link_hash_ops, void, trivial_hash_func, trivial_compare_func, Varlink, varlink_unref);
 
+#if 1 /// elogind keeps idle connections to userdb services around, and reuses them for later lookups
+/* At most one idle connection per service, keyed by the socket path, and only a handful of services. Pooled
+ * connections are not attached to any event loop, and are checked for liveness before being reused. The
+ * pool is shared by all threads, each connection taken out of it is used by one thread at a time. A
+ * forked off child must not reuse the connections of its parent, as both would then talk over the same
+ * socket, hence the pool belongs to the process that filled it. Connections that were not reused for a
+ * while are closed the next time the pool is looked at, all others when the process exits, or we are
+ * unloaded. */
+#define USERDB_POOL_MAX 16U
+#define USERDB_POOL_IDLE_USEC (10 * USEC_PER_SEC)
+
+typedef struct UserDBPoolEntry {
+        Varlink *link;
+        usec_t since;
+} UserDBPoolEntry;
+
+static UserDBPoolEntry* userdb_pool_entry_free(UserDBPoolEntry *e) {
+        if (!e)
+                return NULL;
+
+        varlink_unref(e->link);
+        return mfree(e);
+}
+
+DEFINE_PRIVATE_HASH_OPS_FULL(userdb_pool_hash_ops, char, string_hash_func, string_compare_func, free, UserDBPoolEntry, userdb_pool_entry_free);
+
+/* Held across fork(), so that a child never inherits it locked by a thread it does not have */
+static pthread_mutex_t userdb_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Hashmap *userdb_pool = NULL;
+static pid_t userdb_pool_pid = 0;
+
+static void userdb_pool_atfork_prepare(void) {
+        assert_se(pthread_mutex_lock(&userdb_pool_mutex) == 0);
+}
+
+static void userdb_pool_atfork_release(void) {
+        assert_se(pthread_mutex_unlock(&userdb_pool_mutex) == 0);
+}
+
+static void userdb_pool_atfork_register(void) {
+        assert_se(pthread_atfork(userdb_pool_atfork_prepare, userdb_pool_atfork_release, userdb_pool_atfork_release) == 0);
+}
+
+/* Also run when we are unloaded, e.g. as part of pam_elogind, so that the host keeps no sockets of ours */
+_destructor_ static void userdb_pool_free(void) {
+        userdb_pool = hashmap_free(userdb_pool);
+}
+
+static void userdb_pool_lock(void) {
+        static pthread_once_t once = PTHREAD_ONCE_INIT;
+        UserDBPoolEntry *e;
+        const char *path;
+        usec_t n;
+
+        assert_se(pthread_once(&once, userdb_pool_atfork_register) == 0);
+        assert_se(pthread_mutex_lock(&userdb_pool_mutex) == 0);
+
+        if (userdb_pool_pid != getpid_cached()) {
+                /* Closes our copies of the sockets only, the parent keeps using its own */
+                userdb_pool_free();
+                userdb_pool_pid = getpid_cached();
+                return;
+        }
+
+        n = now(CLOCK_MONOTONIC);
+        HASHMAP_FOREACH_KEY(e, path, userdb_pool) {
+                char *key;
+
+                if (usec_add(e->since, USERDB_POOL_IDLE_USEC) > n)
+                        continue;
+
+                log_debug("Pooled connection to %s was idle for too long, closing it.", path);
+                (void) varlink_close(e->link);
+                userdb_pool_entry_free(hashmap_remove2(userdb_pool, path, (void**) &key));
+                free(key);
+        }
+}
+
+static void userdb_pool_unlock(void) {
+        assert_se(pthread_mutex_unlock(&userdb_pool_mutex) == 0);
+}
+
+static Varlink* userdb_pool_get(const char *path) {
+        _cleanup_free_ char *key = NULL;
+        UserDBPoolEntry *e;
+        Varlink *vl;
+        int r;
+
+        assert(path);
+
+        userdb_pool_lock();
+        e = hashmap_remove2(userdb_pool, path, (void**) &key);
+        userdb_pool_unlock();
+        if (!e)
+                return NULL;
+
+        vl = TAKE_PTR(e->link);
+        userdb_pool_entry_free(e);
+
+        r = varlink_is_idle(vl);
+        if (r <= 0) {
+                log_debug_errno(r, "Pooled connection to %s is not reusable, dropping it.", path);
+                (void) varlink_close(vl);
+                varlink_unref(vl);
+                return NULL;
+        }
+
+        return vl;
+}
+
+static void userdb_pool_put(Varlink *vl) {
+        _cleanup_free_ UserDBPoolEntry *e = NULL;
+        _cleanup_free_ char *key = NULL;
+        const char *path;
+        int r;
+
+        assert(vl);
+
+        /* Takes over the reference to the connection, and either pools it or drops it. The connection might
+         * still be processing the final reply when we are called, but it will be idle by the time it is
+         * handed out again, or will be found to be unusable then. */
+
+        varlink_detach_event(vl);
+        (void) varlink_set_userdata(vl, NULL);
+
+        path = varlink_get_description(vl);
+        if (!path || varlink_get_n_pending(vl) > 1)
+                goto drop;
+
+        key = strdup(path);
+        e = new(UserDBPoolEntry, 1);
+        if (!key || !e)
+                goto drop;
+
+        *e = (UserDBPoolEntry) {
+                .link = vl,
+                .since = now(CLOCK_MONOTONIC),
+        };
+
+        userdb_pool_lock();
+        r = hashmap_size(userdb_pool) >= USERDB_POOL_MAX ? 0 :
+                hashmap_ensure_put(&userdb_pool, &userdb_pool_hash_ops, key, e);
+        userdb_pool_unlock();
+        if (r <= 0)
+                goto drop;
+
+        TAKE_PTR(key);
+        TAKE_PTR(e);
+        return;
+
+drop:
+        (void) varlink_close(vl);
+        varlink_unref(vl);
+}
+#endif // 1
+
 typedef enum LookupWhat {
         LOOKUP_USER,
         LOOKUP_GROUP,
@@ -343,7 +504,14 @@ finish:
                 iterator->error = -r;
 
         assert_se(set_remove(iterator->links, link) == link);
+#if 0 /// elogind reuses connections that ended with a regular reply
         link = varlink_unref(link);
+#else // 0
+        if (FLAGS_SET(flags, VARLINK_REPLY_LOCAL))
+                link = varlink_unref(link);
+        else
+                userdb_pool_put(TAKE_PTR(link));
+#endif // 0
         return 0;
 }
 
@@ -361,9 +529,18 @@ static int userdb_connect(
         assert(path);
         assert(method);
 
+#if 0 /// elogind reuses pooled connections where possible
         r = varlink_connect_address(&vl, path);
         if (r < 0)
                 return log_debug_errno(r, "Unable to connect to %s: %m", path);
+#else // 0
+        vl = userdb_pool_get(path);
+        if (!vl) {
+                r = varlink_connect_address(&vl, path);
+                if (r < 0)
+                        return log_debug_errno(r, "Unable to connect to %s: %m", path);
+        }
+#endif // 0
 
         varlink_set_userdata(vl, iterator);
 
@@ -81,6 +81,21 @@ typedef enum VarlinkState {
                VARLINK_PENDING_METHOD,                  \
                VARLINK_PENDING_METHOD_MORE)
 
+#if 1 /// elogind keeps track of each queued method call, so that they can be pipelined
+typedef struct VarlinkCall VarlinkCall;
+
+/* One method call we enqueued and still expect replies for. Replies arrive in the order the calls were
+ * enqueued, hence the head of the list is always the call the next reply is for. */
+struct VarlinkCall {
+        bool more;
+        VarlinkReply reply_callback; /* if NULL, the connection's reply callback is used */
+        void *userdata;
+        usec_t timestamp; /* when the call was enqueued, its timeout runs from then */
+
+        LIST_FIELDS(VarlinkCall, calls);
+};
+#endif // 1
+
 struct Varlink {
         unsigned n_ref;
 
@@ -112,7 +127,15 @@ struct Varlink {
                           * low, if you so will) state, and while they are not entirely unrelated and
                           * sometimes propagate effects to each other they are only asynchronously connected
                           * at most. */
+#if 0 /// elogind counts the queued method calls, only varlink_call_push() and varlink_call_remove() touch that
         unsigned n_pending;
+#else // 0
+        unsigned n_calls;
+#endif // 0
+#if 1 /// elogind keeps track of each queued method call, so that they can be pipelined
+        LIST_HEAD(VarlinkCall, calls);
+        VarlinkCall *calls_tail;
+#endif // 1
 
         int fd;
 
@@ -121,9 +144,16 @@ struct Varlink {
         size_t input_buffer_size;
         size_t input_buffer_unscanned;
 
+#if 0 /// elogind queues formatted messages as they are, and writes them out with a single sendmsg()
         char *output_buffer; /* valid data starts at output_buffer_index, ends at output_buffer_index+output_buffer_size */
         size_t output_buffer_index;
-        size_t output_buffer_size;
+#else // 0
+        struct iovec *output_queue; /* formatted messages including their NUL delimiter, each its own allocation */
+        size_t output_queue_first;  /* first message that hasn't been written completely yet */
+        size_t n_output_queue;
+        size_t output_buffer_index; /* bytes of the first message that have been written already */
+#endif // 0
+        size_t output_buffer_size;  /* bytes still to be written, in total */
 
         VarlinkReply reply_callback;
 
@@ -318,6 +348,7 @@ int varlink_connect_address(Varlink **ret, const char *address) {
 }
 
 #if 0 /// UNNEEDED by elogind
+#endif // 0
 int varlink_connect_fd(Varlink **ret, int fd) {
         Varlink *v;
         int r;
@@ -346,7 +377,6 @@ int varlink_connect_fd(Varlink **ret, int fd) {
         *ret = v;
         return 0;
 }
-#endif // 0
 
 static void varlink_detach_event_sources(Varlink *v) {
         assert(v);
@@ -357,6 +387,68 @@ static void varlink_detach_event_sources(Varlink *v) {
         v->defer_event_source = sd_event_source_disable_unref(v->defer_event_source);
 }
 
+#if 1 /// elogind keeps track of each queued method call, so that they can be pipelined
+static VarlinkCall* varlink_call_push(Varlink *v, bool more, VarlinkReply callback, void *userdata) {
+        VarlinkCall *c;
+
+        assert(v);
+
+        c = new(VarlinkCall, 1);
+        if (!c)
+                return NULL;
+
+        *c = (VarlinkCall) {
+                .more = more,
+                .reply_callback = callback,
+                .userdata = userdata,
+                .timestamp = now(CLOCK_MONOTONIC),
+        };
+
+        LIST_INSERT_AFTER(calls, v->calls, v->calls_tail, c);
+        v->calls_tail = c;
+        v->n_calls++;
+
+        return c;
+}
+
+static void varlink_call_remove(Varlink *v, VarlinkCall *c) {
+        assert(v);
+        assert(c);
+        assert(v->n_calls > 0);
+
+        if (v->calls_tail == c)
+                v->calls_tail = c->calls_prev;
+        LIST_REMOVE(calls, v->calls, c);
+        v->n_calls--;
+
+        free(c);
+}
+
+static void varlink_calls_free(Varlink *v) {
+        assert(v);
+
+        while (v->calls)
+                varlink_call_remove(v, v->calls);
+}
+
+static VarlinkState varlink_awaiting_state(Varlink *v) {
+        assert(v);
+
+        /* Which client state to be in is determined by the call the next reply is for */
+        if (!v->calls)
+                return VARLINK_IDLE_CLIENT;
+
+        return v->calls->more ? VARLINK_AWAITING_REPLY_MORE : VARLINK_AWAITING_REPLY;
+}
+
+static usec_t varlink_timestamp(Varlink *v) {
+        assert(v);
+
+        /* The oldest queued call is the first to time out, and calls enqueued after it do not extend that */
+        return v->calls ? v->calls->timestamp : v->timestamp;
+}
+#endif // 1
+
 static void varlink_clear(Varlink *v) {
         assert(v);
 
@@ -365,12 +457,23 @@ static void varlink_clear(Varlink *v) {
         v->fd = safe_close(v->fd);
 
         v->input_buffer = mfree(v->input_buffer);
+#if 0 /// elogind queues formatted messages as they are, and writes them out with a single sendmsg()
         v->output_buffer = mfree(v->output_buffer);
+#else // 0
+        for (size_t i = v->output_queue_first; i < v->n_output_queue; i++)
+                free(v->output_queue[i].iov_base);
+        v->output_queue = mfree(v->output_queue);
+        v->output_queue_first = v->n_output_queue = 0;
+        v->output_buffer_index = v->output_buffer_size = 0;
+#endif // 0
 
         v->current = json_variant_unref(v->current);
         v->reply = json_variant_unref(v->reply);
 
         v->event = sd_event_unref(v->event);
+#if 1 /// elogind keeps track of each queued method call, so that they can be pipelined
+        varlink_calls_free(v);
+#endif // 1
 }
 
 static Varlink* varlink_destroy(Varlink *v) {
@@ -451,6 +554,7 @@ static int varlink_write(Varlink *v) {
 
         assert(v->fd >= 0);
 
+#if 0 /// elogind writes out all queued messages at once
         /* We generally prefer recv()/send() (mostly because of MSG_NOSIGNAL) but also want to be compatible
          * with non-socket IO, hence fall back automatically.
          *
@@ -463,6 +567,40 @@ static int varlink_write(Varlink *v) {
         }
         if (prefer_write)
                 n = write(v->fd, v->output_buffer + v->output_buffer_index, v->output_buffer_size);
+#else // 0
+        struct iovec *iov, first;
+        size_t n_iov;
+
+        assert(v->output_queue_first < v->n_output_queue);
+
+        /* Hand the queued messages to the kernel as they are, skipping what was written of the first one
+         * already. The queue entry is patched for that only for the duration of the call. */
+        iov = v->output_queue + v->output_queue_first;
+        n_iov = MIN(v->n_output_queue - v->output_queue_first, (size_t) IOV_MAX);
+
+        first = iov[0];
+        iov[0] = IOVEC_MAKE((uint8_t*) first.iov_base + v->output_buffer_index, first.iov_len - v->output_buffer_index);
+
+        /* We generally prefer sendmsg()/recv() (mostly because of MSG_NOSIGNAL) but also want to be
+         * compatible with non-socket IO, hence fall back automatically.
+         *
+         * Use a local variable to help gcc figure out that we set 'n' in all cases. */
+        bool prefer_write = v->prefer_read_write;
+        if (!prefer_write) {
+                struct msghdr mh = {
+                        .msg_iov = iov,
+                        .msg_iovlen = n_iov,
+                };
+
+                n = sendmsg(v->fd, &mh, MSG_DONTWAIT|MSG_NOSIGNAL);
+                if (n < 0 && errno == ENOTSOCK)
+                        prefer_write = v->prefer_read_write = true;
+        }
+        if (prefer_write)
+                n = writev(v->fd, iov, n_iov);
+
+        iov[0] = first;
+#endif // 0
         if (n < 0) {
                 if (errno == EAGAIN)
                         return 0;
@@ -479,10 +617,27 @@ static int varlink_write(Varlink *v) {
 
         v->output_buffer_size -= n;
 
+#if 0 /// elogind releases the messages that have been written completely
         if (v->output_buffer_size == 0)
                 v->output_buffer_index = 0;
         else
                 v->output_buffer_index += n;
+#else // 0
+        n += v->output_buffer_index;
+        while (v->output_queue_first < v->n_output_queue &&
+               (size_t) n >= v->output_queue[v->output_queue_first].iov_len) {
+                n -= v->output_queue[v->output_queue_first].iov_len;
+                free(v->output_queue[v->output_queue_first++].iov_base);
+        }
+
+        if (v->output_queue_first == v->n_output_queue) {
+                assert(n == 0);
+                assert(v->output_buffer_size == 0);
+                v->output_queue_first = v->n_output_queue = 0;
+        }
+
+        v->output_buffer_index = n;
+#endif // 0
 
         v->timestamp = now(CLOCK_MONOTONIC);
         return 1;
@@ -515,6 +670,7 @@ static int varlink_read(Varlink *v) {
 
                 add = MIN(VARLINK_BUFFER_MAX - v->input_buffer_size, VARLINK_READ_SIZE);
 
+#if 0 /// elogind moves the remaining data to the front of the buffer it already has
                 if (v->input_buffer_index == 0) {
 
                         if (!GREEDY_REALLOC(v->input_buffer, v->input_buffer_size + add))
@@ -532,6 +688,19 @@ static int varlink_read(Varlink *v) {
                         free_and_replace(v->input_buffer, b);
                         v->input_buffer_index = 0;
                 }
+#else // 0
+                /* We only read once everything buffered has been scanned without finding a complete
+                 * message, hence what's left is the beginning of a single message. Move it to the front,
+                 * within the allocation we already have, and only grow that if it still is too small. */
+                if (v->input_buffer_index > 0) {
+                        memmove(v->input_buffer, v->input_buffer + v->input_buffer_index, v->input_buffer_size);
+                        v->input_buffer_index = 0;
+                }
+
+                if (MALLOC_SIZEOF_SAFE(v->input_buffer) <= v->input_buffer_size + add / 2 &&
+                    !GREEDY_REALLOC(v->input_buffer, v->input_buffer_size + add))
+                        return -ENOMEM;
+#endif // 0
         }
 
         rs = MALLOC_SIZEOF_SAFE(v->input_buffer) - (v->input_buffer_index + v->input_buffer_size);
@@ -595,7 +764,11 @@ static int varlink_parse_message(Varlink *v) {
                                                             * This may produce a non-printable journal entry if the message
                                                             * is invalid. We may also expose privileged information. */
 
+#if 0 /// elogind sorts incoming messages, so that looking up their fields can bisect, and parses them into one allocation
         r = json_parse(begin, 0, &v->current, NULL, NULL);
+#else // 0
+        r = json_parse(begin, JSON_PARSE_SORTED|JSON_PARSE_ARENA, &v->current, NULL, NULL);
+#endif // 0
         if (r < 0) {
                 /* If we encounter a parse failure flush all data. We cannot possibly recover from this,
                  * hence drop all buffered data now. */
@@ -622,7 +795,11 @@ static int varlink_test_timeout(Varlink *v) {
         if (v->timeout == USEC_INFINITY)
                 return 0;
 
+#if 0 /// elogind runs the timeout of each queued method call from when it was enqueued
         if (now(CLOCK_MONOTONIC) < usec_add(v->timestamp, v->timeout))
+#else // 0
+        if (now(CLOCK_MONOTONIC) < usec_add(varlink_timestamp(v), v->timeout))
+#endif // 0
                 return 0;
 
         varlink_set_state(v, VARLINK_PENDING_TIMEOUT);
@@ -636,6 +813,7 @@ static int varlink_dispatch_local_error(Varlink *v, const char *error) {
         assert(v);
         assert(error);
 
+#if 0 /// elogind tells every queued method call with a callback of its own, and the connection's callback once
         if (!v->reply_callback)
                 return 0;
 
@@ -644,6 +822,42 @@ static int varlink_dispatch_local_error(Varlink *v, const char *error) {
                 log_debug_errno(r, "Reply callback returned error, ignoring: %m");
 
         return 1;
+#else // 0
+        bool connection_callback = !v->calls, dispatched = false;
+        LIST_HEAD(VarlinkCall, calls);
+
+        /* Take the queue off the connection first: none of these calls will ever get a reply now, and the
+         * callbacks might close the connection from under us. */
+        calls = TAKE_PTR(v->calls);
+        v->calls_tail = NULL;
+        v->n_calls = 0;
+
+        while (calls) {
+                VarlinkCall *c = calls;
+
+                LIST_REMOVE(calls, calls, c);
+
+                if (c->reply_callback) {
+                        r = c->reply_callback(v, NULL, error, VARLINK_REPLY_ERROR|VARLINK_REPLY_LOCAL, c->userdata);
+                        if (r < 0)
+                                log_debug_errno(r, "Reply callback returned error, ignoring: %m");
+
+                        dispatched = true;
+                } else
+                        connection_callback = true;
+
+                free(c);
+        }
+
+        if (!connection_callback || !v->reply_callback)
+                return dispatched;
+
+        r = v->reply_callback(v, NULL, error, VARLINK_REPLY_ERROR|VARLINK_REPLY_LOCAL, v->userdata);
+        if (r < 0)
+                log_debug_errno(r, "Reply callback returned error, ignoring: %m");
+
+        return 1;
+#endif // 0
 }
 
 static int varlink_dispatch_timeout(Varlink *v) {
@@ -699,7 +913,11 @@ static int varlink_dispatch_reply(Varlink *v) {
         if (!v->current)
                 return 0;
 
+#if 0 /// elogind counts the queued method calls, see varlink_call_push()
         assert(v->n_pending > 0);
+#else // 0
+        assert(v->n_calls > 0);
+#endif // 0
 
         if (!json_variant_is_object(v->current))
                 goto invalid;
@@ -749,6 +967,7 @@ static int varlink_dispatch_reply(Varlink *v) {
                 goto invalid;
 
         if (IN_SET(v->state, VARLINK_AWAITING_REPLY, VARLINK_AWAITING_REPLY_MORE)) {
+#if 0 /// elogind delivers the reply to the callback of the call it is for
                 varlink_set_state(v, VARLINK_PROCESSING_REPLY);
 
                 if (v->reply_callback) {
@@ -770,6 +989,39 @@ static int varlink_dispatch_reply(Varlink *v) {
                                           FLAGS_SET(flags, VARLINK_REPLY_CONTINUES) ? VARLINK_AWAITING_REPLY_MORE :
                                           v->n_pending == 0 ? VARLINK_IDLE_CLIENT : VARLINK_AWAITING_REPLY);
                 }
+#else // 0
+                VarlinkReply callback;
+                void *userdata;
+
+                assert(v->calls);
+
+                if (v->calls->reply_callback) {
+                        callback = v->calls->reply_callback;
+                        userdata = v->calls->userdata;
+                } else {
+                        callback = v->reply_callback;
+                        userdata = v->userdata;
+                }
+
+                varlink_set_state(v, VARLINK_PROCESSING_REPLY);
+
+                if (callback) {
+                        r = callback(v, parameters, error, flags, userdata);
+                        if (r < 0)
+                                log_debug_errno(r, "Reply callback returned error, ignoring: %m");
+                }
+
+                v->current = json_variant_unref(v->current);
+
+                /* The callback might have enqueued further calls, but those go to the end of the queue, hence
+                 * the head is still the call this reply was for, unless the connection was closed. */
+                if (v->state == VARLINK_PROCESSING_REPLY) {
+                        if (!FLAGS_SET(flags, VARLINK_REPLY_CONTINUES))
+                                varlink_call_remove(v, v->calls);
+
+                        varlink_set_state(v, varlink_awaiting_state(v));
+                }
+#endif // 0
         } else {
                 assert(v->state == VARLINK_CALLING);
                 varlink_set_state(v, VARLINK_CALLED);
@@ -1126,7 +1378,11 @@ int varlink_get_timeout(Varlink *v, usec_t *ret) {
         if (IN_SET(v->state, VARLINK_AWAITING_REPLY, VARLINK_AWAITING_REPLY_MORE, VARLINK_CALLING) &&
             v->timeout != USEC_INFINITY) {
                 if (ret)
+#if 0 /// elogind runs the timeout of each queued method call from when it was enqueued
                         *ret = usec_add(v->timestamp, v->timeout);
+#else // 0
+                        *ret = usec_add(varlink_timestamp(v), v->timeout);
+#endif // 0
                 return 1;
         } else {
                 if (ret)
@@ -1259,6 +1515,7 @@ static int varlink_enqueue_json(Varlink *v, JsonVariant *m) {
 
         varlink_log(v, "Sending message: %s", text);
 
+#if 0 /// elogind queues the formatted message as it is, instead of copying it into one output buffer
         if (v->output_buffer_size == 0) {
 
                 free_and_replace(v->output_buffer, text);
@@ -1288,6 +1545,21 @@ static int varlink_enqueue_json(Varlink *v, JsonVariant *m) {
                 v->output_buffer_size = new_size;
                 v->output_buffer_index = 0;
         }
+#else // 0
+        /* Reclaim the slots of messages that have been written already, before growing the queue */
+        if (v->output_queue_first > 0 && v->n_output_queue >= MALLOC_ELEMENTSOF(v->output_queue)) {
+                memmove(v->output_queue, v->output_queue + v->output_queue_first,
+                        (v->n_output_queue - v->output_queue_first) * sizeof(struct iovec));
+                v->n_output_queue -= v->output_queue_first;
+                v->output_queue_first = 0;
+        }
+
+        if (!GREEDY_REALLOC(v->output_queue, v->n_output_queue + 1))
+                return -ENOMEM;
+
+        v->output_queue[v->n_output_queue++] = IOVEC_MAKE(TAKE_PTR(text), r + 1);
+        v->output_buffer_size += r + 1;
+#endif // 0
 
         return 0;
 }
@@ -1345,6 +1617,7 @@ int varlink_sendb(Varlink *v, const char *method, ...) {
 }
 #endif // 0
 
+#if 0 /// elogind allows pipelining any kind of method call, see varlink_enqueue_call() below
 int varlink_invoke(Varlink *v, const char *method, JsonVariant *parameters) {
         _cleanup_(json_variant_unrefp) JsonVariant *m = NULL;
         int r;
@@ -1379,6 +1652,66 @@ int varlink_invoke(Varlink *v, const char *method, JsonVariant *parameters) {
 
         return 0;
 }
+#else // 0
+static int varlink_enqueue_call(
+                Varlink *v,
+                const char *method,
+                JsonVariant *parameters,
+                bool more,
+                VarlinkReply callback,
+                void *userdata) {
+
+        _cleanup_(json_variant_unrefp) JsonVariant *m = NULL;
+        VarlinkCall *c;
+        int r;
+
+        assert_return(v, -EINVAL);
+        assert_return(method, -EINVAL);
+
+        if (v->state == VARLINK_DISCONNECTED)
+                return varlink_log_errno(v, SYNTHETIC_ERRNO(ENOTCONN), "Not connected.");
+
+        /* We allow enqueuing multiple method calls at once, including ones with 'more' set: replies arrive
+         * in order, and each queued call knows whether further replies are to be expected for it. Calls may
+         * also be enqueued from within a reply callback. */
+        if (!IN_SET(v->state, VARLINK_IDLE_CLIENT, VARLINK_AWAITING_REPLY, VARLINK_AWAITING_REPLY_MORE, VARLINK_PROCESSING_REPLY))
+                return varlink_log_errno(v, SYNTHETIC_ERRNO(EBUSY), "Connection busy.");
+
+        r = varlink_sanitize_parameters(&parameters);
+        if (r < 0)
+                return varlink_log_errno(v, r, "Failed to sanitize parameters: %m");
+
+        r = json_build(&m, JSON_BUILD_OBJECT(
+                                       JSON_BUILD_PAIR("method", JSON_BUILD_STRING(method)),
+                                       JSON_BUILD_PAIR("parameters", JSON_BUILD_VARIANT(parameters)),
+                                       JSON_BUILD_PAIR_CONDITION(more, "more", JSON_BUILD_BOOLEAN(true))));
+        if (r < 0)
+                return varlink_log_errno(v, r, "Failed to build json message: %m");
+
+        c = varlink_call_push(v, more, callback, userdata);
+        if (!c)
+                return varlink_log_errno(v, SYNTHETIC_ERRNO(ENOMEM), "Failed to allocate method call: %m");
+
+        r = varlink_enqueue_json(v, m);
+        if (r < 0) {
+                varlink_call_remove(v, c);
+                return varlink_log_errno(v, r, "Failed to enqueue json message: %m");
+        }
+
+        if (v->state == VARLINK_IDLE_CLIENT)
+                varlink_set_state(v, varlink_awaiting_state(v));
+
+        return 0;
+}
+
+int varlink_invoke(Varlink *v, const char *method, JsonVariant *parameters) {
+        return varlink_enqueue_call(v, method, parameters, false, NULL, NULL);
+}
+
+int varlink_invoke_async(Varlink *v, const char *method, JsonVariant *parameters, VarlinkReply callback, void *userdata) {
+        return varlink_enqueue_call(v, method, parameters, false, callback, userdata);
+}
+#endif // 0
 
 #if 0 /// UNNEEDED by elogind
 int varlink_invokeb(Varlink *v, const char *method, ...) {
@@ -1399,6 +1732,7 @@ int varlink_invokeb(Varlink *v, const char *method, ...) {
 }
 #endif // 0
 
+#if 0 /// elogind allows pipelining any kind of method call, see varlink_enqueue_call() above
 int varlink_observe(Varlink *v, const char *method, JsonVariant *parameters) {
         _cleanup_(json_variant_unrefp) JsonVariant *m = NULL;
         int r;
@@ -1435,6 +1769,15 @@ int varlink_observe(Varlink *v, const char *method, JsonVariant *parameters) {
 
         return 0;
 }
+#else // 0
+int varlink_observe(Varlink *v, const char *method, JsonVariant *parameters) {
+        return varlink_enqueue_call(v, method, parameters, true, NULL, NULL);
+}
+
+int varlink_observe_async(Varlink *v, const char *method, JsonVariant *parameters, VarlinkReply callback, void *userdata) {
+        return varlink_enqueue_call(v, method, parameters, true, callback, userdata);
+}
+#endif // 0
 
 #if 0 /// UNNEEDED by elogind
 int varlink_observeb(Varlink *v, const char *method, ...) {
@@ -1852,6 +2195,45 @@ int varlink_set_description(Varlink *v, const char *description) {
         return free_and_strdup(&v->description, description);
 }
 
+#if 1 /// elogind pools idle client connections, see userdb.c
+const char* varlink_get_description(Varlink *v) {
+        assert_return(v, NULL);
+
+        return v->description;
+}
+
+unsigned varlink_get_n_pending(Varlink *v) {
+        assert_return(v, 0);
+
+        return v->n_calls;
+}
+
+int varlink_is_idle(Varlink *v) {
+        int r;
+
+        assert_return(v, -EINVAL);
+
+        /* Returns > 0 if this is a client connection with nothing queued in either direction, whose peer
+         * hasn't hung up on us yet, i.e. one that may be handed to a new user. Note that this actually checks
+         * the socket, since an idle connection isn't watched by anyone, and we wouldn't notice otherwise. */
+
+        if (v->state != VARLINK_IDLE_CLIENT || v->connecting)
+                return 0;
+        if (v->output_buffer_size > 0 || v->input_buffer_size > 0 || v->current)
+                return 0;
+        if (v->write_disconnected || v->read_disconnected || v->got_pollhup)
+                return 0;
+
+        /* Nothing should be readable on an idle client connection: if something is, it's either EOF or
+         * garbage the server sent us without being asked. Either way the connection is not reusable. */
+        r = fd_wait_for_event(v->fd, POLLIN, 0);
+        if (r < 0)
+                return r;
+
+        return r == 0;
+}
+#endif // 1
+
 static int io_callback(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         Varlink *v = userdata;
 
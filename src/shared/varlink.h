@@ -56,8 +56,8 @@ typedef void (*VarlinkDisconnect)(VarlinkServer *server, Varlink *link, void *us
 
 int varlink_connect_address(Varlink **ret, const char *address);
 #if 0 /// UNNEEDED by elogind
-int varlink_connect_fd(Varlink **ret, int fd);
 #endif // 0
+int varlink_connect_fd(Varlink **ret, int fd);
 
 Varlink* varlink_ref(Varlink *link);
 Varlink* varlink_unref(Varlink *v);
@@ -95,12 +95,19 @@ int varlink_callb(Varlink *v, const char *method, JsonVariant **ret_parameters,
 
 /* Enqueue method call, expect a reply, which is eventually delivered to the reply callback */
 int varlink_invoke(Varlink *v, const char *method, JsonVariant *parameters);
+#if 1 /// elogind pipelines method calls, each may have its own reply callback
+/* Same, but deliver the reply to the specified callback instead of the one bound to the connection */
+int varlink_invoke_async(Varlink *v, const char *method, JsonVariant *parameters, VarlinkReply callback, void *userdata);
+#endif // 1
 #if 0 /// UNNEEDED by elogind
 int varlink_invokeb(Varlink *v, const char *method, ...);
 #endif // 0
 
 /* Enqueue method call, expect a reply now, and possibly more later, which are all delivered to the reply callback */
 int varlink_observe(Varlink *v, const char *method, JsonVariant *parameters);
+#if 1 /// elogind pipelines method calls, each may have its own reply callback
+int varlink_observe_async(Varlink *v, const char *method, JsonVariant *parameters, VarlinkReply callback, void *userdata);
+#endif // 1
 #if 0 /// UNNEEDED by elogind
 int varlink_observeb(Varlink *v, const char *method, ...);
 
@@ -139,6 +146,11 @@ VarlinkServer* varlink_get_server(Varlink *v);
 #endif // 0
 
 int varlink_set_description(Varlink *v, const char *d);
+#if 1 /// elogind pools idle client connections, see userdb.c
+const char* varlink_get_description(Varlink *v);
+unsigned varlink_get_n_pending(Varlink *v);
+int varlink_is_idle(Varlink *v);
+#endif // 1
 
 #if 0 /// UNNEEDED by elogind
 /* Create a varlink server */
@@ -57,6 +57,14 @@ int sd_pid_get_session(pid_t pid, char **session);
  * return an error for system processes. */
 int sd_pid_get_owner_uid(pid_t pid, uid_t *uid);
 
+/* Similar to sd_pid_get_session() and sd_pid_get_owner_uid(), but
+ * for n_pids PIDs at once. For each PID, the session name (to be
+ * freed by the caller) is stored in sessions[] and the UID of its
+ * owner in uids[]; if the PID is not part of a session, NULL and
+ * (uid_t) -1 are stored instead. Either array may be NULL. Returns
+ * the number of PIDs that are part of a session. */
+int sd_pids_get_sessions(const pid_t *pids, size_t n_pids, char **sessions, uid_t *uids);
+
 /* Get systemd non-slice unit (i.e. service) name from PID, for system
  * services. This will return an error for non-service processes. */
 int sd_pid_get_unit(pid_t pid, char **unit);
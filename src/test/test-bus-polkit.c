@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <unistd.h>
+
+#include "sd-bus.h"
+
+#include "bus-polkit.h"
+#include "tests.h"
+#include "time-util.h"
+
+#define TTL_USEC (200 * USEC_PER_MSEC)
+
+static void test_polkit_cache(void) {
+        _cleanup_(bus_polkit_cache_freep) BusPolkitCache *c = NULL;
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        const char *details[] = { "polkit.message", "foo", NULL },
+                *other_details[] = { "polkit.message", "bar", NULL };
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(bus_polkit_cache_new(&c, bus, TTL_USEC) >= 0);
+
+        assert_se(bus_polkit_cache_lookup(NULL, ":1.1", "org.example.foo", NULL) == -ENOENT);
+        assert_se(bus_polkit_cache_lookup(c, ":1.1", "org.example.foo", NULL) == -ENOENT);
+        assert_se(c->n_hits == 0 && c->n_misses == 1);
+
+        assert_se(bus_polkit_cache_put(c, ":1.1", "org.example.foo", NULL, true) >= 0);
+        assert_se(bus_polkit_cache_put(c, ":1.1", "org.example.bar", details, false) >= 0);
+        assert_se(bus_polkit_cache_put(c, ":1.2", "org.example.foo", NULL, false) >= 0);
+
+        /* Decisions are told apart by sender, action and details */
+        assert_se(bus_polkit_cache_lookup(c, ":1.1", "org.example.foo", NULL) > 0);
+        assert_se(bus_polkit_cache_lookup(c, ":1.1", "org.example.bar", details) == 0);
+        assert_se(bus_polkit_cache_lookup(c, ":1.1", "org.example.bar", other_details) == -ENOENT);
+        assert_se(bus_polkit_cache_lookup(c, ":1.1", "org.example.bar", NULL) == -ENOENT);
+        assert_se(bus_polkit_cache_lookup(c, ":1.2", "org.example.foo", NULL) == 0);
+        assert_se(bus_polkit_cache_lookup(c, ":1.3", "org.example.foo", NULL) == -ENOENT);
+        assert_se(c->n_hits == 3 && c->n_misses == 4);
+
+        /* Only the senders we have decisions for are watched, once each */
+        assert_se(hashmap_size(c->owner_slots) == 2);
+
+        /* A later decision replaces the earlier one */
+        assert_se(bus_polkit_cache_put(c, ":1.2", "org.example.foo", NULL, true) >= 0);
+        assert_se(bus_polkit_cache_lookup(c, ":1.2", "org.example.foo", NULL) > 0);
+        assert_se(set_size(c->decisions) == 3);
+
+        /* Decisions expire after the TTL */
+        usleep(TTL_USEC);
+        assert_se(bus_polkit_cache_lookup(c, ":1.1", "org.example.foo", NULL) == -ENOENT);
+        assert_se(set_size(c->decisions) == 2);
+
+        assert_se(bus_polkit_cache_put(c, ":1.1", "org.example.foo", NULL, true) >= 0);
+        assert_se(bus_polkit_cache_lookup(c, ":1.1", "org.example.foo", NULL) > 0);
+
+        bus_polkit_cache_flush(c);
+        assert_se(set_size(c->decisions) == 0);
+        assert_se(bus_polkit_cache_lookup(c, ":1.1", "org.example.foo", NULL) == -ENOENT);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_polkit_cache();
+
+        return 0;
+}
@@ -1,6 +1,9 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
 #include <math.h>
+#if 1 /// Additional includes needed by elogind
+#include <malloc.h>
+#endif // 1
 
 #include "alloc-util.h"
 #include "escape.h"
@@ -146,6 +149,24 @@ static void test_variant(const char *data, Test test) {
         assert_se((size_t) r == strlen(s));
         printf("Pretty with color:\n%s\n", s);
 
+#if 1 /// elogind: the arena parser has to produce the very same tree
+        _cleanup_free_ char *t = NULL;
+
+        w = json_variant_unref(w);
+        r = json_parse(data, JSON_PARSE_ARENA, &w, NULL, NULL);
+        assert_se(r == 0);
+        assert_se(w);
+        assert_se(json_variant_equal(v, w));
+        assert_se(json_variant_is_normalized(v) == json_variant_is_normalized(w));
+
+        s = mfree(s);
+        assert_se(json_variant_format(v, 0, &s) >= 0);
+        assert_se(json_variant_format(w, 0, &t) >= 0);
+        assert_se(streq(s, t));
+
+        if (test)
+                test(w);
+#endif // 1
         if (test)
                 test(v);
 }
@@ -526,6 +547,264 @@ static void test_bisect(void) {
         }
 }
 
+#if 1 /// elogind can sort objects while parsing, and looks up dispatch table entries by bisection
+static void test_parse_sorted(void) {
+        log_info("/* %s */", __func__);
+
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL, *w = NULL;
+        _cleanup_free_ char *t = NULL;
+
+        assert_se(json_parse("{\"c\":1,\"a\":{\"z\":true,\"y\":false},\"b\":[{\"q\":1,\"p\":2}]}",
+                             JSON_PARSE_SORTED, &v, NULL, NULL) >= 0);
+        assert_se(json_variant_is_sorted(v));
+        assert_se(json_variant_is_normalized(v));
+        assert_se(json_variant_format(v, 0, &t) >= 0);
+        assert_se(streq(t, "{\"a\":{\"y\":false,\"z\":true},\"b\":[{\"p\":2,\"q\":1}],\"c\":1}"));
+
+        assert_se(json_variant_unsigned(json_variant_by_key(v, "c")) == 1);
+        assert_se(json_variant_boolean(json_variant_by_key(json_variant_by_key(v, "a"), "z")));
+        assert_se(!json_variant_by_key(v, "d"));
+
+        /* Duplicate keys can't be sorted strictly, lookups still have to work */
+        assert_se(json_parse("{\"b\":1,\"a\":2,\"b\":3}", JSON_PARSE_SORTED, &w, NULL, NULL) >= 0);
+        assert_se(!json_variant_is_sorted(w));
+        assert_se(json_variant_unsigned(json_variant_by_key(w, "a")) == 2);
+        assert_se(json_variant_by_key(w, "b"));
+}
+
+static void test_parse_sorted_duplicates_one(JsonParseFlags flags) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL, *u = NULL;
+        _cleanup_free_ char *data = NULL;
+        const char *k;
+        JsonVariant *e;
+        unsigned last[3] = {};
+
+        /* Duplicate keys stay in the order they were parsed in, so that the same one is found as without
+         * sorting */
+        assert_se(data = strdup("{"));
+        for (unsigned i = 1; i <= 300; i++)
+                assert_se(strextendf(&data, "%s\"%c\":%u", i > 1 ? "," : "", "cab"[i % 3], i) >= 0);
+        assert_se(strextend(&data, "}"));
+
+        assert_se(json_parse(data, flags, &u, NULL, NULL) >= 0);
+        assert_se(json_parse(data, flags|JSON_PARSE_SORTED, &v, NULL, NULL) >= 0);
+        assert_se(!json_variant_is_sorted(v));
+
+        JSON_VARIANT_OBJECT_FOREACH(k, e, v) {
+                unsigned n = json_variant_unsigned(e);
+
+                assert_se(n > last[k[0] - 'a']);
+                last[k[0] - 'a'] = n;
+        }
+
+        FOREACH_STRING(k, "a", "b", "c")
+                assert_se(json_variant_unsigned(json_variant_by_key(v, k)) ==
+                          json_variant_unsigned(json_variant_by_key(u, k)));
+}
+
+static void test_parse_sorted_duplicates(void) {
+        log_info("/* %s */", __func__);
+
+        test_parse_sorted_duplicates_one(0);
+        test_parse_sorted_duplicates_one(JSON_PARSE_ARENA);
+}
+
+typedef struct DispatchTest {
+        unsigned a, b, c, d;
+        unsigned n_bad;
+} DispatchTest;
+
+static int dispatch_bad(const char *name, JsonVariant *variant, JsonDispatchFlags flags, void *userdata) {
+        DispatchTest *t = userdata;
+
+        t->n_bad++;
+        return 0;
+}
+
+static void test_dispatch(void) {
+        log_info("/* %s */", __func__);
+
+        /* Deliberately not sorted, with a duplicate name and entries after a catch-all entry */
+        static const JsonDispatch table[] = {
+                { "c",         JSON_VARIANT_UNSIGNED, json_dispatch_uint32, offsetof(DispatchTest, c), 0              },
+                { "a",         JSON_VARIANT_UNSIGNED, json_dispatch_uint32, offsetof(DispatchTest, a), JSON_MANDATORY },
+                { "c",         JSON_VARIANT_UNSIGNED, json_dispatch_uint32, offsetof(DispatchTest, d), 0              },
+                { "b",         JSON_VARIANT_UNSIGNED, json_dispatch_uint32, offsetof(DispatchTest, b), 0              },
+                {}
+        };
+        static const JsonDispatch table_wildcard[] = {
+                { "b",         JSON_VARIANT_UNSIGNED, json_dispatch_uint32, offsetof(DispatchTest, b), 0              },
+                { POINTER_MAX, JSON_VARIANT_UNSIGNED, json_dispatch_uint32, offsetof(DispatchTest, d), 0              },
+                { "a",         JSON_VARIANT_UNSIGNED, json_dispatch_uint32, offsetof(DispatchTest, a), 0              },
+                {}
+        };
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL, *w = NULL;
+        DispatchTest t = {};
+
+        assert_se(json_parse("{\"b\":2,\"x\":9,\"c\":3,\"a\":1}", 0, &v, NULL, NULL) >= 0);
+
+        assert_se(json_dispatch(v, table, dispatch_bad, 0, &t) == 4);
+        assert_se(t.a == 1 && t.b == 2 && t.c == 3 && t.d == 0 && t.n_bad == 1);
+
+        t = (DispatchTest) {};
+        assert_se(json_dispatch(v, table, NULL, 0, &t) == -EADDRNOTAVAIL);
+
+        /* Entries after the catch-all entry are never used */
+        t = (DispatchTest) {};
+        assert_se(json_parse("{\"b\":2,\"a\":1}", JSON_PARSE_SORTED, &w, NULL, NULL) >= 0);
+        assert_se(json_dispatch(w, table_wildcard, NULL, 0, &t) == 2);
+        assert_se(t.a == 0 && t.b == 2 && t.c == 0 && t.d == 1 && t.n_bad == 0);
+
+        /* Mandatory fields are still checked */
+        t = (DispatchTest) {};
+        w = json_variant_unref(w);
+        assert_se(json_parse("{\"b\":2}", JSON_PARSE_SORTED, &w, NULL, NULL) >= 0);
+        assert_se(json_dispatch(w, table, NULL, 0, &t) == -ENXIO);
+}
+
+static void test_parse_arena(void) {
+        static const char data[] =
+                "{\n"
+                "\"foo\" : \"bar\",\n"
+                "\"thisisaverylongproperty\" : [ \"andthisisaverylongvalue\", 2, -3, 7.5, {}, [] ],\n"
+                "\"miep\" : { \"hallo\" : null, \"welt\" : [ true ] }\n"
+                "}\n";
+
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL, *w = NULL, *q = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        unsigned line_v, column_v, line_w, column_w;
+        const char *source;
+        const char *e;
+        char *deep;
+
+        log_info("/* %s */", __func__);
+
+        /* Variants referenced from within the arena keep all of it alive */
+        assert_se(json_parse(data, JSON_PARSE_ARENA|JSON_PARSE_SORTED, &v, NULL, NULL) >= 0);
+        assert_se(json_variant_is_sorted(v));
+        assert_se(!json_variant_is_normalized(v)); /* because of the 7.5 */
+        assert_se(q = json_variant_ref(json_variant_by_key(v, "thisisaverylongproperty")));
+        v = json_variant_unref(v);
+        assert_se(json_variant_elements(q) == 6);
+        assert_se(streq(json_variant_string(json_variant_by_index(q, 0)), "andthisisaverylongvalue"));
+        assert_se(json_variant_integer(json_variant_by_index(q, 2)) == -3);
+        assert_se(json_variant_is_blank_object(json_variant_by_index(q, 4)));
+        assert_se(json_variant_is_blank_array(json_variant_by_index(q, 5)));
+
+        /* Variants built from parts of the arena hold a reference too */
+        assert_se(json_variant_new_array(&v, (JsonVariant*[]) { json_variant_by_index(q, 0), q }, 2) >= 0);
+        q = json_variant_unref(q);
+        assert_se(streq(json_variant_string(json_variant_by_index(v, 0)), "andthisisaverylongvalue"));
+        v = json_variant_unref(v);
+
+        /* Locations are only recorded if asked for */
+        assert_se(f = fmemopen_unlocked((void*) data, strlen(data), "r"));
+        assert_se(json_parse_file(f, "waldo", JSON_PARSE_ARENA, &v, NULL, NULL) >= 0);
+        assert_se(json_variant_get_source(json_variant_by_key(v, "miep"), &source, &line_v, &column_v) >= 0);
+        assert_se(!source && line_v == 0 && column_v == 0);
+        v = json_variant_unref(v);
+
+        rewind(f);
+        assert_se(json_parse_file(f, "waldo", 0, &v, NULL, NULL) >= 0);
+        rewind(f);
+        assert_se(json_parse_file(f, "waldo", JSON_PARSE_ARENA|JSON_PARSE_LOCATION, &w, NULL, NULL) >= 0);
+        assert_se(json_variant_get_source(json_variant_by_key(v, "miep"), NULL, &line_v, &column_v) >= 0);
+        assert_se(json_variant_get_source(json_variant_by_key(w, "miep"), &source, &line_w, &column_w) >= 0);
+        assert_se(streq(source, "waldo"));
+        assert_se(line_w == 4 && line_v == line_w && column_v == column_w);
+        v = json_variant_unref(v);
+        w = json_variant_unref(w);
+
+        /* Sensitive input is not parsed into an arena, but the flag is honoured either way */
+        assert_se(json_parse(data, JSON_PARSE_ARENA|JSON_PARSE_SENSITIVE, &v, NULL, NULL) >= 0);
+        assert_se(json_variant_is_sensitive(v));
+        v = json_variant_unref(v);
+
+        assert_se(json_parse(data, JSON_PARSE_ARENA, &v, NULL, NULL) >= 0);
+        json_variant_sensitive(json_variant_by_key(v, "miep"));
+        v = json_variant_unref(v);
+
+        /* Top-level values that aren't objects or arrays */
+        assert_se(json_parse("\"andthisisaverylongvalue\"", JSON_PARSE_ARENA, &v, NULL, NULL) >= 0);
+        assert_se(streq(json_variant_string(v), "andthisisaverylongvalue"));
+        v = json_variant_unref(v);
+        assert_se(json_parse("4711", JSON_PARSE_ARENA, &v, NULL, NULL) >= 0);
+        assert_se(json_variant_unsigned(v) == 4711);
+        v = json_variant_unref(v);
+        assert_se(json_parse("[]", JSON_PARSE_ARENA, &v, NULL, NULL) >= 0);
+        assert_se(json_variant_is_blank_array(v));
+        v = json_variant_unref(v);
+
+        /* Errors are the same as with the regular parser */
+        FOREACH_STRING(e, "[1,", "{\"a\" 1}", "{1:2}", "[1 2]", "\"\\ud800\"", "")
+                assert_se(json_parse(e, JSON_PARSE_ARENA, &v, NULL, NULL) == json_parse(e, 0, &w, NULL, NULL));
+
+        deep = newa(char, 2 * 4096 + 1);
+        memset(deep, '[', 4096);
+        memset(deep + 4096, ']', 4096);
+        deep[2 * 4096] = 0;
+        assert_se(json_parse(deep, 0, &v, NULL, NULL) == -ELNRNG);
+        assert_se(json_parse(deep, JSON_PARSE_ARENA, &v, NULL, NULL) == -ELNRNG);
+}
+
+static void test_parse_arena_benchmark(void) {
+        static const char* const data[] = {
+                "{\"k\": \"v\", \"foo\": [1, 2, 3], \"bar\": {\"zap\": null}}",
+                "{\"mutant\": [1, null, \"1\", {\"1\": [1, \"1\"]}], \"thisisaverylongproperty\": 1.27}",
+                "[ 0, -0, 0.0, -0.0, 0.000, -0.000, 0e0, -0e0, 0e+0, -0e-0, 0e-0, -0e000, 0e+000 ]",
+                "{\"method\":\"io.systemd.UserDatabase.GetUserRecord\",\"parameters\":{\"userName\":\"waldo\","
+                "\"service\":\"io.systemd.Multiplexer\"},\"more\":true}",
+                "{\"parameters\":{\"record\":{\"userName\":\"waldo\",\"uid\":60123,\"gid\":60123,"
+                "\"realName\":\"Waldo Wally\",\"homeDirectory\":\"/home/waldo\",\"shell\":\"/bin/bash\","
+                "\"memberOf\":[\"wheel\",\"audio\",\"video\"],\"disposition\":\"regular\","
+                "\"status\":{\"0123456789abcdef0123456789abcdef\":{\"service\":\"io.systemd.Home\"}}},"
+                "\"incomplete\":false}}",
+        };
+        unsigned n_iterations = slow_tests_enabled() ? 100000 : 1000;
+        JsonParseFlags modes[] = { 0, JSON_PARSE_ARENA };
+        char b[FORMAT_TIMESPAN_MAX];
+
+        log_info("/* %s */", __func__);
+
+        for (size_t m = 0; m < ELEMENTSOF(modes); m++) {
+                JsonVariant *v[ELEMENTSOF(data)] = {};
+                usec_t t;
+
+#if HAVE_MALLINFO2
+                /* How much memory do the trees take up while they are alive? Keep enough of them around that
+                 * recycled chunks don't skew the numbers. */
+                _cleanup_free_ JsonVariant **trees = NULL;
+                size_t n_trees = 1000 * ELEMENTSOF(data), before;
+
+                assert_se(trees = new0(JsonVariant*, n_trees));
+
+                before = mallinfo2().uordblks;
+                for (size_t i = 0; i < n_trees; i++)
+                        assert_se(json_parse(data[i % ELEMENTSOF(data)], modes[m], trees + i, NULL, NULL) >= 0);
+
+                log_info("%s: %zu bytes of heap per set of %zu trees", modes[m] ? "arena" : "regular",
+                         (mallinfo2().uordblks - before) / 1000, ELEMENTSOF(data));
+
+                json_variant_unref_many(trees, n_trees);
+#endif
+
+                t = now(CLOCK_MONOTONIC);
+
+                for (unsigned n = 0; n < n_iterations; n++)
+                        for (size_t i = 0; i < ELEMENTSOF(data); i++) {
+                                assert_se(json_parse(data[i], modes[m], v + i, NULL, NULL) >= 0);
+                                v[i] = json_variant_unref(v[i]);
+                        }
+
+                t = now(CLOCK_MONOTONIC) - t;
+
+                log_info("%s: %u iterations: %s, %.1f parses/s", modes[m] ? "arena" : "regular",
+                         n_iterations, format_timespan(b, sizeof(b), t, 1),
+                         (double) n_iterations * ELEMENTSOF(data) * USEC_PER_SEC / MAX(t, 1u));
+        }
+}
+#endif // 1
+
 int main(int argc, char *argv[]) {
         test_setup_logging(LOG_DEBUG);
 
@@ -578,6 +857,13 @@ int main(int argc, char *argv[]) {
 
         test_normalize();
         test_bisect();
+#if 1 /// elogind can sort objects while parsing, and looks up dispatch table entries by bisection
+        test_parse_sorted();
+        test_parse_sorted_duplicates();
+        test_dispatch();
+        test_parse_arena();
+        test_parse_arena_benchmark();
+#endif // 1
 
         return 0;
 }
@@ -1,12 +1,20 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include <fcntl.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <unistd.h>
 
+#include "fd-util.h"
+#include "fileio.h"
 #include "format-util.h"
+#include "io-util.h"
 #include "log.h"
+#include "memory-util.h"
 #include "process-util.h"
 #include "string-util.h"
+#include "strv.h"
+#include "tmpfile-util.h"
 #include "util.h"
 
 assert_cc(IS_SYNTHETIC_ERRNO(SYNTHETIC_ERRNO(EINVAL)));
@@ -65,6 +73,149 @@ static void test_log_syntax(void) {
         assert_se(log_syntax("unit", LOG_ERR, "filename", 10, SYNTHETIC_ERRNO(ENOTTY), "ENOTTY: %s: %m", "hogehoge") == -ENOTTY);
 }
 
+#if 1 /// elogind can queue log messages
+static void test_log_buffered(void) {
+        _cleanup_close_pair_ int p[2] = { -1, -1 };
+        _cleanup_close_ int saved_stderr = -1;
+        char buf[64] = {};
+        ssize_t n;
+
+        log_set_target(LOG_TARGET_CONSOLE);
+        log_show_color(false);
+        log_open();
+
+        assert_se(pipe2(p, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se((saved_stderr = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 3)) >= 0);
+        assert_se(dup2(p[1], STDERR_FILENO) == STDERR_FILENO);
+
+        assert_se(log_set_buffered(16) >= 0);
+        assert_se(log_get_buffered());
+
+        log_info("one");
+        log_notice("two");
+
+        /* Nothing must have been written out yet */
+        assert_se(read(p[0], buf, sizeof(buf)) < 0 && errno == EAGAIN);
+
+        /* Errors are written out immediately, but only after everything queued before them */
+        log_error("three");
+        log_info("four");
+        log_flush();
+
+        n = read(p[0], buf, sizeof(buf) - 1);
+        assert_se(n > 0);
+        assert_se(streq(buf, "one\ntwo\nthree\nfour\n"));
+
+        /* Filling the queue flushes it implicitly, so nothing is lost */
+        for (unsigned i = 0; i < 20; i++)
+                log_info("x");
+        assert_se(log_set_buffered(0) >= 0);
+        assert_se(!log_get_buffered());
+
+        zero(buf);
+        n = read(p[0], buf, sizeof(buf) - 1);
+        assert_se(n == 40);
+
+        assert_se(dup2(saved_stderr, STDERR_FILENO) == STDERR_FILENO);
+}
+
+static void test_log_buffered_fork(void) {
+        _cleanup_close_pair_ int p[2] = { -1, -1 };
+        _cleanup_close_ int saved_stderr = -1;
+        char buf[64] = {};
+        ssize_t n;
+        int r;
+
+        log_set_target(LOG_TARGET_CONSOLE);
+        log_show_color(false);
+        log_open();
+
+        assert_se(pipe2(p, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se((saved_stderr = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 3)) >= 0);
+        assert_se(dup2(p[1], STDERR_FILENO) == STDERR_FILENO);
+
+        assert_se(log_set_buffered(16) >= 0);
+        log_info("parent");
+
+        /* What the parent queued before the fork is written out by the parent only, even if the child
+         * closes the log, as safe_fork() does with FORK_REOPEN_LOG */
+        r = safe_fork("(test-log)", FORK_WAIT, NULL);
+        assert_se(r >= 0);
+        if (r == 0) {
+                log_close();
+                log_open();
+                log_info("child");
+                log_flush();
+                _exit(EXIT_SUCCESS);
+        }
+
+        assert_se(log_set_buffered(0) >= 0);
+
+        n = read(p[0], buf, sizeof(buf) - 1);
+        assert_se(n > 0);
+        assert_se(streq(buf, "child\nparent\n"));
+
+        assert_se(dup2(saved_stderr, STDERR_FILENO) == STDERR_FILENO);
+}
+
+#define N_LOG_THREADS 4
+#define N_LOG_MESSAGES 5000
+
+static void* log_thread(void *p) {
+        unsigned k = PTR_TO_UINT(p);
+
+        /* Errors are written out synchronously, while other threads may be draining the queue */
+        for (unsigned i = 0; i < N_LOG_MESSAGES; i++)
+                log_full(i % 7 == 0 ? LOG_ERR : LOG_INFO, "%u %u", k, i);
+
+        return NULL;
+}
+
+static void test_log_buffered_threads(void) {
+        _cleanup_close_ int saved_stderr = -1, fd = -1;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_strv_free_ char **lines = NULL;
+        _cleanup_free_ char *contents = NULL;
+        pthread_t threads[N_LOG_THREADS];
+        unsigned next[N_LOG_THREADS] = {};
+        char **l;
+
+        log_set_target(LOG_TARGET_CONSOLE);
+        log_show_color(false);
+        log_open();
+
+        assert_se((fd = open_tmpfile_unlinkable(NULL, O_RDWR|O_CLOEXEC)) >= 0);
+        assert_se((saved_stderr = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 3)) >= 0);
+        assert_se(dup2(fd, STDERR_FILENO) == STDERR_FILENO);
+
+        assert_se(log_set_buffered(16) >= 0);
+
+        for (unsigned k = 0; k < N_LOG_THREADS; k++)
+                assert_se(pthread_create(threads + k, NULL, log_thread, UINT_TO_PTR(k)) == 0);
+        for (unsigned k = 0; k < N_LOG_THREADS; k++)
+                assert_se(pthread_join(threads[k], NULL) == 0);
+
+        assert_se(log_set_buffered(0) >= 0);
+        assert_se(dup2(saved_stderr, STDERR_FILENO) == STDERR_FILENO);
+
+        /* Nothing got lost, and the messages of each thread came out in the order they were logged */
+        assert_se(lseek(fd, 0, SEEK_SET) == 0);
+        assert_se(f = fdopen(TAKE_FD(fd), "r"));
+        assert_se(read_full_stream(f, &contents, NULL) >= 0);
+        assert_se(lines = strv_split(contents, "\n"));
+        assert_se(strv_length(lines) == N_LOG_THREADS * N_LOG_MESSAGES);
+
+        STRV_FOREACH(l, lines) {
+                unsigned k, i;
+
+                assert_se(sscanf(*l, "%u %u", &k, &i) == 2);
+                assert_se(k < N_LOG_THREADS);
+                assert_se(i == next[k]);
+                next[k]++;
+        }
+}
+#endif // 1
+
 int main(int argc, char* argv[]) {
         int target;
 
@@ -81,5 +232,11 @@ int main(int argc, char* argv[]) {
 
         assert_se(log_info_errno(SYNTHETIC_ERRNO(EUCLEAN), "foo") == -EUCLEAN);
 
+#if 1 /// elogind can queue log messages
+        test_log_buffered();
+        test_log_buffered_fork();
+        test_log_buffered_threads();
+#endif // 1
+
         return 0;
 }
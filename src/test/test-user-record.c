@@ -10,6 +10,11 @@
 #include "tmpfile-util.h"
 #include "tests.h"
 #include "user-record.h"
+#if 1 /// Additional includes needed by elogind
+#include "json.h"
+#include "strv.h"
+#include "time-util.h"
+#endif // 1
 
 static void test_read_login_defs(const char *path) {
         log_info("/* %s(\"%s\") */", __func__, path ?: "<custom>");
@@ -90,6 +95,75 @@ static void test_gid_is_system(void) {
         log_info("gid_is_system("GID_FMT") = %s", gid, yes_no(gid_is_system(gid)));
 }
 
+#if 1 /// elogind: measure parse + dispatch cost of a realistic record, unsorted vs. JSON_PARSE_SORTED
+static const char user_record_text[] =
+        "{"
+        "\"userName\":\"waldo\",\"realm\":\"example.com\",\"realName\":\"Waldo Wally\","
+        "\"emailAddress\":\"waldo@example.com\",\"iconName\":\"avatar-default\",\"location\":\"Berlin\","
+        "\"disposition\":\"regular\",\"lastChangeUSec\":1600000000000000,\"lastPasswordChangeUSec\":1600000000000000,"
+        "\"shell\":\"/bin/bash\",\"umask\":18,\"environment\":[\"FOO=bar\",\"LANG=C\"],"
+        "\"timeZone\":\"Europe/Berlin\",\"preferredLanguage\":\"en_US.UTF-8\",\"niceLevel\":5,"
+        "\"locked\":false,\"notBeforeUSec\":0,\"notAfterUSec\":4000000000000000,"
+        "\"storage\":\"directory\",\"diskSize\":10737418240,\"homeDirectory\":\"/home/waldo\","
+        "\"imagePath\":\"/home/waldo.homedir\",\"uid\":60123,\"gid\":60123,"
+        "\"memberOf\":[\"wheel\",\"audio\",\"video\",\"users\"],\"fileSystemType\":\"ext4\","
+        "\"tasksMax\":4096,\"memoryHigh\":1073741824,\"memoryMax\":2147483648,"
+        "\"cpuWeight\":100,\"ioWeight\":100,\"mountNoDevices\":true,\"mountNoSuid\":true,"
+        "\"mountNoExecute\":false,\"passwordHint\":\"the usual\",\"enforcePasswordPolicy\":true,"
+        "\"autoLogin\":false,\"stopDelayUSec\":0,\"killProcesses\":true,"
+        "\"passwordChangeMinUSec\":0,\"passwordChangeMaxUSec\":7776000000000,"
+        "\"passwordChangeWarnUSec\":604800000000,\"passwordChangeInactiveUSec\":0,"
+        "\"passwordChangeNow\":false,\"service\":\"io.example.Test\",\"rateLimitIntervalUSec\":60000000,"
+        "\"rateLimitBurst\":30,"
+        "\"privileged\":{\"hashedPassword\":[\"$6$xyz$abcdefghijklmnopqrstuvwxyz0123456789\"],"
+        "\"sshAuthorizedKeys\":[\"ssh-ed25519 AAAAC3NzaC1lZDI1NTE5AAAAIHq waldo@host\"]},"
+        "\"perMachine\":[{\"matchMachineId\":\"0123456789abcdef0123456789abcdef\",\"diskSize\":21474836480,\"shell\":\"/bin/zsh\"}],"
+        "\"xUnknownField1\":\"ignored\",\"xUnknownField2\":[1,2,3],\"xUnknownField3\":{\"nested\":true}"
+        "}";
+
+static usec_t bench_user_record(JsonParseFlags flags, unsigned n_iterations) {
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (unsigned i = 0; i < n_iterations; i++) {
+                _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+                _cleanup_(user_record_unrefp) UserRecord *u = NULL;
+
+                assert_se(json_parse(user_record_text, flags, &v, NULL, NULL) >= 0);
+                assert_se(u = user_record_new());
+                assert_se(user_record_load(u, v, USER_RECORD_LOAD_FULL|USER_RECORD_PERMISSIVE) >= 0);
+
+                assert_se(streq(u->user_name, "waldo"));
+                assert_se(u->uid == 60123);
+                assert_se(strv_length(u->member_of) == 4);
+        }
+
+        return now(CLOCK_MONOTONIC) - t;
+}
+
+static void test_parse_dispatch_benchmark(void) {
+        unsigned n_iterations = slow_tests_enabled() ? 20000 : 200;
+        char b[FORMAT_TIMESPAN_MAX];
+        int level;
+        usec_t t;
+
+        log_info("/* %s */", __func__);
+
+        /* Unknown fields are logged at debug level, keep that out of the measurement */
+        level = log_get_max_level();
+        log_set_max_level(LOG_INFO);
+
+        t = bench_user_record(0, n_iterations);
+        log_info("%u iterations unsorted: %s", n_iterations, format_timespan(b, sizeof(b), t, 1));
+
+        t = bench_user_record(JSON_PARSE_SORTED, n_iterations);
+        log_info("%u iterations sorted: %s", n_iterations, format_timespan(b, sizeof(b), t, 1));
+
+        log_set_max_level(level);
+}
+#endif // 1
+
 int main(int argc, char *argv[]) {
         test_setup_logging(LOG_DEBUG);
 
@@ -99,6 +173,9 @@ int main(int argc, char *argv[]) {
         test_acquire_ugid_allocation_range();
         test_uid_is_system();
         test_gid_is_system();
+#if 1 /// elogind addition
+        test_parse_dispatch_benchmark();
+#endif // 1
 
         return 0;
 }
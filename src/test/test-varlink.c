@@ -0,0 +1,498 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "sd-event.h"
+
+#include "fd-util.h"
+#include "io-util.h"
+#include "json.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "socket-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "tmpfile-util.h"
+#include "varlink.h"
+
+/* elogind only builds the client side of varlink, hence the peer here is a minimal stub server, running in
+ * a thread of its own. It answers every method call with the "n" parameter it got, sends one additional
+ * reply first for calls with "more" set, hangs up on io.elogind.Test.Hangup, and answers but then hangs up
+ * on io.elogind.Test.Close. Connections are served one after the other. */
+
+#define STUB_BUFFER_MAX (64U*1024U)
+
+static int stub_send(int fd, unsigned n, bool continues) {
+        _cleanup_(json_variant_unrefp) JsonVariant *m = NULL;
+        _cleanup_free_ char *s = NULL;
+        int r;
+
+        r = json_build(&m, JSON_BUILD_OBJECT(
+                                       JSON_BUILD_PAIR("parameters", JSON_BUILD_OBJECT(JSON_BUILD_PAIR("n", JSON_BUILD_UNSIGNED(n)))),
+                                       JSON_BUILD_PAIR_CONDITION(continues, "continues", JSON_BUILD_BOOLEAN(true))));
+        if (r < 0)
+                return r;
+
+        r = json_variant_format(m, 0, &s);
+        if (r < 0)
+                return r;
+
+        /* Include the trailing NUL byte, it's the message delimiter */
+        return loop_write(fd, s, r + 1, false);
+}
+
+/* Returns > 0 if the connection shall be closed */
+static int stub_dispatch(int fd, const char *message) {
+        _cleanup_(json_variant_unrefp) JsonVariant *m = NULL;
+        JsonVariant *parameters, *n, *more;
+        const char *method;
+        int r;
+
+        r = json_parse(message, 0, &m, NULL, NULL);
+        if (r < 0)
+                return r;
+
+        method = json_variant_string(json_variant_by_key(m, "method"));
+        parameters = json_variant_by_key(m, "parameters");
+        n = json_variant_by_key(parameters, "n");
+        more = json_variant_by_key(m, "more");
+
+        if (streq_ptr(method, "io.elogind.Test.Hangup"))
+                return 1;
+
+        if (more && json_variant_boolean(more)) {
+                r = stub_send(fd, json_variant_unsigned(n), true);
+                if (r < 0)
+                        return r;
+        }
+
+        r = stub_send(fd, json_variant_unsigned(n), false);
+        if (r < 0)
+                return r;
+
+        return streq_ptr(method, "io.elogind.Test.Close");
+}
+
+static void stub_serve(int fd) {
+        _cleanup_free_ char *buffer = NULL;
+        size_t size = 0;
+
+        buffer = new(char, STUB_BUFFER_MAX);
+        assert_se(buffer);
+
+        for (;;) {
+                char *e;
+                ssize_t l;
+
+                l = read(fd, buffer + size, STUB_BUFFER_MAX - size);
+                if (l <= 0)
+                        return;
+                size += l;
+
+                while ((e = memchr(buffer, 0, size))) {
+                        size_t k = e - buffer + 1;
+
+                        if (stub_dispatch(fd, buffer) != 0)
+                                return;
+
+                        memmove(buffer, buffer + k, size - k);
+                        size -= k;
+                }
+
+                assert_se(size < STUB_BUFFER_MAX);
+        }
+}
+
+static void *stub_server_thread(void *userdata) {
+        int listen_fd = PTR_TO_FD(userdata);
+
+        /* Runs until the listening socket is shut down */
+        for (;;) {
+                _cleanup_close_ int fd = -1;
+
+                fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+                if (fd < 0)
+                        return NULL;
+
+                stub_serve(fd);
+        }
+}
+
+static int stub_server_start(const char *path, pthread_t *ret_thread) {
+        union sockaddr_union sa;
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+        assert_se(fd >= 0);
+
+        r = sockaddr_un_set_path(&sa.un, path);
+        assert_se(r >= 0);
+
+        assert_se(bind(fd, &sa.sa, r) >= 0);
+        assert_se(listen(fd, SOMAXCONN) >= 0);
+
+        assert_se(pthread_create(ret_thread, NULL, stub_server_thread, FD_TO_PTR(fd)) == 0);
+
+        return TAKE_FD(fd);
+}
+
+static void stub_server_stop(int fd, pthread_t thread) {
+        assert_se(shutdown(fd, SHUT_RDWR) >= 0);
+        assert_se(pthread_join(thread, NULL) == 0);
+        safe_close(fd);
+}
+
+typedef struct Replies {
+        unsigned n_replies;
+        unsigned n_final;
+        unsigned n_errors;
+        unsigned next;  /* the "n" we expect to be answered next */
+} Replies;
+
+static int reply_callback(Varlink *link, JsonVariant *parameters, const char *error_id, VarlinkReplyFlags flags, void *userdata) {
+        Replies *replies = userdata;
+
+        replies->n_replies++;
+
+        if (error_id) {
+                assert_se(streq(error_id, VARLINK_ERROR_DISCONNECTED));
+                assert_se(FLAGS_SET(flags, VARLINK_REPLY_LOCAL));
+                replies->n_errors++;
+                replies->n_final++;
+                return 0;
+        }
+
+        /* Replies must come in the order the calls were enqueued */
+        assert_se(json_variant_unsigned(json_variant_by_key(parameters, "n")) == replies->next);
+
+        if (!FLAGS_SET(flags, VARLINK_REPLY_CONTINUES)) {
+                replies->n_final++;
+                replies->next++;
+        }
+
+        return 0;
+}
+
+static int invoke(Varlink *link, const char *method, unsigned n, bool more, Replies *replies) {
+        _cleanup_(json_variant_unrefp) JsonVariant *parameters = NULL;
+
+        assert_se(json_build(&parameters, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("n", JSON_BUILD_UNSIGNED(n)))) >= 0);
+
+        if (more)
+                return varlink_observe_async(link, method, parameters, reply_callback, replies);
+
+        return varlink_invoke_async(link, method, parameters, reply_callback, replies);
+}
+
+static void run_until(sd_event *e, const unsigned *counter, unsigned target) {
+        while (*counter < target)
+                assert_se(sd_event_run(e, UINT64_MAX) >= 0);
+}
+
+static Varlink* connect_stub(sd_event *e, const char *path) {
+        Varlink *link = NULL;
+
+        assert_se(varlink_connect_address(&link, path) >= 0);
+        assert_se(varlink_attach_event(link, e, SD_EVENT_PRIORITY_NORMAL) >= 0);
+
+        return link;
+}
+
+static void test_pipeline(sd_event *e, const char *path) {
+        _cleanup_(varlink_unrefp) Varlink *link = NULL;
+        Replies replies = {};
+        unsigned n_expected = 0;
+
+        log_info("/* %s */", __func__);
+
+        link = connect_stub(e, path);
+
+        /* Mix plain calls and ones with 'more' set, all in flight at the same time */
+        for (unsigned i = 0; i < 100; i++) {
+                bool more = i % 7 == 0;
+
+                assert_se(invoke(link, "io.elogind.Test.Echo", i, more, &replies) >= 0);
+                n_expected += more ? 2 : 1;
+        }
+        assert_se(varlink_get_n_pending(link) == 100);
+        assert_se(varlink_is_idle(link) == 0);
+
+        run_until(e, &replies.n_final, 100);
+
+        assert_se(replies.n_replies == n_expected);
+        assert_se(replies.n_errors == 0);
+        assert_se(varlink_get_n_pending(link) == 0);
+        assert_se(varlink_is_idle(link) > 0);
+
+        /* The connection remains usable afterwards */
+        assert_se(invoke(link, "io.elogind.Test.Echo", 100, false, &replies) >= 0);
+        run_until(e, &replies.n_final, 101);
+        assert_se(varlink_is_idle(link) > 0);
+}
+
+static void test_disconnect(sd_event *e, const char *path) {
+        _cleanup_(varlink_unrefp) Varlink *link = NULL;
+        Replies replies = {};
+
+        log_info("/* %s */", __func__);
+
+        link = connect_stub(e, path);
+
+        /* The first call is answered, the second makes the server hang up, and thus both it and the
+         * third are failed locally */
+        assert_se(invoke(link, "io.elogind.Test.Echo", 0, false, &replies) >= 0);
+        assert_se(invoke(link, "io.elogind.Test.Hangup", 1, false, &replies) >= 0);
+        assert_se(invoke(link, "io.elogind.Test.Echo", 2, true, &replies) >= 0);
+
+        run_until(e, &replies.n_final, 3);
+
+        assert_se(replies.n_replies == 3);
+        assert_se(replies.n_errors == 2);
+        assert_se(varlink_get_n_pending(link) == 0);
+        assert_se(varlink_is_idle(link) == 0);
+}
+
+static void test_timeout(sd_event *e, const char *path) {
+        _cleanup_(varlink_unrefp) Varlink *link = NULL;
+        Replies replies = {};
+        usec_t deadline, t;
+
+        log_info("/* %s */", __func__);
+
+        link = connect_stub(e, path);
+
+        /* Each call times out on its own, calls enqueued later do not push back the timeout of those
+         * already in flight */
+        assert_se(invoke(link, "io.elogind.Test.Echo", 0, false, &replies) >= 0);
+        assert_se(varlink_get_timeout(link, &deadline) > 0);
+
+        usleep(10 * USEC_PER_MSEC);
+        assert_se(invoke(link, "io.elogind.Test.Echo", 1, false, &replies) >= 0);
+        assert_se(varlink_get_timeout(link, &t) > 0);
+        assert_se(t == deadline);
+
+        /* Once the first call is answered, the second one's timeout applies */
+        run_until(e, &replies.n_final, 1);
+        if (replies.n_final == 1) {
+                assert_se(varlink_get_timeout(link, &t) > 0);
+                assert_se(t >= deadline + 10 * USEC_PER_MSEC);
+        }
+
+        run_until(e, &replies.n_final, 2);
+        assert_se(varlink_get_timeout(link, &t) == 0);
+}
+
+static void test_is_idle(sd_event *e, const char *path) {
+        _cleanup_(varlink_unrefp) Varlink *link = NULL;
+        Replies replies = {};
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        link = connect_stub(e, path);
+
+        /* The server closes the connection right after replying. Nobody watches an idle connection, hence
+         * varlink_is_idle() has to notice that by itself. */
+        assert_se(invoke(link, "io.elogind.Test.Close", 0, false, &replies) >= 0);
+        run_until(e, &replies.n_final, 1);
+        assert_se(replies.n_errors == 0);
+
+        for (unsigned i = 0; i < 1000; i++) {
+                r = varlink_is_idle(link);
+                assert_se(r >= 0);
+                if (r == 0)
+                        break;
+
+                usleep(1000);
+        }
+        assert_se(r == 0);
+}
+
+static void bench_lookups(sd_event *e, const char *path, const char *mode, unsigned n, unsigned depth) {
+        _cleanup_(varlink_unrefp) Varlink *link = NULL;
+        char ts[FORMAT_TIMESPAN_MAX];
+        Replies replies = {};
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC);
+
+        /* depth == 0 means a new connection for each lookup */
+        for (unsigned i = 0, k = MAX(depth, 1U); i < n; i += k) {
+                if (!link)
+                        link = connect_stub(e, path);
+
+                for (unsigned j = 0; j < k && i + j < n; j++)
+                        assert_se(invoke(link, "io.elogind.Test.Echo", i + j, false, &replies) >= 0);
+
+                run_until(e, &replies.n_final, MIN(i + k, n));
+
+                if (depth == 0)
+                        link = varlink_unref(link);
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        assert_se(replies.n_final == n);
+        assert_se(replies.n_errors == 0);
+
+        log_info("%-20s %u lookups in %s, %.0f lookups/s",
+                 mode, n, format_timespan(ts, sizeof(ts), t, USEC_PER_MSEC), (double) n * USEC_PER_SEC / MAX(t, 1U));
+}
+
+static void test_lookup_benchmark(sd_event *e, const char *path) {
+        unsigned n;
+
+        log_info("/* %s */", __func__);
+
+        n = slow_tests_enabled() ? 100000 : 2000;
+
+        /* A new connection per lookup, a reused connection with one call in flight, and pipelined calls */
+        bench_lookups(e, path, "connect per lookup:", n / 10, 0);
+        bench_lookups(e, path, "reused connection:", n, 1);
+        bench_lookups(e, path, "pipelined (16):", n, 16);
+        bench_lookups(e, path, "pipelined (128):", n, 128);
+}
+
+/* A parameters object of about the size of a user record */
+#define PAYLOAD "\"record\":{\"userName\":\"test\",\"uid\":1000,\"gid\":1000,\"realName\":\"Test User\",\"homeDirectory\":\"/home/test\",\"shell\":\"/bin/bash\",\"disposition\":\"regular\",\"memberOf\":[\"wheel\",\"audio\",\"video\"]}"
+
+typedef struct Stream {
+        int fd;
+        unsigned n;
+} Stream;
+
+static void *stream_thread(void *userdata) {
+        Stream *stream = userdata;
+        _cleanup_free_ char *buffer = NULL;
+        size_t size = 0;
+        char c;
+
+        /* Wait for the method call, whatever it is, then answer it with a stream of notifications, just like
+         * a server calling varlink_notify() in a loop would */
+        do
+                assert_se(read(stream->fd, &c, 1) == 1);
+        while (c != 0);
+
+        for (unsigned i = 0; i < stream->n; i++) {
+                char m[LINE_MAX];
+                int k;
+
+                /* All replies are for the same call, hence all carry the same "n" */
+                k = snprintf(m, sizeof(m), "{\"parameters\":{\"n\":0," PAYLOAD "}%s}",
+                             i + 1 < stream->n ? ",\"continues\":true" : "");
+                assert_se(k > 0 && (size_t) k < sizeof(m));
+
+                assert_se(GREEDY_REALLOC(buffer, size + k + 1));
+                memcpy(buffer + size, m, k + 1);
+                size += k + 1;
+        }
+
+        assert_se(loop_write(stream->fd, buffer, size, true) >= 0);
+        return NULL;
+}
+
+static void *drain_thread(void *userdata) {
+        int fd = PTR_TO_FD(userdata);
+        char buffer[64 * 1024];
+
+        while (read(fd, buffer, sizeof(buffer)) > 0)
+                ;
+
+        return NULL;
+}
+
+static void test_stream_benchmark(sd_event *e) {
+        _cleanup_(varlink_unrefp) Varlink *link = NULL;
+        _cleanup_close_pair_ int fds[2] = { -1, -1 };
+        char ts[FORMAT_TIMESPAN_MAX];
+        Replies replies = {};
+        pthread_t thread;
+        Stream stream;
+        usec_t t;
+
+        log_info("/* %s */", __func__);
+
+        /* Reading: a stream of 'more' replies to a single call, all parsed where they were received */
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, fds) >= 0);
+        stream = (Stream) {
+                .fd = fds[1],
+                .n = slow_tests_enabled() ? 200000 : 20000,
+        };
+        assert_se(pthread_create(&thread, NULL, stream_thread, &stream) == 0);
+
+        assert_se(varlink_connect_fd(&link, TAKE_FD(fds[0])) >= 0);
+        assert_se(varlink_attach_event(link, e, SD_EVENT_PRIORITY_NORMAL) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(invoke(link, "io.elogind.Test.Stream", 0, true, &replies) >= 0);
+        run_until(e, &replies.n_final, 1);
+        t = now(CLOCK_MONOTONIC) - t;
+
+        assert_se(pthread_join(thread, NULL) == 0);
+        assert_se(replies.n_replies == stream.n);
+        assert_se(replies.n_errors == 0);
+
+        log_info("received %u notifications in %s, %.0f messages/s",
+                 stream.n, format_timespan(ts, sizeof(ts), t, USEC_PER_MSEC), (double) stream.n * USEC_PER_SEC / MAX(t, 1U));
+
+        link = varlink_unref(link);
+        fds[1] = safe_close(fds[1]);
+
+        /* Writing: many queued calls, flushed in one go */
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, fds) >= 0);
+        assert_se(pthread_create(&thread, NULL, drain_thread, FD_TO_PTR(fds[1])) == 0);
+
+        assert_se(varlink_connect_fd(&link, TAKE_FD(fds[0])) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < stream.n; i++) {
+                if (i % 1024 == 0)
+                        assert_se(varlink_flush(link) >= 0);
+
+                assert_se(invoke(link, "io.elogind.Test.Echo", i, false, &replies) >= 0);
+        }
+        assert_se(varlink_flush(link) >= 0);
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("sent %u method calls in %s, %.0f messages/s",
+                 stream.n, format_timespan(ts, sizeof(ts), t, USEC_PER_MSEC), (double) stream.n * USEC_PER_SEC / MAX(t, 1U));
+
+        link = varlink_unref(link);
+        assert_se(pthread_join(thread, NULL) == 0);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmpdir = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_free_ char *path = NULL;
+        pthread_t thread;
+        int fd;
+
+        test_setup_logging(LOG_DEBUG);
+
+        assert_se(mkdtemp_malloc("/tmp/varlink-test-XXXXXX", &tmpdir) >= 0);
+        assert_se(path = path_join(tmpdir, "socket"));
+
+        fd = stub_server_start(path, &thread);
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        test_pipeline(e, path);
+        test_disconnect(e, path);
+        test_timeout(e, path);
+        test_is_idle(e, path);
+
+        /* Don't drown the numbers in per-message debug logging */
+        log_set_max_level(LOG_INFO);
+        test_lookup_benchmark(e, path);
+        test_stream_benchmark(e);
+
+        stub_server_stop(fd, thread);
+
+        return 0;
+}